@@ -13,6 +13,7 @@ layout(push_constant) uniform params_t
   vec4 wCamPos;
   vec4 lightDir;
   vec4 lightPlaneEq;
+  vec4 material;     // x - material layer
 
 } params;
 
@@ -41,6 +42,7 @@ layout (location = 0 ) out VS_OUT
   vec3 wNorm;
   vec3 wTangent;
   vec2 texCoord;
+  flat float layer; // material layer of diffColor array
 
 } vOut;
 
@@ -53,6 +55,7 @@ void main(void)
   vOut.wNorm    = (params.mNormalMatrix*wNorm).xyz;
   vOut.wTangent = (params.mNormalMatrix*wTang).xyz;
   vOut.texCoord = vTexCoordAndTang.xy;
+  vOut.layer    = params.material.x;
 
   gl_Position   = params.mWorldViewProj*vec4(vOut.wPos, 1.0);
 }
@@ -9,11 +9,12 @@ layout (location = 0 ) in VS_OUT
   vec3 wNorm;
   vec3 wTangent;
   vec2 texCoord;
+  flat float layer; // material layer of diffColor array
 
 } surf;
 
-layout (binding = 0) uniform sampler2D diffColor;
-layout (binding = 1) uniform sampler2D shadowMap;
+layout (binding = 0) uniform sampler2DArray diffColor; // layer per material
+layout (binding = 1) uniform sampler2DShadow shadowMap; // compare sampler, LESS_OR_EQUAL
 
 layout(push_constant) uniform params_t
 {
@@ -34,7 +35,7 @@ void main()
   const vec2 shadowTexCoord    = posLightSpaceNDC.xy*0.5f + vec2(0.5f, 0.5f);  // just shift coords from [-1,1] to [0,1]               
 
   const bool  outOfView = (shadowTexCoord.x < 0.001f || shadowTexCoord.x > 0.999f || shadowTexCoord.y < 0.001f || shadowTexCoord.y > 0.999f);
-  const float shadow    = ((posLightSpaceNDC.z < textureLod(shadowMap, shadowTexCoord, 0).x + 0.001f) || outOfView) ? 1.0f : 0.0f;  
+  const float shadow    = outOfView ? 1.0f : texture(shadowMap, vec3(shadowTexCoord, posLightSpaceNDC.z - 0.001f)); // 2x2 PCF if depth is linear filtered
 
   const float dpFactor = max(dot(params.lightDir.xyz, surf.wNorm), 0.0f);
   const float cosPower = 120.0f;
@@ -42,5 +43,5 @@ void main()
   const vec3  r        = reflect(v, surf.wNorm);
   const float cosAlpha = clamp(dot(params.lightDir.xyz, r), 0.0f, 1.0f);
 
-  out_fragColor = texture(diffColor, surf.texCoord*2.0f)*(dpFactor*shadow + 0.25f) + vec4(1,1,1,1)*pow(cosAlpha, cosPower)*dpFactor*shadow;
+  out_fragColor = texture(diffColor, vec3(surf.texCoord*2.0f, surf.layer))*(dpFactor*shadow + 0.25f) + vec4(1,1,1,1)*pow(cosAlpha, cosPower)*dpFactor*shadow;
 }
\ No newline at end of file
@@ -1,90 +1,629 @@
+#include "Bitmap.h"
+
 #include <vector>
-#include <fstream>
+#include <cstdio>
 #include <cstring>
+#include <cstdint>
+#include <thread>
+#include <algorithm>
+#include <memory>
+#include <cassert>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #include <immintrin.h>
+  #define BMP_SIMD_X86 1
+  #define BMP_TARGET(X) __attribute__((target(X)))   // SIMD paths are compiled for their ISA and selected at run time
+#elif defined(_MSC_VER) && defined(__AVX2__)
+  #include <immintrin.h>
+  #define BMP_SIMD_X86 1
+  #define BMP_TARGET(X)
+#endif
 
-struct Pixel { unsigned char r, g, b; };
+#ifdef WIN32
+#undef min
+#undef max
+#endif
 
-void WriteBMP(const char* fname, Pixel* a_pixelData, int width, int height)
+// Pixels are R8G8B8A8 in memory, i.e. (b << 16) | (g << 8) | r in unsigned int; BMP rows are B8G8R8 padded to 4 bytes.
+// Alpha of loaded 24 bit images is 0, same as it always was.
+//
+static const size_t PARALLEL_MIN_PIXELS = 1024*1024; ///< smaller images are converted by calling thread only
+
+static void DecodeRowScalar(const unsigned char* a_src, unsigned int* a_dst, int a_width)
 {
-  int paddedsize = (width*height) * sizeof(Pixel);
+  for(int j = 0; j < a_width; j++)
+    a_dst[j] = (uint32_t(a_src[j*3+0]) << 16) | (uint32_t(a_src[j*3+1]) << 8) | (uint32_t(a_src[j*3+2]) << 0);
+}
 
-  unsigned char bmpfileheader[14] = {'B','M', 0,0,0,0, 0,0, 0,0, 54,0,0,0};
-  unsigned char bmpinfoheader[40] = {40,0,0,0, 0,0,0,0, 0,0,0,0, 1,0, 24,0};
+static void EncodeRowScalar(const unsigned int* a_src, unsigned char* a_dst, int a_width)
+{
+  for(int j = 0; j < a_width; j++)
+  {
+    a_dst[j*3+0] = (unsigned char)((a_src[j] & 0x00FF0000) >> 16);
+    a_dst[j*3+1] = (unsigned char)((a_src[j] & 0x0000FF00) >> 8);
+    a_dst[j*3+2] = (unsigned char)((a_src[j] & 0x000000FF));
+  }
+}
 
-  bmpfileheader[ 2] = (unsigned char)(paddedsize    );
-  bmpfileheader[ 3] = (unsigned char)(paddedsize>> 8);
-  bmpfileheader[ 4] = (unsigned char)(paddedsize>>16);
-  bmpfileheader[ 5] = (unsigned char)(paddedsize>>24);
+static void DecodeRowBGRAScalar(const unsigned char* a_src, unsigned int* a_dst, int a_width, bool a_alpha)
+{
+  const uint32_t alphaMask = a_alpha ? 0xFF000000 : 0;
+  for(int j = 0; j < a_width; j++)
+    a_dst[j] = (uint32_t(a_src[j*4+0]) << 16) | (uint32_t(a_src[j*4+1]) << 8) | (uint32_t(a_src[j*4+2]) << 0) | ((uint32_t(a_src[j*4+3]) << 24) & alphaMask);
+}
 
-  bmpinfoheader[ 4] = (unsigned char)(width    );
-  bmpinfoheader[ 5] = (unsigned char)(width>> 8);
-  bmpinfoheader[ 6] = (unsigned char)(width>>16);
-  bmpinfoheader[ 7] = (unsigned char)(width>>24);
-  bmpinfoheader[ 8] = (unsigned char)(height    );
-  bmpinfoheader[ 9] = (unsigned char)(height>> 8);
-  bmpinfoheader[10] = (unsigned char)(height>>16);
-  bmpinfoheader[11] = (unsigned char)(height>>24);
+#ifdef BMP_SIMD_X86
 
-  std::ofstream out(fname, std::ios::out | std::ios::binary);
-  out.write((const char*)bmpfileheader, 14);
-  out.write((const char*)bmpinfoheader, 40);
-  out.write((const char*)a_pixelData, paddedsize);
-  out.flush();
-  out.close();
+// loads and stores never cross the end of the row (3*a_width bytes), so rows may be converted by different threads
+
+BMP_TARGET("ssse3") static void DecodeRowSSSE3(const unsigned char* a_src, unsigned int* a_dst, int a_width)
+{
+  const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -128, 5, 4, 3, -128, 8, 7, 6, -128, 11, 10, 9, -128); // 4 x BGR --> 4 x RGB0
+  int j = 0;
+  for(; j + 6 <= a_width; j += 4)
+  {
+    const __m128i bgr = _mm_loadu_si128((const __m128i*)(a_src + j*3));
+    _mm_storeu_si128((__m128i*)(a_dst + j), _mm_shuffle_epi8(bgr, shuffle));
+  }
+  DecodeRowScalar(a_src + j*3, a_dst + j, a_width - j);
 }
 
-void SaveBMP(const char* fname, const unsigned int* pixels, int w, int h)
+BMP_TARGET("ssse3") static void EncodeRowSSSE3(const unsigned int* a_src, unsigned char* a_dst, int a_width)
+{
+  const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -128, -128, -128, -128); // 4 x RGBA --> 4 x BGR, 4 zero bytes
+  int j = 0;
+  for(; j + 6 <= a_width; j += 4)
+  {
+    const __m128i rgba = _mm_loadu_si128((const __m128i*)(a_src + j));
+    _mm_storeu_si128((__m128i*)(a_dst + j*3), _mm_shuffle_epi8(rgba, shuffle)); // zero tail is overwritten by the next store
+  }
+  EncodeRowScalar(a_src + j, a_dst + j*3, a_width - j);
+}
+
+BMP_TARGET("avx2") static void DecodeRowAVX2(const unsigned char* a_src, unsigned int* a_dst, int a_width)
+{
+  // 8 pixels = 24 bytes = 6 dwords; spread them to lanes (3 dwords each), then shuffle inside lanes same as SSSE3 version
+  //
+  const __m256i spread  = _mm256_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0);
+  const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, -128, 5, 4, 3, -128, 8, 7, 6, -128, 11, 10, 9, -128,
+                                           2, 1, 0, -128, 5, 4, 3, -128, 8, 7, 6, -128, 11, 10, 9, -128);
+  int j = 0;
+  for(; j + 11 <= a_width; j += 8)
+  {
+    const __m256i bgr = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(a_src + j*3)), spread);
+    _mm256_storeu_si256((__m256i*)(a_dst + j), _mm256_shuffle_epi8(bgr, shuffle));
+  }
+  DecodeRowSSSE3(a_src + j*3, a_dst + j, a_width - j);
+}
+
+BMP_TARGET("avx2") static void EncodeRowAVX2(const unsigned int* a_src, unsigned char* a_dst, int a_width)
+{
+  // shuffle inside lanes to 12 bytes + 4 zero bytes, then pack 6 dwords of data together; last 2 dwords take zero dword 3
+  //
+  const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -128, -128, -128, -128,
+                                           2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -128, -128, -128, -128);
+  const __m256i pack    = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 3);
+  int j = 0;
+  for(; j + 11 <= a_width; j += 8)
+  {
+    const __m256i bgr = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(a_src + j)), shuffle);
+    _mm256_storeu_si256((__m256i*)(a_dst + j*3), _mm256_permutevar8x32_epi32(bgr, pack));
+  }
+  EncodeRowSSSE3(a_src + j, a_dst + j*3, a_width - j);
+}
+
+BMP_TARGET("ssse3") static void DecodeRowBGRASSSE3(const unsigned char* a_src, unsigned int* a_dst, int a_width, bool a_alpha)
+{
+  const char    a       = a_alpha ? 3 : -128;
+  const __m128i shuffle = _mm_setr_epi8(2, 1, 0, a, 6, 5, 4, char(a + 4), 10, 9, 8, char(a + 8), 14, 13, 12, char(a + 12)); // 4 x BGRA --> 4 x RGBA
+  int j = 0;
+  for(; j + 4 <= a_width; j += 4)
+    _mm_storeu_si128((__m128i*)(a_dst + j), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(a_src + j*4)), shuffle));
+  DecodeRowBGRAScalar(a_src + j*4, a_dst + j, a_width - j, a_alpha);
+}
+
+BMP_TARGET("avx2") static void DecodeRowBGRAAVX2(const unsigned char* a_src, unsigned int* a_dst, int a_width, bool a_alpha)
+{
+  const char    a       = a_alpha ? 3 : -128;
+  const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, a, 6, 5, 4, char(a + 4), 10, 9, 8, char(a + 8), 14, 13, 12, char(a + 12),
+                                           2, 1, 0, a, 6, 5, 4, char(a + 4), 10, 9, 8, char(a + 8), 14, 13, 12, char(a + 12));
+  int j = 0;
+  for(; j + 8 <= a_width; j += 8)
+    _mm256_storeu_si256((__m256i*)(a_dst + j), _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(a_src + j*4)), shuffle));
+  DecodeRowBGRASSSE3(a_src + j*4, a_dst + j, a_width - j, a_alpha);
+}
+
+#endif
+
+typedef void (*DecodeRowFunc)(const unsigned char* a_src, unsigned int* a_dst, int a_width);
+typedef void (*EncodeRowFunc)(const unsigned int* a_src, unsigned char* a_dst, int a_width);
+
+static DecodeRowFunc SelectDecodeRow()
+{
+#if defined(BMP_SIMD_X86) && defined(__GNUC__)
+  if(__builtin_cpu_supports("avx2"))
+    return DecodeRowAVX2;
+  if(__builtin_cpu_supports("ssse3"))
+    return DecodeRowSSSE3;
+#elif defined(BMP_SIMD_X86)
+  return DecodeRowAVX2;
+#endif
+  return DecodeRowScalar;
+}
+
+typedef void (*DecodeRowBGRAFunc)(const unsigned char* a_src, unsigned int* a_dst, int a_width, bool a_alpha);
+
+static DecodeRowBGRAFunc SelectDecodeRowBGRA()
 {
-  std::vector<Pixel> pixels2(w*h);
+#if defined(BMP_SIMD_X86) && defined(__GNUC__)
+  if(__builtin_cpu_supports("avx2"))
+    return DecodeRowBGRAAVX2;
+  if(__builtin_cpu_supports("ssse3"))
+    return DecodeRowBGRASSSE3;
+#elif defined(BMP_SIMD_X86)
+  return DecodeRowBGRAAVX2;
+#endif
+  return DecodeRowBGRAScalar;
+}
+
+static EncodeRowFunc SelectEncodeRow()
+{
+#if defined(BMP_SIMD_X86) && defined(__GNUC__)
+  if(__builtin_cpu_supports("avx2"))
+    return EncodeRowAVX2;
+  if(__builtin_cpu_supports("ssse3"))
+    return EncodeRowSSSE3;
+#elif defined(BMP_SIMD_X86)
+  return EncodeRowAVX2;
+#endif
+  return EncodeRowScalar;
+}
 
-  for (size_t i = 0; i < pixels2.size(); i++)
+/**
+\brief call a_func(rowBegin, rowEnd) for row ranges of the image; large images are split between hardware threads.
+*/
+template<typename RowsFunc>
+static void ForEachRows(int a_width, int a_height, RowsFunc a_func)
+{
+  const size_t pixels     = size_t(a_width)*size_t(a_height);
+  const int    threadsNum = (pixels >= PARALLEL_MIN_PIXELS) ? std::min(a_height, std::max(1, int(std::thread::hardware_concurrency()))) : 1;
+  if(threadsNum <= 1)
   {
-    Pixel px;
-    px.r       = (pixels[i] & 0x00FF0000) >> 16;
-    px.g       = (pixels[i] & 0x0000FF00) >> 8;
-    px.b       = (pixels[i] & 0x000000FF);
-    pixels2[i] = px;
+    a_func(0, a_height);
+    return;
   }
 
-  WriteBMP(fname, &pixels2[0], w, h);
+  const int rowsPerThread = (a_height + threadsNum - 1) / threadsNum;
+
+  std::vector<std::thread> threads;
+  threads.reserve(threadsNum);
+  for(int rowBegin = rowsPerThread; rowBegin < a_height; rowBegin += rowsPerThread)
+    threads.emplace_back(a_func, rowBegin, std::min(a_height, rowBegin + rowsPerThread));
+
+  a_func(0, std::min(a_height, rowsPerThread));
+
+  for(auto& thread : threads)
+    thread.join();
+}
+
+/**
+\brief Read-only view of the whole file: memory mapped if possible, otherwise read with single fread (without zeroing the buffer first).
+*/
+struct FileView
+{
+  FileView(const char* a_fileName)
+  {
+#ifndef WIN32
+    const int fd = open(a_fileName, O_RDONLY);
+    if(fd < 0)
+      return;
+    struct stat st;
+    if(fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+      void* mapped = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+      if(mapped != MAP_FAILED)
+      {
+        m_data   = (const unsigned char*)mapped;
+        m_size   = size_t(st.st_size);
+        m_mapped = true;
+      }
+    }
+    close(fd);
+    if(m_mapped)
+      return;
+#endif
+    FILE* f = fopen(a_fileName, "rb");
+    if(f == NULL)
+      return;
+
+    fseek(f, 0, SEEK_END);
+    const long fileSize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    if(fileSize > 0)
+    {
+      m_buffer.reset(new unsigned char[size_t(fileSize)]);
+      if(fread(m_buffer.get(), 1, size_t(fileSize), f) == size_t(fileSize))
+      {
+        m_data = m_buffer.get();
+        m_size = size_t(fileSize);
+      }
+    }
+    fclose(f);
+  }
+
+  ~FileView()
+  {
+#ifndef WIN32
+    if(m_mapped)
+      munmap((void*)m_data, m_size);
+#endif
+  }
+
+  const unsigned char* Data() const { return m_data; }
+  size_t               Size() const { return m_size; }
+
+private:
+
+  const unsigned char*             m_data   = nullptr;
+  size_t                           m_size   = 0;
+  bool                             m_mapped = false;
+  std::unique_ptr<unsigned char[]> m_buffer;
+
+  FileView(const FileView& a_rhs) = delete;
+  FileView& operator=(const FileView& a_rhs) = delete;
+};
+
+static inline void WriteInt32(unsigned char* a_dst, int32_t a_value) { memcpy(a_dst, &a_value, sizeof(int32_t)); }
+static inline int32_t ReadInt32(const unsigned char* a_src)          { int32_t res; memcpy(&res, a_src, sizeof(int32_t)); return res; }
+
+void SaveBMP(const char* fname, const unsigned int* pixels, int w, int h)
+{
+  const size_t rowPadded = (size_t(w)*3 + 3) & (~size_t(3));
+  const size_t dataSize  = rowPadded*size_t(h);
+
+  std::vector<unsigned char> file(54 + dataSize, 0); // padding bytes of the rows stay zero
+
+  unsigned char bmpfileheader[14] = {'B','M', 0,0,0,0, 0,0, 0,0, 54,0,0,0};
+  unsigned char bmpinfoheader[40] = {40,0,0,0, 0,0,0,0, 0,0,0,0, 1,0, 24,0};
+
+  WriteInt32(bmpfileheader + 2, int32_t(file.size()));
+  WriteInt32(bmpinfoheader + 4, w);
+  WriteInt32(bmpinfoheader + 8, h);
+  WriteInt32(bmpinfoheader + 20, int32_t(dataSize));
+
+  memcpy(file.data(),      bmpfileheader, 14);
+  memcpy(file.data() + 14, bmpinfoheader, 40);
+
+  const EncodeRowFunc encodeRow = SelectEncodeRow();
+  ForEachRows(w, h, [&](int a_rowBegin, int a_rowEnd)
+  {
+    for(int i = a_rowBegin; i < a_rowEnd; i++)
+      encodeRow(pixels + size_t(i)*size_t(w), file.data() + 54 + size_t(i)*rowPadded, w);
+  });
+
+  FILE* f = fopen(fname, "wb");
+  if(f == NULL)
+    return;
+  fwrite(file.data(), 1, file.size(), f);
+  fclose(f);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-std::vector<unsigned int> LoadBMP(const char* filename, int* pW, int* pH)
+// Header driven decoding. Output rows always go bottom to top (same as in usual bottom-up BMP and as LoadBMP always did),
+// so top-down files are flipped.
+//
+enum BMP_COMPRESSION { BMP_RGB = 0, BMP_RLE8 = 1, BMP_RLE4 = 2, BMP_BITFIELDS = 3 };
+
+struct BMPHeader
 {
-  FILE* f = fopen(filename, "rb");
+  size_t   offBits;
+  int      width;
+  int      height;
+  bool     topDown;
+  int      bpp;
+  int      compression;
+  uint32_t masks[4];        ///< r, g, b, a for 32 bit images
+  uint32_t palette[256];    ///< R8G8B8A8 with alpha 0, same as 24 bit pixels
+  bool     grayPalette;     ///< all palette entries have r == g == b, so image is single channel
+};
 
-  if(f == NULL)
+static inline uint16_t ReadUInt16(const unsigned char* a_src) { uint16_t res; memcpy(&res, a_src, sizeof(uint16_t)); return res; }
+static inline uint32_t ReadUInt32(const unsigned char* a_src) { uint32_t res; memcpy(&res, a_src, sizeof(uint32_t)); return res; }
+
+static inline size_t RowSize(int a_width, int a_bpp) { return ((size_t(a_width)*size_t(a_bpp) + 31) / 32) * 4; }
+
+static bool ParseHeader(const unsigned char* a_data, size_t a_size, BMPHeader* a_pHeader)
+{
+  BMPHeader& hdr = (*a_pHeader);
+  memset(&hdr, 0, sizeof(BMPHeader));
+
+  if(a_size < 54 || a_data[0] != 'B' || a_data[1] != 'M')
+    return false;
+
+  const uint32_t infoSize = ReadUInt32(a_data + 14); // 40 for BITMAPINFOHEADER, 108/124 for V4/V5; OS/2 headers are not supported
+  if(infoSize < 40 || 14 + size_t(infoSize) > a_size)
+    return false;
+
+  hdr.offBits     = ReadUInt32(a_data + 10);
+  hdr.width       = ReadInt32 (a_data + 18);
+  hdr.height      = ReadInt32 (a_data + 22);
+  hdr.topDown     = (hdr.height < 0);
+  hdr.height      = hdr.topDown ? -hdr.height : hdr.height;
+  hdr.bpp         = ReadUInt16(a_data + 28);
+  hdr.compression = int(ReadUInt32(a_data + 30));
+
+  if(hdr.width <= 0 || hdr.height <= 0 || hdr.offBits >= a_size)
+    return false;
+
+  const bool supported = (hdr.bpp == 24 && hdr.compression == BMP_RGB)  ||
+                         (hdr.bpp == 32 && (hdr.compression == BMP_RGB || hdr.compression == BMP_BITFIELDS)) ||
+                         ((hdr.bpp == 1 || hdr.bpp == 4 || hdr.bpp == 8) && hdr.compression == BMP_RGB) ||
+                         (hdr.bpp == 8  && hdr.compression == BMP_RLE8) ||
+                         (hdr.bpp == 4  && hdr.compression == BMP_RLE4);
+  if(!supported)
+    return false;
+
+  // color masks are at the same place for BITMAPINFOHEADER (right after it) and V4/V5 headers (inside them)
+  //
+  size_t paletteOffset = 14 + size_t(infoSize);
+  if(hdr.compression == BMP_BITFIELDS)
   {
-    (*pW) = 0;
-    (*pH) = 0;
-    return std::vector<unsigned int>();
+    if(a_size < 66)
+      return false;
+    hdr.masks[0] = ReadUInt32(a_data + 54);
+    hdr.masks[1] = ReadUInt32(a_data + 58);
+    hdr.masks[2] = ReadUInt32(a_data + 62);
+    hdr.masks[3] = (infoSize >= 56 && a_size >= 70) ? ReadUInt32(a_data + 66) : 0;
+    if(infoSize == 40)
+      paletteOffset += 12;
+  }
+  else
+  {
+    hdr.masks[0] = 0x00FF0000;
+    hdr.masks[1] = 0x0000FF00;
+    hdr.masks[2] = 0x000000FF;
+    hdr.masks[3] = 0xFF000000;
   }
 
-  unsigned char info[54];
-  fread(info, sizeof(unsigned char), 54, f); // read the 54-byte header
+  if(hdr.bpp <= 8)
+  {
+    const uint32_t clrUsed    = ReadUInt32(a_data + 46);
+    const size_t   maxEntries = (paletteOffset < a_size) ? (a_size - paletteOffset) / 4 : 0;
+    const size_t   entries    = std::min(std::min(size_t(clrUsed != 0 ? clrUsed : (1u << hdr.bpp)), size_t(256)), maxEntries);
 
-  int width  = *(int*)&info[18];
-  int height = *(int*)&info[22];
+    hdr.grayPalette = true;
+    for(size_t i = 0; i < entries; i++)
+    {
+      const unsigned char* entry = a_data + paletteOffset + i*4; // B, G, R, reserved
+      hdr.palette[i]   = (uint32_t(entry[0]) << 16) | (uint32_t(entry[1]) << 8) | uint32_t(entry[2]);
+      hdr.grayPalette &= (entry[0] == entry[1] && entry[1] == entry[2]);
+    }
+  }
 
-  int row_padded      = (width*3 + 3) & (~3);
-  unsigned char* data = new unsigned char[row_padded];
+  if(hdr.compression == BMP_RGB || hdr.compression == BMP_BITFIELDS)
+    return (hdr.offBits + RowSize(hdr.width, hdr.bpp)*size_t(hdr.height) <= a_size);
 
-  std::vector<unsigned int> res(width*height);
+  return true;
+}
 
-  for(int i = 0; i < height; i++)
+static void DecodeRowIndexed(const unsigned char* a_src, int a_bpp, int a_width, const BMPHeader& a_hdr, int a_channels, unsigned char* a_dst)
+{
+  for(int j = 0; j < a_width; j++)
   {
-    fread(data, sizeof(unsigned char), row_padded, f);
-    for(int j = 0; j < width; j++)
-      res[i*width+j] = (uint32_t(data[j*3+0]) << 16) | (uint32_t(data[j*3+1]) << 8)  | (uint32_t(data[j*3+2]) << 0);
+    uint32_t index;
+    if(a_bpp == 8)
+      index = a_src[j];
+    else if(a_bpp == 4)
+      index = (a_src[j >> 1] >> ((j & 1) ? 0 : 4)) & 0xF;
+    else
+      index = (a_src[j >> 3] >> (7 - (j & 7))) & 0x1;
+
+    if(a_channels == 1)
+      a_dst[j] = (unsigned char)(a_hdr.palette[index] & 0xFF);
+    else
+      memcpy(a_dst + j*4, &a_hdr.palette[index], sizeof(uint32_t));
   }
+}
 
-  fclose(f);
-  delete [] data;
+static void DecodeRowMasked(const unsigned char* a_src, int a_width, const BMPHeader& a_hdr, unsigned char* a_dst)
+{
+  // general 32 bit bitfields; each channel is scaled to 8 bits
+  //
+  int      shifts[4];
+  uint32_t maxValues[4];
+  for(int c = 0; c < 4; c++)
+  {
+    shifts[c]    = 0;
+    maxValues[c] = 0;
+    if(a_hdr.masks[c] == 0)
+      continue;
+    while(((a_hdr.masks[c] >> shifts[c]) & 1) == 0)
+      shifts[c]++;
+    maxValues[c] = a_hdr.masks[c] >> shifts[c];
+  }
 
-  (*pW) = width;
-  (*pH) = height;
+  for(int j = 0; j < a_width; j++)
+  {
+    const uint32_t texel = ReadUInt32(a_src + j*4);
+    for(int c = 0; c < 4; c++)
+      a_dst[j*4 + c] = (maxValues[c] == 0) ? 0 : (unsigned char)((uint64_t((texel & a_hdr.masks[c]) >> shifts[c])*255 + maxValues[c]/2) / maxValues[c]);
+  }
+}
+
+/**
+\brief Decode RLE8/RLE4 data to 8 bit indices, a_width*a_height of them, bottom row first. Pixels skipped by delta escapes stay 0.
+*/
+static void DecodeRLE(const unsigned char* a_src, size_t a_size, int a_bpp, int a_width, int a_height, unsigned char* a_indices)
+{
+  int    x = 0, y = 0;
+  size_t p = 0;
+
+  auto put = [&](uint32_t a_index) 
+  { 
+    if(x < a_width && y < a_height) 
+      a_indices[size_t(y)*size_t(a_width) + size_t(x)] = (unsigned char)a_index; 
+    x++;
+  };
+
+  while(p + 1 < a_size && y < a_height)
+  {
+    const uint32_t count = a_src[p];
+    const uint32_t value = a_src[p+1];
+    p += 2;
+
+    if(count != 0) // encoded run; RLE4 runs alternate two indices
+    {
+      for(uint32_t k = 0; k < count; k++)
+        put((a_bpp == 8) ? value : ((k & 1) ? (value & 0xF) : (value >> 4)));
+    }
+    else if(value == 0) // end of line
+    {
+      x = 0;
+      y++;
+    }
+    else if(value == 1) // end of bitmap
+      break;
+    else if(value == 2) // delta
+    {
+      if(p + 1 >= a_size)
+        break;
+      x += a_src[p];
+      y += a_src[p+1];
+      p += 2;
+    }
+    else // absolute mode, 'value' indices as is, padded to 16 bits
+    {
+      const size_t bytes = (a_bpp == 8) ? value : (value + 1)/2;
+      if(p + bytes > a_size)
+        break;
+      for(uint32_t k = 0; k < value; k++)
+        put((a_bpp == 8) ? a_src[p + k] : ((k & 1) ? (a_src[p + k/2] & 0xF) : (a_src[p + k/2] >> 4)));
+      p += bytes + (bytes & 1);
+    }
+  }
+}
+
+static void DecodeImage(const unsigned char* a_data, size_t a_size, const BMPHeader& a_hdr, void* a_dst, size_t a_dstRowPitch, int a_channels)
+{
+  const int      width  = a_hdr.width;
+  const int      height = a_hdr.height;
+  unsigned char* dst    = (unsigned char*)a_dst;
+
+  if(a_hdr.compression == BMP_RLE8 || a_hdr.compression == BMP_RLE4)
+  {
+    std::vector<unsigned char> indices(size_t(width)*size_t(height), 0);
+    DecodeRLE(a_data + a_hdr.offBits, a_size - a_hdr.offBits, a_hdr.bpp, width, height, indices.data());
+    ForEachRows(width, height, [&](int a_rowBegin, int a_rowEnd)
+    {
+      for(int i = a_rowBegin; i < a_rowEnd; i++)
+        DecodeRowIndexed(indices.data() + size_t(i)*size_t(width), 8, width, a_hdr, a_channels, dst + size_t(i)*a_dstRowPitch);
+    });
+    return;
+  }
+
+  const size_t rowSize = RowSize(width, a_hdr.bpp);
+  auto srcRow = [&](int a_row) { return a_data + a_hdr.offBits + size_t(a_hdr.topDown ? height - 1 - a_row : a_row)*rowSize; };
+
+  const bool standardMasks = (a_hdr.masks[0] == 0x00FF0000 && a_hdr.masks[1] == 0x0000FF00 && a_hdr.masks[2] == 0x000000FF &&
+                             (a_hdr.masks[3] == 0xFF000000 || a_hdr.masks[3] == 0));
+
+  const DecodeRowFunc     decodeRow     = SelectDecodeRow();
+  const DecodeRowBGRAFunc decodeRowBGRA = SelectDecodeRowBGRA();
+
+  ForEachRows(width, height, [&](int a_rowBegin, int a_rowEnd)
+  {
+    for(int i = a_rowBegin; i < a_rowEnd; i++)
+    {
+      unsigned char* dstRow = dst + size_t(i)*a_dstRowPitch;
+      if(a_hdr.bpp <= 8)
+        DecodeRowIndexed(srcRow(i), a_hdr.bpp, width, a_hdr, a_channels, dstRow);
+      else if(a_hdr.bpp == 24)
+        decodeRow(srcRow(i), (unsigned int*)dstRow, width);
+      else if(standardMasks)
+        decodeRowBGRA(srcRow(i), (unsigned int*)dstRow, width, a_hdr.masks[3] != 0);
+      else
+        DecodeRowMasked(srcRow(i), width, a_hdr, dstRow);
+    }
+  });
+}
+
+bool LoadBMPInfo(const char* fname, BMPInfo* pInfo)
+{
+  FileView  file(fname);
+  BMPHeader hdr;
+  if(!ParseHeader(file.Data(), file.Size(), &hdr))
+    return false;
+
+  pInfo->width    = hdr.width;
+  pInfo->height   = hdr.height;
+  pInfo->channels = (hdr.bpp <= 8 && hdr.grayPalette) ? 1 : 4;
+  return true;
+}
+
+bool DecodeBMP(const char* fname, void* pDst, size_t dstRowPitch, int dstChannels)
+{
+  FileView  file(fname);
+  BMPHeader hdr;
+  if(!ParseHeader(file.Data(), file.Size(), &hdr))
+    return false;
+
+  const int nativeChannels = (hdr.bpp <= 8 && hdr.grayPalette) ? 1 : 4;
+  const int channels       = (dstChannels == 0) ? nativeChannels : dstChannels;
+  if(channels != nativeChannels && !(channels == 4 && hdr.bpp <= 8)) // only palette images may be expanded
+    return false;
+
+  if(dstRowPitch == 0)
+    dstRowPitch = size_t(hdr.width)*size_t(channels);
+
+  assert(dstRowPitch >= size_t(hdr.width)*size_t(channels));
+  assert(channels == 1 || dstRowPitch % 4 == 0);
+  DecodeImage(file.Data(), file.Size(), hdr, pDst, dstRowPitch, channels);
+  return true;
+}
+
+std::vector<unsigned char> LoadBMPData(const char* fname, BMPInfo* pInfo)
+{
+  FileView  file(fname);
+  BMPHeader hdr;
+  if(!ParseHeader(file.Data(), file.Size(), &hdr))
+  {
+    (*pInfo) = BMPInfo{0, 0, 0};
+    return std::vector<unsigned char>();
+  }
+
+  pInfo->width    = hdr.width;
+  pInfo->height   = hdr.height;
+  pInfo->channels = (hdr.bpp <= 8 && hdr.grayPalette) ? 1 : 4;
+
+  std::vector<unsigned char> res(size_t(hdr.width)*size_t(hdr.height)*size_t(pInfo->channels));
+  DecodeImage(file.Data(), file.Size(), hdr, res.data(), size_t(hdr.width)*size_t(pInfo->channels), pInfo->channels);
   return res;
-}
\ No newline at end of file
+}
+
+std::vector<unsigned int> LoadBMP(const char* filename, int* pW, int* pH)
+{
+  (*pW) = 0;
+  (*pH) = 0;
+
+  FileView  file(filename); // the whole file is mapped or read with single call
+  BMPHeader hdr;
+  if(!ParseHeader(file.Data(), file.Size(), &hdr))
+    return std::vector<unsigned int>();
+
+  std::vector<unsigned int> res(size_t(hdr.width)*size_t(hdr.height));
+  DecodeImage(file.Data(), file.Size(), hdr, res.data(), size_t(hdr.width)*sizeof(unsigned int), 4); // gray images are expanded to RGBA
+
+  (*pW) = hdr.width;
+  (*pH) = hdr.height;
+  return res;
+}
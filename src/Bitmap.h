@@ -2,6 +2,7 @@
 #define BITMAP_GUARDIAN_H
 
 #include <vector>
+#include <cstddef>
 
 /**
 \brief save 24 bit RGB bitmap images.
@@ -9,19 +10,56 @@
 \param w      - input image width
 \param h      - input image height
 \param pixels - R8G8B8A8 data, 4 bytes per pixel, one byte for channel.
+
+  The whole file is formed in memory and written with single call; rows are converted with SIMD (if CPU supports it) and by several threads for large images.
 */
 void SaveBMP(const char* fname, const unsigned int* pixels, int w, int h);
 
 /**
-\brief load 24 bit RGB bitmap images.
+\brief load bitmap images as R8G8B8A8.
 \param fname - file name
 \param pW    - out image width
 \param pH    - out image height
 \return R8G8B8A8 data, 4 bytes per pixel, one byte for channel.
 
-  Note that this function in this sample works correctly _ONLY_ for 24 bit RGB ".bmp" images.
-  If you want to support gray-scale images or images with palette, please upgrade its implementation.
+  The file is memory mapped (or read with single call); rows are converted with SSSE3/AVX2 shuffles if CPU supports them 
+  and by several threads for large images.
+
+  Supports same formats as DecodeBMP; gray-scale images are expanded to RGBA.
 */
 std::vector<unsigned int> LoadBMP(const char* fname, int* pW, int* pH);
 
+struct BMPInfo
+{
+  int width;
+  int height;
+  int channels; ///< 1 for images with gray palette (masks, heightmaps), 4 (R8G8B8A8) for others
+};
+
+/**
+\brief read bitmap header only, so that application could prepare memory for DecodeBMP (i.e. staging buffer).
+\param fname - file name
+\param pInfo - out image size and channels
+\return false if file can't be read or its format is not supported
+*/
+bool LoadBMPInfo(const char* fname, BMPInfo* pInfo);
+
+/**
+\brief decode bitmap directly to application memory, for example to mapped staging buffer.
+\param fname       - file name
+\param pDst        - out pixels, height rows of dstRowPitch bytes; the bottom row goes first, as in usual BMP (top-down files are flipped)
+\param dstRowPitch - input row pitch of pDst in bytes; 0 means tightly packed rows; must be multiple of 4 for 4 channels
+\param dstChannels - input channels of output, 0 means BMPInfo::channels; palette images may be expanded to 4 channels
+\return false if file can't be read or its format is not supported
+
+  Supported formats: 1/4/8 bit with palette (uncompressed, RLE4, RLE8), 24 bit BGR, 32 bit BGRA and 32 bit with bit fields. 
+  Alpha is taken from 32 bit images with alpha channel and is 0 for others.
+*/
+bool DecodeBMP(const char* fname, void* pDst, size_t dstRowPitch, int dstChannels = 0);
+
+/**
+\brief load bitmap with its native channels (1 or 4), i.e. width*height*channels bytes; see DecodeBMP.
+*/
+std::vector<unsigned char> LoadBMPData(const char* fname, BMPInfo* pInfo);
+
 #endif
@@ -76,6 +76,24 @@ cmesh::SimpleMesh cmesh::CreateQuad(const int a_sizeX, const int a_sizeY, const
   return res;
 }
 
+cmesh::MeshRange cmesh::AppendMesh(SimpleMesh& a_scene, const SimpleMesh& a_mesh)
+{
+  MeshRange range;
+  range.firstIndex   = uint32_t(a_scene.IndicesNum());
+  range.indexCount   = uint32_t(a_mesh.IndicesNum());
+  range.vertexOffset = int32_t(a_scene.VerticesNum());
+  range.vertexCount  = uint32_t(a_mesh.VerticesNum());
+
+  a_scene.vPos4f.insert     (a_scene.vPos4f.end(),      a_mesh.vPos4f.begin(),      a_mesh.vPos4f.end());
+  a_scene.vNorm4f.insert    (a_scene.vNorm4f.end(),     a_mesh.vNorm4f.begin(),     a_mesh.vNorm4f.end());
+  a_scene.vTang4f.insert    (a_scene.vTang4f.end(),     a_mesh.vTang4f.begin(),     a_mesh.vTang4f.end());
+  a_scene.vTexCoord2f.insert(a_scene.vTexCoord2f.end(), a_mesh.vTexCoord2f.begin(), a_mesh.vTexCoord2f.end());
+  a_scene.indices.insert    (a_scene.indices.end(),     a_mesh.indices.begin(),     a_mesh.indices.end());
+  a_scene.matIndices.insert (a_scene.matIndices.end(),  a_mesh.matIndices.begin(),  a_mesh.matIndices.end());
+
+  return range;
+}
+
 cmesh::SimpleMesh cmesh::LoadMeshFromVSGF(const char* a_fileName)
 {
   std::ifstream input(a_fileName, std::ios::binary);
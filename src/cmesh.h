@@ -10,6 +10,7 @@
 #include <sstream>
 #include <memory>
 #include <cassert>
+#include <cstdint>
 
 namespace cmesh
 {
@@ -48,6 +49,23 @@ namespace cmesh
   SimpleMesh LoadMeshFromVSGF(const char* a_fileName);
   SimpleMesh CreateQuad(const int a_sizeX, const int a_sizeY, const float a_size);
 
+  // location of a sub-mesh inside a bigger (merged) mesh; indices of a sub-mesh are local, i.e. relative to vertexOffset
+  //
+  struct MeshRange
+  {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    int32_t  vertexOffset;
+    uint32_t vertexCount;
+  };
+
+  /**
+  \brief append a_mesh to the end of a_scene. Indices are copied as is (i.e. they stay local), so use returned range to draw appended mesh.
+  \param a_scene - input/output merged mesh
+  \param a_mesh  - input mesh that we want to add
+  */
+  MeshRange AppendMesh(SimpleMesh& a_scene, const SimpleMesh& a_mesh);
+
   //struct MultiIndexMesh
   //{
   //  struct Triangle
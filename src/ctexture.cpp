@@ -0,0 +1,706 @@
+#include "ctexture.h"
+#include "LiteMath.h"
+
+#include <cmath>
+#include <thread>
+#include <cstring>
+#include <cstdio>
+
+#ifdef WIN32
+#undef min
+#undef max
+#endif
+
+// Mip level i+1 is filtered from float (linear) copy of level i, level 0 is decoded from 8 bit on the fly, so the biggest
+// temporary buffer is level 1 in float, i.e. the same size as level 0 in RGBA8.
+// Filter is separable: for each destination row source rows are accumulated vertically into a row buffer, then the row is filtered horizontally.
+//
+static const size_t PARALLEL_MIN_TEXELS = 64*1024; ///< smaller levels are filtered by calling thread only
+static const float  KAISER_RADIUS       = 1.5f;    ///< in destination texels
+static const float  KAISER_ALPHA        = 4.0f;
+
+int ctexture::MipLevelsNum(int a_width, int a_height)
+{
+  int levels = 1;
+  while((std::max(a_width, a_height) >> levels) > 0)
+    levels++;
+  return levels;
+}
+
+static float SRGBToLinear(float a_val) { return (a_val <= 0.04045f)   ? a_val/12.92f : std::pow((a_val + 0.055f)/1.055f, 2.4f); }
+static float LinearToSRGB(float a_val) { return (a_val <= 0.0031308f) ? a_val*12.92f : 1.055f*std::pow(a_val, 1.0f/2.4f) - 0.055f; }
+
+static const float* SRGBToLinearTable()
+{
+  static const std::vector<float> table = []()
+  {
+    std::vector<float> res(256);
+    for(int i=0;i<256;i++)
+      res[i] = SRGBToLinear(float(i)/255.0f);
+    return res;
+  }();
+  return table.data();
+}
+
+static const int LINEAR_TABLE_SIZE = 65536; ///< sRGB is steep near zero, so linear value is quantized to 16 bit before look up
+
+static const unsigned char* LinearToSRGBTable()
+{
+  static const std::vector<unsigned char> table = []()
+  {
+    std::vector<unsigned char> res(LINEAR_TABLE_SIZE);
+    for(int i=0;i<LINEAR_TABLE_SIZE;i++)
+      res[i] = (unsigned char)(LinearToSRGB(float(i)/float(LINEAR_TABLE_SIZE-1))*255.0f + 0.5f);
+    return res;
+  }();
+  return table.data();
+}
+
+/**
+\brief Filter taps for 1D resampling from a_srcSize to a_dstSize; taps of destination texel i are [offsets[i], offsets[i+1]).
+*/
+struct FilterTaps
+{
+  std::vector<int>   offsets;
+  std::vector<int>   indices;
+  std::vector<float> weights;
+};
+
+static float BesselI0(float a_x)
+{
+  float sum = 1.0f, term = 1.0f;
+  const float halfX2 = 0.25f*a_x*a_x;
+  for(int k=1;k<32 && term > 1e-8f*sum;k++)
+  {
+    term *= halfX2/float(k*k);
+    sum  += term;
+  }
+  return sum;
+}
+
+static float KaiserSinc(float a_t)
+{
+  const float r = a_t/KAISER_RADIUS;
+  if(std::abs(r) >= 1.0f)
+    return 0.0f;
+  const float pit    = 3.14159265358979323846f*a_t;
+  const float sinc   = (std::abs(a_t) < 1e-6f) ? 1.0f : std::sin(pit)/pit;
+  const float window = BesselI0(KAISER_ALPHA*std::sqrt(1.0f - r*r))/BesselI0(KAISER_ALPHA);
+  return sinc*window;
+}
+
+static FilterTaps MakeTaps(int a_srcSize, int a_dstSize, ctexture::MIP_FILTER a_filter)
+{
+  FilterTaps res;
+  res.offsets.reserve(a_dstSize+1);
+  res.offsets.push_back(0);
+
+  const float scale = float(a_srcSize)/float(a_dstSize);
+  for(int i=0;i<a_dstSize;i++)
+  {
+    const size_t first = res.weights.size();
+    if(a_srcSize == a_dstSize)
+    {
+      res.indices.push_back(i);
+      res.weights.push_back(1.0f);
+    }
+    else if(a_filter == ctexture::MIP_FILTER_KAISER)
+    {
+      const float center = (float(i) + 0.5f)*scale;              // in source texels, texel j covers [j, j+1]
+      const int   begin  = int(std::floor(center - KAISER_RADIUS*scale));
+      const int   end    = int(std::ceil (center + KAISER_RADIUS*scale));
+      for(int j=begin;j<end;j++)
+      {
+        const float w = KaiserSinc((float(j) + 0.5f - center)/scale);
+        if(w == 0.0f)
+          continue;
+        res.indices.push_back(std::min(std::max(j, 0), a_srcSize-1)); // clamp to edge
+        res.weights.push_back(w);
+      }
+    }
+    else
+    {
+      const float begin = float(i)*scale;                       // for odd sizes footprint covers fractions of border texels
+      const float end   = float(i+1)*scale;
+      for(int j=int(std::floor(begin));j<int(std::ceil(end)) && j<a_srcSize;j++)
+      {
+        const float w = std::min(end, float(j+1)) - std::max(begin, float(j));
+        if(w <= 0.0f)
+          continue;
+        res.indices.push_back(j);
+        res.weights.push_back(w);
+      }
+    }
+
+    float sum = 0.0f;
+    for(size_t k=first;k<res.weights.size();k++)
+      sum += res.weights[k];
+    for(size_t k=first;k<res.weights.size();k++)
+      res.weights[k] /= sum;
+
+    res.offsets.push_back(int(res.weights.size()));
+  }
+
+  return res;
+}
+
+template<typename RowsFunc>
+static void ForEachRows(int a_threadsNum, int a_width, int a_height, RowsFunc a_func)
+{
+  const size_t texels     = size_t(a_width)*size_t(a_height);
+  const int    threadsNum = (texels >= PARALLEL_MIN_TEXELS) ? std::min(a_height, a_threadsNum) : 1;
+  if(threadsNum <= 1)
+  {
+    a_func(0, a_height);
+    return;
+  }
+
+  const int rowsPerThread = (a_height + threadsNum - 1) / threadsNum;
+
+  std::vector<std::thread> threads;
+  threads.reserve(threadsNum);
+  for(int rowBegin = rowsPerThread; rowBegin < a_height; rowBegin += rowsPerThread)
+    threads.emplace_back(a_func, rowBegin, std::min(a_height, rowBegin + rowsPerThread));
+
+  a_func(0, std::min(a_height, rowsPerThread));
+
+  for(auto& thread : threads)
+    thread.join();
+}
+
+static void DecodeRow(const unsigned int* a_src, float* a_dst, int a_width, bool a_srgb)
+{
+  const float* toLinear = SRGBToLinearTable();
+  for(int x=0;x<a_width;x++)
+  {
+    const unsigned int texel = a_src[x];
+    const float        alpha = float(texel >> 24)*(1.0f/255.0f);
+    if(a_srgb)
+      LiteMath::store_u(a_dst + x*4, LiteMath::float4(toLinear[texel & 0xFF], toLinear[(texel >> 8) & 0xFF], toLinear[(texel >> 16) & 0xFF], alpha));
+    else
+      LiteMath::store_u(a_dst + x*4, LiteMath::float4(float(texel & 0xFF), float((texel >> 8) & 0xFF), float((texel >> 16) & 0xFF), float(texel >> 24))*(1.0f/255.0f));
+  }
+}
+
+static void EncodeRow(const float* a_src, unsigned int* a_dst, int a_width, bool a_srgb)
+{
+  const unsigned char*   toSRGB = LinearToSRGBTable();
+  const LiteMath::float4 zero(0.0f, 0.0f, 0.0f, 0.0f);
+  const LiteMath::float4 one (1.0f, 1.0f, 1.0f, 1.0f);
+  const LiteMath::float4 scale = a_srgb ? LiteMath::float4(float(LINEAR_TABLE_SIZE-1), float(LINEAR_TABLE_SIZE-1), float(LINEAR_TABLE_SIZE-1), 255.0f)
+                                        : LiteMath::float4(255.0f, 255.0f, 255.0f, 255.0f);
+  float q[4];
+  for(int x=0;x<a_width;x++)
+  {
+    LiteMath::store_u(q, LiteMath::clamp(LiteMath::load_u(a_src + x*4), zero, one)*scale + 0.5f); // Kaiser may overshoot a bit
+    const unsigned int r = a_srgb ? toSRGB[int(q[0])] : (unsigned int)(q[0]);
+    const unsigned int g = a_srgb ? toSRGB[int(q[1])] : (unsigned int)(q[1]);
+    const unsigned int b = a_srgb ? toSRGB[int(q[2])] : (unsigned int)(q[2]);
+    const unsigned int a = (unsigned int)(q[3]);
+    a_dst[x] = r | (g << 8) | (b << 16) | (a << 24);
+  }
+}
+
+ctexture::MipChainRGBA8 ctexture::GenerateMipsRGBA8(const unsigned int* a_pixels, int a_width, int a_height, bool a_srgb,
+                                                    MIP_FILTER a_filter, int a_threadsNum)
+{
+  MipChainRGBA8 res;
+  if(a_pixels == nullptr || a_width <= 0 || a_height <= 0)
+    return res;
+
+  if(a_threadsNum <= 0)
+    a_threadsNum = std::max(1, int(std::thread::hardware_concurrency()));
+
+  res.width  = a_width;
+  res.height = a_height;
+  res.levels.resize(MipLevelsNum(a_width, a_height));
+  res.levels[0].assign(a_pixels, a_pixels + size_t(a_width)*size_t(a_height));
+
+  std::vector<float> srcLinear, dstLinear; // level i-1 and level i in linear float; empty for level 0 which is decoded from res.levels[0]
+
+  for(int level = 1; level < res.LevelsNum(); level++)
+  {
+    const int srcW = res.LevelWidth(level-1);
+    const int srcH = res.LevelHeight(level-1);
+    const int dstW = res.LevelWidth(level);
+    const int dstH = res.LevelHeight(level);
+
+    const bool lastLevel = (level == res.LevelsNum() - 1);
+
+    const FilterTaps tapsX = MakeTaps(srcW, dstW, a_filter);
+    const FilterTaps tapsY = MakeTaps(srcH, dstH, a_filter);
+
+    res.levels[level].resize(size_t(dstW)*size_t(dstH));
+    if(!lastLevel)
+      dstLinear.resize(size_t(dstW)*size_t(dstH)*4);
+
+    const unsigned int* srcPixels = res.levels[level-1].data();
+    const float*        srcFloats = (level == 1) ? nullptr : srcLinear.data();
+    unsigned int*       dstPixels = res.levels[level].data();
+    float*              dstFloats = lastLevel ? nullptr : dstLinear.data();
+
+    ForEachRows(a_threadsNum, dstW, dstH, [&](int a_rowBegin, int a_rowEnd)
+    {
+      std::vector<float> rowAcc(size_t(srcW)*4), decoded(srcFloats == nullptr ? size_t(srcW)*4 : 0), rowOut(size_t(dstW)*4);
+
+      for(int y = a_rowBegin; y < a_rowEnd; y++)
+      {
+        // vertical pass: weighted sum of source rows
+        //
+        std::fill(rowAcc.begin(), rowAcc.end(), 0.0f);
+        for(int k = tapsY.offsets[y]; k < tapsY.offsets[y+1]; k++)
+        {
+          const float* srcRow = nullptr;
+          if(srcFloats != nullptr)
+            srcRow = srcFloats + size_t(tapsY.indices[k])*size_t(srcW)*4;
+          else
+          {
+            DecodeRow(srcPixels + size_t(tapsY.indices[k])*size_t(srcW), decoded.data(), srcW, a_srgb);
+            srcRow = decoded.data();
+          }
+
+          const float w = tapsY.weights[k];
+          for(int x = 0; x < srcW; x++)
+            LiteMath::store_u(rowAcc.data() + x*4, LiteMath::load_u(rowAcc.data() + x*4) + LiteMath::load_u(srcRow + x*4)*w);
+        }
+
+        // horizontal pass
+        //
+        float* dstRow = (dstFloats != nullptr) ? dstFloats + size_t(y)*size_t(dstW)*4 : rowOut.data();
+        for(int x = 0; x < dstW; x++)
+        {
+          LiteMath::float4 acc(0.0f, 0.0f, 0.0f, 0.0f);
+          for(int k = tapsX.offsets[x]; k < tapsX.offsets[x+1]; k++)
+            acc = acc + LiteMath::load_u(rowAcc.data() + tapsX.indices[k]*4)*tapsX.weights[k];
+          LiteMath::store_u(dstRow + x*4, acc);
+        }
+
+        EncodeRow(dstRow, dstPixels + size_t(y)*size_t(dstW), dstW, a_srgb);
+      }
+    });
+
+    srcLinear.swap(dstLinear);
+  }
+
+  return res;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// BCn encoder. Block texels are float4 in [0, 255]; BC1 palette is built from 565 endpoints expanded exactly as decoder does,
+// so indices are chosen by the real error. BC1 blocks are always in 4 color mode, i.e. c0 > c1.
+//
+using LiteMath::float4;
+
+size_t ctexture::BlockBytes(BC_FORMAT a_format)
+{
+  return (a_format == BC_FORMAT_BC1 || a_format == BC_FORMAT_BC4) ? 8 : 16;
+}
+
+size_t ctexture::CompressedSize(BC_FORMAT a_format, int a_width, int a_height)
+{
+  return size_t((a_width + 3)/4)*size_t((a_height + 3)/4)*BlockBytes(a_format);
+}
+
+static void LoadBlock(const unsigned int* a_pixels, int a_width, int a_height, int a_blockX, int a_blockY, float4 a_block[16])
+{
+  for(int y=0;y<4;y++)
+  {
+    const unsigned int* row = a_pixels + size_t(std::min(a_blockY*4 + y, a_height - 1))*size_t(a_width);
+    for(int x=0;x<4;x++)
+    {
+      const unsigned int texel = row[std::min(a_blockX*4 + x, a_width - 1)];
+      a_block[y*4+x] = float4(float(texel & 0xFF), float((texel >> 8) & 0xFF), float((texel >> 16) & 0xFF), float(texel >> 24));
+    }
+  }
+}
+
+static inline float Dot3(const float4& a, const float4& b) { return a.x*b.x + a.y*b.y + a.z*b.z; } // dot3f of LiteMath needs SSE4.1
+
+static void WriteLE(unsigned char* a_dst, uint64_t a_val, int a_bytes)
+{
+  for(int i=0;i<a_bytes;i++)
+    a_dst[i] = (unsigned char)(a_val >> (8*i));
+}
+
+static uint16_t To565(const float4& a_color)
+{
+  const int r = std::min(std::max(int(a_color.x*(31.0f/255.0f) + 0.5f), 0), 31);
+  const int g = std::min(std::max(int(a_color.y*(63.0f/255.0f) + 0.5f), 0), 63);
+  const int b = std::min(std::max(int(a_color.z*(31.0f/255.0f) + 0.5f), 0), 31);
+  return uint16_t((r << 11) | (g << 5) | b);
+}
+
+static float4 From565(uint16_t a_color)
+{
+  const int r = (a_color >> 11) & 31;
+  const int g = (a_color >> 5)  & 63;
+  const int b = (a_color >> 0)  & 31;
+  return float4(float((r << 3) | (r >> 2)), float((g << 2) | (g >> 4)), float((b << 3) | (b >> 2)), 0.0f);
+}
+
+/**
+\brief Choose indices for quantized endpoints (a_c0 >= a_c1), return squared rgb error.
+*/
+static float ColorIndices(const float4 a_block[16], uint16_t a_c0, uint16_t a_c1, uint32_t* a_pIndices)
+{
+  float4 palette[4];
+  palette[0] = From565(a_c0);
+  palette[1] = From565(a_c1);
+  palette[2] = (palette[0]*2.0f + palette[1])*(1.0f/3.0f);
+  palette[3] = (palette[0] + palette[1]*2.0f)*(1.0f/3.0f);
+  const int palSize = (a_c0 == a_c1) ? 1 : 4; // equal endpoints mean 3 color mode with black in index 3, so use only index 0
+
+  uint32_t indices = 0;
+  float    error   = 0.0f;
+  for(int i=0;i<16;i++)
+  {
+    int   best    = 0;
+    float bestErr = 1e30f;
+    for(int k=0;k<palSize;k++)
+    {
+      const float4 diff = a_block[i] - palette[k];
+      const float  err  = Dot3(diff, diff);
+      if(err < bestErr)
+      {
+        bestErr = err;
+        best    = k;
+      }
+    }
+    indices |= uint32_t(best) << (2*i);
+    error   += bestErr;
+  }
+
+  (*a_pIndices) = indices;
+  return error;
+}
+
+struct ColorBlock
+{
+  uint16_t c0, c1;
+  uint32_t indices;
+  float    error;
+};
+
+static ColorBlock QuantizeColorEndpoints(const float4 a_block[16], const float4& a_end0, const float4& a_end1)
+{
+  ColorBlock res;
+  res.c0 = To565(a_end0);
+  res.c1 = To565(a_end1);
+  if(res.c0 < res.c1)
+    std::swap(res.c0, res.c1);
+  res.error = ColorIndices(a_block, res.c0, res.c1, &res.indices);
+  return res;
+}
+
+/**
+\brief Solve for endpoints that minimize error with current indices fixed; returns false for degenerate (single index) blocks.
+*/
+static bool RefineColorEndpoints(const float4 a_block[16], uint32_t a_indices, float4* a_pEnd0, float4* a_pEnd1)
+{
+  static const float weight0[4] = { 1.0f, 0.0f, 2.0f/3.0f, 1.0f/3.0f };
+
+  float  aa = 0.0f, bb = 0.0f, ab = 0.0f;
+  float4 ax(0.0f, 0.0f, 0.0f, 0.0f), bx(0.0f, 0.0f, 0.0f, 0.0f);
+  for(int i=0;i<16;i++)
+  {
+    const float a = weight0[(a_indices >> (2*i)) & 3];
+    const float b = 1.0f - a;
+    aa += a*a;
+    bb += b*b;
+    ab += a*b;
+    ax  = ax + a_block[i]*a;
+    bx  = bx + a_block[i]*b;
+  }
+
+  const float det = aa*bb - ab*ab;
+  if(std::abs(det) < 1e-6f)
+    return false;
+
+  const float4 zero(0.0f, 0.0f, 0.0f, 0.0f), full(255.0f, 255.0f, 255.0f, 255.0f);
+  (*a_pEnd0) = LiteMath::clamp((ax*bb - bx*ab)*(1.0f/det), zero, full);
+  (*a_pEnd1) = LiteMath::clamp((bx*aa - ax*ab)*(1.0f/det), zero, full);
+  return true;
+}
+
+static void EncodeColorBlock(const float4 a_block[16], ctexture::BC_QUALITY a_quality, unsigned char* a_dst)
+{
+  float4 minColor = a_block[0], maxColor = a_block[0], mean = a_block[0];
+  for(int i=1;i<16;i++)
+  {
+    minColor = LiteMath::min(minColor, a_block[i]);
+    maxColor = LiteMath::max(maxColor, a_block[i]);
+    mean     = mean + a_block[i];
+  }
+  mean = mean*(1.0f/16.0f);
+
+  // principal axis: power iterations on covariance matrix, started from bounding box diagonal
+  //
+  float4 axis = maxColor - minColor;
+  if(a_quality != ctexture::BC_QUALITY_FAST)
+  {
+    float cov[6] = {0,0,0,0,0,0}; // rr, rg, rb, gg, gb, bb
+    for(int i=0;i<16;i++)
+    {
+      const float4 d = a_block[i] - mean;
+      cov[0] += d.x*d.x; cov[1] += d.x*d.y; cov[2] += d.x*d.z;
+      cov[3] += d.y*d.y; cov[4] += d.y*d.z; cov[5] += d.z*d.z;
+    }
+    for(int iter=0;iter<4;iter++)
+    {
+      const float4 next(cov[0]*axis.x + cov[1]*axis.y + cov[2]*axis.z,
+                        cov[1]*axis.x + cov[3]*axis.y + cov[4]*axis.z,
+                        cov[2]*axis.x + cov[4]*axis.y + cov[5]*axis.z, 0.0f);
+      const float len = std::max(std::max(std::abs(next.x), std::abs(next.y)), std::abs(next.z));
+      if(len < 1e-6f)
+        break;
+      axis = next*(1.0f/len);
+    }
+  }
+
+  float minProj = 1e30f, maxProj = -1e30f;
+  for(int i=0;i<16;i++)
+  {
+    const float proj = Dot3(a_block[i] - mean, axis);
+    minProj = std::min(minProj, proj);
+    maxProj = std::max(maxProj, proj);
+  }
+
+  const float axisLen2 = Dot3(axis, axis);
+  float4 end0 = mean, end1 = mean;
+  if(axisLen2 > 1e-6f)
+  {
+    end0 = mean + axis*(maxProj/axisLen2);
+    end1 = mean + axis*(minProj/axisLen2);
+  }
+
+  ColorBlock best = QuantizeColorEndpoints(a_block, end0, end1);
+
+  const int refineIters = (a_quality == ctexture::BC_QUALITY_HIGH) ? 8 : (a_quality == ctexture::BC_QUALITY_NORMAL ? 1 : 0);
+  for(int iter=0; iter<refineIters && best.error > 0.0f; iter++)
+  {
+    if(!RefineColorEndpoints(a_block, best.indices, &end0, &end1))
+      break;
+    const ColorBlock refined = QuantizeColorEndpoints(a_block, end0, end1);
+    if(refined.error >= best.error)
+      break;
+    best = refined;
+  }
+
+  WriteLE(a_dst + 0, best.c0, 2);
+  WriteLE(a_dst + 2, best.c1, 2);
+  WriteLE(a_dst + 4, best.indices, 4);
+}
+
+static int ChannelIndices(const int a_values[16], int a_r0, int a_r1, uint64_t* a_pIndices)
+{
+  int palette[8];
+  palette[0] = a_r0;
+  palette[1] = a_r1;
+  if(a_r0 > a_r1)
+  {
+    for(int i=1;i<7;i++)
+      palette[i+1] = ((7-i)*a_r0 + i*a_r1 + 3)/7;
+  }
+  else
+  {
+    for(int i=1;i<5;i++)
+      palette[i+1] = ((5-i)*a_r0 + i*a_r1 + 2)/5;
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+
+  uint64_t indices = 0;
+  int      error   = 0;
+  for(int i=0;i<16;i++)
+  {
+    int best = 0, bestErr = 1 << 30;
+    for(int k=0;k<8;k++)
+    {
+      const int err = (a_values[i] - palette[k])*(a_values[i] - palette[k]);
+      if(err < bestErr)
+      {
+        bestErr = err;
+        best    = k;
+      }
+    }
+    indices |= uint64_t(best) << (3*i);
+    error   += bestErr;
+  }
+
+  (*a_pIndices) = indices;
+  return error;
+}
+
+/**
+\brief BC4 block, also alpha of BC3 and each channel of BC5.
+*/
+static void EncodeChannelBlock(const float4 a_block[16], int a_channel, ctexture::BC_QUALITY a_quality, unsigned char* a_dst)
+{
+  int values[16];
+  int minVal = 255, maxVal = 0;
+  int minInner = 255, maxInner = 0;  // without 0 and 255 which are exact in 6 values mode
+  for(int i=0;i<16;i++)
+  {
+    const float4& t = a_block[i];
+    values[i] = int(a_channel == 0 ? t.x : (a_channel == 1 ? t.y : (a_channel == 2 ? t.z : t.w)));
+    minVal    = std::min(minVal, values[i]);
+    maxVal    = std::max(maxVal, values[i]);
+    if(values[i] != 0 && values[i] != 255)
+    {
+      minInner = std::min(minInner, values[i]);
+      maxInner = std::max(maxInner, values[i]);
+    }
+  }
+
+  int      r0 = maxVal, r1 = minVal;   // 8 values mode
+  uint64_t indices = 0;
+  int      error   = ChannelIndices(values, r0, r1, &indices);
+
+  if(a_quality == ctexture::BC_QUALITY_HIGH && error > 0 && minInner <= maxInner)
+  {
+    uint64_t indices6 = 0;
+    const int error6  = ChannelIndices(values, minInner, maxInner, &indices6);
+    if(error6 < error)
+    {
+      r0      = minInner;
+      r1      = maxInner;
+      indices = indices6;
+    }
+  }
+
+  a_dst[0] = (unsigned char)r0;
+  a_dst[1] = (unsigned char)r1;
+  WriteLE(a_dst + 2, indices, 6);
+}
+
+void ctexture::CompressBC(const unsigned int* a_pixels, int a_width, int a_height, BC_FORMAT a_format, BC_QUALITY a_quality,
+                          unsigned char* a_dst, int a_threadsNum)
+{
+  if(a_threadsNum <= 0)
+    a_threadsNum = std::max(1, int(std::thread::hardware_concurrency()));
+
+  const int    blocksX    = (a_width  + 3)/4;
+  const int    blocksY    = (a_height + 3)/4;
+  const size_t blockBytes = BlockBytes(a_format);
+
+  ForEachRows(a_threadsNum, blocksX*16, blocksY, [&](int a_rowBegin, int a_rowEnd)
+  {
+    float4 block[16];
+    for(int by = a_rowBegin; by < a_rowEnd; by++)
+    {
+      for(int bx = 0; bx < blocksX; bx++)
+      {
+        LoadBlock(a_pixels, a_width, a_height, bx, by, block);
+        unsigned char* dst = a_dst + (size_t(by)*size_t(blocksX) + size_t(bx))*blockBytes;
+        switch(a_format)
+        {
+          case BC_FORMAT_BC1:
+            EncodeColorBlock(block, a_quality, dst);
+            break;
+          case BC_FORMAT_BC3:
+            EncodeChannelBlock(block, 3, a_quality, dst);
+            EncodeColorBlock(block, a_quality, dst + 8);
+            break;
+          case BC_FORMAT_BC4:
+            EncodeChannelBlock(block, 0, a_quality, dst);
+            break;
+          case BC_FORMAT_BC5:
+            EncodeChannelBlock(block, 0, a_quality, dst);
+            EncodeChannelBlock(block, 1, a_quality, dst + 8);
+            break;
+        };
+      }
+    }
+  });
+}
+
+ctexture::MipChainBC ctexture::CompressMips(const MipChainRGBA8& a_mips, BC_FORMAT a_format, BC_QUALITY a_quality, int a_threadsNum)
+{
+  MipChainBC res;
+  res.format = a_format;
+  res.width  = a_mips.width;
+  res.height = a_mips.height;
+  res.levels.resize(a_mips.levels.size());
+  for(int i=0;i<a_mips.LevelsNum();i++)
+  {
+    res.levels[i].resize(CompressedSize(a_format, a_mips.LevelWidth(i), a_mips.LevelHeight(i)));
+    CompressBC(a_mips.levels[i].data(), a_mips.LevelWidth(i), a_mips.LevelHeight(i), a_format, a_quality, res.levels[i].data(), a_threadsNum);
+  }
+  return res;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint64_t ctexture::Hash64(const void* a_data, size_t a_size, uint64_t a_seed)
+{
+  const unsigned char* bytes = (const unsigned char*)a_data;
+  uint64_t hash = a_seed;
+  for(size_t i=0;i<a_size;i++)
+  {
+    hash ^= uint64_t(bytes[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+struct MipsCacheHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;
+  uint32_t format;
+  int32_t  width;
+  int32_t  height;
+  int32_t  levels;
+};
+
+static const uint32_t MIPS_CACHE_MAGIC   = 0x31434342; // "BCC1"
+static const uint32_t MIPS_CACHE_VERSION = 1;
+
+bool ctexture::SaveMipsCache(const char* a_fileName, const MipChainBC& a_mips, uint64_t a_key)
+{
+  FILE* f = fopen(a_fileName, "wb");
+  if(f == nullptr)
+    return false;
+
+  const MipsCacheHeader header = { MIPS_CACHE_MAGIC, MIPS_CACHE_VERSION, a_key, uint32_t(a_mips.format), a_mips.width, a_mips.height, a_mips.LevelsNum() };
+  bool ok = (fwrite(&header, sizeof(header), 1, f) == 1);
+  for(const auto& level : a_mips.levels)
+    ok = ok && (fwrite(level.data(), 1, level.size(), f) == level.size());
+
+  fclose(f);
+  if(!ok)
+    remove(a_fileName); // don't leave truncated cache
+  return ok;
+}
+
+bool ctexture::LoadMipsCache(const char* a_fileName, uint64_t a_key, MipChainBC* a_pMips)
+{
+  FILE* f = fopen(a_fileName, "rb");
+  if(f == nullptr)
+    return false;
+
+  MipsCacheHeader header = {};
+  bool ok = (fread(&header, sizeof(header), 1, f) == 1) && header.magic == MIPS_CACHE_MAGIC && header.version == MIPS_CACHE_VERSION && header.key == a_key &&
+            header.format <= uint32_t(BC_FORMAT_BC5) && header.width > 0 && header.height > 0 && header.levels == MipLevelsNum(header.width, header.height);
+
+  if(ok)
+  {
+    MipChainBC& mips = (*a_pMips);
+    mips.format = BC_FORMAT(header.format);
+    mips.width  = header.width;
+    mips.height = header.height;
+    mips.levels.resize(header.levels);
+    for(int i=0; i<header.levels && ok; i++)
+    {
+      mips.levels[i].resize(CompressedSize(mips.format, std::max(1, mips.width >> i), std::max(1, mips.height >> i)));
+      ok = (fread(mips.levels[i].data(), 1, mips.levels[i].size(), f) == mips.levels[i].size());
+    }
+  }
+
+  fclose(f);
+  return ok;
+}
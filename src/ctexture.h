@@ -0,0 +1,126 @@
+#ifndef CTEXTURE_H
+#define CTEXTURE_H
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+namespace ctexture
+{
+  // very simple utility texture processing on the CPU in C++; textures are R8G8B8A8 packed in unsigned int, same as LoadBMP returns
+  //
+
+  enum MIP_FILTER { MIP_FILTER_BOX    = 0,   ///< exact area average of the source footprint, correct for odd (NPOT) sizes too
+                    MIP_FILTER_KAISER = 1 }; ///< Kaiser windowed sinc, sharper than box, slight ringing is clamped
+
+  /**
+  \brief Full mip chain of RGBA8 texture; level i has max(1, width >> i) x max(1, height >> i) tightly packed texels,
+         i.e. exactly what vk_texture::SimpleTexture2D::UpdateMips expects.
+  */
+  struct MipChainRGBA8
+  {
+    int width  = 0;
+    int height = 0;
+    std::vector< std::vector<unsigned int> > levels;
+
+    int LevelsNum()          const { return int(levels.size()); }
+    int LevelWidth (int a_i) const { return std::max(1, width  >> a_i); }
+    int LevelHeight(int a_i) const { return std::max(1, height >> a_i); }
+
+    std::vector<const void*> LevelPointers() const
+    {
+      std::vector<const void*> res(levels.size());
+      for(size_t i=0;i<levels.size();i++)
+        res[i] = levels[i].data();
+      return res;
+    }
+  };
+
+  /**
+  \brief Number of mip levels for full chain down to 1x1, same as vk_texture::SimpleTexture2D::CreateImage allocates.
+  */
+  int MipLevelsNum(int a_width, int a_height);
+
+  /**
+  \brief Generate full mip chain on the CPU. Filtering is done in linear float space with SIMD and rows are processed in several threads.
+         Each level is filtered from the previous one; level 0 is copied as is.
+  \param a_pixels     - input level 0, a_width*a_height texels
+  \param a_width      - input width
+  \param a_height     - input height
+  \param a_srgb       - input if true, rgb is sRGB encoded: it is converted to linear before filtering and back to sRGB after (alpha is always linear).
+                        Use it for color textures even if they are stored in UNORM image, otherwise mips get darker.
+  \param a_filter     - input downsampling filter
+  \param a_threadsNum - input threads number; 0 means std::thread::hardware_concurrency()
+  */
+  MipChainRGBA8 GenerateMipsRGBA8(const unsigned int* a_pixels, int a_width, int a_height, bool a_srgb,
+                                  MIP_FILTER a_filter = MIP_FILTER_BOX, int a_threadsNum = 0);
+
+  //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+  enum BC_FORMAT { BC_FORMAT_BC1 = 0,   ///< rgb, 8 bytes per 4x4 block  (VK_FORMAT_BC1_RGB_UNORM_BLOCK); alpha is not stored
+                   BC_FORMAT_BC3 = 1,   ///< rgba, 16 bytes per 4x4 block (VK_FORMAT_BC3_UNORM_BLOCK)
+                   BC_FORMAT_BC4 = 2,   ///< r, 8 bytes per 4x4 block     (VK_FORMAT_BC4_UNORM_BLOCK)
+                   BC_FORMAT_BC5 = 3 }; ///< rg, 16 bytes per 4x4 block   (VK_FORMAT_BC5_UNORM_BLOCK), i.e. normal maps
+
+  enum BC_QUALITY { BC_QUALITY_FAST   = 0,   ///< bounding box endpoints
+                    BC_QUALITY_NORMAL = 1,   ///< principal axis endpoints refined once with least squares
+                    BC_QUALITY_HIGH   = 2 }; ///< iterative least squares refinement, both BC4 modes are tried
+
+  size_t BlockBytes(BC_FORMAT a_format);
+  size_t CompressedSize(BC_FORMAT a_format, int a_width, int a_height); ///< rows of 4x4 blocks, partial blocks are rounded up
+
+  /**
+  \brief Compress RGBA8 image to BCn blocks. Texels are encoded as is, i.e. sRGB colors stay sRGB (use UNORM or SRGB Vulkan format accordingly).
+         Rows of blocks are processed in several threads.
+  \param a_pixels     - input image, a_width*a_height texels; border blocks replicate edge texels
+  \param a_width      - input width
+  \param a_height     - input height
+  \param a_format     - input block format
+  \param a_quality    - input speed/quality trade off
+  \param a_dst        - output blocks, CompressedSize(a_format, a_width, a_height) bytes
+  \param a_threadsNum - input threads number; 0 means std::thread::hardware_concurrency()
+  */
+  void CompressBC(const unsigned int* a_pixels, int a_width, int a_height, BC_FORMAT a_format, BC_QUALITY a_quality,
+                  unsigned char* a_dst, int a_threadsNum = 0);
+
+  /**
+  \brief Block compressed mip chain; level i has max(1, width >> i) x max(1, height >> i) texels, stored as CompressedSize(...) bytes.
+  */
+  struct MipChainBC
+  {
+    BC_FORMAT format = BC_FORMAT_BC1;
+    int       width  = 0;
+    int       height = 0;
+    std::vector< std::vector<unsigned char> > levels;
+
+    int LevelsNum() const { return int(levels.size()); }
+
+    std::vector<const void*> LevelPointers() const
+    {
+      std::vector<const void*> res(levels.size());
+      for(size_t i=0;i<levels.size();i++)
+        res[i] = levels[i].data();
+      return res;
+    }
+  };
+
+  MipChainBC CompressMips(const MipChainRGBA8& a_mips, BC_FORMAT a_format, BC_QUALITY a_quality, int a_threadsNum = 0);
+
+  /**
+  \brief 64 bit FNV-1a hash, i.e. to make cache key from source texels and compression parameters.
+  */
+  uint64_t Hash64(const void* a_data, size_t a_size, uint64_t a_seed = 14695981039346656037ULL);
+
+  /**
+  \brief Store compressed mip chain in a cache file. a_key should identify source data and parameters, see Hash64.
+  */
+  bool SaveMipsCache(const char* a_fileName, const MipChainBC& a_mips, uint64_t a_key);
+
+  /**
+  \brief Load compressed mip chain from a cache file. Returns false if there is no such file, it is broken or it was saved with other a_key.
+  */
+  bool LoadMipsCache(const char* a_fileName, uint64_t a_key, MipChainBC* a_pMips);
+};
+
+#endif
@@ -0,0 +1,178 @@
+#include "ctexture_file.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static const char TEXTURE_FILE_MAGIC[8] = { 'C', 'T', 'E', 'X', '\r', '\n', '\x1a', '\n' };
+
+static uint64_t AlignUp(uint64_t a_size, uint64_t a_alignment) { return (a_size + a_alignment - 1) / a_alignment * a_alignment; }
+
+bool ctexture::SaveTextureFile(const char* a_fileName, const TextureFileDesc& a_desc, const void* const* a_subres, const size_t* a_sizes)
+{
+  if(a_desc.width <= 0 || a_desc.height <= 0 || a_desc.levels <= 0 || a_desc.layers <= 0)
+    return false;
+
+  const size_t subresNum = size_t(a_desc.levels)*size_t(a_desc.layers);
+
+  TextureFileHeader header = {};
+  memcpy(header.magic, TEXTURE_FILE_MAGIC, sizeof(header.magic));
+  header.version      = TEXTURE_FILE_VERSION;
+  header.vkFormat     = a_desc.vkFormat;
+  header.width        = uint32_t(a_desc.width);
+  header.height       = uint32_t(a_desc.height);
+  header.levels       = uint32_t(a_desc.levels);
+  header.layers       = uint32_t(a_desc.layers);
+  header.flags        = a_desc.flags;
+  header.alignment    = TEXTURE_FILE_ALIGNMENT;
+  header.subresOffset = sizeof(TextureFileHeader);
+
+  std::vector<TextureFileSubresource> table(subresNum);
+  uint64_t offset = header.subresOffset + subresNum*sizeof(TextureFileSubresource);
+  for(size_t i=0;i<subresNum;i++)
+  {
+    offset          = AlignUp(offset, TEXTURE_FILE_ALIGNMENT);
+    table[i].offset = offset;
+    table[i].size   = a_sizes[i];
+    offset         += a_sizes[i];
+  }
+  header.fileSize = offset;
+
+  FILE* f = fopen(a_fileName, "wb");
+  if(f == nullptr)
+    return false;
+
+  static const unsigned char zeros[TEXTURE_FILE_ALIGNMENT] = {};
+
+  bool ok = (fwrite(&header, sizeof(header), 1, f) == 1) && (fwrite(table.data(), sizeof(TextureFileSubresource), subresNum, f) == subresNum);
+  uint64_t written = header.subresOffset + subresNum*sizeof(TextureFileSubresource);
+  for(size_t i=0; i<subresNum && ok; i++)
+  {
+    const size_t pad = size_t(table[i].offset - written);
+    ok      = (fwrite(zeros, 1, pad, f) == pad) && (fwrite(a_subres[i], 1, a_sizes[i], f) == a_sizes[i]);
+    written = table[i].offset + table[i].size;
+  }
+
+  fclose(f);
+  if(!ok)
+    remove(a_fileName); // don't leave truncated file
+  return ok;
+}
+
+bool ctexture::TextureFile::Open(const char* a_fileName)
+{
+  Close();
+
+#ifndef WIN32
+  const int fd = open(a_fileName, O_RDONLY);
+  if(fd < 0)
+    return false;
+  struct stat st;
+  if(fstat(fd, &st) == 0 && st.st_size > 0)
+  {
+    void* mapped = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if(mapped != MAP_FAILED)
+    {
+      m_data   = (const unsigned char*)mapped;
+      m_size   = size_t(st.st_size);
+      m_mapped = true;
+    }
+  }
+  close(fd);
+#endif
+
+  if(!m_mapped)
+  {
+    FILE* f = fopen(a_fileName, "rb");
+    if(f == nullptr)
+      return false;
+
+    fseek(f, 0, SEEK_END);
+    const long fileSize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    if(fileSize > 0)
+    {
+      m_buffer.reset(new unsigned char[size_t(fileSize)]);
+      if(fread(m_buffer.get(), 1, size_t(fileSize), f) == size_t(fileSize))
+      {
+        m_data = m_buffer.get();
+        m_size = size_t(fileSize);
+      }
+    }
+    fclose(f);
+  }
+
+  // validate header and table, so that Data() never points outside of the file
+  //
+  TextureFileHeader header;
+  bool ok = (m_size >= sizeof(header));
+  if(ok)
+  {
+    memcpy(&header, m_data, sizeof(header));
+    ok = memcmp(header.magic, TEXTURE_FILE_MAGIC, sizeof(header.magic)) == 0 && header.version == TEXTURE_FILE_VERSION && header.fileSize == m_size &&
+         header.width > 0 && header.height > 0 && header.levels > 0 && header.levels <= 32 && header.layers > 0 && header.layers <= 65536;
+  }
+
+  const uint64_t subresNum = ok ? uint64_t(header.levels)*uint64_t(header.layers) : 0;
+  ok = ok && header.subresOffset <= m_size && subresNum*sizeof(TextureFileSubresource) <= m_size - header.subresOffset;
+  if(ok)
+  {
+    m_subres.resize(size_t(subresNum));
+    memcpy(m_subres.data(), m_data + header.subresOffset, m_subres.size()*sizeof(TextureFileSubresource));
+    for(const auto& subres : m_subres)
+      ok = ok && subres.offset <= m_size && subres.size <= m_size - subres.offset;
+  }
+
+  if(!ok)
+  {
+    Close();
+    return false;
+  }
+
+  m_desc.vkFormat = header.vkFormat;
+  m_desc.width    = int(header.width);
+  m_desc.height   = int(header.height);
+  m_desc.levels   = int(header.levels);
+  m_desc.layers   = int(header.layers);
+  m_desc.flags    = header.flags;
+  return true;
+}
+
+void ctexture::TextureFile::Close()
+{
+#ifndef WIN32
+  if(m_mapped)
+    munmap((void*)m_data, m_size);
+#endif
+  m_data   = nullptr;
+  m_size   = 0;
+  m_mapped = false;
+  m_buffer = nullptr;
+  m_desc   = TextureFileDesc();
+  m_subres.clear();
+}
+
+const void* ctexture::TextureFile::Data(int a_level, int a_layer) const
+{
+  return m_data + m_subres[size_t(a_level)*size_t(m_desc.layers) + size_t(a_layer)].offset;
+}
+
+size_t ctexture::TextureFile::Size(int a_level, int a_layer) const
+{
+  return size_t(m_subres[size_t(a_level)*size_t(m_desc.layers) + size_t(a_layer)].size);
+}
+
+std::vector<const void*> ctexture::TextureFile::LevelPointers(int a_layer) const
+{
+  std::vector<const void*> res(m_desc.levels);
+  for(int i=0;i<m_desc.levels;i++)
+    res[i] = Data(i, a_layer);
+  return res;
+}
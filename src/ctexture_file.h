@@ -0,0 +1,99 @@
+#ifndef CTEXTURE_FILE_H
+#define CTEXTURE_FILE_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace ctexture
+{
+  // Binary texture container: header, table of subresources (levels x layers) and payload. Texels (or blocks) of each subresource are
+  // stored tightly packed exactly as Vulkan copy expects them, so the payload is uploaded directly from the mapped file.
+  //
+  //  [TextureFileHeader][TextureFileSubresource x levels*layers][pad][level 0 layer 0][pad][level 0 layer 1] ...
+  //
+  // Subresource offsets are aligned to TEXTURE_FILE_ALIGNMENT. Subresource i = level*layers + layer.
+  //
+  static const uint32_t TEXTURE_FILE_VERSION   = 1;
+  static const uint32_t TEXTURE_FILE_ALIGNMENT = 256;
+
+  enum TEXTURE_FILE_FLAGS { TEXTURE_FILE_SRGB_DATA = 1 }; ///< rgb is sRGB encoded, even if vkFormat is UNORM
+
+  struct TextureFileHeader
+  {
+    char     magic[8];       ///< "CTEX\r\n\x1a\n"
+    uint32_t version;
+    uint32_t vkFormat;       ///< VkFormat of payload
+    uint32_t width;
+    uint32_t height;
+    uint32_t levels;
+    uint32_t layers;
+    uint32_t flags;          ///< TEXTURE_FILE_FLAGS
+    uint32_t alignment;      ///< alignment of subresources offsets
+    uint64_t subresOffset;   ///< offset of TextureFileSubresource table
+    uint64_t fileSize;
+    uint64_t reserved;
+  };
+
+  struct TextureFileSubresource
+  {
+    uint64_t offset;         ///< from the beginning of the file
+    uint64_t size;           ///< in bytes
+  };
+
+  struct TextureFileDesc
+  {
+    uint32_t vkFormat = 0;
+    int      width    = 0;
+    int      height   = 0;
+    int      levels   = 1;
+    int      layers   = 1;
+    uint32_t flags    = 0;
+  };
+
+  /**
+  \brief Write texture container.
+  \param a_fileName - input file name
+  \param a_desc     - input format, size and subresources number
+  \param a_subres   - input data of subresources, a_desc.levels*a_desc.layers pointers; subresource i = level*layers + layer
+  \param a_sizes    - input sizes of subresources in bytes
+  \return false if file can't be written
+  */
+  bool SaveTextureFile(const char* a_fileName, const TextureFileDesc& a_desc, const void* const* a_subres, const size_t* a_sizes);
+
+  /**
+  \brief Read-only view of texture container. The file is memory mapped (or read with single fread if mapping is not available),
+         Data() points inside it, so subresources are not copied until they go to staging buffer.
+  */
+  struct TextureFile
+  {
+    TextureFile() {}
+    ~TextureFile() { Close(); }
+
+    bool Open(const char* a_fileName); ///< returns false if file can't be read or is broken
+    void Close();
+
+    const TextureFileDesc& Desc() const { return m_desc; }
+
+    const void* Data(int a_level, int a_layer = 0) const;
+    size_t      Size(int a_level, int a_layer = 0) const;
+
+    std::vector<const void*> LevelPointers(int a_layer = 0) const; ///< all levels of a_layer, i.e. for SimpleTexture2D::UpdateMips
+
+  protected:
+
+    TextureFile(const TextureFile& a_rhs) = delete;
+    TextureFile& operator=(const TextureFile& a_rhs) = delete;
+
+    const unsigned char*             m_data   = nullptr;
+    size_t                           m_size   = 0;
+    bool                             m_mapped = false;
+    std::unique_ptr<unsigned char[]> m_buffer;
+
+    TextureFileDesc                     m_desc;
+    std::vector<TextureFileSubresource> m_subres;
+  };
+};
+
+#endif
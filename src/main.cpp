@@ -13,6 +13,9 @@
 #include <algorithm>
 #include <vector>
 #include <memory>
+#include <thread>
+#include <exception>
+#include <chrono>
 
 #include <cstring>
 #include <cstdlib>
@@ -23,10 +26,13 @@
 #include "vk_geom.h"
 #include "vk_copy.h"
 #include "vk_texture.h"
+#include "vk_texture_stream.h"
 #include "vk_quad.h"
 #include "vk_program.h"
 #include "vk_graphics_pipeline.h"
 #include "Bitmap.h"
+#include "ctexture.h"
+#include "ctexture_file.h"
 
 #include "Camera.h"
 
@@ -53,6 +59,12 @@ struct g_input_t
   bool capturedMouseJustNow = false;
   bool drawFSQuad   = false;
   bool controlLight = false;
+  bool drawIndirect = true;      ///!< draw scene with multi-draw-indirect instead of per-object draws
+  bool runDrawBenchmark = false; ///!< record both draw paths for many objects and print CPU time
+  bool drawInstances    = false; ///!< draw a grid of small teapots with hardware instancing
+  bool animateBunny     = false; ///!< bend bunny with GPU skinning (compute shader) before shadow and main passes
+  bool dumpShadowMap    = false; ///!< read shadow map back to CPU and save it to 'shadowmap.bmp' when it is ready
+  bool raiseTerrain     = false; ///!< raise next band of terrain rows (dynamic vertex update of double buffered mesh, per-object draw path)
 
   float lastX,lastY, scrollY;
   float camMoveSpeed     = 1.0f;
@@ -85,6 +97,45 @@ void OnKeyboardPressed(GLFWwindow* window, int key, int scancode, int action, in
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     break;
 
+  case GLFW_KEY_3:
+    g_input.drawIndirect = false;
+    break;
+
+  case GLFW_KEY_4:
+    g_input.drawIndirect = true;
+    break;
+
+  case GLFW_KEY_5:
+    g_input.drawInstances = true;
+    break;
+
+  case GLFW_KEY_6:
+    g_input.drawInstances = false;
+    break;
+
+  case GLFW_KEY_7:
+    g_input.animateBunny = true;
+    break;
+
+  case GLFW_KEY_8:
+    g_input.animateBunny = false;
+    break;
+
+  case GLFW_KEY_B:
+    if (action == GLFW_PRESS)
+      g_input.runDrawBenchmark = true;
+    break;
+
+  case GLFW_KEY_P:
+    if (action == GLFW_PRESS)
+      g_input.dumpShadowMap = true;
+    break;
+
+  case GLFW_KEY_T:
+    if (action == GLFW_PRESS)
+      g_input.raiseTerrain = true;
+    break;
+
   case GLFW_KEY_9:
     g_input.drawFSQuad = true;
     break;  
@@ -198,11 +249,19 @@ private:
   VkPipeline       graphicsPipeline       = VK_NULL_HANDLE; ///!< main pipeline 
   VkPipeline       graphicsPipelineShadow = VK_NULL_HANDLE; ///!< simplified pipiline for shadowmap
 
+  VkPipeline       graphicsPipelineIndirect       = VK_NULL_HANDLE; ///!< main pipeline for multi-draw-indirect path; reads model matrices from per-draw SSBO
+  VkPipeline       graphicsPipelineShadowIndirect = VK_NULL_HANDLE; ///!< shadowmap pipeline for multi-draw-indirect path
+
+  VkPipeline       graphicsPipelineInstanced       = VK_NULL_HANDLE; ///!< main pipeline for hardware instancing; reads model matrices from per-instance attributes
+  VkPipeline       graphicsPipelineShadowInstanced = VK_NULL_HANDLE; ///!< shadowmap pipeline for hardware instancing
+
   // allocated memory for useful objects
   //
   VkDeviceMemory        m_memAllMeshes   = VK_NULL_HANDLE; //
-  VkDeviceMemory        m_memAllTextures = VK_NULL_HANDLE;
-  VkDeviceMemory        m_memShadowMap   = VK_NULL_HANDLE;
+  VkDeviceMemory        m_memDrawList    = VK_NULL_HANDLE;
+  VkDeviceMemory        m_memBenchDrawList = VK_NULL_HANDLE;
+  VkDeviceMemory        m_memInstances   = VK_NULL_HANDLE;
+  VkDeviceMemory        m_memDeformer    = VK_NULL_HANDLE;
 
   // sync objects and command buffers per "frame-in-flight"
   //
@@ -246,37 +305,51 @@ private:
   //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
   //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-  /**
-  \brief Simple copy engine implementation. Our mesh and texture helpers require use to implement copy by himself.
-         So, we make such implementation by calling simple helpers from vk_copy::SimpleCopyHelper
-
-  */
-  struct CopyEngine : public vk_geom::ICopyEngine, 
-                      public vk_texture::ICopyEngine
-  {
-    CopyEngine(VkPhysicalDevice a_physicalDevice, VkDevice a_device, VkQueue a_transferQueue, size_t a_stagingBuffSize) : m_helper(a_physicalDevice, a_device, a_transferQueue, a_stagingBuffSize) {}
-  
-    void UpdateBuffer(VkBuffer a_dst, size_t a_dstOffset, const void* a_src, size_t a_size)    override { m_helper.UpdateBuffer(a_dst, a_dstOffset, a_src, a_size); }
-    void UpdateImage(VkImage a_image, const void* a_src, int a_width, int a_height, int a_bpp) override { m_helper.UpdateImage(a_image, a_src, a_width, a_height, a_bpp); }
-
-    VkCommandBuffer CmdBuffer() { return m_helper.CmdBuffer(); }
-
-    vk_copy::SimpleCopyHelper m_helper;
-  };
-
-  //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-  std::unique_ptr<CopyEngine>       m_pCopyHelper;
+  std::unique_ptr<vk_copy::CopyEngine> m_pCopyHelper;
+  std::unique_ptr<vk_copy::ReadbackHelper> m_pReadback;
+  std::vector<unsigned int>         m_shadowMapDump;
+  uint64_t                          m_shadowMapDumpTicket  = 0;
+  bool                              m_shadowMapDumpPending = false;
   std::shared_ptr<vk_geom::IMesh>   m_pTerrainMesh;
   std::shared_ptr<vk_geom::IMesh>   m_pTeapotMesh;
   std::shared_ptr<vk_geom::IMesh>   m_pBunnyMesh;
   std::shared_ptr<vk_utils::FSQuad> m_pFSQuad;
 
   enum {TERRAIN_TEX = 0, STONE_TEX = 1, METAL_TEX = 2, TEXTURES_NUM = 3 };  
+  enum {TERRAIN_MESH = 0, TEAPOT_MESH = 1, BUNNY_MESH = 2, MESHES_NUM = 3 };
+  enum {SHADOW_PASS = 0, MAIN_PASS = 1, POST_PASS = 2 };   ///!< passes of a frame, lifetimes of render targets for AliasingAllocator
+  enum {BENCH_OBJECTS_NUM = 10000 };
+  enum {INSTANCES_GRID = 32 };       ///!< we draw INSTANCES_GRID*INSTANCES_GRID teapots with hardware instancing
+  enum {TERRAIN_GRID = 64, TERRAIN_BAND = 4 }; ///!< terrain quads per side; rows raised with one dynamic update
 
-  std::shared_ptr<vk_texture::SimpleTexture2D>     m_pTex[TEXTURES_NUM];
+  // dynamic terrain: vertices are updated in the back copy of double buffered mesh, copies are swapped when upload is complete
+  //
+  cmesh::SimpleMesh                          m_terrainData;
+  int                                        m_terrainRow           = 0;
+  uint64_t                                   m_terrainUploadTicket  = 0;
+  bool                                       m_terrainUploadPending = false;
+
+  std::shared_ptr<vk_geom::InstanceMatrices> m_pTeapotInstances;
+
+  // GPU skinning for bunny: 2 bones, the upper one bends around m_bunnyPivot
+  //
+  std::shared_ptr<vk_geom::MeshDeformer>     m_pBunnyDeformer;
+  LiteMath::float3                           m_bunnyPivot;
+  bool                                       m_bunnyDeformed = false; ///!< vertex buffers hold deformed bunny, rest pose must be restored when animation is off
+
+  // multi-draw-indirect path: all meshes are merged in single vertex/index buffers and drawn with a single indirect call per pass
+  //
+  std::shared_ptr<vk_geom::IMesh>            m_pSceneMesh;
+  std::shared_ptr<vk_geom::IndirectDrawList> m_pDrawList;
+  std::shared_ptr<vk_geom::IndirectDrawList> m_pBenchDrawList;
+  cmesh::MeshRange                           m_sceneRanges[MESHES_NUM];
+  uint32_t                                   m_materialDraws[TEXTURES_NUM+1] = {}; ///!< draws of material i are [m_materialDraws[i], m_materialDraws[i+1])
+
+  std::shared_ptr<vk_texture::TextureStreamer>     m_pStreamer;
+  int                                              m_materialsTex = 0; ///< streamed texture array, layer i is material (texture) i
   std::shared_ptr<vk_texture::RenderableTexture2D> m_pShadowMap;
+  std::unique_ptr<vk_texture::AliasingAllocator>   m_pTargetsMemory;
+  std::shared_ptr<vk_texture::SamplerCache>        m_pSamplers;
 
   // Descriptors represent resources in shaders. They allow us to use things like
   // uniform buffers, storage buffers and images in GLSL.
@@ -284,10 +357,14 @@ private:
   // into descriptor sets, which are basically just collections of descriptors.
   // 
   VkDescriptorSet       descriptorSetForQuad; // for our textures
-  VkDescriptorSet       descriptorSetWithSM[TEXTURES_NUM] = {};
+  VkDescriptorSet       descriptorSetWithSM     = nullptr;  ///< materials texture array and shadow map
   VkDescriptorSetLayout descriptorSetLayoutQuad = nullptr;
   VkDescriptorSetLayout descriptorSetLayoutSM   = nullptr;
 
+  VkDescriptorSet       descriptorSetDraws       = nullptr; // per-draw data (SSBO) for multi-draw-indirect path
+  VkDescriptorSet       descriptorSetBenchDraws  = nullptr;
+  VkDescriptorSetLayout descriptorSetLayoutDraws = nullptr;
+
   std::shared_ptr<vk_utils::ProgramBindings> m_pBindings = nullptr;
 
   //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -390,7 +467,7 @@ private:
   
     physicalDevice    = vk_utils::FindPhysicalDevice(instance, true, deviceId);
     auto queueFID     = vk_utils::GetQueueFamilyIndex(physicalDevice, VK_QUEUE_GRAPHICS_BIT);
-    auto queueCopyFID = vk_utils::GetQueueFamilyIndex(physicalDevice, VK_QUEUE_TRANSFER_BIT);
+    auto queueCopyFID = vk_utils::GetTransferQueueFamilyIndex(physicalDevice, queueFID); // DMA queue if present, so uploads don't stall graphics
 
     VkBool32 presentSupport = false;
     vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, queueFID, surface, &presentSupport);
@@ -399,19 +476,25 @@ private:
 
     // logical device, queues and command pool
     //
-    device = vk_utils::CreateLogicalDevice(queueFID, physicalDevice, enabledLayers, deviceExtensions);
+    device = vk_utils::CreateLogicalDevice(queueFID, physicalDevice, enabledLayers, deviceExtensions, queueCopyFID);
     vkGetDeviceQueue(device, queueFID,     0, &graphicsQueue);
     vkGetDeviceQueue(device, queueFID,     0, &presentQueue);
     vkGetDeviceQueue(device, queueCopyFID, 0, &transferQueue);
 
     // helper copy engine (for copying from CPU to GPU)
     //
-    m_pCopyHelper = std::make_unique<CopyEngine>(physicalDevice, device, transferQueue, 64*1024*1024);
+    m_pCopyHelper = std::make_unique<vk_copy::CopyEngine>(physicalDevice, device, transferQueue, queueCopyFID, 16*1024*1024, queueFID);
+    m_pCopyHelper->m_helper.SetFillThreads(0); // staging memory for large uploads is filled (and meshes are encoded) by all hardware threads
+    m_pReadback   = std::make_unique<vk_copy::ReadbackHelper>(physicalDevice, device, graphicsQueue, queueFID, 16*1024*1024); // graphics queue writes the data we read
 
     // helper object that simplify descriptor sets creation
     //
-    VkDescriptorType dtypes[2] = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER , VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER };
-    m_pBindings = std::make_shared<vk_utils::ProgramBindings>(device, dtypes, 2, 64);
+    VkDescriptorType dtypes[3] = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER , VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER };
+    m_pBindings = std::make_shared<vk_utils::ProgramBindings>(device, dtypes, 3, 64);
+
+    // all textures take samplers from here, so equal sampler states share single VkSampler
+    //
+    m_pSamplers = std::make_shared<vk_texture::SamplerCache>(device, physicalDevice);
 
     CreateSyncObjects(device, &m_sync);
   }
@@ -428,8 +511,8 @@ private:
 
     vk_utils::CreateScreenImageViews(device, &screen);
 
-    vk_utils::CreateDepthTexture(device, physicalDevice, WIDTH, HEIGHT, 
-                                 &depthImageMemory, &depthImage, &depthImageView);
+    vk_utils::CreateDepthTexture(device, physicalDevice, WIDTH, HEIGHT,                    // transient: depth is cleared and not stored by renderPass,
+                                 &depthImageMemory, &depthImage, &depthImageView, true); // so tile GPUs don't need memory for it
 
     CreateRenderPass(device, screen.swapChainImageFormat, 
                      &renderPass);
@@ -447,77 +530,77 @@ private:
                       vk_utils::RenderTargetInfo2D{ VkExtent2D{ WIDTH, HEIGHT }, screen.swapChainImageFormat, 
                                                     VK_ATTACHMENT_LOAD_OP_LOAD, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR });
  
-    // create textures
+    // create textures: precompiled containers (data/*.ctex, see texconv) are mapped and uploaded as is; BMP is the fallback.
+    // textures are loaded in parallel, their uploads are recorded to the copy helper and go to the GPU with the single Submit below
     //
-    int  w1, h1, w2, h2, w3, h3;
-    auto data1 = LoadBMP("data/texture1.bmp",   &w1, &h1);
-    auto data2 = LoadBMP("data/stonebrick.bmp", &w2, &h2);
-    auto data3 = LoadBMP("data/metal.bmp",      &w3, &h3);
-
-    if (data1.size() == 0)
-      RUN_TIME_ERROR("data/texture1.bmp | NOT FOUND!");
-    if (data2.size() == 0)
-      RUN_TIME_ERROR("data/stonebrick.bmp | NOT FOUND!");
-    if (data3.size() == 0)
-      RUN_TIME_ERROR("data/metal.bmp | NOT FOUND!");
-
-    for(int i=0;i<TEXTURES_NUM;i++)
-      m_pTex[i] = std::make_shared<vk_texture::SimpleTexture2D>();
-    m_pShadowMap = std::make_shared<vk_texture::RenderableTexture2D>();
-   
-    auto memReqTex1 = m_pTex[TERRAIN_TEX]->CreateImage(device, w1, h1, VK_FORMAT_R8G8B8A8_UNORM);
-    auto memReqTex2 = m_pTex[STONE_TEX]->CreateImage(device, w2, h2, VK_FORMAT_R8G8B8A8_UNORM);
-    auto memReqTex3 = m_pTex[METAL_TEX]->CreateImage(device, w3, h3, VK_FORMAT_R8G8B8A8_UNORM);
-    auto memReqTex4 = m_pShadowMap->CreateImage(device, 2048, 2048, VK_FORMAT_D16_UNORM); 
-
-    assert(memReqTex1.memoryTypeBits == memReqTex2.memoryTypeBits);
-    assert(memReqTex1.memoryTypeBits == memReqTex3.memoryTypeBits);
-    //assert(memReqTex1.memoryTypeBits == memReqTex4.memoryTypeBits); // well, usually not, please make separate allocation for shadow map :)
+    const bool useBC = vk_texture::IsSampledFormatSupported(physicalDevice, VK_FORMAT_BC1_RGB_UNORM_BLOCK);
     
-    // memory for all read-only textures
-    {
-      VkMemoryAllocateInfo allocateInfo = {};
-      allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-      allocateInfo.pNext           = nullptr;
-      allocateInfo.allocationSize  = memReqTex1.size + memReqTex2.size + memReqTex3.size;
-      allocateInfo.memoryTypeIndex = vk_utils::FindMemoryType(memReqTex1.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, physicalDevice);
+    const char* texNames[TEXTURES_NUM] = { "data/texture1", "data/stonebrick", "data/metal" };
+    TextureSource* texSrc = m_texSrc; // kept while the app runs, streamer reads mips from them
+    LoadTextureSources(texNames, TEXTURES_NUM, useBC, texSrc);
 
-      VK_CHECK_RESULT(vkAllocateMemory(device, &allocateInfo, NULL, &m_memAllTextures));
+    // all materials are layers of a single texture array, so the scene is drawn with one descriptor set and draws select layer (push constant or per-draw data);
+    // layers must have the same size, so the array gets the size of the smallest texture and larger ones skip their top mips
+    //
+    int arrayWidth = texSrc[0].width, arrayHeight = texSrc[0].height;
+    for(int i=1;i<TEXTURES_NUM;i++)
+    {
+      arrayWidth  = std::min(arrayWidth,  texSrc[i].width);
+      arrayHeight = std::min(arrayHeight, texSrc[i].height);
+      if(texSrc[i].format != texSrc[0].format)
+        RUN_TIME_ERROR((std::string(texNames[i]) + " | all material textures must have the same format").c_str());
     }
 
-    // memory for all shadowmaps (well, if you have them more than 1 ...)
-    {
-      VkMemoryAllocateInfo allocateInfo = {};
-      allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-      allocateInfo.pNext           = nullptr;
-      allocateInfo.allocationSize  = memReqTex4.size;
-      allocateInfo.memoryTypeIndex = vk_utils::FindMemoryType(memReqTex4.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, physicalDevice);
+    vk_texture::StreamingSource materials;
+    materials.format                = texSrc[0].format;
+    materials.width                 = arrayWidth;
+    materials.height                = arrayHeight;
+    materials.levels                = ctexture::MipLevelsNum(arrayWidth, arrayHeight);
+    materials.layers                = TEXTURES_NUM;
+    materials.sampler.maxAnisotropy = 8.0f; // ground is mostly seen at grazing angles; clamped to device limit (or disabled) by sampler cache
 
-      VK_CHECK_RESULT(vkAllocateMemory(device, &allocateInfo, NULL, &m_memShadowMap));
+    for(int i=0;i<TEXTURES_NUM;i++)
+    {
+      int skip = 0;
+      while(std::max(texSrc[i].width >> skip, 1) > arrayWidth)
+        skip++;
+      if(std::max(texSrc[i].width >> skip, 1) != arrayWidth || std::max(texSrc[i].height >> skip, 1) != arrayHeight)
+        RUN_TIME_ERROR((std::string(texNames[i]) + " | aspect ratio differs from other materials").c_str());
+      if(int(texSrc[i].levels.size()) != skip + materials.levels)
+        RUN_TIME_ERROR((std::string(texNames[i]) + " | mip chain is not complete").c_str());
+
+      materials.subres.insert(materials.subres.end(), texSrc[i].levels.begin() + skip, texSrc[i].levels.end());
+      materials.sizes.insert (materials.sizes.end(),  texSrc[i].sizes.begin()  + skip, texSrc[i].sizes.end());
     }
 
-    m_pTex[0]->BindMemory(m_memAllTextures, 0);
-    m_pTex[1]->BindMemory(m_memAllTextures, memReqTex1.size);
-    m_pTex[2]->BindMemory(m_memAllTextures, memReqTex1.size + memReqTex2.size);
-    m_pShadowMap->BindMemory(m_memShadowMap, 0);
+    // materials are streamed: only mip tail is uploaded now, finer mips come in when they are requested (see RequestMaterialMips)
+    //
+    vk_texture::StreamingParams streaming;
+    streaming.budget         = 32*1024*1024;
+    streaming.framesInFlight = MAX_FRAMES_IN_FLIGHT;
 
+    m_pStreamer    = std::make_shared<vk_texture::TextureStreamer>(device, physicalDevice, &m_pCopyHelper->m_helper, m_pSamplers, streaming);
+    m_materialsTex = m_pStreamer->AddTexture(materials);    // --> tail is in transfer_dst layout
 
-    // DS for drawing objects
+    // memory for all per-frame render targets: targets with disjoint lifetimes (in passes of a frame) share memory;
+    // shadow map is written in shadow pass and read up to the debug quad, so it is alive for the whole frame now
     //
-    m_pBindings->BindBegin(VK_SHADER_STAGE_FRAGMENT_BIT);
-    m_pBindings->BindImage(0, m_pTex[TERRAIN_TEX]->View(), m_pTex[TERRAIN_TEX]->Sampler());
-    m_pBindings->BindImage(1, m_pShadowMap->View(), m_pShadowMap->Sampler());
-    m_pBindings->BindEnd(&descriptorSetWithSM[TERRAIN_TEX], &descriptorSetLayoutSM);
+    m_pShadowMap = std::make_shared<vk_texture::RenderableTexture2D>();
+    auto memReqSM  = m_pShadowMap->CreateImage(device, 2048, 2048, VK_FORMAT_D16_UNORM, m_pSamplers); 
 
-    m_pBindings->BindBegin(VK_SHADER_STAGE_FRAGMENT_BIT);
-    m_pBindings->BindImage(0, m_pTex[STONE_TEX]->View(), m_pTex[STONE_TEX]->Sampler());
-    m_pBindings->BindImage(1, m_pShadowMap->View(), m_pShadowMap->Sampler());
-    m_pBindings->BindEnd(&descriptorSetWithSM[STONE_TEX]);
+    m_pTargetsMemory = std::make_unique<vk_texture::AliasingAllocator>(device, physicalDevice);
+    const int smTarget = m_pTargetsMemory->AddTarget(memReqSM, SHADOW_PASS, POST_PASS);
+    m_pTargetsMemory->Allocate();
+
+    m_pShadowMap->BindMemory(m_pTargetsMemory->Memory(), m_pTargetsMemory->Offset(smTarget));
 
+
+    // DS for drawing objects
+    //
     m_pBindings->BindBegin(VK_SHADER_STAGE_FRAGMENT_BIT);
-    m_pBindings->BindImage(0, m_pTex[METAL_TEX]->View(), m_pTex[METAL_TEX]->Sampler());
-    m_pBindings->BindImage(1, m_pShadowMap->View(), m_pShadowMap->Sampler());
-    m_pBindings->BindEnd(&descriptorSetWithSM[METAL_TEX]);
+    m_pBindings->BindImage(0, m_pStreamer->View(m_materialsTex), m_pStreamer->Sampler(m_materialsTex)); // rewritten when residency changes
+    m_pBindings->BindImage(1, m_pShadowMap->View(), m_pShadowMap->CompareSampler()); // sampler2DShadow, hardware compare
+    m_pBindings->BindEnd(&descriptorSetWithSM, &descriptorSetLayoutSM);
 
     // DS for srawing quad
     //
@@ -525,37 +608,16 @@ private:
     m_pBindings->BindImage(0, m_pShadowMap->View(), m_pShadowMap->Sampler());
     m_pBindings->BindEnd(&descriptorSetForQuad, &descriptorSetLayoutQuad);
     
-    m_pTex[TERRAIN_TEX]->Update(data1.data(), w1, h1, sizeof(int), m_pCopyHelper.get()); // --> put m_pTex[i] in transfer_dst layout
-    m_pTex[STONE_TEX]->Update(data2.data(), w2, h2, sizeof(int), m_pCopyHelper.get());   // --> put m_pTex[i] in transfer_dst layout
-    m_pTex[METAL_TEX]->Update(data3.data(), w3, h3, sizeof(int), m_pCopyHelper.get());   // --> put m_pTex[i] in transfer_dst layout
-    
-    // generate all mips
-    //
-    {
-      VkCommandBuffer cmdBuff = m_pCopyHelper->CmdBuffer(); // you can any other command buffer with transfer capability here ... 
-
-      vkResetCommandBuffer(cmdBuff, 0);
-      VkCommandBufferBeginInfo beginInfo = {};
-      beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-      beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-      if (vkBeginCommandBuffer(cmdBuff, &beginInfo) != VK_SUCCESS) 
-         throw std::runtime_error("[FFF]: failed to begin command buffer!");
-      
-      for (int i = 0; i<TEXTURES_NUM; i++)
-        m_pTex[i]->GenerateMipsCmd(cmdBuff);                                            // --> put m_pTex[i] in shader_read layout
-     
-      vkEndCommandBuffer(cmdBuff);
-
-      vk_utils::ExecuteCommandBufferNow(cmdBuff, transferQueue, device);
-    }
+    m_pCopyHelper->Submit();                               // don't wait here, meshes are uploaded in the mean time
 
     // create meshes
     //
-    m_pTerrainMesh = std::make_shared< vk_geom::CompactMesh_T3V4x2F >();
+    m_pTerrainMesh = std::make_shared< vk_geom::CompactMesh_T3V4x2F >(true, m_pCopyHelper->ConcurrentFamilies()); // double buffered and updated repeatedly by transfer queue, see UpdateTerrainCmd
     m_pTeapotMesh  = std::make_shared< vk_geom::CompactMesh_T3V4x2F >();
     m_pBunnyMesh   = std::make_shared< vk_geom::CompactMesh_T3V4x2F >();
 
-    auto meshData  = cmesh::CreateQuad(64, 64, 4.0f);
+    m_terrainData  = cmesh::CreateQuad(TERRAIN_GRID, TERRAIN_GRID, 4.0f);
+    const auto& meshData = m_terrainData;
     auto teapData  = cmesh::LoadMeshFromVSGF("data/teapot.vsgf");
     auto bunnyData = cmesh::LoadMeshFromVSGF("data/bunny0.vsgf");
 
@@ -566,26 +628,129 @@ private:
     auto memReq2 = m_pTeapotMesh->CreateBuffers (device, int(teapData.VerticesNum()), int(teapData.IndicesNum())); //
     auto memReq3 = m_pBunnyMesh->CreateBuffers  (device, int(bunnyData.VerticesNum()), int(bunnyData.IndicesNum())); //
 
-    assert(memReq1.memoryTypeBits == memReq2.memoryTypeBits); // assume this in our simple demo
-    assert(memReq1.memoryTypeBits == memReq3.memoryTypeBits); // assume this in our simple demo
+    // merge all meshes in a single vertex/index buffers for multi-draw-indirect path
+    //
+    cmesh::SimpleMesh sceneData;
+    m_sceneRanges[TERRAIN_MESH] = cmesh::AppendMesh(sceneData, meshData);
+    m_sceneRanges[TEAPOT_MESH]  = cmesh::AppendMesh(sceneData, teapData);
+    m_sceneRanges[BUNNY_MESH]   = cmesh::AppendMesh(sceneData, bunnyData);
+
+    m_pSceneMesh = std::make_shared< vk_geom::CompactMesh_T3V4x2F >();
+    auto memReq4 = m_pSceneMesh->CreateBuffers(device, int(sceneData.VerticesNum()), int(sceneData.IndicesNum()));
 
-    // allocate memory for all meshes
+    // allocate memory for all meshes; with resizable BAR or integrated GPU it is host visible, so meshes are encoded right there, without staging copy
     //
-    VkMemoryAllocateInfo allocateInfo = {};
-    allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocateInfo.pNext           = nullptr;
-    allocateInfo.allocationSize  = memReq1.size + memReq2.size + memReq3.size; // specify required memory size
-    allocateInfo.memoryTypeIndex = vk_utils::FindMemoryType(memReq1.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, physicalDevice); 
-    
-    VK_CHECK_RESULT(vkAllocateMemory(device, &allocateInfo, NULL, &m_memAllMeshes));
+    VkMemoryRequirements memReqAll = memReq1;
+    memReqAll.size           = memReq1.size + memReq2.size + memReq3.size + memReq4.size; // specify required memory size
+    memReqAll.memoryTypeBits = memReq1.memoryTypeBits & memReq2.memoryTypeBits & memReq3.memoryTypeBits & memReq4.memoryTypeBits; // all buffers must accept it
+    assert(memReqAll.memoryTypeBits != 0);
+
+    m_memAllMeshes = m_pCopyHelper->AllocateBufferMemory(memReqAll);
+    std::cout << "mesh upload path: " << (m_pCopyHelper->MappedMemory(m_memAllMeshes) != nullptr ? "direct write (ReBAR/UMA)" : "staging copy") << std::endl;
 
     m_pTerrainMesh->BindBuffers(m_memAllMeshes, 0);
     m_pTeapotMesh->BindBuffers (m_memAllMeshes, memReq1.size);
     m_pBunnyMesh->BindBuffers  (m_memAllMeshes, memReq1.size + memReq2.size);
+    m_pSceneMesh->BindBuffers  (m_memAllMeshes, memReq1.size + memReq2.size + memReq3.size);
 
     m_pTerrainMesh->UpdateBuffers(meshData, m_pCopyHelper.get());
     m_pTeapotMesh->UpdateBuffers (teapData, m_pCopyHelper.get());
     m_pBunnyMesh->UpdateBuffers  (bunnyData, m_pCopyHelper.get()); 
+    m_pSceneMesh->UpdateBuffers  (sceneData, m_pCopyHelper.get()); 
+
+    // draw list for multi-draw-indirect path; material layer is per-draw data, draws are sorted by material only to skip terrain in shadow pass
+    //
+    {
+      LiteMath::float4x4 mModel[MESHES_NUM];
+      mModel[TERRAIN_MESH] = LiteMath::rotate4x4X(-LiteMath::DEG_TO_RAD*90.0f);
+      mModel[TEAPOT_MESH]  = LiteMath::translate4x4({ -0.5f, 0.4f, -0.5f });
+      mModel[BUNNY_MESH]   = LiteMath::translate4x4({ +1.25f, 0.6f, 0.5f })*LiteMath::scale4x4({ 75.0, 75.0, 75.0 });
+
+      m_pDrawList = CreateDrawList(MESHES_NUM, &m_memDrawList);
+
+      m_materialDraws[TERRAIN_TEX] = m_pDrawList->AddDraw(m_sceneRanges[TERRAIN_MESH], (const float*)&mModel[TERRAIN_MESH], TERRAIN_TEX);
+      m_materialDraws[STONE_TEX]   = m_pDrawList->AddDraw(m_sceneRanges[TEAPOT_MESH],  (const float*)&mModel[TEAPOT_MESH],  STONE_TEX);
+      m_materialDraws[METAL_TEX]   = m_pDrawList->AddDraw(m_sceneRanges[BUNNY_MESH],   (const float*)&mModel[BUNNY_MESH],   METAL_TEX);
+      m_materialDraws[TEXTURES_NUM] = m_pDrawList->DrawsNum();
+
+      m_pDrawList->UpdateBuffers(m_pCopyHelper.get());
+
+      m_pBindings->BindBegin(VK_SHADER_STAGE_VERTEX_BIT);
+      m_pBindings->BindStorageBuffer(0, m_pDrawList->InstanceBuffer());
+      m_pBindings->BindEnd(&descriptorSetDraws, &descriptorSetLayoutDraws);
+    }
+
+    // per-instance matrices for hardware instancing; small teapots on a grid over the terrain
+    //
+    {
+      std::vector<LiteMath::float4x4> instMatrices(INSTANCES_GRID*INSTANCES_GRID);
+      for(int y=0;y<INSTANCES_GRID;y++)
+      {
+        for(int x=0;x<INSTANCES_GRID;x++)
+        {
+          auto mtranslate = LiteMath::translate4x4({ 0.12f*float(x - INSTANCES_GRID/2), 0.04f, 0.12f*float(y - INSTANCES_GRID/2) });
+          auto mscale     = LiteMath::scale4x4({ 0.1f, 0.1f, 0.1f });
+          instMatrices[y*INSTANCES_GRID + x] = mtranslate*mscale;
+        }
+      }
+
+      m_pTeapotInstances = std::make_shared<vk_geom::InstanceMatrices>();
+      auto memReq = m_pTeapotInstances->CreateBuffers(device, int(instMatrices.size()));
+
+      VkMemoryAllocateInfo allocateInfo = {};
+      allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+      allocateInfo.pNext           = nullptr;
+      allocateInfo.allocationSize  = memReq.size;
+      allocateInfo.memoryTypeIndex = vk_utils::FindMemoryType(memReq.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, physicalDevice);
+      VK_CHECK_RESULT(vkAllocateMemory(device, &allocateInfo, NULL, &m_memInstances));
+
+      m_pTeapotInstances->BindBuffers(m_memInstances, 0);
+      m_pTeapotInstances->UpdateBuffers((const float*)instMatrices.data(), int(instMatrices.size()), m_pCopyHelper.get());
+    }
+
+    // skin data for bunny: lower part follows bone 0 (static), upper part follows bone 1, smooth blend in between
+    //
+    {
+      float minY = +1e10f, maxY = -1e10f;
+      float avgX = 0.0f,   avgZ = 0.0f;
+      for(size_t i=0;i<bunnyData.VerticesNum();i++)
+      {
+        minY  = std::min(minY, bunnyData.vPos4f[i*4+1]);
+        maxY  = std::max(maxY, bunnyData.vPos4f[i*4+1]);
+        avgX += bunnyData.vPos4f[i*4+0];
+        avgZ += bunnyData.vPos4f[i*4+2];
+      }
+      avgX /= float(bunnyData.VerticesNum());
+      avgZ /= float(bunnyData.VerticesNum());
+
+      const float midY  = 0.5f*(minY + maxY);
+      const float band  = 0.25f*(maxY - minY);
+      m_bunnyPivot      = LiteMath::float3(avgX, midY, avgZ);
+
+      std::vector<vk_geom::SkinVertex> skin(bunnyData.VerticesNum());
+      for(size_t i=0;i<skin.size();i++)
+      {
+        const float t = LiteMath::clamp((bunnyData.vPos4f[i*4+1] - midY + band)/(2.0f*band), 0.0f, 1.0f);
+        const float w = t*t*(3.0f - 2.0f*t);
+        skin[i] = vk_geom::SkinVertex{ {1.0f - w, w, 0.0f, 0.0f}, {0, 1, 0, 0} };
+      }
+
+      m_pBunnyDeformer = std::make_shared<vk_geom::MeshDeformer>();
+      auto memReq = m_pBunnyDeformer->CreateBuffers(device, int(bunnyData.VerticesNum()), 2);
+
+      VkMemoryAllocateInfo allocateInfo = {};
+      allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+      allocateInfo.pNext           = nullptr;
+      allocateInfo.allocationSize  = memReq.size;
+      allocateInfo.memoryTypeIndex = vk_utils::FindMemoryType(memReq.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, physicalDevice);
+      VK_CHECK_RESULT(vkAllocateMemory(device, &allocateInfo, NULL, &m_memDeformer));
+
+      m_pBunnyDeformer->BindBuffers(m_memDeformer, 0);
+      m_pBunnyDeformer->CreatePipeline("shaders/skinning.spv");
+      m_pBunnyDeformer->UpdateBuffers(bunnyData, skin.data(), m_pCopyHelper.get());
+    }
+
+    AcquireUploadsNow(); // all uploads are batched, wait for them only once
 
     assert(m_pShadowMap   != nullptr);
     assert(m_pTerrainMesh != nullptr);
@@ -600,9 +765,23 @@ private:
     paths[VK_SHADER_STAGE_FRAGMENT_BIT] = "shaders/direct_light.spv";
     builder.Shaders(device, paths);
 
-    pipelineLayout   = builder.Layout  (device, descriptorSetLayoutSM, 4 * 16 * sizeof(float));
+    pipelineLayout   = builder.Layout  (device, {descriptorSetLayoutSM, descriptorSetLayoutDraws}, 4 * 16 * sizeof(float));
     graphicsPipeline = builder.Pipeline(device, m_pTerrainMesh->VertexInputLayout(), renderPass);
 
+    paths.clear();
+    paths[VK_SHADER_STAGE_VERTEX_BIT]   = "shaders/cmesh_t3v4x2_indirect.spv";
+    paths[VK_SHADER_STAGE_FRAGMENT_BIT] = "shaders/direct_light.spv";
+    builder.Shaders(device, paths);
+
+    graphicsPipelineIndirect = builder.Pipeline(device, m_pSceneMesh->VertexInputLayout(), renderPass);
+
+    paths.clear();
+    paths[VK_SHADER_STAGE_VERTEX_BIT]   = "shaders/cmesh_t3v4x2_instanced.spv";
+    paths[VK_SHADER_STAGE_FRAGMENT_BIT] = "shaders/direct_light.spv";
+    builder.Shaders(device, paths);
+
+    graphicsPipelineInstanced = builder.Pipeline(device, m_pTeapotMesh->VertexInputLayoutInstanced(), renderPass);
+
     paths.clear();
     paths[VK_SHADER_STAGE_VERTEX_BIT]   = "shaders/cmesh_t3v4x2.spv";
     builder.Shaders(device, paths);
@@ -611,6 +790,176 @@ private:
     builder.viewport.height = +(float)m_pShadowMap->Height();
     builder.scissor.extent  = VkExtent2D{ uint32_t(m_pShadowMap->Width()), uint32_t(m_pShadowMap->Height()) };
     graphicsPipelineShadow  = builder.Pipeline(device, m_pTerrainMesh->VertexInputLayout(), m_pShadowMap->Renderpass());
+
+    paths.clear();
+    paths[VK_SHADER_STAGE_VERTEX_BIT]   = "shaders/cmesh_t3v4x2_indirect.spv";
+    builder.Shaders(device, paths);
+
+    graphicsPipelineShadowIndirect = builder.Pipeline(device, m_pSceneMesh->VertexInputLayout(), m_pShadowMap->Renderpass());
+
+    paths.clear();
+    paths[VK_SHADER_STAGE_VERTEX_BIT]   = "shaders/cmesh_t3v4x2_instanced.spv";
+    builder.Shaders(device, paths);
+
+    graphicsPipelineShadowInstanced = builder.Pipeline(device, m_pTeapotMesh->VertexInputLayoutInstanced(), m_pShadowMap->Renderpass());
+  }
+
+  /**
+  \brief Full mip chain of texture ready for SimpleTexture2D::UpdateMips; levels point to one of the storages.
+  */
+  struct TextureSource
+  {
+    VkFormat                 format = VK_FORMAT_UNDEFINED;
+    int                      width  = 0;
+    int                      height = 0;
+    std::vector<const void*> levels;
+    std::vector<size_t>      sizes;
+
+    std::unique_ptr<ctexture::TextureFile> file; ///< mapped container, levels point directly to it
+    ctexture::MipChainBC                   bc;
+    ctexture::MipChainRGBA8                rgba;
+  };
+
+  TextureSource m_texSrc[TEXTURES_NUM];
+
+  /**
+  \brief Get texture from container a_name + ".ctex" if it exists and its format can be sampled; 
+         otherwise load a_name + ".bmp" and generate mips on the CPU (BC1 compressed and cached if a_useBC).
+  \param a_threadsNum - input threads for mips generation and compression; 0 means std::thread::hardware_concurrency()
+  */
+  TextureSource LoadTextureSource(const std::string& a_name, bool a_useBC, int a_threadsNum = 0)
+  {
+    TextureSource res;
+
+    const std::string containerName = a_name + ".ctex";
+    res.file = std::make_unique<ctexture::TextureFile>();
+    if(res.file->Open(containerName.c_str()))
+    {
+      const ctexture::TextureFileDesc& desc = res.file->Desc();
+      if(desc.layers == 1 && desc.levels == ctexture::MipLevelsNum(desc.width, desc.height) && vk_texture::IsSampledFormatSupported(physicalDevice, VkFormat(desc.vkFormat)))
+      {
+        res.format = VkFormat(desc.vkFormat);
+        res.width  = desc.width;
+        res.height = desc.height;
+        res.levels = res.file->LevelPointers();
+        for(int i=0;i<desc.levels;i++)
+          res.sizes.push_back(res.file->Size(i));
+        return res;
+      }
+      std::cout << "can't use " << containerName.c_str() << ", its format is not supported; loading bmp" << std::endl;
+    }
+    res.file = nullptr;
+
+    const std::string bmpName = a_name + ".bmp";
+    const std::vector<unsigned int> data = LoadBMP(bmpName.c_str(), &res.width, &res.height);
+    if (data.size() == 0)
+      RUN_TIME_ERROR((bmpName + " | NOT FOUND!").c_str());
+
+    // mips are generated on the CPU in linear space (textures are sRGB colors stored in UNORM images)
+    //
+    if(a_useBC)
+    {
+      res.format = VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+      res.bc     = LoadOrCompressMips(bmpName.c_str(), data, res.width, res.height, a_threadsNum);
+      res.levels = res.bc.LevelPointers();
+      for(const auto& level : res.bc.levels)
+        res.sizes.push_back(level.size());
+    }
+    else
+    {
+      res.format = VK_FORMAT_R8G8B8A8_UNORM;
+      res.rgba   = ctexture::GenerateMipsRGBA8(data.data(), res.width, res.height, true, ctexture::MIP_FILTER_BOX, a_threadsNum);
+      res.levels = res.rgba.LevelPointers();
+      for(const auto& level : res.rgba.levels)
+        res.sizes.push_back(level.size()*sizeof(unsigned int));
+    }
+    return res;
+  }
+
+  /**
+  \brief Load several textures at once, each one on its own worker: decoding, mips generation and compression of different textures
+         overlap, so that single-threaded parts (BMP decode, file reads, cache hashing) don't serialize the whole load.
+         Hardware threads are split between textures for their inner loops. The first error is rethrown after all workers are done.
+  \param a_names   - input texture names, see LoadTextureSource
+  \param a_num     - input textures number
+  \param a_useBC   - input see LoadTextureSource
+  \param a_pResult - output a_num texture sources
+  */
+  void LoadTextureSources(const char* const* a_names, int a_num, bool a_useBC, TextureSource* a_pResult)
+  {
+    const int hwThreads    = std::max(1, int(std::thread::hardware_concurrency()));
+    const int innerThreads = std::max(1, hwThreads/std::max(a_num, 1));
+
+    std::vector<std::exception_ptr> errors(a_num);
+    vk_copy::WorkerPool loaders(std::min(a_num, hwThreads));
+    loaders.ParallelFor(size_t(a_num), [&](size_t i)
+    {
+      try
+      {
+        a_pResult[i] = LoadTextureSource(a_names[i], a_useBC, innerThreads);
+      }
+      catch(...)
+      {
+        errors[i] = std::current_exception(); // exception must not leave worker thread
+      }
+    });
+
+    for(const auto& error : errors)
+      if(error != nullptr)
+        std::rethrow_exception(error);
+  }
+
+  /**
+  \brief Get BC1 mip chain of texture from cache file (a_fileName + ".bc1"); if there is no valid cache, generate mips, compress them and save the cache.
+  \param a_fileName - input source image file name
+  \param a_data     - input source texels, used both for compression and as cache key
+  \param a_width    - input source width
+  \param a_height   - input source height
+  \param a_threadsNum - input threads for mips generation and compression; 0 means std::thread::hardware_concurrency()
+  */
+  static ctexture::MipChainBC LoadOrCompressMips(const char* a_fileName, const std::vector<unsigned int>& a_data, int a_width, int a_height, int a_threadsNum = 0)
+  {
+    const ctexture::BC_FORMAT  format  = ctexture::BC_FORMAT_BC1;
+    const ctexture::BC_QUALITY quality = ctexture::BC_QUALITY_NORMAL;
+
+    const int32_t  params[4] = { a_width, a_height, int32_t(format), int32_t(quality) };
+    const uint64_t key       = ctexture::Hash64(params, sizeof(params), ctexture::Hash64(a_data.data(), a_data.size()*sizeof(unsigned int)));
+    const std::string cacheName = std::string(a_fileName) + ".bc1";
+
+    ctexture::MipChainBC mips;
+    if(ctexture::LoadMipsCache(cacheName.c_str(), key, &mips))
+      return mips;
+
+    mips = ctexture::CompressMips(ctexture::GenerateMipsRGBA8(a_data.data(), a_width, a_height, true, ctexture::MIP_FILTER_BOX, a_threadsNum), format, quality, a_threadsNum);
+    if(!ctexture::SaveMipsCache(cacheName.c_str(), mips, key))
+      std::cout << "can't write texture cache " << cacheName.c_str() << std::endl;
+    return mips;
+  }
+
+  /**
+  \brief create draw list for multi-draw-indirect path and allocate memory for it
+  \param a_maxDraws - input maximum number of draws in the list
+  \param a_pMemory  - output memory that application should free later
+  */
+  std::shared_ptr<vk_geom::IndirectDrawList> CreateDrawList(int a_maxDraws, VkDeviceMemory* a_pMemory)
+  {
+    auto pDrawList = std::make_shared<vk_geom::IndirectDrawList>();
+    auto memReq    = pDrawList->CreateBuffers(device, a_maxDraws);
+
+    VkMemoryAllocateInfo allocateInfo = {};
+    allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.pNext           = nullptr;
+    allocateInfo.allocationSize  = memReq.size;
+    allocateInfo.memoryTypeIndex = vk_utils::FindMemoryType(memReq.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, physicalDevice);
+
+    VK_CHECK_RESULT(vkAllocateMemory(device, &allocateInfo, NULL, a_pMemory));
+    pDrawList->BindBuffers(*a_pMemory, 0);
+
+    VkPhysicalDeviceFeatures features = {};                // CreateLogicalDevice enables these features if they are supported
+    vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+    pDrawList->SetFeatures(features.multiDrawIndirect == VK_TRUE, features.drawIndirectFirstInstance == VK_TRUE);
+
+    return pDrawList;
   }
 
 
@@ -633,7 +982,15 @@ private:
         UpdateCamera(m_cam, diffTime);
       
       glfwPollEvents();
+
+      if(g_input.runDrawBenchmark)
+      {
+        RunDrawBenchmark(BENCH_OBJECTS_NUM);
+        g_input.runDrawBenchmark = false;
+      }
+
       DrawFrame();
+      DumpShadowMapIfNeeded();
 
       // count and print FPS
       //
@@ -656,24 +1013,37 @@ private:
   void Cleanup() 
   { 
     m_pShadowMap = nullptr;
-    for(int i=0;i<TEXTURES_NUM;i++)
-      m_pTex[i] = nullptr;    // smart pointer will destroy resources
+    m_pTargetsMemory = nullptr; // after render targets that are bound to it
+    m_pStreamer  = nullptr;   // smart pointer will destroy resources
+    m_pSamplers  = nullptr;   // after all textures, they share samplers
   
-    m_pCopyHelper  = nullptr; // smart pointer will destroy resources
     m_pTerrainMesh = nullptr; // smart pointer will destroy resources
     m_pTeapotMesh  = nullptr; // smart pointer will destroy resources
     m_pBunnyMesh   = nullptr; // smart pointer will destroy resources
+    m_pSceneMesh   = nullptr; // smart pointer will destroy resources
+    m_pCopyHelper->FreeBufferMemory(m_memAllMeshes); // our vbos, after the meshes bound to it; copy helper allocated them
+    m_pCopyHelper  = nullptr; // smart pointer will destroy resources
+    m_pReadback    = nullptr; // smart pointer will destroy resources
+    m_pDrawList    = nullptr; // smart pointer will destroy resources
+    m_pBenchDrawList = nullptr; // smart pointer will destroy resources
+    m_pTeapotInstances = nullptr; // smart pointer will destroy resources
+    m_pBunnyDeformer = nullptr; // smart pointer will destroy resources
     m_pFSQuad      = nullptr; // smart pointer will destroy resources
     m_pBindings    = nullptr; // smart pointer will destroy resources
 
-    // free our vbos
-    vkFreeMemory(device, m_memAllMeshes, NULL);
 
-    if(m_memAllTextures != nullptr)
-      vkFreeMemory(device, m_memAllTextures, NULL);
 
-    if(m_memShadowMap != nullptr)
-      vkFreeMemory(device, m_memShadowMap, NULL);
+    if(m_memDrawList != nullptr)
+      vkFreeMemory(device, m_memDrawList, NULL);
+
+    if(m_memBenchDrawList != nullptr)
+      vkFreeMemory(device, m_memBenchDrawList, NULL);
+
+    if(m_memInstances != nullptr)
+      vkFreeMemory(device, m_memInstances, NULL);
+
+    if(m_memDeformer != nullptr)
+      vkFreeMemory(device, m_memDeformer, NULL);
 
     if(depthImageMemory != nullptr)
     {
@@ -707,6 +1077,14 @@ private:
     vkDestroyPipeline(device, graphicsPipeline, nullptr);
     if(graphicsPipelineShadow != nullptr)
       vkDestroyPipeline(device, graphicsPipelineShadow, nullptr);
+    if(graphicsPipelineIndirect != nullptr)
+      vkDestroyPipeline(device, graphicsPipelineIndirect, nullptr);
+    if(graphicsPipelineShadowIndirect != nullptr)
+      vkDestroyPipeline(device, graphicsPipelineShadowIndirect, nullptr);
+    if(graphicsPipelineInstanced != nullptr)
+      vkDestroyPipeline(device, graphicsPipelineInstanced, nullptr);
+    if(graphicsPipelineShadowInstanced != nullptr)
+      vkDestroyPipeline(device, graphicsPipelineShadowInstanced, nullptr);
 
     vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
     vkDestroyRenderPass    (device, renderPass, nullptr);
@@ -817,9 +1195,11 @@ private:
       matrices[2] = mrot;
     }
 
+    vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, a_layout, 0, 1, &descriptorSetWithSM, 0, NULL); // all materials, bound once
+
     if (!a_drawToShadowMap) // in this particular sample we don't want to draw ground in the shadow map
     {
-      vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, a_layout, 0, 1, descriptorSetWithSM + TERRAIN_TEX, 0, NULL);
+      matrices[3].set_col(3, LiteMath::float4(float(TERRAIN_TEX), 0.0f, 0.0f, 0.0f)); // material layer
       vkCmdPushConstants(a_cmdBuff, a_layout, (VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT), 0, sizeof(float) * 4 * 16, matrices);
       m_pTerrainMesh->DrawCmd(a_cmdBuff);
     }
@@ -834,7 +1214,7 @@ private:
       matrices[2]     = LiteMath::float4x4();
     }
    
-    vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, a_layout, 0, 1, descriptorSetWithSM + STONE_TEX, 0, NULL);
+    matrices[3].set_col(3, LiteMath::float4(float(STONE_TEX), 0.0f, 0.0f, 0.0f));
     vkCmdPushConstants(a_cmdBuff, a_layout, (VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT), 0, sizeof(float) * 4 * 16, matrices);
     m_pTeapotMesh->DrawCmd(a_cmdBuff);
 
@@ -849,11 +1229,331 @@ private:
       matrices[2]     = LiteMath::float4x4();
     }
 
-    vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, a_layout, 0, 1, descriptorSetWithSM + METAL_TEX, 0, NULL);
+    matrices[3].set_col(3, LiteMath::float4(float(METAL_TEX), 0.0f, 0.0f, 0.0f));
     vkCmdPushConstants(a_cmdBuff, a_layout, (VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT), 0, sizeof(float) * 4 * 16, matrices);
     m_pBunnyMesh->DrawCmd(a_cmdBuff);
   }
+
+  /**
+  \brief same as DrawSceneCmd, but draws the whole scene with multi-draw-indirect: 
+         single vkCmdDrawIndexedIndirect per pass (material layer is taken from per-draw SSBO, same as model matrix).
+  \param a_cmdBuff         - output command buffer in wich commands will be written to
+  \param a_mViewProj       - input  view projection matrix; model matrices are taken from per-draw SSBO
+  \param a_lightMatrix     - input  light view projection matrix; ignored if a_drawToShadowMap == true;
+  \param a_drawToShadowMap - input flag that signals we drawing geometry only in the shadow map
+  */
+  void DrawSceneIndirectCmd(VkCommandBuffer a_cmdBuff, LiteMath::float4x4 a_mViewProj, LiteMath::float4x4 a_lightMatrix, bool a_drawToShadowMap)
+  {
+    LiteMath::float3 a_lightDir = LiteMath::normalize(m_light.cam.pos - m_light.cam.lookAt);
+    auto             a_layout   = pipelineLayout;
+
+    LiteMath::float4x4 matrices[4];
+    matrices[0] = a_mViewProj;
+    matrices[1] = a_lightMatrix;
+    matrices[3].set_col(0, LiteMath::to_float4(m_cam.pos, 0.0f));
+    matrices[3].set_col(1, LiteMath::to_float4(a_lightDir, m_light.lightTargetDist));
+
+    vkCmdPushConstants(a_cmdBuff, a_layout, (VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT), 0, sizeof(float) * 4 * 16, matrices);
+    vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, a_layout, 0, 1, &descriptorSetWithSM, 0, NULL);
+    vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, a_layout, 1, 1, &descriptorSetDraws, 0, NULL);
+    m_pSceneMesh->BindCmd(a_cmdBuff);
+
+    if (a_drawToShadowMap) // in this particular sample we don't want to draw ground in the shadow map; terrain draws are placed first in the list
+      m_pDrawList->DrawCmd(a_cmdBuff, m_materialDraws[STONE_TEX], m_materialDraws[TEXTURES_NUM] - m_materialDraws[STONE_TEX]);
+    else
+      m_pDrawList->DrawCmd(a_cmdBuff);
+  }
+
+  /**
+  \brief draw INSTANCES_GRID*INSTANCES_GRID teapots with single instanced draw; binds its own pipeline.
+  \param a_cmdBuff         - output command buffer in wich commands will be written to
+  \param a_mViewProj       - input  view projection matrix; model matrices are taken from per-instance attributes
+  \param a_lightMatrix     - input  light view projection matrix; ignored if a_drawToShadowMap == true;
+  \param a_drawToShadowMap - input flag that signals we drawing geometry only in the shadow map
+  */
+  void DrawInstancesCmd(VkCommandBuffer a_cmdBuff, LiteMath::float4x4 a_mViewProj, LiteMath::float4x4 a_lightMatrix, bool a_drawToShadowMap)
+  {
+    LiteMath::float3 a_lightDir = LiteMath::normalize(m_light.cam.pos - m_light.cam.lookAt);
+    auto             a_layout   = pipelineLayout;
+
+    LiteMath::float4x4 matrices[4];
+    matrices[0] = a_mViewProj;
+    matrices[1] = a_lightMatrix;
+    matrices[3].set_col(0, LiteMath::to_float4(m_cam.pos, 0.0f));
+    matrices[3].set_col(1, LiteMath::to_float4(a_lightDir, m_light.lightTargetDist));
+
+    vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, a_drawToShadowMap ? graphicsPipelineShadowInstanced : graphicsPipelineInstanced);
+    matrices[3].set_col(3, LiteMath::float4(float(STONE_TEX), 0.0f, 0.0f, 0.0f));
+    vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, a_layout, 0, 1, &descriptorSetWithSM, 0, NULL);
+    vkCmdPushConstants(a_cmdBuff, a_layout, (VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT), 0, sizeof(float) * 4 * 16, matrices);
+    m_pTeapotMesh->DrawInstancedCmd(a_cmdBuff, m_pTeapotInstances->Buffer(), 0, m_pTeapotInstances->InstancesNum());
+  }
+
+  /**
+  \brief bend upper part of bunny with GPU skinning; writes vertex buffer which is used by current draw path. Must be called outside of render pass.
+  \param a_cmdBuff - output command buffer in wich commands will be written to
+  \param a_time    - input time in seconds
+  */
+  void AnimateBunnyCmd(VkCommandBuffer a_cmdBuff, float a_time)
+  {
+    const float angle = 0.35f*sinf(2.0f*a_time);
+
+    LiteMath::float4x4 bones[2];
+    bones[0] = LiteMath::float4x4();
+    bones[1] = LiteMath::translate4x4(m_bunnyPivot)*LiteMath::rotate4x4Z(angle)*LiteMath::translate4x4(m_bunnyPivot*(-1.0f));
+
+    m_pBunnyDeformer->UpdateBonesCmd(a_cmdBuff, (const float*)bones, 2);
+
+    if(g_input.drawIndirect)
+      m_pBunnyDeformer->DeformCmd(a_cmdBuff, m_pSceneMesh->VertexBuffers()[0], uint32_t(m_sceneRanges[BUNNY_MESH].vertexOffset));
+    else
+      m_pBunnyDeformer->DeformCmd(a_cmdBuff, m_pBunnyMesh->VertexBuffers()[0], 0);
+
+    m_bunnyDeformed = true;
+  }
+
+  /**
+  \brief put bunny back to the rest pose after animation was turned off; both draw paths are restored, since path could be switched while animating. 
+         Must be called outside of render pass.
+  \param a_cmdBuff - output command buffer in wich commands will be written to
+  */
+  void RestoreBunnyCmd(VkCommandBuffer a_cmdBuff)
+  {
+    m_pBunnyDeformer->RestPoseCmd(a_cmdBuff, m_pSceneMesh->VertexBuffers()[0], uint32_t(m_sceneRanges[BUNNY_MESH].vertexOffset));
+    m_pBunnyDeformer->RestPoseCmd(a_cmdBuff, m_pBunnyMesh->VertexBuffers()[0], 0);
+    m_bunnyDeformed = false;
+  }
+
+  /**
+  \brief Request shadow map readback on key press and save it when it is ready; render loop is never stalled.
+  */
+  void DumpShadowMapIfNeeded()
+  {
+    const int w = m_pShadowMap->Width();
+    const int h = m_pShadowMap->Height();
+
+    if(g_input.dumpShadowMap && !m_shadowMapDumpPending)
+    {
+      m_shadowMapDump.resize(size_t(w)*size_t(h));
+      m_pReadback->ReadbackImage(m_pShadowMap->Image(), m_pShadowMap->Format(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, w, h, m_shadowMapDump.data());
+      m_shadowMapDumpTicket  = m_pReadback->Submit();
+      m_shadowMapDumpPending = true;
+      g_input.dumpShadowMap  = false;
+    }
+
+    if(m_shadowMapDumpPending && m_pReadback->IsComplete(m_shadowMapDumpTicket))
+    {
+      SaveBMP("shadowmap.bmp", m_shadowMapDump.data(), w, h);
+      std::cout << "shadow map is saved to 'shadowmap.bmp'" << std::endl;
+      m_shadowMapDumpPending = false;
+    }
+  }
+
+  /**
+  \brief Streaming feedback: estimate the finest mip of materials from the distance to the closest object, 
+         assuming texture coordinates span about one unit of world space (shaders tile them twice).
+  */
+  void RequestMaterialMips()
+  {
+    const LiteMath::float3 terrainPoint(LiteMath::clamp(m_cam.pos.x, -2.0f, 2.0f), 0.0f, LiteMath::clamp(m_cam.pos.z, -2.0f, 2.0f));
+    const LiteMath::float3 objects[3] = { terrainPoint, LiteMath::float3(-0.5f, 0.4f, -0.5f), LiteMath::float3(+1.25f, 0.6f, 0.5f) };
+
+    float dist = 1e10f;
+    for(const auto& pos : objects)
+      dist = std::min(dist, LiteMath::length(pos - m_cam.pos));
+
+    int arrayWidth = m_texSrc[0].width; // level 0 of materials array, see CreateResources
+    for(int i=1;i<TEXTURES_NUM;i++)
+      arrayWidth = std::min(arrayWidth, m_texSrc[i].width);
+
+    const float texelsPerUnit  = 2.0f*float(arrayWidth);
+    const float pixelsPerUnit  = float(HEIGHT) / (2.0f*std::max(dist, 0.01f)*tanf(0.5f*m_cam.fov*LiteMath::DEG_TO_RAD));
+    const float texelsPerPixel = std::max(texelsPerUnit/pixelsPerUnit, 1.0f);
+
+    m_pStreamer->RequestMip(m_materialsTex, int(floorf(log2f(texelsPerPixel))));
+  }
+
+  /**
+  \brief Point materials binding of descriptorSetWithSM to the currently resident image. Set must not be used by pending command buffers:
+         DrawFrame waits for the fence of the only frame in flight before recording, so the previous frame is complete here.
+         More frames in flight would need a copy of the set per frame.
+  */
+  void UpdateMaterialsDescriptor()
+  {
+    static_assert(MAX_FRAMES_IN_FLIGHT == 1, "descriptorSetWithSM is shared by all frames, it is updated only when no frame is in flight");
+
+    VkDescriptorImageInfo imageInfo = {};
+    imageInfo.sampler     = m_pStreamer->Sampler(m_materialsTex);
+    imageInfo.imageView   = m_pStreamer->View(m_materialsTex);
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkWriteDescriptorSet write = {};
+    write.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet          = descriptorSetWithSM;
+    write.dstBinding      = 0;
+    write.descriptorCount = 1;
+    write.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo      = &imageInfo;
+
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+  }
+
+  /**
+  \brief Wait for all pending uploads and make uploaded data available for the graphics queue: 
+         acquire ownership from transfer queue family (if it is separate) and make textures readable in shaders.
+  */
+  void AcquireUploadsNow()
+  {
+    VkCommandBuffer cmdBuff = commandBuffers[0];
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkResetCommandBuffer(cmdBuff, 0);
+    vkBeginCommandBuffer(cmdBuff, &beginInfo);
+
+    m_pCopyHelper->AcquireOwnershipCmd(cmdBuff);  // copies on transfer queue are waited by the semaphores below
+
+    m_pStreamer->AcquireTailsCmd(cmdBuff);        // does nothing if tails are already readable
+
+    vkEndCommandBuffer(cmdBuff);
+    vk_utils::ExecuteCommandBufferNow(cmdBuff, graphicsQueue, device, m_pCopyHelper->TakeWaitSemaphores());
+  }
+
+  /**
+  \brief CPU-side benchmark: record shadow pass for a_objectsNum teapots with per-object draws and with multi-draw-indirect, print average recording time.
+         Command buffer is recorded but never submitted.
+  \param a_objectsNum - input objects number
+  */
+  void RunDrawBenchmark(int a_objectsNum)
+  {
+    vkDeviceWaitIdle(device); // we are going to re-record command buffer that could be in use now
+
+    const int side = int(sqrtf(float(a_objectsNum))) + 1;
+    std::vector<LiteMath::float4x4> objMatrices(a_objectsNum);
+    for(int i=0;i<a_objectsNum;i++)
+      objMatrices[i] = LiteMath::translate4x4({ 1.5f*float(i%side - side/2), 0.4f, 1.5f*float(i/side - side/2) });
+
+    if(m_pBenchDrawList == nullptr)
+    {
+      m_pBenchDrawList = CreateDrawList(a_objectsNum, &m_memBenchDrawList);
+      for(int i=0;i<a_objectsNum;i++)
+        m_pBenchDrawList->AddDraw(m_sceneRanges[TEAPOT_MESH], (const float*)&objMatrices[i]);
+      m_pBenchDrawList->UpdateBuffers(m_pCopyHelper.get());
+      AcquireUploadsNow();
+
+      m_pBindings->BindBegin(VK_SHADER_STAGE_VERTEX_BIT);
+      m_pBindings->BindStorageBuffer(0, m_pBenchDrawList->InstanceBuffer());
+      m_pBindings->BindEnd(&descriptorSetBenchDraws);
+    }
+    assert(int(m_pBenchDrawList->MaxDraws()) >= a_objectsNum);
+
+    VkCommandBuffer    cmdBuff = commandBuffers[0];
+    LiteMath::float4x4 mViewProj, mLightViewProj;
+    LiteMath::float4x4 matrices[4];
+
+    auto beginCmd = [&](VkPipeline a_pipeline)
+    {
+      vkResetCommandBuffer(cmdBuff, 0);
+      VkCommandBufferBeginInfo beginInfo = {};
+      beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+      beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+      if (vkBeginCommandBuffer(cmdBuff, &beginInfo) != VK_SUCCESS) 
+        throw std::runtime_error("[RunDrawBenchmark]: failed to begin recording command buffer!");
+      m_pShadowMap->BeginRenderingToThisTexture(cmdBuff);
+      vkCmdBindPipeline(cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, a_pipeline);
+    };
+
+    auto endCmd = [&]()
+    {
+      m_pShadowMap->EndRenderingToThisTexture(cmdBuff);
+      vkEndCommandBuffer(cmdBuff);
+    };
+
+    const int NRepeat = 10;
+    double timeDirect = 0.0, timeIndirect = 0.0, timeFill = 0.0;
+
+    for(int iter = 0; iter < NRepeat; iter++)
+    {
+      // (1) one bind + push constants + draw per object
+      //
+      auto t0 = std::chrono::high_resolution_clock::now();
+      beginCmd(graphicsPipelineShadow);
+      for(int i=0;i<a_objectsNum;i++)
+      {
+        matrices[0] = mViewProj*objMatrices[i];
+        matrices[1] = mLightViewProj*objMatrices[i];
+        matrices[2] = LiteMath::float4x4();
+        vkCmdBindDescriptorSets(cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSetWithSM, 0, NULL);
+        vkCmdPushConstants(cmdBuff, pipelineLayout, (VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT), 0, sizeof(float) * 4 * 16, matrices);
+        m_pTeapotMesh->DrawCmd(cmdBuff);
+      }
+      endCmd();
+      auto t1 = std::chrono::high_resolution_clock::now();
+
+      // (2) CPU part of updating draw list (only needed if objects move); upload is not measured
+      //
+      m_pBenchDrawList->Clear();
+      for(int i=0;i<a_objectsNum;i++)
+        m_pBenchDrawList->AddDraw(m_sceneRanges[TEAPOT_MESH], (const float*)&objMatrices[i]);
+      auto t2 = std::chrono::high_resolution_clock::now();
+
+      // (3) single indirect draw for all objects
+      //
+      beginCmd(graphicsPipelineShadowIndirect);
+      matrices[0] = mViewProj;
+      matrices[1] = mLightViewProj;
+      vkCmdPushConstants(cmdBuff, pipelineLayout, (VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT), 0, sizeof(float) * 4 * 16, matrices);
+      vkCmdBindDescriptorSets(cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &descriptorSetBenchDraws, 0, NULL);
+      m_pSceneMesh->BindCmd(cmdBuff);
+      m_pBenchDrawList->DrawCmd(cmdBuff);
+      endCmd();
+      auto t3 = std::chrono::high_resolution_clock::now();
+
+      timeDirect   += std::chrono::duration<double, std::milli>(t1 - t0).count();
+      timeFill     += std::chrono::duration<double, std::milli>(t2 - t1).count();
+      timeIndirect += std::chrono::duration<double, std::milli>(t3 - t2).count();
+    }
+
+    std::cout << "[RunDrawBenchmark]: " << a_objectsNum << " objects, average of " << NRepeat << " runs" << std::endl;
+    std::cout << "  per-object draws, record   : " << timeDirect/double(NRepeat)   << " ms" << std::endl;
+    std::cout << "  indirect draw,    record   : " << timeIndirect/double(NRepeat) << " ms" << std::endl;
+    std::cout << "  indirect draw,    list fill: " << timeFill/double(NRepeat)     << " ms" << std::endl;
+  }
   
+  /**
+  \brief Raise a band of terrain rows on key press. Upload goes to the back copy of terrain vertices, while frames keep drawing the front one;
+         copies are swapped only when the upload ticket is complete, so render loop is never stalled and never draws half-uploaded vertices.
+         Must be called before draws are recorded to a_cmdBuff.
+  \param a_cmdBuff - output command buffer in wich acquire barriers (for dedicated transfer queue) will be written to
+  */
+  void UpdateTerrainCmd(VkCommandBuffer a_cmdBuff)
+  {
+    if(m_terrainUploadPending && m_pCopyHelper->IsComplete(m_terrainUploadTicket))
+    {
+      m_pCopyHelper->AcquireOwnershipCmd(a_cmdBuff); // vertex buffers are concurrent, frame submit just waits for the handoff semaphore
+      m_pTerrainMesh->SwapVertexCopies();            // draws that are recorded after this point use new vertices
+      m_terrainUploadPending = false;
+    }
+
+    if(!g_input.raiseTerrain || m_terrainUploadPending) // next change waits until the previous one is swapped in
+      return;
+
+    const int vertsX    = TERRAIN_GRID + 1;
+    const int firstVert = m_terrainRow*vertsX;
+    const int vertsNum  = std::min(int(TERRAIN_BAND), TERRAIN_GRID + 1 - m_terrainRow)*vertsX;
+    for(int i = firstVert; i < firstVert + vertsNum; i++)
+      m_terrainData.vPos4f[i*4+2] += 0.05f; // quad is in XY plane and rotated to XZ, so z is height
+
+    m_pTerrainMesh->UpdateVerticesRange(m_terrainData, firstVert, vertsNum, m_pCopyHelper.get());
+    m_terrainUploadTicket  = m_pCopyHelper->Submit();
+    m_terrainUploadPending = true;
+
+    m_terrainRow         = (m_terrainRow + TERRAIN_BAND) % (TERRAIN_GRID + 1);
+    g_input.raiseTerrain = false;
+  }
+
   /**
   \brief Main draw function
   \param a_cmdBuff - output command buffer in wich commands will be written to 
@@ -877,6 +1577,23 @@ private:
     if (vkBeginCommandBuffer(a_cmdBuff, &beginInfo) != VK_SUCCESS) 
       throw std::runtime_error("[WriteCommandBuffer]: failed to begin recording command buffer!");
 
+    //// texture streaming: request mips for this frame, swap in completed uploads; descriptor set is not bound yet, so it can be updated now
+    //
+    RequestMaterialMips();
+    if(m_pStreamer->UpdateCmd(a_cmdBuff))
+      UpdateMaterialsDescriptor();
+
+    //// dynamic terrain: swap vertex copies when their upload is complete, start next upload on key press
+    //
+    UpdateTerrainCmd(a_cmdBuff);
+
+    //// deform animated meshes once, so that both shadow and main passes use the same result
+    //
+    if(g_input.animateBunny)
+      AnimateBunnyCmd(a_cmdBuff, float(glfwGetTime()));
+    else if(m_bunnyDeformed)
+      RestoreBunnyCmd(a_cmdBuff);
+
     //// draw scene to shadow map (don't draw plane/terrain in the shadowmap)
     //
     assert(m_pShadowMap != nullptr);
@@ -884,8 +1601,6 @@ private:
     {
       m_pShadowMap->BeginRenderingToThisTexture(a_cmdBuff);
 
-      vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, this->graphicsPipelineShadow);
-
       LiteMath::float4x4 mProj;
       if(m_light.usePerspectiveM)
         mProj = LiteMath::perspectiveMatrix(m_light.cam.fov, 1.0f, 1.0f, m_light.lightTargetDist*2.0f);
@@ -896,7 +1611,19 @@ private:
       auto mLookAt        = LiteMath::lookAt(m_light.cam.pos, m_light.cam.pos + m_light.cam.forward()*10.0f, m_light.cam.up);
       auto mWorldViewProj = mProjFix*mProj*mLookAt;
 
-      DrawSceneCmd(a_cmdBuff, mWorldViewProj, LiteMath::float4x4(), true);
+      if(g_input.drawIndirect)
+      {
+        vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, this->graphicsPipelineShadowIndirect);
+        DrawSceneIndirectCmd(a_cmdBuff, mWorldViewProj, LiteMath::float4x4(), true);
+      }
+      else
+      {
+        vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, this->graphicsPipelineShadow);
+        DrawSceneCmd(a_cmdBuff, mWorldViewProj, LiteMath::float4x4(), true);
+      }
+
+      if(g_input.drawInstances)
+        DrawInstancesCmd(a_cmdBuff, mWorldViewProj, LiteMath::float4x4(), true);
 
       m_pShadowMap->EndRenderingToThisTexture(a_cmdBuff);
 
@@ -920,7 +1647,7 @@ private:
       renderPassInfo.pClearValues    = &clearValues[0];
 
       vkCmdBeginRenderPass(a_cmdBuff, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-      vkCmdBindPipeline   (a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, a_graphicsPipeline);
+      vkCmdBindPipeline   (a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, g_input.drawIndirect ? this->graphicsPipelineIndirect : a_graphicsPipeline);
 
       const float aspect  = float(a_frameBufferExtent.width)/float(a_frameBufferExtent.height); 
       auto mProjFix       = LiteMath::OpenglToVulkanProjectionMatrixFix();  // http://matthewwellings.com/blog/the-new-vulkan-coordinate-system/
@@ -928,7 +1655,13 @@ private:
       auto mLookAt        = LiteMath::lookAt(m_cam.pos, m_cam.pos + m_cam.forward()*10.0f, m_cam.up);
       auto mWorldViewProj = mProjFix*mProj*mLookAt;
 
-      DrawSceneCmd(a_cmdBuff, mWorldViewProj, lightMatrix, false);
+      if(g_input.drawIndirect)
+        DrawSceneIndirectCmd(a_cmdBuff, mWorldViewProj, lightMatrix, false);
+      else
+        DrawSceneCmd(a_cmdBuff, mWorldViewProj, lightMatrix, false);
+
+      if(g_input.drawInstances)
+        DrawInstancesCmd(a_cmdBuff, mWorldViewProj, lightMatrix, false);
 
       vkCmdEndRenderPass(a_cmdBuff);
     }
@@ -986,14 +1719,18 @@ private:
     //
     DrawFrameCmd(commandBuffers[imageIndex], screen.swapChainFramebuffers[imageIndex], screen.swapChainImageViews[imageIndex]);
 
-    VkSemaphore      waitSemaphores[] = { m_sync.imageAvailableSemaphores[currentFrame] };
-    VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+    // uploads that were handed to graphics queue while recording (terrain, streamed mips) are waited on GPU only
+    //
+    std::vector<VkSemaphore>          waitSemaphores = m_pCopyHelper->TakeWaitSemaphores();
+    std::vector<VkPipelineStageFlags> waitStages(waitSemaphores.size(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    waitSemaphores.push_back(m_sync.imageAvailableSemaphores[currentFrame]);
+    waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
    
     VkSubmitInfo submitInfo       = {};
     submitInfo.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores    = waitSemaphores;
-    submitInfo.pWaitDstStageMask  = waitStages;
+    submitInfo.waitSemaphoreCount = uint32_t(waitSemaphores.size());
+    submitInfo.pWaitSemaphores    = waitSemaphores.data();
+    submitInfo.pWaitDstStageMask  = waitStages.data();
 
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers    = &commandBuffers[imageIndex]; // note that we will draw from this command buffer now
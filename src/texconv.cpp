@@ -0,0 +1,122 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Offline texture converter: BMP -> texture container (see ctexture_file.h) with full mip chain and optional BC compression,
+// so the application only maps the file and uploads it. Usage:
+//
+//   texconv [--format rgba8|bc1|bc3|bc4|bc5] [--quality fast|normal|high] [--filter box|kaiser] [--linear] input.bmp output.ctex
+//
+// By default rgb is treated as sRGB for mip filtering (color textures); use --linear for normal maps, masks and other data.
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <vulkan/vulkan.h> // only for VkFormat values
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <iostream>
+
+#include "Bitmap.h"
+#include "ctexture.h"
+#include "ctexture_file.h"
+
+static void PrintUsage()
+{
+  std::cout << "usage: texconv [--format rgba8|bc1|bc3|bc4|bc5] [--quality fast|normal|high] [--filter box|kaiser] [--linear] input.bmp output.ctex" << std::endl;
+}
+
+int main(int argc, const char** argv)
+{
+  std::string           format  = "bc1";
+  ctexture::BC_QUALITY  quality = ctexture::BC_QUALITY_NORMAL;
+  ctexture::MIP_FILTER  filter  = ctexture::MIP_FILTER_BOX;
+  bool                  srgb    = true;
+  std::vector<std::string> files;
+
+  for(int i=1;i<argc;i++)
+  {
+    const std::string arg = argv[i];
+    if(arg == "--format" && i+1 < argc)
+      format = argv[++i];
+    else if(arg == "--quality" && i+1 < argc)
+    {
+      const std::string val = argv[++i];
+      quality = (val == "fast") ? ctexture::BC_QUALITY_FAST : (val == "high" ? ctexture::BC_QUALITY_HIGH : ctexture::BC_QUALITY_NORMAL);
+    }
+    else if(arg == "--filter" && i+1 < argc)
+      filter = (std::string(argv[++i]) == "kaiser") ? ctexture::MIP_FILTER_KAISER : ctexture::MIP_FILTER_BOX;
+    else if(arg == "--linear")
+      srgb = false;
+    else if(arg.size() > 0 && arg[0] != '-')
+      files.push_back(arg);
+    else
+    {
+      PrintUsage();
+      return 1;
+    }
+  }
+
+  ctexture::BC_FORMAT bcFormat = ctexture::BC_FORMAT_BC1;
+  VkFormat            vkFormat = VK_FORMAT_UNDEFINED;
+  if(format == "rgba8")    vkFormat = VK_FORMAT_R8G8B8A8_UNORM;
+  else if(format == "bc1") { vkFormat = VK_FORMAT_BC1_RGB_UNORM_BLOCK; bcFormat = ctexture::BC_FORMAT_BC1; }
+  else if(format == "bc3") { vkFormat = VK_FORMAT_BC3_UNORM_BLOCK;     bcFormat = ctexture::BC_FORMAT_BC3; }
+  else if(format == "bc4") { vkFormat = VK_FORMAT_BC4_UNORM_BLOCK;     bcFormat = ctexture::BC_FORMAT_BC4; }
+  else if(format == "bc5") { vkFormat = VK_FORMAT_BC5_UNORM_BLOCK;     bcFormat = ctexture::BC_FORMAT_BC5; }
+
+  if(vkFormat == VK_FORMAT_UNDEFINED || files.size() != 2)
+  {
+    PrintUsage();
+    return 1;
+  }
+
+  auto timeStart = std::chrono::high_resolution_clock::now();
+
+  int width = 0, height = 0;
+  const std::vector<unsigned int> pixels = LoadBMP(files[0].c_str(), &width, &height);
+  if(pixels.empty())
+  {
+    std::cout << "can't load " << files[0].c_str() << std::endl;
+    return 1;
+  }
+
+  const ctexture::MipChainRGBA8 mips = ctexture::GenerateMipsRGBA8(pixels.data(), width, height, srgb, filter);
+
+  std::vector<const void*> levels;
+  std::vector<size_t>      sizes;
+  ctexture::MipChainBC     compressed;
+  if(vkFormat == VK_FORMAT_R8G8B8A8_UNORM)
+  {
+    levels = mips.LevelPointers();
+    for(const auto& level : mips.levels)
+      sizes.push_back(level.size()*sizeof(unsigned int));
+  }
+  else
+  {
+    compressed = ctexture::CompressMips(mips, bcFormat, quality);
+    levels     = compressed.LevelPointers();
+    for(const auto& level : compressed.levels)
+      sizes.push_back(level.size());
+  }
+
+  ctexture::TextureFileDesc desc;
+  desc.vkFormat = uint32_t(vkFormat);
+  desc.width    = width;
+  desc.height   = height;
+  desc.levels   = mips.LevelsNum();
+  desc.layers   = 1;
+  desc.flags    = srgb ? ctexture::TEXTURE_FILE_SRGB_DATA : 0;
+
+  if(!ctexture::SaveTextureFile(files[1].c_str(), desc, levels.data(), sizes.data()))
+  {
+    std::cout << "can't write " << files[1].c_str() << std::endl;
+    return 1;
+  }
+
+  size_t totalSize = 0;
+  for(size_t size : sizes)
+    totalSize += size;
+
+  const float ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - timeStart).count();
+  std::cout << files[1].c_str() << ": " << width << "x" << height << ", " << desc.levels << " mips, " << format.c_str() << ", "
+            << totalSize << " bytes, " << ms << " ms" << std::endl;
+  return 0;
+}
@@ -0,0 +1,385 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Upload bandwidth benchmark for copy helpers. Headless (no window and no surface), so it can run on a software Vulkan
+// driver (lavapipe, SwiftShader) in CI. Usage:
+//
+//   upload_bench [--max-size bytes] [--device id] [--csv file.csv] [--quick]
+//
+// For each transfer size (256 B ... 512 MB by default, x4 steps) and each strategy, prints GB/s and per-call latency percentiles.
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+
+#include "vk_utils.h"
+#include "vk_copy.h"
+
+#ifdef WIN32
+#undef min
+#undef max
+#endif
+
+struct BenchContext
+{
+  VkInstance       instance       = VK_NULL_HANDLE;
+  VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+  VkDevice         device         = VK_NULL_HANDLE;
+  VkQueue          queue          = VK_NULL_HANDLE;
+  uint32_t         queueFID       = 0;
+  VkPhysicalDeviceProperties props;
+};
+
+struct BenchResult
+{
+  std::string target;    ///< "buffer" or "image"
+  std::string strategy;
+  size_t      size;
+  int         calls;
+  double      gbPerSec;
+  double      p50us, p90us, p99us;
+};
+
+static double Percentile(std::vector<double> a_values, double a_p)
+{
+  if(a_values.empty())
+    return 0.0;
+  std::sort(a_values.begin(), a_values.end());
+  const size_t id = std::min(a_values.size() - 1, size_t(a_p*double(a_values.size())));
+  return a_values[id];
+}
+
+static double NowUs()
+{
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+\brief Create buffer and allocate dedicated memory for it; returns false if memory can't be allocated (i.e. too large size for software driver)
+*/
+static bool CreateBufferWithMemory(const BenchContext& a_ctx, size_t a_size, VkBufferUsageFlags a_usage, VkMemoryPropertyFlags a_props,
+                                   VkBuffer* a_pBuffer, VkDeviceMemory* a_pMemory)
+{
+  VkBufferCreateInfo bufferCreateInfo = {};
+  bufferCreateInfo.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferCreateInfo.size        = a_size;
+  bufferCreateInfo.usage       = a_usage;
+  bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  VK_CHECK_RESULT(vkCreateBuffer(a_ctx.device, &bufferCreateInfo, NULL, a_pBuffer));
+
+  VkMemoryRequirements memReq;
+  vkGetBufferMemoryRequirements(a_ctx.device, (*a_pBuffer), &memReq);
+
+  VkMemoryAllocateInfo allocateInfo = {};
+  allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocateInfo.allocationSize  = memReq.size;
+  allocateInfo.memoryTypeIndex = vk_utils::FindMemoryType(memReq.memoryTypeBits, a_props, a_ctx.physicalDevice);
+  if(allocateInfo.memoryTypeIndex == uint32_t(-1) || vkAllocateMemory(a_ctx.device, &allocateInfo, NULL, a_pMemory) != VK_SUCCESS)
+  {
+    vkDestroyBuffer(a_ctx.device, (*a_pBuffer), NULL);
+    (*a_pBuffer) = VK_NULL_HANDLE;
+    return false;
+  }
+
+  VK_CHECK_RESULT(vkBindBufferMemory(a_ctx.device, (*a_pBuffer), (*a_pMemory), 0));
+  return true;
+}
+
+static bool CreateImageWithMemory(const BenchContext& a_ctx, int a_width, int a_height, VkImage* a_pImage, VkDeviceMemory* a_pMemory)
+{
+  VkImageCreateInfo imgCreateInfo = {};
+  imgCreateInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imgCreateInfo.imageType     = VK_IMAGE_TYPE_2D;
+  imgCreateInfo.format        = VK_FORMAT_R8G8B8A8_UNORM;
+  imgCreateInfo.extent        = VkExtent3D{ uint32_t(a_width), uint32_t(a_height), 1 };
+  imgCreateInfo.mipLevels     = 1;
+  imgCreateInfo.arrayLayers   = 1;
+  imgCreateInfo.samples       = VK_SAMPLE_COUNT_1_BIT;
+  imgCreateInfo.tiling        = VK_IMAGE_TILING_OPTIMAL;
+  imgCreateInfo.usage         = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+  imgCreateInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+  imgCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  VK_CHECK_RESULT(vkCreateImage(a_ctx.device, &imgCreateInfo, nullptr, a_pImage));
+
+  VkMemoryRequirements memReq;
+  vkGetImageMemoryRequirements(a_ctx.device, (*a_pImage), &memReq);
+
+  VkMemoryAllocateInfo allocateInfo = {};
+  allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocateInfo.allocationSize  = memReq.size;
+  allocateInfo.memoryTypeIndex = vk_utils::FindMemoryType(memReq.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, a_ctx.physicalDevice);
+  if(allocateInfo.memoryTypeIndex == uint32_t(-1) || vkAllocateMemory(a_ctx.device, &allocateInfo, NULL, a_pMemory) != VK_SUCCESS)
+  {
+    vkDestroyImage(a_ctx.device, (*a_pImage), NULL);
+    (*a_pImage) = VK_NULL_HANDLE;
+    return false;
+  }
+
+  VK_CHECK_RESULT(vkBindImageMemory(a_ctx.device, (*a_pImage), (*a_pMemory), 0));
+  return true;
+}
+
+/**
+\brief Naive blocking staging: staging buffer as large as the upload; memcpy, one copy command, submit and wait.
+*/
+struct BlockingStaging
+{
+  BlockingStaging(const BenchContext& a_ctx) : m_ctx(a_ctx), m_submit(a_ctx.physicalDevice, a_ctx.device, a_ctx.queue, a_ctx.queueFID, 2) {}
+  ~BlockingStaging() { Free(); }
+
+  bool Reserve(size_t a_size)
+  {
+    if(a_size <= m_size)
+      return true;
+
+    Free();
+    if(!CreateBufferWithMemory(m_ctx, a_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &m_buffer, &m_memory))
+      return false;
+
+    void* mapped = nullptr;
+    VK_CHECK_RESULT(vkMapMemory(m_ctx.device, m_memory, 0, a_size, 0, &mapped));
+    m_mapped = (char*)mapped;
+    m_size   = a_size;
+    return true;
+  }
+
+  void UpdateBuffer(VkBuffer a_dst, const void* a_src, size_t a_size)
+  {
+    memcpy(m_mapped, a_src, a_size);
+    VkCommandBuffer cmd = m_submit.Begin();
+    VkBufferCopy region = {0, 0, a_size};
+    vkCmdCopyBuffer(cmd, m_buffer, a_dst, 1, &region);
+    m_submit.Wait(m_submit.Submit(cmd));
+  }
+
+  void UpdateImage(VkImage a_image, const void* a_src, int a_width, int a_height)
+  {
+    memcpy(m_mapped, a_src, size_t(a_width)*size_t(a_height)*4);
+    VkCommandBuffer cmd = m_submit.Begin();
+
+    VkImageMemoryBarrier imgBar = {};
+    imgBar.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imgBar.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imgBar.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imgBar.srcAccessMask       = 0;
+    imgBar.dstAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+    imgBar.oldLayout           = VK_IMAGE_LAYOUT_UNDEFINED;
+    imgBar.newLayout           = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    imgBar.image               = a_image;
+    imgBar.subresourceRange    = VkImageSubresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imgBar);
+
+    VkBufferImageCopy region = {};
+    region.imageSubresource  = VkImageSubresourceLayers{VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.imageExtent       = VkExtent3D{ uint32_t(a_width), uint32_t(a_height), 1 };
+    vkCmdCopyBufferToImage(cmd, m_buffer, a_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    m_submit.Wait(m_submit.Submit(cmd));
+  }
+
+private:
+
+  void Free()
+  {
+    if(m_buffer == VK_NULL_HANDLE)
+      return;
+    vkUnmapMemory  (m_ctx.device, m_memory);
+    vkDestroyBuffer(m_ctx.device, m_buffer, NULL);
+    vkFreeMemory   (m_ctx.device, m_memory, NULL);
+    m_buffer = VK_NULL_HANDLE;
+    m_size   = 0;
+  }
+
+  const BenchContext&     m_ctx;
+  vk_utils::SubmitContext m_submit;
+  VkBuffer                m_buffer = VK_NULL_HANDLE;
+  VkDeviceMemory          m_memory = VK_NULL_HANDLE;
+  char*                   m_mapped = nullptr;
+  size_t                  m_size   = 0;
+};
+
+/**
+\brief vkCmdUpdateBuffer path: data goes inside command buffer in pieces of 65536 bytes (the limit of vkCmdUpdateBuffer)
+*/
+static void UpdateBufferInline(vk_utils::SubmitContext& a_submit, VkBuffer a_dst, const void* a_src, size_t a_size)
+{
+  VkCommandBuffer cmd = a_submit.Begin();
+  for(size_t done = 0; done < a_size; done += 65536)
+    vkCmdUpdateBuffer(cmd, a_dst, done, std::min(size_t(65536), a_size - done), (const char*)a_src + done);
+  a_submit.Wait(a_submit.Submit(cmd));
+}
+
+static int CallsForSize(size_t a_size, bool a_quick)
+{
+  const size_t bytesPerPoint = a_quick ? (size_t(16) << 20) : (size_t(256) << 20);
+  return int(std::max(size_t(3), std::min(size_t(a_quick ? 20 : 200), bytesPerPoint / a_size)));
+}
+
+/**
+\brief Measure a_calls uploads; a_upload does single upload and a_finish waits for all of them (for async strategy).
+*/
+template<typename UploadFunc, typename FinishFunc>
+static BenchResult Measure(const char* a_target, const char* a_strategy, size_t a_size, int a_calls, UploadFunc a_upload, FinishFunc a_finish)
+{
+  a_upload(); // warm up (pipeline of the driver, page faults of the staging memory)
+  a_finish();
+
+  std::vector<double> latencies(a_calls);
+  const double tStart = NowUs();
+  for(int i=0;i<a_calls;i++)
+  {
+    const double t0 = NowUs();
+    a_upload();
+    latencies[i] = NowUs() - t0;
+  }
+  a_finish();
+  const double total = NowUs() - tStart;
+
+  BenchResult res;
+  res.target   = a_target;
+  res.strategy = a_strategy;
+  res.size     = a_size;
+  res.calls    = a_calls;
+  res.gbPerSec = (double(a_size)*double(a_calls)) / (total*1e-6) / 1e9;
+  res.p50us    = Percentile(latencies, 0.50);
+  res.p90us    = Percentile(latencies, 0.90);
+  res.p99us    = Percentile(latencies, 0.99);
+  return res;
+}
+
+static void PrintResult(const BenchResult& a_res, std::ofstream* a_pCsv)
+{
+  std::cout << std::setw(6)  << a_res.target << " " << std::setw(16) << a_res.strategy << " " << std::setw(11) << a_res.size << " B "
+            << std::fixed << std::setprecision(3) << std::setw(9) << a_res.gbPerSec << " GB/s   p50 = "
+            << std::setprecision(1) << std::setw(10) << a_res.p50us << " us, p90 = " << std::setw(10) << a_res.p90us << " us, p99 = " << std::setw(10) << a_res.p99us << " us" << std::endl;
+
+  if(a_pCsv != nullptr && a_pCsv->is_open())
+    (*a_pCsv) << a_res.target << "," << a_res.strategy << "," << a_res.size << "," << a_res.calls << "," << a_res.gbPerSec << "," << a_res.p50us << "," << a_res.p90us << "," << a_res.p99us << std::endl;
+}
+
+int main(int argc, const char** argv)
+{
+  size_t      maxSize   = size_t(512) << 20;
+  int         deviceId  = 0;
+  bool        quick     = false;
+  std::string csvPath;
+
+  for(int i=1;i<argc;i++)
+  {
+    const std::string arg = argv[i];
+    if(arg == "--max-size" && i+1 < argc)
+      maxSize = size_t(std::stoull(argv[++i]));
+    else if(arg == "--device" && i+1 < argc)
+      deviceId = std::stoi(argv[++i]);
+    else if(arg == "--csv" && i+1 < argc)
+      csvPath = argv[++i];
+    else if(arg == "--quick")                 // CI mode: up to 16 MB and fewer calls per size
+      quick = true;
+    else
+    {
+      std::cout << "usage: upload_bench [--max-size bytes] [--device id] [--csv file.csv] [--quick]" << std::endl;
+      return 1;
+    }
+  }
+
+  if(quick)
+    maxSize = std::min(maxSize, size_t(16) << 20);
+
+  // headless Vulkan context: no surface and no swapchain extensions
+  //
+  BenchContext ctx;
+  std::vector<const char*> enabledLayers;
+  ctx.instance       = vk_utils::CreateInstance(false, enabledLayers);
+  ctx.physicalDevice = vk_utils::FindPhysicalDevice(ctx.instance, true, deviceId);
+  ctx.queueFID       = vk_utils::GetQueueFamilyIndex(ctx.physicalDevice, VK_QUEUE_TRANSFER_BIT);
+  ctx.device         = vk_utils::CreateLogicalDevice(ctx.queueFID, ctx.physicalDevice, enabledLayers);
+  vkGetDeviceQueue(ctx.device, ctx.queueFID, 0, &ctx.queue);
+  vkGetPhysicalDeviceProperties(ctx.physicalDevice, &ctx.props);
+
+  std::ofstream csv;
+  if(!csvPath.empty())
+  {
+    csv.open(csvPath);
+    csv << "target,strategy,size,calls,gb_per_sec,p50_us,p90_us,p99_us" << std::endl;
+  }
+
+  const size_t stagingSize = std::min(maxSize, size_t(16) << 20); // same as in the demo app
+  {
+    vk_copy::SimpleCopyHelper chunked(ctx.physicalDevice, ctx.device, ctx.queue, stagingSize, ctx.queueFID);
+    vk_copy::AsyncCopyHelper  async  (ctx.physicalDevice, ctx.device, ctx.queue, ctx.queueFID, stagingSize);
+    vk_utils::SubmitContext   inlineSubmit(ctx.physicalDevice, ctx.device, ctx.queue, ctx.queueFID, 2);
+    BlockingStaging           blocking(ctx);
+
+    std::vector<uint8_t> srcData;
+
+    for(size_t size = 256; size <= maxSize; size *= 4)
+    {
+      srcData.resize(size);
+      for(size_t i=0;i<size;i++)
+        srcData[i] = uint8_t(i*7 + 13);
+
+      const int calls = CallsForSize(size, quick);
+
+      // buffers
+      //
+      VkBuffer       dstBuffer = VK_NULL_HANDLE;
+      VkDeviceMemory dstMemory = VK_NULL_HANDLE;
+      if(!CreateBufferWithMemory(ctx, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &dstBuffer, &dstMemory))
+      {
+        std::cout << "can't allocate " << size << " bytes of device memory, stop here" << std::endl;
+        break;
+      }
+
+      if(size <= (size_t(16) << 20)) // vkCmdUpdateBuffer for large sizes takes too long and too much command buffer memory
+      {
+        PrintResult(Measure("buffer", "update-buffer", size, calls, [&]() { UpdateBufferInline(inlineSubmit, dstBuffer, srcData.data(), size); }, [](){}), &csv);
+      }
+
+      if(blocking.Reserve(size))
+        PrintResult(Measure("buffer", "staging-blocking", size, calls, [&]() { blocking.UpdateBuffer(dstBuffer, srcData.data(), size); }, [](){}), &csv);
+
+      PrintResult(Measure("buffer", "staging-async", size, calls, [&]() { async.UpdateBuffer(dstBuffer, 0, srcData.data(), size); async.Submit(); },
+                                                                  [&]() { async.WaitAll(); }), &csv);
+
+      PrintResult(Measure("buffer", "chunked", size, calls, [&]() { chunked.UpdateBuffer(dstBuffer, 0, srcData.data(), size); }, [](){}), &csv);
+
+      vkDestroyBuffer(ctx.device, dstBuffer, NULL);
+      vkFreeMemory   (ctx.device, dstMemory, NULL);
+
+      // images, RGBA8, as square as possible for the size
+      //
+      const int      width  = std::max(1, std::min(int(ctx.props.limits.maxImageDimension2D), int(std::sqrt(double(size/4)))));
+      const int      height = std::max(1, std::min(int(ctx.props.limits.maxImageDimension2D), int(size/4) / width));
+      const size_t   imgSize = size_t(width)*size_t(height)*4;
+
+      VkImage        dstImage    = VK_NULL_HANDLE;
+      VkDeviceMemory dstImageMem = VK_NULL_HANDLE;
+      if(!CreateImageWithMemory(ctx, width, height, &dstImage, &dstImageMem))
+        continue;
+
+      if(blocking.Reserve(imgSize))
+        PrintResult(Measure("image", "staging-blocking", imgSize, calls, [&]() { blocking.UpdateImage(dstImage, srcData.data(), width, height); }, [](){}), &csv);
+
+      PrintResult(Measure("image", "staging-async", imgSize, calls, [&]() { async.UpdateImage(dstImage, srcData.data(), width, height, 4); async.Submit(); },
+                                                                    [&]() { async.WaitAll(); }), &csv);
+
+      PrintResult(Measure("image", "chunked", imgSize, calls, [&]() { chunked.UpdateImage(dstImage, srcData.data(), width, height, 4); }, [](){}), &csv);
+
+      vkDestroyImage(ctx.device, dstImage, NULL);
+      vkFreeMemory  (ctx.device, dstImageMem, NULL);
+    }
+  }
+
+  vkDestroyDevice  (ctx.device, NULL);
+  vkDestroyInstance(ctx.instance, NULL);
+  return 0;
+}
@@ -9,6 +9,7 @@
 #include <cassert>
 
 #include <algorithm>
+#include <numeric>
 #ifdef WIN32
 #undef min
 #undef max
@@ -54,7 +55,205 @@ static void CreateStagingBuffer(VkDevice a_device, VkPhysicalDevice a_physDevice
   VK_CHECK_RESULT(vkBindBufferMemory(a_device, (*a_pBuffer), (*a_pBufferMemory), 0));
 }
 
-vk_copy::SimpleCopyHelper::SimpleCopyHelper(VkPhysicalDevice a_physicalDevice, VkDevice a_device, VkQueue a_transferQueue, size_t a_stagingBuffSize)
+// Regions are sorted by destination (keeping the order inside one destination) and packed to staging memory in packs;
+// each pack fits in a_maxPack bytes and is recorded with one vkCmdCopyBuffer per destination.
+//
+static std::vector<size_t> SortRegionsByDst(const vk_copy::BufferRegion* a_regions, size_t a_regionsNum)
+{
+  std::vector<size_t> order(a_regionsNum);
+  for(size_t i=0;i<a_regionsNum;i++)
+    order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [a_regions](size_t a, size_t b) { return a_regions[a].dst < a_regions[b].dst; });
+  return order;
+}
+
+static size_t PackEnd(const vk_copy::BufferRegion* a_regions, const std::vector<size_t>& a_order, size_t a_first, size_t a_maxPack, size_t* a_pPackSize)
+{
+  size_t packSize = 0;
+  size_t last     = a_first;
+  while(last < a_order.size())
+  {
+    const size_t regionSize = (a_regions[a_order[last]].size + 15) & ~size_t(15); // keep each region 16 bytes aligned in staging
+    if(packSize + regionSize > a_maxPack)
+      break;
+    packSize += regionSize;
+    last++;
+  }
+  (*a_pPackSize) = packSize;
+  return last;
+}
+
+static void CopyPackCmd(VkCommandBuffer a_cmdBuff, VkBuffer a_staging, char* a_mappedStaging, size_t a_stagingOffset,
+                        const vk_copy::BufferRegion* a_regions, const std::vector<size_t>& a_order, size_t a_first, size_t a_last)
+{
+  std::vector<VkBufferCopy> copies;
+  copies.reserve(a_last - a_first);
+
+  size_t offset = a_stagingOffset;
+  for(size_t i = a_first; i < a_last; i++)
+  {
+    const vk_copy::BufferRegion& region = a_regions[a_order[i]];
+    if(region.size != 0) // zero size copies are not allowed
+    {
+      memcpy(a_mappedStaging + offset, region.src, region.size);
+
+      VkBufferCopy copy = {};
+      copy.srcOffset    = offset;
+      copy.dstOffset    = region.dstOffset;
+      copy.size         = region.size;
+      copies.push_back(copy);
+      offset += (region.size + 15) & ~size_t(15);
+    }
+
+    if(!copies.empty() && (i + 1 == a_last || a_regions[a_order[i+1]].dst != region.dst))
+    {
+      vkCmdCopyBuffer(a_cmdBuff, a_staging, region.dst, uint32_t(copies.size()), copies.data());
+      copies.clear();
+    }
+  }
+}
+
+static inline size_t AlignUp(size_t a_size, size_t a_aligment) { return ((a_size + a_aligment - 1) / a_aligment) * a_aligment; }
+
+static const size_t MIN_FILL_SLICE = 256*1024; ///< smaller parts of staging memory are not worth to be filled by separate worker
+
+// Image subresources are split in pieces of whole rows of blocks (so that each piece fits in staging chunk);
+// pieces are packed to staging memory and each pack is recorded with single vkCmdCopyBufferToImage.
+//
+struct FormatBlock
+{
+  uint32_t width, height, bytes;
+  size_t   alignment;            ///< bufferOffset must be multiple of 4 and of block size
+};
+
+struct ImagePiece
+{
+  size_t   subres;     ///< index of subresource 
+  uint32_t firstRow;   ///< first row of blocks
+  uint32_t rowsNum;    ///< rows of blocks
+  size_t   srcOffset;  ///< offset in subresource source data
+  size_t   size;
+};
+
+static FormatBlock GetFormatBlock(VkFormat a_format)
+{
+  FormatBlock block;
+  if(!vk_utils::GetFormatBlockInfo(a_format, &block.width, &block.height, &block.bytes))
+    RUN_TIME_ERROR("[vk_copy::UpdateImageSubresources]: unsupported image format");
+  block.alignment = (16 % block.bytes == 0) ? 16 : std::lcm(size_t(block.bytes), size_t(4));
+  return block;
+}
+
+// Pieces are whole rows of at most a_maxPack - (alignment - 1) bytes, so that every piece fits in an empty pack of a_maxPack bytes 
+// after its size is aligned up (i.e. 12 byte texels are not multiple of 16 and rows of them are never multiple of the alignment).
+//
+static std::vector<ImagePiece> SplitSubresources(const vk_copy::ImageSubresourceData* a_subres, size_t a_subresNum, const FormatBlock& a_block, size_t a_maxPack)
+{
+  const size_t maxPiece = (a_maxPack > a_block.alignment) ? a_maxPack - (a_block.alignment - 1) : 0;
+
+  std::vector<ImagePiece> pieces;
+  pieces.reserve(a_subresNum);
+
+  for(size_t i=0;i<a_subresNum;i++)
+  {
+    const uint32_t blocksX  = (a_subres[i].width  + a_block.width  - 1) / a_block.width;
+    const uint32_t blocksY  = (a_subres[i].height + a_block.height - 1) / a_block.height;
+    const size_t   rowBytes = size_t(blocksX)*size_t(a_block.bytes);
+    if(rowBytes > maxPiece)
+      RUN_TIME_ERROR("[vk_copy::UpdateImageSubresources]: row of image does not fit in staging buffer, please allocate larger staging buffer");
+
+    const uint32_t rowsPerPiece = uint32_t(std::min(maxPiece / rowBytes, size_t(blocksY)));
+    for(uint32_t row = 0; row < blocksY; row += rowsPerPiece)
+    {
+      const uint32_t rowsNum = std::min(rowsPerPiece, blocksY - row);
+      pieces.push_back(ImagePiece{i, row, rowsNum, size_t(row)*rowBytes, size_t(rowsNum)*rowBytes});
+    }
+  }
+
+  return pieces;
+}
+
+static size_t ImagePackEnd(const std::vector<ImagePiece>& a_pieces, size_t a_first, size_t a_maxPack, size_t a_alignment, size_t* a_pPackSize)
+{
+  size_t packSize = 0;
+  size_t last     = a_first;
+  while(last < a_pieces.size() && packSize + AlignUp(a_pieces[last].size, a_alignment) <= a_maxPack)
+  {
+    packSize += AlignUp(a_pieces[last].size, a_alignment);
+    last++;
+  }
+  (*a_pPackSize) = packSize;
+  return last;
+}
+
+static void CopyImagePackCmd(VkCommandBuffer a_cmdBuff, VkBuffer a_staging, char* a_mappedStaging, size_t a_stagingOffset, VkImage a_image, VkImageAspectFlags a_aspect,
+                             const vk_copy::ImageSubresourceData* a_subres, const FormatBlock& a_block, const std::vector<ImagePiece>& a_pieces, size_t a_first, size_t a_last)
+{
+  std::vector<VkBufferImageCopy> regions(a_last - a_first);
+
+  size_t offset = a_stagingOffset;
+  for(size_t i = a_first; i < a_last; i++)
+  {
+    const ImagePiece&                    piece  = a_pieces[i];
+    const vk_copy::ImageSubresourceData& subres = a_subres[piece.subres];
+    memcpy(a_mappedStaging + offset, (const char*)subres.src + piece.srcOffset, piece.size);
+
+    const uint32_t firstTexelRow = piece.firstRow*a_block.height;
+
+    VkBufferImageCopy& region = regions[i - a_first];
+    region                   = {};
+    region.bufferOffset      = offset;
+    region.bufferRowLength   = 0;  // tightly packed
+    region.bufferImageHeight = 0;  //
+    region.imageOffset       = VkOffset3D{ 0, int32_t(firstTexelRow), 0 };
+    region.imageExtent       = VkExtent3D{ subres.width, std::min(piece.rowsNum*a_block.height, subres.height - firstTexelRow), 1 };
+    region.imageSubresource.aspectMask     = a_aspect;
+    region.imageSubresource.mipLevel       = subres.mipLevel;
+    region.imageSubresource.baseArrayLayer = subres.arrayLayer;
+    region.imageSubresource.layerCount     = 1;
+
+    offset += AlignUp(piece.size, a_block.alignment);
+  }
+
+  vkCmdCopyBufferToImage(a_cmdBuff, a_staging, a_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, uint32_t(regions.size()), regions.data());
+}
+
+static VkImageSubresourceRange WholeImageRange(VkFormat a_format, uint32_t a_mipLevels, uint32_t a_arrayLayers)
+{
+  VkImageSubresourceRange range = {};
+  range.aspectMask     = vk_utils::IsDepthFormat(a_format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+  range.baseMipLevel   = 0;
+  range.levelCount     = a_mipLevels;
+  range.baseArrayLayer = 0;
+  range.layerCount     = a_arrayLayers;
+  return range;
+}
+
+static void ImageToTransferDstCmd(VkCommandBuffer a_cmdBuff, VkImage a_image, const VkImageSubresourceRange& a_range)
+{
+  VkImageMemoryBarrier imgBar = {};
+  imgBar.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  imgBar.pNext               = nullptr;
+  imgBar.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imgBar.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imgBar.srcAccessMask       = 0;
+  imgBar.dstAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+  imgBar.oldLayout           = VK_IMAGE_LAYOUT_UNDEFINED;
+  imgBar.newLayout           = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  imgBar.image               = a_image;
+  imgBar.subresourceRange    = a_range;
+
+  vkCmdPipelineBarrier(a_cmdBuff,
+                       VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       0,
+                       0, nullptr,
+                       0, nullptr,
+                       1, &imgBar);
+}
+
+vk_copy::SimpleCopyHelper::SimpleCopyHelper(VkPhysicalDevice a_physicalDevice, VkDevice a_device, VkQueue a_transferQueue, size_t a_stagingBuffSize,
+                                            uint32_t a_queueFID)
 {
   physDev = a_physicalDevice;
   dev     = a_device;
@@ -63,7 +262,19 @@ vk_copy::SimpleCopyHelper::SimpleCopyHelper(VkPhysicalDevice a_physicalDevice, V
   VkCommandPoolCreateInfo poolInfo = {};
   poolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
   poolInfo.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-  poolInfo.queueFamilyIndex = vk_utils::GetQueueFamilyIndex(a_physicalDevice, VK_QUEUE_TRANSFER_BIT);
+  const uint32_t queueFID  = (a_queueFID == VK_QUEUE_FAMILY_IGNORED) ? vk_utils::GetQueueFamilyIndex(a_physicalDevice, VK_QUEUE_TRANSFER_BIT) : a_queueFID;
+  poolInfo.queueFamilyIndex = queueFID;
+
+  // there is no ownership transfer here, uploaded resources stay owned by the family of a_transferQueue; 
+  // transfer only family can't use them, so it would be a silent error to accept it
+  //
+  uint32_t familiesNum = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(a_physicalDevice, &familiesNum, nullptr);
+  std::vector<VkQueueFamilyProperties> families(familiesNum);
+  vkGetPhysicalDeviceQueueFamilyProperties(a_physicalDevice, &familiesNum, families.data());
+  if(queueFID >= familiesNum || (families[queueFID].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == 0)
+    throw std::runtime_error("[vk_utils::SimpleCopyHelper::SimpleCopyHelper]: dedicated transfer queue family is not supported, use AsyncCopyHelper with a_dstQueueFID!");
+
   if (vkCreateCommandPool(a_device, &poolInfo, nullptr, &cmdPool) != VK_SUCCESS)
     throw std::runtime_error("[vk_utils::SimpleCopyHelper::SimpleCopyHelper]: failed to create command pool!");
 
@@ -75,21 +286,60 @@ vk_copy::SimpleCopyHelper::SimpleCopyHelper(VkPhysicalDevice a_physicalDevice, V
   if (vkAllocateCommandBuffers(a_device, &allocInfo, &cmdBuff) != VK_SUCCESS)
     throw std::runtime_error("[CreateCommandPoolAndBuffers]: failed to allocate command buffers!");  
 
+  submitCtx = std::make_unique<vk_utils::SubmitContext>(a_physicalDevice, a_device, a_transferQueue, queueFID, STAGING_PARTS + 1);
+  for(int i=0;i<STAGING_PARTS;i++)
+    partTicket[i] = 0;
+
   CreateStagingBuffer(a_device, a_physicalDevice, a_stagingBuffSize, 
                       &stagingBuff, &stagingBuffMemory);
 
   stagingSize = a_stagingBuffSize;
+  partSize    = (stagingSize / STAGING_PARTS) & ~size_t(15); // keep chunks offsets aligned for both buffers and any texel size up to 16 bytes
+
+  if(partSize == 0)
+    throw std::runtime_error("[vk_utils::SimpleCopyHelper::SimpleCopyHelper]: too small staging buffer!");
+
+  void* mappedMemory = nullptr;
+  VK_CHECK_RESULT(vkMapMemory(dev, stagingBuffMemory, 0, stagingSize, 0, &mappedMemory));
+  mappedStaging = (char*)mappedMemory;
 }
 
 vk_copy::SimpleCopyHelper::~SimpleCopyHelper()
 {
+  WaitAllParts();
+
+  vkUnmapMemory  (dev, stagingBuffMemory);
   vkDestroyBuffer(dev, stagingBuff, NULL);
   vkFreeMemory   (dev, stagingBuffMemory, NULL);
 
+  submitCtx = nullptr;
   vkFreeCommandBuffers(dev, cmdPool, 1, &cmdBuff);
   vkDestroyCommandPool(dev, cmdPool, nullptr);
 }
 
+VkCommandBuffer vk_copy::SimpleCopyHelper::BeginPart(int a_part)
+{
+  // the part of staging buffer could still be read by previous chunk
+  //
+  if(partTicket[a_part] != 0)
+  {
+    submitCtx->Wait(partTicket[a_part]);
+    partTicket[a_part] = 0;
+  }
+  return submitCtx->Begin();
+}
+
+void vk_copy::SimpleCopyHelper::SubmitPart(int a_part, VkCommandBuffer a_cmdPart)
+{
+  partTicket[a_part] = submitCtx->Submit(a_cmdPart);
+}
+
+void vk_copy::SimpleCopyHelper::WaitAllParts()
+{
+  submitCtx->WaitAll();
+  for(int i=0;i<STAGING_PARTS;i++)
+    partTicket[i] = 0;
+}
 
 void vk_copy::SimpleCopyHelper::UpdateBuffer(VkBuffer a_dst, size_t a_dstOffset, const void* a_src, size_t a_size)
 {
@@ -99,135 +349,1255 @@ void vk_copy::SimpleCopyHelper::UpdateBuffer(VkBuffer a_dst, size_t a_dstOffset,
   if (a_size <= 65536)
   //if(false)
   {
-    VkCommandBufferBeginInfo beginInfo = {};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    VkCommandBuffer cmdSmall = submitCtx->Begin(); // no fence creation per update, command buffers and fences are recycled
+    vkCmdUpdateBuffer(cmdSmall, a_dst, a_dstOffset, a_size, a_src);
+    submitCtx->Wait(submitCtx->Submit(cmdSmall));
+    return;
+  }
+
+  // split input in chunks of partSize; while device copies chunk from one part of staging buffer, we fill the other one
+  //
+  const char* src  = (const char*)a_src;
+  int         part = 0;
+
+  for(size_t done = 0; done < a_size; done += partSize, part = (part + 1) % STAGING_PARTS)
+  {
+    const size_t chunkSize = std::min(partSize, a_size - done);
+    VkCommandBuffer cmdPart = BeginPart(part);
+
+    memcpy(mappedStaging + part*partSize, src + done, chunkSize);
+
+    VkBufferCopy region0 = {};
+    region0.srcOffset    = part*partSize;
+    region0.dstOffset    = a_dstOffset + done;
+    region0.size         = chunkSize;
+    vkCmdCopyBuffer(cmdPart, stagingBuff, a_dst, 1, &region0);
 
-    vkResetCommandBuffer(cmdBuff, 0);
-    vkBeginCommandBuffer(cmdBuff, &beginInfo);
-    vkCmdUpdateBuffer   (cmdBuff, a_dst, a_dstOffset, a_size, a_src);
-    vkEndCommandBuffer  (cmdBuff);
+    SubmitPart(part, cmdPart);
   }
-  else
+
+  WaitAllParts();
+}
+
+void vk_copy::SimpleCopyHelper::UpdateBuffers(const BufferRegion* a_regions, size_t a_regionsNum)
+{
+  const std::vector<size_t> order = SortRegionsByDst(a_regions, a_regionsNum);
+
+  int    part  = 0;
+  size_t first = 0;
+  while(first < order.size())
   {
-    if (a_size > stagingSize)
+    const BufferRegion& region = a_regions[order[first]];
+    assert(region.dstOffset % 4 == 0);
+    assert(region.size      % 4 == 0);
+
+    size_t packSize = 0;
+    const size_t last = PackEnd(a_regions, order, first, partSize, &packSize);
+    if(last == first)                                                         // region is larger than the part, it goes in chunks
     {
-      std::stringstream strOut;
-      strOut << "[vk_utils::SimpleCopyHelper::UpdateBuffer]: too large input size " << a_size << ", please allocate larger staging buff";
-      throw std::runtime_error(strOut.str().c_str());
+      UpdateBuffer(region.dst, region.dstOffset, region.src, region.size);
+      first++;
+      continue;
     }
 
-    void* mappedMemory = nullptr;
-    vkMapMemory(dev, stagingBuffMemory, 0, a_size, 0, &mappedMemory);
-    memcpy(mappedMemory, a_src, a_size);
-    vkUnmapMemory(dev, stagingBuffMemory);
+    VkCommandBuffer cmdPart = BeginPart(part);
+    CopyPackCmd(cmdPart, stagingBuff, mappedStaging, part*partSize, a_regions, order, first, last);
+    SubmitPart(part, cmdPart);
 
-    VkCommandBufferBeginInfo beginInfo = {};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    part  = (part + 1) % STAGING_PARTS;
+    first = last;
+  }
 
-    vkResetCommandBuffer(cmdBuff, 0);
-    vkBeginCommandBuffer(cmdBuff, &beginInfo);
-     
-    VkBufferCopy region0 = {};
-    region0.srcOffset    = 0;
-    region0.dstOffset    = a_dstOffset;
-    region0.size         = a_size;
+  WaitAllParts();
+}
+
+void vk_copy::SimpleCopyHelper::UpdateImageSubresources(VkImage a_image, VkFormat a_format, const ImageSubresourceData* a_subres, size_t a_subresNum, 
+                                                        uint32_t a_mipLevels, uint32_t a_arrayLayers)
+{
+  const FormatBlock             block   = GetFormatBlock(a_format);
+  const size_t                  maxPack = partSize - (block.alignment - 1); // part start is aligned up, by (alignment - 1) at most
+  const std::vector<ImagePiece> pieces  = SplitSubresources(a_subres, a_subresNum, block, maxPack);
+  const VkImageSubresourceRange range   = WholeImageRange(a_format, a_mipLevels, a_arrayLayers);
+
+  int    part  = 0;
+  size_t first = 0;
+  while(first < pieces.size())
+  {
+    size_t packSize = 0;
+    const size_t last = ImagePackEnd(pieces, first, maxPack, block.alignment, &packSize);
+    assert(last > first);
+
+    VkCommandBuffer cmdPart = BeginPart(part);
+    if(first == 0)
+      ImageToTransferDstCmd(cmdPart, a_image, range); // parts go to the same queue, so the barrier covers all of them
 
-    vkCmdCopyBuffer(cmdBuff, stagingBuff, a_dst, 1, &region0);
+    CopyImagePackCmd(cmdPart, stagingBuff, mappedStaging, AlignUp(part*partSize, block.alignment), a_image, range.aspectMask, 
+                     a_subres, block, pieces, first, last);
+    SubmitPart(part, cmdPart);
 
-    vkEndCommandBuffer(cmdBuff);
+    part  = (part + 1) % STAGING_PARTS;
+    first = last;
   }
 
-  vk_utils::ExecuteCommandBufferNow(cmdBuff, queue, dev);
+  WaitAllParts();
 }
 
 void vk_copy::SimpleCopyHelper::UpdateImage(VkImage a_image, const void* a_src, int a_width, int a_height, int a_bpp)
 {
-  size_t a_size = a_width * a_height * a_bpp;
+  const size_t rowPitch = size_t(a_width) * size_t(a_bpp);
+  const char*  src      = (const char*)a_src;
+
+  VkImageSubresourceLayers shittylayers = {};
+  shittylayers.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+  shittylayers.mipLevel       = 0;
+  shittylayers.baseArrayLayer = 0;
+  shittylayers.layerCount     = 1;
+
+  // Split image in chunks of whole rows if a row fits in the part of staging buffer, otherwise split each row in pieces. 
+  // Layout transition is recorded in the first chunk only; chunks are submitted to the same queue, so the barrier covers all of them.
+  //
+  const int rowsPerChunk = int(std::min(partSize / rowPitch, size_t(a_height)));
+  const int pixPerChunk  = (rowsPerChunk == 0) ? int(partSize / size_t(a_bpp)) : a_width;
+
+  int part = 0;
+  for(int y = 0; y < a_height; y += std::max(rowsPerChunk, 1))
+  {
+    const int rowsNum = std::max(std::min(rowsPerChunk, a_height - y), 1);
+
+    for(int x = 0; x < a_width; x += pixPerChunk, part = (part + 1) % STAGING_PARTS)
+    {
+      const int    pixNum    = std::min(pixPerChunk, a_width - x);
+      const size_t chunkSize = size_t(pixNum) * size_t(a_bpp);
+      VkCommandBuffer cmdPart = BeginPart(part);
+
+      if(rowsPerChunk != 0)
+        memcpy(mappedStaging + part*partSize, src + size_t(y)*rowPitch, rowPitch*size_t(rowsNum));
+      else
+        memcpy(mappedStaging + part*partSize, src + size_t(y)*rowPitch + size_t(x)*size_t(a_bpp), chunkSize);
+
+      if(y == 0 && x == 0)
+      {
+        VkImageMemoryBarrier imgBar = {};
+        imgBar.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imgBar.pNext               = nullptr;
+        imgBar.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imgBar.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  
+        imgBar.srcAccessMask = 0;
+        imgBar.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        imgBar.oldLayout     = VK_IMAGE_LAYOUT_UNDEFINED;
+        imgBar.newLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        imgBar.image         = a_image;
+  
+        imgBar.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        imgBar.subresourceRange.baseMipLevel   = 0;
+        imgBar.subresourceRange.levelCount     = 1;
+        imgBar.subresourceRange.baseArrayLayer = 0;
+        imgBar.subresourceRange.layerCount     = 1;
+  
+        vkCmdPipelineBarrier(cmdPart,
+                             VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             0,
+                             0, nullptr,
+                             0, nullptr,
+                             1, &imgBar);
+      }
+
+      VkBufferImageCopy region = {};
+      region.bufferOffset      = part*partSize;
+      region.bufferRowLength   = uint32_t(pixNum);
+      region.bufferImageHeight = uint32_t(rowsNum);
+      region.imageExtent       = VkExtent3D{ uint32_t(pixNum), uint32_t(rowsNum), 1 };
+      region.imageOffset       = VkOffset3D{ x, y, 0 };
+      region.imageSubresource  = shittylayers;
+
+      vkCmdCopyBufferToImage(cmdPart, stagingBuff, a_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+      SubmitPart(part, cmdPart);
+    }
+  }
+
+  WaitAllParts();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+vk_copy::WorkerPool::WorkerPool(int a_threadsNum) : job(nullptr), tasksNum(0), nextTask(0), generation(0), doneWorkers(0), stop(false)
+{
+  if(a_threadsNum <= 0)
+    a_threadsNum = std::max(1, int(std::thread::hardware_concurrency()));
+
+  for(int i=1;i<a_threadsNum;i++) // calling thread is the one more worker
+    threads.emplace_back(&WorkerPool::WorkerLoop, this);
+}
+
+vk_copy::WorkerPool::~WorkerPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+  }
+  wakeUp.notify_all();
+  for(auto& thread : threads)
+    thread.join();
+}
+
+void vk_copy::WorkerPool::RunTasks()
+{
+  for(size_t i = nextTask.fetch_add(1); i < tasksNum; i = nextTask.fetch_add(1))
+    (*job)(i);
+}
+
+void vk_copy::WorkerPool::WorkerLoop()
+{
+  uint64_t seenGeneration = 0;
+  while(true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wakeUp.wait(lock, [&]() { return stop || generation != seenGeneration; });
+      if(stop)
+        return;
+      seenGeneration = generation;
+    }
+
+    RunTasks();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      doneWorkers++;
+    }
+    finished.notify_one();
+  }
+}
+
+void vk_copy::WorkerPool::ParallelFor(size_t a_tasksNum, const std::function<void(size_t)>& a_func)
+{
+  if(threads.empty() || a_tasksNum <= 1)
+  {
+    for(size_t i=0;i<a_tasksNum;i++)
+      a_func(i);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    job         = &a_func;
+    tasksNum    = a_tasksNum;
+    nextTask    = 0;
+    doneWorkers = 0;
+    generation++;
+  }
+  wakeUp.notify_all();
+
+  RunTasks();
+
+  // every worker takes part in each job, so the next ParallelFor never starts while some worker still sees the old one
+  //
+  std::unique_lock<std::mutex> lock(mutex);
+  finished.wait(lock, [&]() { return doneWorkers == int(threads.size()); });
+  job = nullptr;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+vk_copy::AsyncCopyHelper::AsyncCopyHelper(VkPhysicalDevice a_physicalDevice, VkDevice a_device, VkQueue a_transferQueue, uint32_t a_queueFID, size_t a_ringSize, int a_maxBatches,
+                                          uint32_t a_dstQueueFID)
+{
+  assert(a_maxBatches > 0);
+
+  physDev     = a_physicalDevice;
+  dev         = a_device;
+  queue       = a_transferQueue;
+  queueFID    = a_queueFID;
+  dstQueueFID = (a_dstQueueFID == VK_QUEUE_FAMILY_IGNORED) ? a_queueFID : a_dstQueueFID;
+
+  VkCommandPoolCreateInfo poolInfo = {};
+  poolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  poolInfo.queueFamilyIndex = a_queueFID;
+  if (vkCreateCommandPool(a_device, &poolInfo, nullptr, &cmdPool) != VK_SUCCESS)
+    throw std::runtime_error("[vk_copy::AsyncCopyHelper::AsyncCopyHelper]: failed to create command pool!");
+
+  std::vector<VkCommandBuffer> cmdBuffs(a_maxBatches);
+
+  VkCommandBufferAllocateInfo allocInfo = {};
+  allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.commandPool        = cmdPool;
+  allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandBufferCount = uint32_t(a_maxBatches);
+  if (vkAllocateCommandBuffers(a_device, &allocInfo, cmdBuffs.data()) != VK_SUCCESS)
+    throw std::runtime_error("[vk_copy::AsyncCopyHelper::AsyncCopyHelper]: failed to allocate command buffers!");
 
+  VkFenceCreateInfo fenceCreateInfo = {};
+  fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fenceCreateInfo.flags = 0;
+
+  VkSemaphoreCreateInfo semaphoreInfo = {};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+  batches.resize(a_maxBatches);
+  for(int i=0;i<a_maxBatches;i++)
+  {
+    batches[i].cmdBuff   = cmdBuffs[i];
+    batches[i].ticket    = 0;
+    batches[i].ringBytes = 0;
+    VK_CHECK_RESULT(vkCreateFence(a_device, &fenceCreateInfo, NULL, &batches[i].fence));
+    VK_CHECK_RESULT(vkCreateSemaphore(a_device, &semaphoreInfo, NULL, &batches[i].semaphore));
+  }
+
+  CreateStagingBuffer(a_device, a_physicalDevice, a_ringSize, 
+                      &stagingBuff, &stagingBuffMemory);
+
+  // persistent mapping, memory is coherent, so vkQueueSubmit makes our writes visible to device without any flush
+  //
   void* mappedMemory = nullptr;
-  vkMapMemory(dev, stagingBuffMemory, 0, a_size, 0, &mappedMemory);
-  memcpy(mappedMemory, a_src, a_size);
-  vkUnmapMemory(dev, stagingBuffMemory);
+  VK_CHECK_RESULT(vkMapMemory(dev, stagingBuffMemory, 0, a_ringSize, 0, &mappedMemory));
+  mappedRing = (char*)mappedMemory;
 
+  directMemType   = vk_utils::FindDirectWriteMemoryType(~0u, a_physicalDevice);
 
-  VkCommandBufferBeginInfo beginInfo = {};
-  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  ringSize        = a_ringSize;
+  ringHead        = 0;
+  ringUsed        = 0;
+  currBatch       = 0;
+  currBatchOpen   = false;
+  oldestBatch     = 0;
+  inFlight        = 0;
+  lastTicket      = 0;
+  completedTicket = 0;
+  handoffTicket   = 0;
+}
+
+vk_copy::AsyncCopyHelper::~AsyncCopyHelper()
+{
+  WaitAll(); // device must not read the ring when we destroy it
 
-  vkResetCommandBuffer(cmdBuff, 0);
-  vkBeginCommandBuffer(cmdBuff, &beginInfo);
+  for(const auto& alloc : directAllocs)
+    vkFreeMemory(dev, alloc.memory, NULL);
 
-  VkImageMemoryBarrier imgBar = {};
+  vkUnmapMemory  (dev, stagingBuffMemory);
+  vkDestroyBuffer(dev, stagingBuff, NULL);
+  vkFreeMemory   (dev, stagingBuffMemory, NULL);
+
+  for(auto& batch : batches)
   {
-    imgBar.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    imgBar.pNext = nullptr;
-    imgBar.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    imgBar.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-
-    imgBar.srcAccessMask = 0;
-    imgBar.dstAccessMask = 0;
-    imgBar.oldLayout     = VK_IMAGE_LAYOUT_UNDEFINED;
-    imgBar.newLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    imgBar.image         = a_image;
-
-    imgBar.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-    imgBar.subresourceRange.baseMipLevel   = 0;
-    imgBar.subresourceRange.levelCount     = 1;
-    imgBar.subresourceRange.baseArrayLayer = 0;
-    imgBar.subresourceRange.layerCount     = 1;
-  };
+    vkDestroyFence      (dev, batch.fence, NULL);
+    vkDestroySemaphore  (dev, batch.semaphore, NULL);
+    vkFreeCommandBuffers(dev, cmdPool, 1, &batch.cmdBuff);
+  }
+  vkDestroyCommandPool(dev, cmdPool, nullptr);
+}
 
-  vkCmdPipelineBarrier(cmdBuff,
-                       VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                       VK_PIPELINE_STAGE_TRANSFER_BIT,
-                       0,
-                       0, nullptr,
-                       0, nullptr,
-                       1, &imgBar);
+VkCommandBuffer vk_copy::AsyncCopyHelper::CmdBuffer()
+{
+  if(!currBatchOpen)
+  {
+    if(inFlight == int(batches.size()))
+      RetireOldest();
 
+    currBatch = (oldestBatch + inFlight) % int(batches.size());
 
-  VkImageSubresourceLayers shittylayers = {};
-  shittylayers.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-  shittylayers.mipLevel       = 0;
-  shittylayers.baseArrayLayer = 0;
-  shittylayers.layerCount     = 1;
+    Batch& batch    = batches[currBatch];
+    batch.ticket    = 0;
+    batch.ringBytes = 0;
 
-  VkBufferImageCopy wholeRegion = {};
-  wholeRegion.bufferOffset      = 0;
-  wholeRegion.bufferRowLength   = uint32_t(a_width);
-  wholeRegion.bufferImageHeight = uint32_t(a_height);
-  wholeRegion.imageExtent       = VkExtent3D{ uint32_t(a_width), uint32_t(a_height), 1 };
-  wholeRegion.imageOffset       = VkOffset3D{ 0,0,0 };
-  wholeRegion.imageSubresource  = shittylayers;
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-  vkCmdCopyBufferToImage(cmdBuff, stagingBuff, a_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &wholeRegion);
+    vkResetCommandBuffer(batch.cmdBuff, 0);
+    vkBeginCommandBuffer(batch.cmdBuff, &beginInfo);
+    currBatchOpen = true;
+  }
 
-  /*
-  imgBar.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-  imgBar.pNext = nullptr;
-  imgBar.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  imgBar.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  return batches[currBatch].cmdBuff;
+}
 
-  imgBar.srcAccessMask = 0;
-  imgBar.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  imgBar.oldLayout     = VK_IMAGE_LAYOUT_UNDEFINED;
-  imgBar.newLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-  imgBar.image         = a_image;
+uint64_t vk_copy::AsyncCopyHelper::Submit()
+{
+  return SubmitBatch(false);
+}
 
-  imgBar.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-  imgBar.subresourceRange.baseMipLevel   = 0;
-  imgBar.subresourceRange.levelCount     = 1;
-  imgBar.subresourceRange.baseArrayLayer = 0;
-  imgBar.subresourceRange.layerCount     = 1;
- 
-  vkCmdPipelineBarrier(cmdBuff,
-                       VK_PIPELINE_STAGE_TRANSFER_BIT,
-                       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                       0,
-                       0, nullptr,
-                       0, nullptr,
-                       1, &imgBar);  
-  */
-  vkEndCommandBuffer(cmdBuff);
+uint64_t vk_copy::AsyncCopyHelper::SubmitBatch(bool a_signalSemaphore)
+{
+  if(!currBatchOpen)
+    return lastTicket;
+
+  Batch& batch = batches[currBatch];
+  vkEndCommandBuffer(batch.cmdBuff);
+
+  VkSubmitInfo submitInfo         = {};
+  submitInfo.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount   = 1;
+  submitInfo.pCommandBuffers      = &batch.cmdBuff;
+  submitInfo.signalSemaphoreCount = a_signalSemaphore ? 1 : 0;
+  submitInfo.pSignalSemaphores    = &batch.semaphore;
+
+  VK_CHECK_RESULT(vkResetFences(dev, 1, &batch.fence));
+  VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, batch.fence));
+
+  batch.ticket  = ++lastTicket;
+  currBatchOpen = false;
+  inFlight++;
+
+  return batch.ticket;
+}
+
+void vk_copy::AsyncCopyHelper::RetireOldest()
+{
+  assert(inFlight > 0);
+
+  Batch& batch = batches[oldestBatch];
+  VK_CHECK_RESULT(vkWaitForFences(dev, 1, &batch.fence, VK_TRUE, 100000000000));
+
+  ringUsed       -= batch.ringBytes; // batches are retired in the same order they took the ring space
+  completedTicket = batch.ticket;
+  oldestBatch     = (oldestBatch + 1) % int(batches.size());
+  inFlight--;
+}
+
+void vk_copy::AsyncCopyHelper::RetireCompleted()
+{
+  while(inFlight > 0 && vkGetFenceStatus(dev, batches[oldestBatch].fence) == VK_SUCCESS)
+    RetireOldest();
+}
 
-  vk_utils::ExecuteCommandBufferNow(cmdBuff, queue, dev);
-}
\ No newline at end of file
+bool vk_copy::AsyncCopyHelper::IsComplete(uint64_t a_ticket)
+{
+  if(a_ticket > completedTicket)
+    RetireCompleted();
+  return (a_ticket <= completedTicket);
+}
+
+void vk_copy::AsyncCopyHelper::Wait(uint64_t a_ticket)
+{
+  assert(a_ticket <= lastTicket); // you should Submit() before waiting
+  while(completedTicket < a_ticket && inFlight > 0)
+    RetireOldest();
+}
+
+size_t vk_copy::AsyncCopyHelper::AllocateInRing(size_t a_size, size_t a_alignment)
+{
+  if (a_size > ringSize)
+  {
+    std::stringstream strOut;
+    strOut << "[vk_copy::AsyncCopyHelper::AllocateInRing]: too large input size " << a_size << ", please allocate larger staging ring";
+    throw std::runtime_error(strOut.str().c_str());
+  }
+
+  while(true)
+  {
+    if(ringUsed == 0)
+      ringHead = 0;
+
+    size_t offset = AlignUp(ringHead, a_alignment);
+    size_t waste  = offset - ringHead;
+    if(offset + a_size > ringSize) // wrap around; the tail of the ring is wasted until this batch is retired
+    {
+      offset = 0;
+      waste  = ringSize - ringHead;
+    }
+
+    if(ringUsed + waste + a_size <= ringSize)
+    {
+      CmdBuffer(); // open batch if needed, it may retire old batches but that only frees space
+      batches[currBatch].ringBytes += waste + a_size;
+      ringUsed += waste + a_size;
+      ringHead  = offset + a_size;
+      return offset;
+    }
+
+    // not enough space: wait for the oldest batch or submit current one if only it holds the ring
+    //
+    if(inFlight > 0)
+      RetireOldest();
+    else
+      Submit();
+  }
+}
+
+void vk_copy::AsyncCopyHelper::UpdateBuffer(VkBuffer a_dst, size_t a_dstOffset, const void* a_src, size_t a_size)
+{
+  assert(a_dstOffset % 4 == 0);
+  assert(a_size      % 4 == 0);
+
+  if(workers != nullptr && a_size >= 2*MIN_FILL_SLICE) // large data is copied to the ring by several threads
+  {
+    const UploadItem item = {a_dst, a_dstOffset, a_size, a_src};
+    UpdateBuffers(&item, 1);
+    return;
+  }
+
+  TouchBuffer(a_dst);
+
+  // data larger than a half of the ring goes in chunks, so the device copies previous chunk while we fill the next one
+  //
+  const size_t maxChunk = (ringSize / 2) & ~size_t(15);
+  const char*  src      = (const char*)a_src;
+
+  for(size_t done = 0; done < a_size; done += maxChunk)
+  {
+    const size_t chunkSize = std::min(maxChunk, a_size - done);
+    const size_t offset    = AllocateInRing(chunkSize, 4);
+    memcpy(mappedRing + offset, src + done, chunkSize);
+
+    VkBufferCopy region0 = {};
+    region0.srcOffset    = offset;
+    region0.dstOffset    = a_dstOffset + done;
+    region0.size         = chunkSize;
+
+    vkCmdCopyBuffer(CmdBuffer(), stagingBuff, a_dst, 1, &region0);
+  }
+}
+
+void vk_copy::AsyncCopyHelper::UpdateBuffers(const BufferRegion* a_regions, size_t a_regionsNum)
+{
+  if(workers != nullptr)
+  {
+    std::vector<UploadItem> items(a_regionsNum);
+    for(size_t i=0;i<a_regionsNum;i++)
+      items[i] = UploadItem{a_regions[i].dst, a_regions[i].dstOffset, a_regions[i].size, a_regions[i].src};
+    UpdateBuffers(items.data(), items.size());
+    return;
+  }
+
+  const std::vector<size_t> order    = SortRegionsByDst(a_regions, a_regionsNum);
+  const size_t              maxChunk = (ringSize / 2) & ~size_t(15);
+
+  size_t first = 0;
+  while(first < order.size())
+  {
+    const BufferRegion& region = a_regions[order[first]];
+    assert(region.dstOffset % 4 == 0);
+    assert(region.size      % 4 == 0);
+
+    size_t packSize = 0;
+    const size_t last = PackEnd(a_regions, order, first, maxChunk, &packSize);
+    if(last == first)                                                         // region is larger than the chunk, it goes in chunks
+    {
+      UpdateBuffer(region.dst, region.dstOffset, region.src, region.size);
+      first++;
+      continue;
+    }
+
+    for(size_t i = first; i < last; i++)
+      TouchBuffer(a_regions[order[i]].dst);
+
+    const size_t offset = AllocateInRing(packSize, 16); // may submit current batch, so take command buffer after it
+    CopyPackCmd(CmdBuffer(), stagingBuff, mappedRing, offset, a_regions, order, first, last);
+    first = last;
+  }
+}
+
+void vk_copy::AsyncCopyHelper::UpdateBuffers(const UploadItem* a_items, size_t a_itemsNum)
+{
+  // items are sorted by destination and split in pieces of a half of the ring at most; pieces are packed to the ring,
+  // each pack is filled (possibly by several threads) and copied with single vkCmdCopyBuffer per destination
+  //
+  std::vector<size_t> order(a_itemsNum);
+  for(size_t i=0;i<a_itemsNum;i++)
+    order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [a_items](size_t a, size_t b) { return a_items[a].dst < a_items[b].dst; });
+
+  const size_t maxChunk = (ringSize / 2) & ~size_t(15);
+
+  std::vector<FillPiece> pieces;
+  pieces.reserve(a_itemsNum);
+  for(size_t id : order)
+  {
+    const UploadItem& item = a_items[id];
+    assert(item.dstOffset   % 4 == 0);
+    assert(item.size        % 4 == 0);
+    assert(item.granularity % 4 == 0 && item.granularity != 0 && item.granularity <= maxChunk);
+
+    TouchBuffer(item.dst);
+
+    const size_t maxPiece = (maxChunk / item.granularity) * item.granularity;
+    for(size_t done = 0; done < item.size; done += maxPiece) // zero size items have no pieces, zero size copies are not allowed
+      pieces.push_back(FillPiece{id, done, std::min(maxPiece, item.size - done)});
+  }
+
+  std::vector<VkBufferCopy> copies;
+  size_t first = 0;
+  while(first < pieces.size())
+  {
+    size_t packSize = 0;
+    size_t last     = first;
+    while(last < pieces.size() && packSize + AlignUp(pieces[last].size, 16) <= maxChunk)
+      packSize += AlignUp(pieces[last++].size, 16);
+
+    const size_t offset = AllocateInRing(packSize, 16); // may submit current batch, so take command buffer after it
+    FillRing(a_items, pieces.data() + first, last - first, offset);
+
+    size_t ringOffset = offset;
+    for(size_t i = first; i < last; i++)
+    {
+      const UploadItem& item = a_items[pieces[i].item];
+      copies.push_back(VkBufferCopy{ringOffset, item.dstOffset + pieces[i].begin, pieces[i].size});
+      ringOffset += AlignUp(pieces[i].size, 16);
+
+      if(i + 1 == last || a_items[pieces[i+1].item].dst != item.dst)
+      {
+        vkCmdCopyBuffer(CmdBuffer(), stagingBuff, item.dst, uint32_t(copies.size()), copies.data());
+        copies.clear();
+      }
+    }
+    first = last;
+  }
+}
+
+void vk_copy::AsyncCopyHelper::FillRing(const UploadItem* a_items, const FillPiece* a_pieces, size_t a_piecesNum, size_t a_ringOffset)
+{
+  // large pieces are split in slices, so that all threads get the work; each slice goes to its own part of the ring
+  //
+  struct Slice
+  {
+    size_t item;
+    size_t begin;
+    size_t size;
+    size_t ringOffset;
+  };
+
+  const size_t threadsNum = (workers != nullptr) ? size_t(workers->ThreadsNum()) : 1;
+
+  std::vector<Slice> slices;
+  slices.reserve(a_piecesNum);
+
+  size_t ringOffset = a_ringOffset;
+  for(size_t i=0;i<a_piecesNum;i++)
+  {
+    const FillPiece& piece     = a_pieces[i];
+    const size_t     sliceSize = AlignUp(std::max(MIN_FILL_SLICE, piece.size / threadsNum), a_items[piece.item].granularity);
+    for(size_t done = 0; done < piece.size; done += sliceSize)
+      slices.push_back(Slice{piece.item, piece.begin + done, std::min(sliceSize, piece.size - done), ringOffset + done});
+    ringOffset += AlignUp(piece.size, 16);
+  }
+
+  auto fillSlice = [this, a_items, &slices](size_t a_sliceId)
+  {
+    const Slice&      slice = slices[a_sliceId];
+    const UploadItem& item  = a_items[slice.item];
+    if(item.encode)
+      item.encode(slice.begin, slice.size, mappedRing + slice.ringOffset);
+    else
+      memcpy(mappedRing + slice.ringOffset, (const char*)item.src + slice.begin, slice.size);
+  };
+
+  if(workers != nullptr)
+    workers->ParallelFor(slices.size(), fillSlice);
+  else
+  {
+    for(size_t i=0;i<slices.size();i++)
+      fillSlice(i);
+  }
+}
+
+void vk_copy::AsyncCopyHelper::SetFillThreads(int a_threadsNum)
+{
+  if(a_threadsNum == 1)
+    workers = nullptr;
+  else
+    workers = std::make_unique<WorkerPool>(a_threadsNum);
+}
+
+void vk_copy::AsyncCopyHelper::UpdateImageSubresources(VkImage a_image, VkFormat a_format, const ImageSubresourceData* a_subres, size_t a_subresNum, 
+                                                       uint32_t a_mipLevels, uint32_t a_arrayLayers)
+{
+  const size_t maxChunk = (ringSize / 2) & ~size_t(15);
+
+  const FormatBlock             block  = GetFormatBlock(a_format);
+  const std::vector<ImagePiece> pieces = SplitSubresources(a_subres, a_subresNum, block, maxChunk); // ring allocation aligns pack start by itself
+  const VkImageSubresourceRange range  = WholeImageRange(a_format, a_mipLevels, a_arrayLayers);
+
+  ImageToTransferDstCmd(CmdBuffer(), a_image, range);
+  TouchImage(a_image, range);
+
+  size_t first = 0;
+  while(first < pieces.size())
+  {
+    size_t packSize = 0;
+    const size_t last   = ImagePackEnd(pieces, first, maxChunk, block.alignment, &packSize);
+    assert(last > first);
+    const size_t offset = AllocateInRing(packSize, block.alignment); // may submit current batch, so take command buffer after it
+    CopyImagePackCmd(CmdBuffer(), stagingBuff, mappedRing, offset, a_image, range.aspectMask, a_subres, block, pieces, first, last);
+    first = last;
+  }
+}
+
+void vk_copy::AsyncCopyHelper::UpdateImage(VkImage a_image, const void* a_src, int a_width, int a_height, int a_bpp)
+{
+  const size_t rowPitch = size_t(a_width) * size_t(a_bpp);
+  const size_t maxChunk = (ringSize / 2) & ~size_t(15);
+  const char*  src      = (const char*)a_src;
+
+  VkImageMemoryBarrier imgBar = {};
+  imgBar.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  imgBar.pNext               = nullptr;
+  imgBar.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imgBar.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imgBar.srcAccessMask       = 0;
+  imgBar.dstAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+  imgBar.oldLayout           = VK_IMAGE_LAYOUT_UNDEFINED;
+  imgBar.newLayout           = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  imgBar.image               = a_image;
+
+  imgBar.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+  imgBar.subresourceRange.baseMipLevel   = 0;
+  imgBar.subresourceRange.levelCount     = 1;
+  imgBar.subresourceRange.baseArrayLayer = 0;
+  imgBar.subresourceRange.layerCount     = 1;
+  TouchImage(a_image, imgBar.subresourceRange);
+
+  vkCmdPipelineBarrier(CmdBuffer(),
+                       VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       0,
+                       0, nullptr,
+                       0, nullptr,
+                       1, &imgBar);
+
+  // whole rows per chunk if a row fits in the chunk, pieces of rows otherwise
+  //
+  const int rowsPerChunk = int(std::min(maxChunk / rowPitch, size_t(a_height)));
+  const int pixPerChunk  = (rowsPerChunk == 0) ? int(maxChunk / size_t(a_bpp)) : a_width;
+
+  for(int y = 0; y < a_height; y += std::max(rowsPerChunk, 1))
+  {
+    const int rowsNum = std::max(std::min(rowsPerChunk, a_height - y), 1);
+
+    for(int x = 0; x < a_width; x += pixPerChunk)
+    {
+      const int    pixNum    = std::min(pixPerChunk, a_width - x);
+      const size_t chunkSize = (rowsPerChunk != 0) ? rowPitch*size_t(rowsNum) : size_t(pixNum)*size_t(a_bpp);
+      const size_t offset    = AllocateInRing(chunkSize, 16); // bufferOffset must be multiple of 4 and of texel size
+      memcpy(mappedRing + offset, src + size_t(y)*rowPitch + size_t(x)*size_t(a_bpp), chunkSize);
+
+      VkBufferImageCopy region = {};
+      region.bufferOffset      = offset;
+      region.bufferRowLength   = uint32_t(pixNum);
+      region.bufferImageHeight = uint32_t(rowsNum);
+      region.imageExtent       = VkExtent3D{ uint32_t(pixNum), uint32_t(rowsNum), 1 };
+      region.imageOffset       = VkOffset3D{ x, y, 0 };
+      region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+      region.imageSubresource.mipLevel       = 0;
+      region.imageSubresource.baseArrayLayer = 0;
+      region.imageSubresource.layerCount     = 1;
+
+      vkCmdCopyBufferToImage(CmdBuffer(), stagingBuff, a_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    }
+  }
+}
+
+void vk_copy::AsyncCopyHelper::AcquireOwnershipCmd(VkCommandBuffer a_dstCmdBuff)
+{
+  if(!currBatchOpen && lastTicket == handoffTicket) // everything submitted so far was already handed off
+    return;
+
+  // Only written subresources are transferred (other mips are undefined and can be taken by any family without transfer);
+  // layout is not changed, so the image stays in transfer dst layout, same as without ownership transfer.
+  // Concurrent buffers are not in the touched list, semaphore is enough for them.
+  //
+  std::vector<VkBufferMemoryBarrier> bufBars(touchedBuffers.size());
+  std::vector<VkImageMemoryBarrier>  imgBars(touchedImages.size());
+
+  for(size_t i=0;i<touchedBuffers.size();i++)
+  {
+    VkBufferMemoryBarrier& bar = bufBars[i];
+    bar                     = {};
+    bar.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    bar.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+    bar.dstAccessMask       = 0;
+    bar.srcQueueFamilyIndex = queueFID;
+    bar.dstQueueFamilyIndex = dstQueueFID;
+    bar.buffer              = touchedBuffers[i];
+    bar.offset              = 0;
+    bar.size                = VK_WHOLE_SIZE;
+  }
+
+  for(size_t i=0;i<touchedImages.size();i++)
+  {
+    VkImageMemoryBarrier& bar = imgBars[i];
+    bar                     = {};
+    bar.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    bar.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+    bar.dstAccessMask       = 0;
+    bar.oldLayout           = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    bar.newLayout           = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    bar.srcQueueFamilyIndex = queueFID;
+    bar.dstQueueFamilyIndex = dstQueueFID;
+    bar.image               = touchedImages[i].image;
+    bar.subresourceRange    = touchedImages[i].range;
+  }
+
+  // release on transfer queue; the batch signals its semaphore, which is waited by the destination queue submit, so CPU never waits here
+  //
+  VkCommandBuffer cmdBuff = CmdBuffer();
+  if(!bufBars.empty() || !imgBars.empty())
+  {
+    vkCmdPipelineBarrier(cmdBuff,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                         0,
+                         0, nullptr,
+                         uint32_t(bufBars.size()), bufBars.data(),
+                         uint32_t(imgBars.size()), imgBars.data());
+  }
+
+  const int handoffBatch = currBatch;
+  handoffTicket = SubmitBatch(true);
+  waitSemaphores.push_back(batches[handoffBatch].semaphore);
+
+  // acquire on destination queue; barriers must be identical except access masks
+  //
+  if(!bufBars.empty() || !imgBars.empty())
+  {
+    for(auto& bar : bufBars) { bar.srcAccessMask = 0; bar.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT; }
+    for(auto& bar : imgBars) { bar.srcAccessMask = 0; bar.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT; }
+
+    vkCmdPipelineBarrier(a_dstCmdBuff,
+                         VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                         0,
+                         0, nullptr,
+                         uint32_t(bufBars.size()), bufBars.data(),
+                         uint32_t(imgBars.size()), imgBars.data());
+  }
+
+  touchedBuffers.clear();
+  touchedImages.clear();
+}
+
+std::vector<VkSemaphore> vk_copy::AsyncCopyHelper::TakeWaitSemaphores()
+{
+  std::vector<VkSemaphore> res;
+  res.swap(waitSemaphores);
+  return res;
+}
+
+std::vector<uint32_t> vk_copy::AsyncCopyHelper::ConcurrentFamilies() const
+{
+  if(!SeparateQueueFamily())
+    return std::vector<uint32_t>();
+  return std::vector<uint32_t>{queueFID, dstQueueFID};
+}
+
+void vk_copy::AsyncCopyHelper::AddConcurrentBuffer(VkBuffer a_buffer)
+{
+  if(std::find(concurrentBuffers.begin(), concurrentBuffers.end(), a_buffer) == concurrentBuffers.end())
+    concurrentBuffers.push_back(a_buffer);
+  touchedBuffers.erase(std::remove(touchedBuffers.begin(), touchedBuffers.end(), a_buffer), touchedBuffers.end());
+}
+
+void vk_copy::AsyncCopyHelper::TouchBuffer(VkBuffer a_buffer)
+{
+  if(!SeparateQueueFamily() || std::find(concurrentBuffers.begin(), concurrentBuffers.end(), a_buffer) != concurrentBuffers.end())
+    return;
+
+  if(std::find(touchedBuffers.begin(), touchedBuffers.end(), a_buffer) == touchedBuffers.end())
+    touchedBuffers.push_back(a_buffer);
+}
+
+VkDeviceMemory vk_copy::AsyncCopyHelper::AllocateBufferMemory(const VkMemoryRequirements& a_memReq, bool a_allowDirect)
+{
+  VkMemoryAllocateInfo allocateInfo = {};
+  allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocateInfo.pNext           = nullptr;
+  allocateInfo.allocationSize  = a_memReq.size;
+  allocateInfo.memoryTypeIndex = uint32_t(-1);
+
+  if(a_allowDirect && UploadPath(a_memReq.memoryTypeBits) == UPLOAD_PATH_DIRECT)
+    allocateInfo.memoryTypeIndex = vk_utils::FindDirectWriteMemoryType(a_memReq.memoryTypeBits, physDev);
+
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  if(allocateInfo.memoryTypeIndex != uint32_t(-1) && vkAllocateMemory(dev, &allocateInfo, NULL, &memory) == VK_SUCCESS)
+  {
+    void* mappedMemory = nullptr;
+    VK_CHECK_RESULT(vkMapMemory(dev, memory, 0, a_memReq.size, 0, &mappedMemory));
+    directAllocs.push_back(DirectAllocation{memory, (char*)mappedMemory});
+    return memory;
+  }
+
+  // no direct write memory for these buffers (or its heap is full), fall back to staging path
+  //
+  allocateInfo.memoryTypeIndex = vk_utils::FindMemoryType(a_memReq.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, physDev);
+  VK_CHECK_RESULT(vkAllocateMemory(dev, &allocateInfo, NULL, &memory));
+  return memory;
+}
+
+vk_copy::UPLOAD_PATH vk_copy::AsyncCopyHelper::UploadPath(uint32_t a_memoryTypeBits) const
+{
+  if(directMemType == uint32_t(-1))
+    return UPLOAD_PATH_STAGING;
+  return (vk_utils::FindDirectWriteMemoryType(a_memoryTypeBits, physDev) != uint32_t(-1)) ? UPLOAD_PATH_DIRECT : UPLOAD_PATH_STAGING;
+}
+
+void vk_copy::AsyncCopyHelper::FreeBufferMemory(VkDeviceMemory a_memory)
+{
+  for(size_t i=0;i<directAllocs.size();i++)
+  {
+    if(directAllocs[i].memory == a_memory)
+    {
+      directAllocs.erase(directAllocs.begin() + i);
+      break;
+    }
+  }
+  vkFreeMemory(dev, a_memory, NULL); // implicitly unmaps
+}
+
+void* vk_copy::AsyncCopyHelper::MappedMemory(VkDeviceMemory a_memory) const
+{
+  for(const auto& alloc : directAllocs)
+  {
+    if(alloc.memory == a_memory)
+      return alloc.mapped;
+  }
+  return nullptr;
+}
+
+void vk_copy::AsyncCopyHelper::TouchImage(VkImage a_image, const VkImageSubresourceRange& a_range)
+{
+  if(!SeparateQueueFamily())
+    return;
+
+  for(auto& touched : touchedImages)
+  {
+    if(touched.image == a_image) // ranges always start from mip 0 and layer 0
+    {
+      touched.range.levelCount = std::max(touched.range.levelCount, a_range.levelCount);
+      touched.range.layerCount = std::max(touched.range.layerCount, a_range.layerCount);
+      return;
+    }
+  }
+
+  touchedImages.push_back(TouchedImage{a_image, a_range});
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+vk_copy::ReadbackHelper::ReadbackHelper(VkPhysicalDevice a_physicalDevice, VkDevice a_device, VkQueue a_queue, uint32_t a_queueFID, size_t a_ringSize, int a_maxBatches)
+{
+  assert(a_maxBatches > 0);
+
+  dev        = a_device;
+  ringSize   = a_ringSize;
+  ringHead   = 0;
+  ringUsed   = 0;
+  maxBatches = a_maxBatches;
+  currCmd    = nullptr;
+  lastTicket = 0;
+  currBatch  = Batch{0, 0, {}};
+
+  submitCtx  = std::make_unique<vk_utils::SubmitContext>(a_physicalDevice, a_device, a_queue, a_queueFID, a_maxBatches);
+
+  VkBufferCreateInfo bufferCreateInfo = {};
+  bufferCreateInfo.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferCreateInfo.size        = a_ringSize;
+  bufferCreateInfo.usage       = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  VK_CHECK_RESULT(vkCreateBuffer(a_device, &bufferCreateInfo, NULL, &ringBuff));
+
+  VkMemoryRequirements memoryRequirements;
+  vkGetBufferMemoryRequirements(a_device, ringBuff, &memoryRequirements);
+
+  // host reads this memory, so cached memory is much faster (uncached reads are extremely slow); 
+  // cached memory is often not coherent, then we invalidate it before reading
+  //
+  VkMemoryPropertyFlags memProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  uint32_t memTypeId = vk_utils::FindMemoryType(memoryRequirements.memoryTypeBits, memProps, a_physicalDevice);
+  if(memTypeId == uint32_t(-1))
+  {
+    memProps  = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    memTypeId = vk_utils::FindMemoryType(memoryRequirements.memoryTypeBits, memProps, a_physicalDevice);
+  }
+  if(memTypeId == uint32_t(-1))
+  {
+    memProps  = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    memTypeId = vk_utils::FindMemoryType(memoryRequirements.memoryTypeBits, memProps, a_physicalDevice);
+  }
+  ringCoherent = (memProps & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+  VkMemoryAllocateInfo allocateInfo = {};
+  allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocateInfo.allocationSize  = memoryRequirements.size;
+  allocateInfo.memoryTypeIndex = memTypeId;
+  VK_CHECK_RESULT(vkAllocateMemory(a_device, &allocateInfo, NULL, &ringMemory));
+  VK_CHECK_RESULT(vkBindBufferMemory(a_device, ringBuff, ringMemory, 0));
+
+  void* mappedMemory = nullptr;
+  VK_CHECK_RESULT(vkMapMemory(dev, ringMemory, 0, VK_WHOLE_SIZE, 0, &mappedMemory));
+  mappedRing = (char*)mappedMemory;
+}
+
+vk_copy::ReadbackHelper::~ReadbackHelper()
+{
+  WaitAll();
+  submitCtx = nullptr;
+
+  vkUnmapMemory  (dev, ringMemory);
+  vkDestroyBuffer(dev, ringBuff, NULL);
+  vkFreeMemory   (dev, ringMemory, NULL);
+}
+
+VkCommandBuffer vk_copy::ReadbackHelper::CmdBuffer()
+{
+  if(currCmd == nullptr)
+  {
+    if(int(inFlight.size()) >= maxBatches)
+      RetireOldest();
+    currCmd   = submitCtx->Begin();
+    currBatch = Batch{0, 0, {}};
+  }
+  return currCmd;
+}
+
+uint64_t vk_copy::ReadbackHelper::Submit()
+{
+  if(currCmd == nullptr)
+    return lastTicket;
+
+  // make transfer writes visible to the host
+  //
+  VkMemoryBarrier memBar = {};
+  memBar.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  memBar.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  memBar.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  vkCmdPipelineBarrier(currCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memBar, 0, nullptr, 0, nullptr);
+
+  currBatch.ticket = submitCtx->Submit(currCmd);
+  lastTicket       = currBatch.ticket;
+  inFlight.push_back(std::move(currBatch));
+  currCmd          = nullptr;
+  return lastTicket;
+}
+
+void vk_copy::ReadbackHelper::RetireOldest()
+{
+  assert(!inFlight.empty());
+  Batch& batch = inFlight.front();
+  submitCtx->Wait(batch.ticket);
+
+  if(!ringCoherent)
+  {
+    VkMappedMemoryRange range = {};
+    range.sType  = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = ringMemory;
+    range.offset = 0;
+    range.size   = VK_WHOLE_SIZE;
+    VK_CHECK_RESULT(vkInvalidateMappedMemoryRanges(dev, 1, &range));
+  }
+
+  for(const auto& copy : batch.copies)
+  {
+    const char* src = mappedRing + copy.ringOffset;
+    uint32_t*   out = (uint32_t*)copy.dst;
+
+    switch(copy.conv)
+    {
+      case CONV_BGRA8:
+      for(size_t i=0;i<copy.size/4;i++)
+      {
+        uint32_t texel;
+        memcpy(&texel, src + i*4, 4);
+        out[i] = (texel & 0xFF00FF00) | ((texel & 0x00FF0000) >> 16) | ((texel & 0x000000FF) << 16);
+      }
+      break;
+
+      case CONV_GRAY8:
+      for(size_t i=0;i<copy.size;i++)
+      {
+        const uint32_t g = uint8_t(src[i]);
+        out[i] = g | (g << 8) | (g << 16) | 0xFF000000;
+      }
+      break;
+
+      case CONV_GRAY16:
+      for(size_t i=0;i<copy.size/2;i++)
+      {
+        uint16_t texel;
+        memcpy(&texel, src + i*2, 2);
+        const uint32_t g = uint32_t(texel >> 8);
+        out[i] = g | (g << 8) | (g << 16) | 0xFF000000;
+      }
+      break;
+
+      case CONV_GRAY32F:
+      for(size_t i=0;i<copy.size/4;i++)
+      {
+        float texel;
+        memcpy(&texel, src + i*4, 4);
+        const uint32_t g = uint32_t(std::max(std::min(texel, 1.0f), 0.0f)*255.0f);
+        out[i] = g | (g << 8) | (g << 16) | 0xFF000000;
+      }
+      break;
+
+      default:
+      memcpy(copy.dst, src, copy.size);
+      break;
+    };
+  }
+
+  ringUsed -= batch.ringBytes;
+  inFlight.pop_front();
+}
+
+bool vk_copy::ReadbackHelper::IsComplete(uint64_t a_ticket)
+{
+  while(!inFlight.empty() && inFlight.front().ticket <= a_ticket && submitCtx->IsComplete(inFlight.front().ticket))
+    RetireOldest();
+  return inFlight.empty() || inFlight.front().ticket > a_ticket;
+}
+
+void vk_copy::ReadbackHelper::Wait(uint64_t a_ticket)
+{
+  assert(a_ticket <= lastTicket); // you should Submit() before waiting
+  while(!inFlight.empty() && inFlight.front().ticket <= a_ticket)
+    RetireOldest();
+}
+
+size_t vk_copy::ReadbackHelper::AllocateInRing(size_t a_size, size_t a_alignment)
+{
+  if (a_size > ringSize)
+    RUN_TIME_ERROR("[vk_copy::ReadbackHelper::AllocateInRing]: too large input size, please allocate larger ring");
+
+  while(true)
+  {
+    if(ringUsed == 0)
+      ringHead = 0;
+
+    size_t offset = AlignUp(ringHead, a_alignment);
+    size_t waste  = offset - ringHead;
+    if(offset + a_size > ringSize) // wrap around
+    {
+      offset = 0;
+      waste  = ringSize - ringHead;
+    }
+
+    if(ringUsed + waste + a_size <= ringSize)
+    {
+      CmdBuffer();
+      currBatch.ringBytes += waste + a_size;
+      ringUsed += waste + a_size;
+      ringHead  = offset + a_size;
+      return offset;
+    }
+
+    if(!inFlight.empty())
+      RetireOldest();
+    else
+      Submit();
+  }
+}
+
+void vk_copy::ReadbackHelper::ReadbackBuffer(VkBuffer a_src, size_t a_srcOffset, void* a_dst, size_t a_size)
+{
+  // wait for any writes to a_src (shaders, transfers) that were submitted to this queue before
+  //
+  VkMemoryBarrier memBar = {};
+  memBar.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  memBar.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+  memBar.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  vkCmdPipelineBarrier(CmdBuffer(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memBar, 0, nullptr, 0, nullptr);
+
+  const size_t maxChunk = (ringSize / 2) & ~size_t(15);
+  char*        dst      = (char*)a_dst;
+
+  for(size_t done = 0; done < a_size; done += maxChunk)
+  {
+    const size_t chunkSize = std::min(maxChunk, a_size - done);
+    const size_t offset    = AllocateInRing(chunkSize, 16); // may submit current batch, so take command buffer after it
+
+    VkBufferCopy region0 = {};
+    region0.srcOffset    = a_srcOffset + done;
+    region0.dstOffset    = offset;
+    region0.size         = chunkSize;
+    vkCmdCopyBuffer(CmdBuffer(), a_src, ringBuff, 1, &region0);
+
+    currBatch.copies.push_back(HostCopy{offset, dst + done, chunkSize, CONV_NONE});
+  }
+}
+
+void vk_copy::ReadbackHelper::ReadbackImage(VkImage a_image, VkFormat a_format, VkImageLayout a_layout, int a_width, int a_height, void* a_dst, bool a_toRGBA8)
+{
+  uint32_t blockW, blockH, texelBytes;
+  if(!vk_utils::GetFormatBlockInfo(a_format, &blockW, &blockH, &texelBytes) || blockW != 1 || blockH != 1)
+    RUN_TIME_ERROR("[vk_copy::ReadbackHelper::ReadbackImage]: unsupported (or compressed) image format");
+
+  CONVERSION conv = CONV_NONE;
+  if(a_toRGBA8)
+  {
+    switch(a_format)
+    {
+      case VK_FORMAT_R8G8B8A8_UNORM: case VK_FORMAT_R8G8B8A8_SRGB: conv = CONV_NONE;    break;
+      case VK_FORMAT_B8G8R8A8_UNORM: case VK_FORMAT_B8G8R8A8_SRGB: conv = CONV_BGRA8;   break;
+      case VK_FORMAT_R8_UNORM:                                     conv = CONV_GRAY8;   break;
+      case VK_FORMAT_R16_UNORM:      case VK_FORMAT_D16_UNORM:     conv = CONV_GRAY16;  break;
+      case VK_FORMAT_R32_SFLOAT:     case VK_FORMAT_D32_SFLOAT:    conv = CONV_GRAY32F; break;
+      default:
+      RUN_TIME_ERROR("[vk_copy::ReadbackHelper::ReadbackImage]: can't convert this format to RGBA8, read raw texels instead");
+    };
+  }
+
+  const size_t dstTexelBytes = a_toRGBA8 ? 4 : texelBytes;
+  const size_t rowPitch      = size_t(a_width)*size_t(texelBytes);
+  const size_t maxChunk      = (ringSize / 2) & ~size_t(15);
+  const int    rowsPerChunk  = int(std::min(maxChunk / rowPitch, size_t(a_height)));
+  if(rowsPerChunk == 0)
+    RUN_TIME_ERROR("[vk_copy::ReadbackHelper::ReadbackImage]: row of image does not fit in the ring, please allocate larger ring");
+
+  VkImageMemoryBarrier imgBar = {};
+  imgBar.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  imgBar.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imgBar.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imgBar.srcAccessMask       = VK_ACCESS_MEMORY_WRITE_BIT;
+  imgBar.dstAccessMask       = VK_ACCESS_TRANSFER_READ_BIT;
+  imgBar.oldLayout           = a_layout;
+  imgBar.newLayout           = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  imgBar.image               = a_image;
+
+  imgBar.subresourceRange.aspectMask     = vk_utils::IsDepthFormat(a_format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+  imgBar.subresourceRange.baseMipLevel   = 0;
+  imgBar.subresourceRange.levelCount     = 1;
+  imgBar.subresourceRange.baseArrayLayer = 0;
+  imgBar.subresourceRange.layerCount     = 1;
+
+  vkCmdPipelineBarrier(CmdBuffer(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imgBar);
+
+  const size_t alignment = (16 % texelBytes == 0) ? 16 : std::lcm(size_t(texelBytes), size_t(4));
+  char*        dst       = (char*)a_dst;
+
+  for(int y = 0; y < a_height; y += rowsPerChunk)
+  {
+    const int    rowsNum   = std::min(rowsPerChunk, a_height - y);
+    const size_t chunkSize = rowPitch*size_t(rowsNum);
+    const size_t offset    = AllocateInRing(chunkSize, alignment); // may submit current batch, batches go to the same queue in order
+
+    VkBufferImageCopy region = {};
+    region.bufferOffset      = offset;
+    region.bufferRowLength   = 0;
+    region.bufferImageHeight = 0;
+    region.imageOffset       = VkOffset3D{ 0, y, 0 };
+    region.imageExtent       = VkExtent3D{ uint32_t(a_width), uint32_t(rowsNum), 1 };
+    region.imageSubresource.aspectMask     = imgBar.subresourceRange.aspectMask;
+    region.imageSubresource.mipLevel       = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount     = 1;
+    vkCmdCopyImageToBuffer(CmdBuffer(), a_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, ringBuff, 1, &region);
+
+    currBatch.copies.push_back(HostCopy{offset, dst + size_t(y)*size_t(a_width)*dstTexelBytes, chunkSize, conv});
+  }
+
+  // return image to its layout
+  //
+  imgBar.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  imgBar.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+  imgBar.oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  imgBar.newLayout     = a_layout;
+  vkCmdPipelineBarrier(CmdBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imgBar);
+}
@@ -3,32 +3,164 @@
 
 #include <vulkan/vulkan.h>
 #include <vector>
+#include <deque>
+#include <cstdint>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "vk_utils.h"
+#include "vk_geom.h"
+#include "vk_texture.h"
 
 #include <stdexcept>
 #include <sstream>
 
 namespace vk_copy
 {
+  /**
+  \brief Destination region and source data for batched buffer updates
+  */
+  struct BufferRegion
+  {
+    VkBuffer    dst;
+    size_t      dstOffset;
+    const void* src;
+    size_t      size;
+  };
+
+  /**
+  \brief Upload work item: destination region and either raw source data or callback which encodes data right to staging memory.
+         Large items are split in slices (multiple of 'granularity' bytes) that may be filled by different threads.
+  */
+  struct UploadItem
+  {
+    VkBuffer    dst;
+    size_t      dstOffset;
+    size_t      size;
+    const void* src;         ///< raw copy if 'encode' is empty
+    std::function<void(size_t a_begin, size_t a_size, void* a_out)> encode; ///< writes bytes [a_begin, a_begin + a_size) of the item to a_out; called concurrently for disjoint slices
+    size_t      granularity = 4; ///< slice size for 'encode'; multiple of 4 (i.e. element size of encoded data)
+  };
+
+  /**
+  \brief Minimal pool of worker threads for the host side work of copy helpers, i.e. filling staging memory.
+  */
+  struct WorkerPool
+  {
+    WorkerPool(int a_threadsNum = 0); ///< 0 means std::thread::hardware_concurrency(); calling thread also works in ParallelFor
+    ~WorkerPool();
+
+    /**
+    \brief Call a_func(i) for i in [0, a_tasksNum) on workers and calling thread; returns when all calls are done.
+    */
+    void ParallelFor(size_t a_tasksNum, const std::function<void(size_t)>& a_func);
+    int  ThreadsNum() const { return int(threads.size()) + 1; }
+
+  private:
+
+    void WorkerLoop();
+    void RunTasks();
+
+    std::vector<std::thread>           threads;
+    std::mutex                         mutex;
+    std::condition_variable            wakeUp;
+    std::condition_variable            finished;
+    const std::function<void(size_t)>* job;
+    size_t                             tasksNum;
+    std::atomic<size_t>                nextTask;
+    uint64_t                           generation;  ///< incremented for each ParallelFor, so workers don't run the same job twice
+    int                                doneWorkers;
+    bool                               stop;
+
+    WorkerPool(const WorkerPool& rhs) = delete;
+    WorkerPool& operator=(const WorkerPool& rhs) = delete;
+  };
+
+  /**
+  \brief Source data of single mip level of single array layer. Data is tightly packed: rows of texels, or rows of blocks for compressed formats.
+  */
+  struct ImageSubresourceData
+  {
+    const void* src;
+    uint32_t    mipLevel;
+    uint32_t    arrayLayer;
+    uint32_t    width;      ///< width  of this mip level in texels
+    uint32_t    height;     ///< height of this mip level in texels
+  };
   
+  /**
+  \brief How CPU data gets to device local buffers
+  */
+  enum UPLOAD_PATH
+  {
+    UPLOAD_PATH_STAGING = 0, ///< copy commands from staging memory (discrete GPU without resizable BAR)
+    UPLOAD_PATH_DIRECT  = 1, ///< CPU writes mapped DEVICE_LOCAL | HOST_VISIBLE memory directly (resizable BAR or integrated GPU)
+  };
+
+  /**
+  \brief Blocking copy helper. Uploads of any size are supported: large ones are split in chunks that are 
+         pipelined through STAGING_PARTS parts of the staging buffer, so the staging buffer may be small.
+
+         There is no queue family ownership transfer: uploaded resources are owned by the family of a_transferQueue,
+         so they must be used by queues of the same family. Dedicated (transfer only) families are refused, use AsyncCopyHelper for them.
+  */
   struct SimpleCopyHelper
   {
-    SimpleCopyHelper(VkPhysicalDevice a_physicalDevice, VkDevice a_device, VkQueue a_transferQueue, size_t a_stagingBuffSize);
+    /**
+    \param a_queueFID - input queue family index of a_transferQueue; if VK_QUEUE_FAMILY_IGNORED, the first family with transfer support is assumed;
+                       family must support graphics or compute, otherwise constructor throws
+    */
+    SimpleCopyHelper(VkPhysicalDevice a_physicalDevice, VkDevice a_device, VkQueue a_transferQueue, size_t a_stagingBuffSize, 
+                     uint32_t a_queueFID = VK_QUEUE_FAMILY_IGNORED);
     ~SimpleCopyHelper();
 
     void UpdateBuffer(VkBuffer a_dst, size_t a_dstOffset, const void* a_src, size_t a_size);
     void UpdateImage (VkImage a_image, const void* a_src, int a_width, int a_height, int a_bpp);
 
+    /**
+    \brief Pack all regions to staging buffer and copy them with single vkCmdCopyBuffer per destination buffer (and per staging part)
+    */
+    void UpdateBuffers(const BufferRegion* a_regions, size_t a_regionsNum);
+
+    /**
+    \brief Upload precomputed mip levels and array layers (compressed formats are supported). All subresources that fit in a part of 
+           staging buffer are copied with single vkCmdCopyBufferToImage. Whole image (a_mipLevels x a_arrayLayers) is left in transfer dst layout.
+    \param a_image       - input image
+    \param a_format      - input image format, see vk_utils::GetFormatBlockInfo for supported ones
+    \param a_subres      - input subresources data
+    \param a_subresNum   - input subresources number
+    \param a_mipLevels   - input mip levels number of the image
+    \param a_arrayLayers - input array layers number of the image
+    */
+    void UpdateImageSubresources(VkImage a_image, VkFormat a_format, const ImageSubresourceData* a_subres, size_t a_subresNum, uint32_t a_mipLevels, uint32_t a_arrayLayers);
+
     VkCommandBuffer CmdBuffer() { return cmdBuff; }
 
   private:
 
+    enum {STAGING_PARTS = 2}; ///< large uploads are split in chunks which go through parts of staging buffer in turn
+
+    VkCommandBuffer BeginPart(int a_part);
+    void            SubmitPart(int a_part, VkCommandBuffer a_cmdPart);
+    void            WaitAllParts();
+
     VkQueue         queue;
     VkCommandPool   cmdPool;
     VkCommandBuffer cmdBuff;
 
+    std::unique_ptr<vk_utils::SubmitContext> submitCtx; ///< command buffers and fences for chunks and small updates are recycled here
+
     VkBuffer        stagingBuff;
     VkDeviceMemory  stagingBuffMemory;
     size_t          stagingSize;
+    size_t          partSize;
+    char*           mappedStaging;
+
+    uint64_t        partTicket[STAGING_PARTS]; ///< last submission that reads the part of staging buffer; 0 if none
 
     VkPhysicalDevice physDev;
     VkDevice         dev;
@@ -38,6 +170,322 @@ namespace vk_copy
     SimpleCopyHelper& operator=(const SimpleCopyHelper& rhs) { return *this; }
   };
 
+  /**
+  \brief Asynchronous copy helper. Source data is copied to persistently mapped staging ring buffer immediately, 
+         copy commands are accumulated in the current batch and go to the queue with single submit.
+         
+         Submit() returns a ticket; the application waits only when it really needs the data (Wait/IsComplete).
+         If the ring is full, the current batch is submitted automatically and the oldest batches are waited for.
+         So UpdateBuffer/UpdateImage never block while there is a free space in the ring.
+
+         Uploads are handed to the queue that uses them with AcquireOwnershipCmd() and TakeWaitSemaphores(), CPU doesn't wait for them.
+         If a_transferQueue belongs to a dedicated transfer family (a_dstQueueFID differs from a_queueFID), uploaded buffers and images 
+         are owned by transfer family until AcquireOwnershipCmd() is called. Ownership goes from transfer to destination family only,
+         so buffers that are updated repeatedly must be created with VK_SHARING_MODE_CONCURRENT for ConcurrentFamilies() and 
+         registered with AddConcurrentBuffer(); images may be written again only in subresources which content was discarded.
+  */
+  struct AsyncCopyHelper
+  {
+    /**
+    \param a_physicalDevice - input physical device
+    \param a_device         - input logical device
+    \param a_transferQueue  - input queue for copy commands
+    \param a_queueFID       - input queue family index of a_transferQueue
+    \param a_ringSize       - input staging ring buffer size; larger uploads are split in chunks of a half of the ring
+    \param a_maxBatches     - input maximum number of batches in flight
+    \param a_dstQueueFID    - input queue family which is going to use uploaded data (usually graphics); VK_QUEUE_FAMILY_IGNORED means a_queueFID
+    */
+    AsyncCopyHelper(VkPhysicalDevice a_physicalDevice, VkDevice a_device, VkQueue a_transferQueue, uint32_t a_queueFID, size_t a_ringSize, int a_maxBatches = 4,
+                    uint32_t a_dstQueueFID = VK_QUEUE_FAMILY_IGNORED);
+    ~AsyncCopyHelper();
+
+    void     UpdateBuffer(VkBuffer a_dst, size_t a_dstOffset, const void* a_src, size_t a_size);
+    void     UpdateImage (VkImage a_image, const void* a_src, int a_width, int a_height, int a_bpp); ///< leaves image in transfer dst layout, same as SimpleCopyHelper
+    void     UpdateBuffers(const BufferRegion* a_regions, size_t a_regionsNum);                        ///< packed to the ring, single vkCmdCopyBuffer per destination
+    void     UpdateImageSubresources(VkImage a_image, VkFormat a_format, const ImageSubresourceData* a_subres, size_t a_subresNum, 
+                                     uint32_t a_mipLevels, uint32_t a_arrayLayers);                   ///< same as SimpleCopyHelper::UpdateImageSubresources
+
+
+    /**
+    \brief Pack items to the ring, single vkCmdCopyBuffer per destination. Items (or their slices) are copied/encoded to the ring 
+           in parallel if fill threads are enabled, each thread writes its own disjoint part of the ring.
+    */
+    void     UpdateBuffers(const UploadItem* a_items, size_t a_itemsNum);
+
+    /**
+    \brief Use a_threadsNum threads for filling staging memory for large uploads; 0 means all hardware threads, 1 disables worker pool
+    */
+    void     SetFillThreads(int a_threadsNum);
+
+    uint64_t Submit();                         ///< submit current batch (if it is not empty); returns ticket of the last submitted batch
+    bool     IsComplete(uint64_t a_ticket);    ///< non blocking
+    void     Wait(uint64_t a_ticket);          ///< wait for all batches up to a_ticket
+    void     WaitAll() { Wait(Submit()); }
+
+    /**
+    \brief Command buffer of the current batch (already begun), so that application could add its own commands after copies; 
+           they will go to the queue with next Submit().
+    */
+    VkCommandBuffer CmdBuffer();
+
+    /**
+    \brief Hand all uploads submitted so far to the destination queue without waiting for them.
+           Release barriers go to the transfer queue with a batch that signals a semaphore (see TakeWaitSemaphores()), 
+           matching acquire barriers are recorded to a_dstCmdBuff; after a_dstCmdBuff is executed on the destination queue 
+           by the submit that waits for the semaphore, uploaded data can be used there. Does nothing if there are no new uploads.
+    \param a_dstCmdBuff - output command buffer that will be submitted to the queue of a_dstQueueFID family
+    */
+    void AcquireOwnershipCmd(VkCommandBuffer a_dstCmdBuff);
+
+    /**
+    \brief Semaphores of the handoffs made by AcquireOwnershipCmd() since the previous call; the list is cleared.
+           Next submit to the destination queue must wait for all of them (VK_PIPELINE_STAGE_ALL_COMMANDS_BIT is enough).
+           Semaphore belongs to a batch and is signalled again when the batch is reused, i.e. a_maxBatches batches later,
+           the waiting submit must be executed by then.
+    */
+    std::vector<VkSemaphore> TakeWaitSemaphores();
+
+    bool SeparateQueueFamily() const { return (dstQueueFID != queueFID); }
+
+    /**
+    \brief Queue families for VK_SHARING_MODE_CONCURRENT buffers; empty if transfer and destination family are the same (use exclusive mode then)
+    */
+    std::vector<uint32_t> ConcurrentFamilies() const;
+
+    /**
+    \brief Buffer created with VK_SHARING_MODE_CONCURRENT for ConcurrentFamilies(); AcquireOwnershipCmd doesn't transfer its ownership, 
+           so it can be updated any number of times
+    */
+    void AddConcurrentBuffer(VkBuffer a_buffer);
+
+    /**
+    \brief Allocate memory for buffers that are filled by CPU (meshes, for example). If direct write path is available for them (see UploadPath(a_memReq.memoryTypeBits))
+           and a_allowDirect is true, memory is DEVICE_LOCAL | HOST_VISIBLE and persistently mapped, see MappedMemory(); 
+           otherwise it is DEVICE_LOCAL memory that is updated with copies from staging ring.
+    \param a_memReq      - input memory requirements of buffers
+    \param a_allowDirect - input allow direct write memory
+    */
+    VkDeviceMemory AllocateBufferMemory(const VkMemoryRequirements& a_memReq, bool a_allowDirect = true);
+    void           FreeBufferMemory(VkDeviceMemory a_memory);  ///< memory allocated with AllocateBufferMemory
+
+    /**
+    \brief Host pointer to the beginning of a_memory if it was allocated with AllocateBufferMemory in direct write memory; nullptr otherwise.
+           Writes through this pointer are visible to the device after the next vkQueueSubmit (memory is coherent), no copy commands are needed; 
+           application must not write the data that device is using now.
+    */
+    void*          MappedMemory(VkDeviceMemory a_memory) const;
+
+    /**
+    \brief Capability query: the path AllocateBufferMemory would take for buffers of given memory types (direct write memory type must be one of them)
+    \param a_memoryTypeBits - input VkMemoryRequirements::memoryTypeBits of the buffers; ~0u means any buffer
+    */
+    UPLOAD_PATH    UploadPath(uint32_t a_memoryTypeBits = ~0u) const;
+
+  private:
+
+    struct Batch
+    {
+      VkCommandBuffer cmdBuff;
+      VkFence         fence;
+      VkSemaphore     semaphore; ///< signalled by submit of AcquireOwnershipCmd only
+      uint64_t        ticket;    ///< 0 if batch is not submitted
+      size_t          ringBytes; ///< bytes of the ring this batch holds (including wasted tail on wrap)
+    };
+
+    uint64_t SubmitBatch(bool a_signalSemaphore);
+    size_t AllocateInRing(size_t a_size, size_t a_alignment);
+    void   RetireOldest();
+    void   RetireCompleted();
+
+    struct FillPiece
+    {
+      size_t item;   ///< index in items array
+      size_t begin;  ///< bytes [begin, begin + size) of the item
+      size_t size;
+    };
+
+    void   FillRing(const UploadItem* a_items, const FillPiece* a_pieces, size_t a_piecesNum, size_t a_ringOffset);
+
+    VkQueue          queue;
+    VkCommandPool    cmdPool;
+    uint32_t         queueFID;
+    uint32_t         dstQueueFID;
+
+    struct TouchedImage
+    {
+      VkImage                 image;
+      VkImageSubresourceRange range;     ///< subresources that were written and are in transfer dst layout now
+    };
+
+    void TouchBuffer(VkBuffer a_buffer);
+    void TouchImage(VkImage a_image, const VkImageSubresourceRange& a_range);
+
+    std::vector<VkBuffer>     touchedBuffers; ///< resources that wait for ownership transfer to dstQueueFID
+    std::vector<TouchedImage> touchedImages;  ///< 
+    std::vector<VkBuffer>     concurrentBuffers;
+    std::vector<VkSemaphore>  waitSemaphores; ///< handoffs that destination queue has not waited for yet
+
+    struct DirectAllocation
+    {
+      VkDeviceMemory memory;
+      char*          mapped;
+    };
+
+    uint32_t                      directMemType; ///< DEVICE_LOCAL | HOST_VISIBLE memory type of large heap; uint32_t(-1) if none
+    std::vector<DirectAllocation> directAllocs;
+
+    std::unique_ptr<WorkerPool>   workers;       ///< null if staging memory is filled by calling thread only
+
+    VkBuffer         stagingBuff;
+    VkDeviceMemory   stagingBuffMemory;
+    char*            mappedRing;
+    size_t           ringSize;
+    size_t           ringHead;  ///< next write position 
+    size_t           ringUsed;  ///< bytes from the oldest in flight data to ringHead
+
+    std::vector<Batch> batches;
+    int              currBatch;    ///< index of batch that is recorded now
+    bool             currBatchOpen;
+    int              oldestBatch;  ///< index of the oldest batch in flight
+    int              inFlight;     ///< number of batches in flight
+    uint64_t         lastTicket;
+    uint64_t         completedTicket;
+    uint64_t         handoffTicket; ///< last ticket handed off with AcquireOwnershipCmd
+
+    VkPhysicalDevice physDev;
+    VkDevice         dev;
+
+    AsyncCopyHelper(const AsyncCopyHelper& rhs) = delete;
+    AsyncCopyHelper& operator=(const AsyncCopyHelper& rhs) = delete;
+  };
+
+  /**
+  \brief Asynchronous readback (device to host) helper. Copy commands write to persistently mapped ring buffer (host cached if possible);
+         they are accumulated in the current batch and go to the queue with single submit, same as for AsyncCopyHelper.
+         
+         Data is written to application memory (a_dst) when the batch is retired, i.e. inside IsComplete/Wait/WaitAll,
+         so a_dst must stay valid until Submit() ticket is complete. Large readbacks are split in chunks of a half of the ring;
+         if the ring is full, current batch is submitted and the oldest batches are retired.
+
+         Use the queue that wrote the data (usually graphics), then no ownership transfer is needed.
+  */
+  struct ReadbackHelper
+  {
+    ReadbackHelper(VkPhysicalDevice a_physicalDevice, VkDevice a_device, VkQueue a_queue, uint32_t a_queueFID, size_t a_ringSize, int a_maxBatches = 4);
+    ~ReadbackHelper();
+
+    void     ReadbackBuffer(VkBuffer a_src, size_t a_srcOffset, void* a_dst, size_t a_size);
+
+    /**
+    \brief Read mip 0 of layer 0 of the image.
+    \param a_image   - input image, must be created with VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+    \param a_format  - input image format
+    \param a_layout  - input current layout of the image; image is returned to this layout after copy
+    \param a_width   - input image width
+    \param a_height  - input image height
+    \param a_dst     - output texels, a_width*a_height of them
+    \param a_toRGBA8 - input convert texels to R8G8B8A8, one unsigned int per pixel (same as SaveBMP/LoadBMP); 
+                       depth and single channel formats become gray. If false, raw texels are written.
+    */
+    void     ReadbackImage(VkImage a_image, VkFormat a_format, VkImageLayout a_layout, int a_width, int a_height, void* a_dst, bool a_toRGBA8 = true);
+
+    uint64_t Submit();                         ///< submit current batch (if it is not empty); returns ticket of the last submitted batch
+    bool     IsComplete(uint64_t a_ticket);    ///< non blocking; writes data of completed batches to the application memory
+    void     Wait(uint64_t a_ticket);
+    void     WaitAll() { Wait(Submit()); }
+
+  private:
+
+    enum CONVERSION { CONV_NONE = 0, CONV_BGRA8 = 1, CONV_GRAY8 = 2, CONV_GRAY16 = 3, CONV_GRAY32F = 4 };
+
+    struct HostCopy
+    {
+      size_t     ringOffset;
+      char*      dst;
+      size_t     size;       ///< bytes in the ring
+      CONVERSION conv;
+    };
+
+    struct Batch
+    {
+      uint64_t              ticket;
+      size_t                ringBytes;
+      std::vector<HostCopy> copies;
+    };
+
+    VkCommandBuffer CmdBuffer();
+    size_t          AllocateInRing(size_t a_size, size_t a_alignment);
+    void            RetireOldest();
+
+    VkDevice         dev;
+    VkBuffer         ringBuff;
+    VkDeviceMemory   ringMemory;
+    char*            mappedRing;
+    bool             ringCoherent;
+    size_t           ringSize;
+    size_t           ringHead;
+    size_t           ringUsed;
+    int              maxBatches;
+
+    std::unique_ptr<vk_utils::SubmitContext> submitCtx;
+    VkCommandBuffer   currCmd;   ///< null if current batch is not open
+    Batch             currBatch;
+    std::deque<Batch> inFlight;
+    uint64_t          lastTicket;
+
+    ReadbackHelper(const ReadbackHelper& rhs) = delete;
+    ReadbackHelper& operator=(const ReadbackHelper& rhs) = delete;
+  };
+
+  /**
+  \brief Copy engine for vk_geom and vk_texture helpers (they require application to implement copy by itself) on top of AsyncCopyHelper;
+         uploads are batched, so call WaitAll() before you actually use uploaded data, or call AcquireOwnershipCmd() with the command buffer
+         of destination queue and let its submit wait for TakeWaitSemaphores(), then CPU doesn't wait at all.
+  */
+  struct CopyEngine : public vk_geom::ICopyEngine, 
+                      public vk_texture::ICopyEngine
+  {
+    CopyEngine(VkPhysicalDevice a_physicalDevice, VkDevice a_device, VkQueue a_transferQueue, uint32_t a_queueFID, size_t a_stagingBuffSize, 
+               uint32_t a_dstQueueFID = VK_QUEUE_FAMILY_IGNORED) : 
+               m_helper(a_physicalDevice, a_device, a_transferQueue, a_queueFID, a_stagingBuffSize, 4, a_dstQueueFID) {}
+  
+    void UpdateBuffer(VkBuffer a_dst, size_t a_dstOffset, const void* a_src, size_t a_size)    override { m_helper.UpdateBuffer(a_dst, a_dstOffset, a_src, a_size); }
+    void UpdateImage(VkImage a_image, const void* a_src, int a_width, int a_height, int a_bpp) override { m_helper.UpdateImage(a_image, a_src, a_width, a_height, a_bpp); }
+
+    void UpdateImageMips(VkImage a_image, VkFormat a_format, const MipData* a_mips, size_t a_mipsNum, uint32_t a_mipLevels, uint32_t a_arrayLayers) override
+    {
+      std::vector<ImageSubresourceData> subres(a_mipsNum);
+      for(size_t i=0;i<a_mipsNum;i++)
+        subres[i] = ImageSubresourceData{a_mips[i].src, a_mips[i].mipLevel, a_mips[i].arrayLayer, a_mips[i].width, a_mips[i].height};
+      m_helper.UpdateImageSubresources(a_image, a_format, subres.data(), subres.size(), a_mipLevels, a_arrayLayers);
+    }
+
+    void UpdateBuffers(const Region* a_regions, size_t a_regionsNum) override
+    {
+      std::vector<UploadItem> items(a_regionsNum);
+      for(size_t i=0;i<a_regionsNum;i++)
+        items[i] = UploadItem{a_regions[i].dst, a_regions[i].dstOffset, a_regions[i].size, a_regions[i].src, a_regions[i].encode, a_regions[i].granularity};
+      m_helper.UpdateBuffers(items.data(), items.size());
+    }
+
+    void* MappedMemory(VkDeviceMemory a_memory) override { return m_helper.MappedMemory(a_memory); }
+    void  MarkConcurrent(VkBuffer a_buffer)      override { m_helper.AddConcurrentBuffer(a_buffer); }
+
+    VkDeviceMemory AllocateBufferMemory(const VkMemoryRequirements& a_memReq, bool a_allowDirect = true) { return m_helper.AllocateBufferMemory(a_memReq, a_allowDirect); }
+    void           FreeBufferMemory(VkDeviceMemory a_memory)                                             { m_helper.FreeBufferMemory(a_memory); }
+
+    VkCommandBuffer CmdBuffer() { return m_helper.CmdBuffer(); } ///< command buffer of the current batch
+    uint64_t        Submit()    { return m_helper.Submit();    }
+    bool            IsComplete(uint64_t a_ticket) { return m_helper.IsComplete(a_ticket); }
+    void            Wait(uint64_t a_ticket)       { m_helper.Wait(a_ticket); }
+    void            WaitAll()   { m_helper.WaitAll();          }
+    void            AcquireOwnershipCmd(VkCommandBuffer a_cmdBuff) { m_helper.AcquireOwnershipCmd(a_cmdBuff); }
+    std::vector<VkSemaphore> TakeWaitSemaphores()       { return m_helper.TakeWaitSemaphores(); }
+    std::vector<uint32_t>    ConcurrentFamilies() const { return m_helper.ConcurrentFamilies(); }
+
+    AsyncCopyHelper m_helper;
+  };
+
 };
 
 #endif
\ No newline at end of file
@@ -3,6 +3,12 @@
 
 #include <cstring>
 #include <stdexcept>
+#include <algorithm>
+
+#ifdef WIN32
+#undef min
+#undef max
+#endif
 
 static inline unsigned int EncodeNormal(const float n[3])
 {
@@ -43,11 +49,13 @@ static inline float as_float(unsigned int x)
   return res;
 }
 
-vk_geom::CompactMesh_T3V4x2F::CompactMesh_T3V4x2F()
+vk_geom::CompactMesh_T3V4x2F::CompactMesh_T3V4x2F(bool a_doubleBuffered, const std::vector<uint32_t>& a_concurrentFamilies) : m_dev(nullptr), m_vertNum(0), m_indNum(0), 
+                                                                         m_doubleBuffered(a_doubleBuffered), m_concurrentFamilies(a_concurrentFamilies), m_frontCopy(0), m_pendingFirst(0), m_pendingNum(0),
+                                                                         m_backFirst(0), m_backNum(0)
 {
-   m_vertexBuffers[0] = nullptr;
-   m_vertexBuffers[1] = nullptr;
-   m_indexBuffer      = nullptr;   
+   for(auto& buff : m_vertexBuffers)
+     buff = nullptr;
+   m_indexBuffer = nullptr;   
 }
 
 vk_geom::CompactMesh_T3V4x2F::~CompactMesh_T3V4x2F()
@@ -59,9 +67,13 @@ void vk_geom::CompactMesh_T3V4x2F::DestroyBuffersIfNeeded()
 {
   if(m_vertexBuffers[0] != nullptr && m_indexBuffer != nullptr && m_dev != nullptr)
   {
-    vkDestroyBuffer(m_dev, m_vertexBuffers[0], NULL);
-    vkDestroyBuffer(m_dev, m_vertexBuffers[1], NULL);
+    for(int i=0;i<VertexBuffersNum();i++)
+    {
+      vkDestroyBuffer(m_dev, m_vertexBuffers[i], NULL);
+      m_vertexBuffers[i] = nullptr;
+    }
     vkDestroyBuffer(m_dev, m_indexBuffer, NULL);
+    m_indexBuffer = nullptr;
   }
 }
 
@@ -76,6 +88,28 @@ size_t Padding(size_t a_size, size_t a_aligment)
   }
 }
 
+// extend range [a_pFirst, a_pFirst + a_pNum) to cover [a_first, a_first + a_num) too
+//
+static inline void MergeRange(int* a_pFirst, int* a_pNum, int a_first, int a_num)
+{
+  if(a_num <= 0)
+    return;
+  if((*a_pNum) <= 0)
+  {
+    (*a_pFirst) = a_first;
+    (*a_pNum)   = a_num;
+    return;
+  }
+  const int end = std::max((*a_pFirst) + (*a_pNum), a_first + a_num);
+  (*a_pFirst)   = std::min((*a_pFirst), a_first);
+  (*a_pNum)     = end - (*a_pFirst);
+}
+
+static inline size_t IndexSize(VkIndexType a_type)
+{
+  return (a_type == VK_INDEX_TYPE_UINT16) ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
 VkMemoryRequirements vk_geom::CompactMesh_T3V4x2F::CreateBuffers(VkDevice a_dev, int a_vertNum, int a_indexNum)
 {
   assert(a_dev != nullptr); // you should set Vulkan context before using this function
@@ -90,39 +124,66 @@ VkMemoryRequirements vk_geom::CompactMesh_T3V4x2F::CreateBuffers(VkDevice a_dev,
   bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
   bufferCreateInfo.size  = f4size;
   // this class assume GPU simulation for mesh, i.e. we want to write buffer in the compute shader 
-  // we also want to transfer data there .. 
-  bufferCreateInfo.usage       = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  // we also want to transfer data there .. and read it back for debugging and tests
+  bufferCreateInfo.usage       = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
   bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  if(m_concurrentFamilies.size() >= 2)
+  {
+    bufferCreateInfo.sharingMode           = VK_SHARING_MODE_CONCURRENT;
+    bufferCreateInfo.queueFamilyIndexCount = uint32_t(m_concurrentFamilies.size());
+    bufferCreateInfo.pQueueFamilyIndices   = m_concurrentFamilies.data();
+  }
 
-  VK_CHECK_RESULT(vkCreateBuffer(m_dev, &bufferCreateInfo, NULL, &m_vertexBuffers[0]));
-  VK_CHECK_RESULT(vkCreateBuffer(m_dev, &bufferCreateInfo, NULL, &m_vertexBuffers[1]));
+  for(int i=0;i<VertexBuffersNum();i++)
+    VK_CHECK_RESULT(vkCreateBuffer(m_dev, &bufferCreateInfo, NULL, &m_vertexBuffers[i]));
+
+  // indices are written once, exclusive mode is fine for them
+  //
+  bufferCreateInfo.sharingMode           = VK_SHARING_MODE_EXCLUSIVE;
+  bufferCreateInfo.queueFamilyIndexCount = 0;
+  bufferCreateInfo.pQueueFamilyIndices   = nullptr;
+
+  // use 16 bit indices when possible, this halves index memory and bandwidth; 
+  // size is padded to 4 bytes because vkCmdUpdateBuffer/vkCmdCopyBuffer sizes must be multiple of 4
+  //
+  m_indexType = (a_vertNum < 65536) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
 
   bufferCreateInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-  bufferCreateInfo.size  = a_indexNum*sizeof(int);
+  bufferCreateInfo.size  = Padding(a_indexNum*IndexSize(m_indexType), 4);
   VK_CHECK_RESULT(vkCreateBuffer(m_dev, &bufferCreateInfo, NULL, &m_indexBuffer));
   
-  m_vertNum = a_vertNum;
-  m_indNum  = a_indexNum;
-
-  // piece of shit with memory aligment
+  m_vertNum      = a_vertNum;
+  m_indNum       = a_indexNum;
+  m_frontCopy    = 0;
+  m_pendingFirst = 0;
+  m_pendingNum   = 0;
+  m_backFirst    = 0;
+  m_backNum      = 0;
+
+  // piece of shit with memory aligment; index buffer goes after all vertex buffers
   //
-  VkMemoryRequirements memoryRequirements[3];
-  vkGetBufferMemoryRequirements(m_dev, m_vertexBuffers[0], &memoryRequirements[0]);
-  vkGetBufferMemoryRequirements(m_dev, m_vertexBuffers[1], &memoryRequirements[1]);
-  vkGetBufferMemoryRequirements(m_dev, m_indexBuffer,      &memoryRequirements[2]);
-
-  buffOffsets[0] = 0;
-  buffOffsets[1] = Padding(memoryRequirements[0].size                             , memoryRequirements[1].alignment);
-  buffOffsets[2] = Padding(memoryRequirements[0].size + memoryRequirements[1].size, memoryRequirements[2].alignment);
-
-  memoryRequirements[0].size = Padding(buffOffsets[2] + memoryRequirements[2].size, memoryRequirements[2].alignment); // this is actually may be an issue if some other buffer will need the same memory
-
-  assert(memoryRequirements[0].alignment == memoryRequirements[1].alignment);
-  assert(memoryRequirements[0].alignment == memoryRequirements[2].alignment);
+  const int buffersNum = VertexBuffersNum() + 1;
+  VkBuffer  buffers[5] = {};
+  for(int i=0;i<VertexBuffersNum();i++)
+    buffers[i] = m_vertexBuffers[i];
+  buffers[buffersNum-1] = m_indexBuffer;
+
+  VkMemoryRequirements memoryRequirements[5];
+  size_t currOffset = 0;
+  for(int i=0;i<buffersNum;i++)
+  {
+    vkGetBufferMemoryRequirements(m_dev, buffers[i], &memoryRequirements[i]);
+    buffOffsets[i] = Padding(currOffset, memoryRequirements[i].alignment);
+    currOffset     = buffOffsets[i] + memoryRequirements[i].size;
+  }
 
-  assert(memoryRequirements[0].memoryTypeBits == memoryRequirements[1].memoryTypeBits);
-  assert(memoryRequirements[0].memoryTypeBits == memoryRequirements[2].memoryTypeBits);
+  for(int i=1;i<buffersNum;i++) // offsets are already aligned for each buffer, so the whole block needs the strictest alignment
+  {
+    assert(memoryRequirements[0].memoryTypeBits == memoryRequirements[i].memoryTypeBits);
+    memoryRequirements[0].alignment = std::max(memoryRequirements[0].alignment, memoryRequirements[i].alignment);
+  }
 
+  memoryRequirements[0].size = Padding(currOffset, memoryRequirements[0].alignment); // this is actually may be an issue if some other buffer will need the same memory
   return memoryRequirements[0];
 }
 
@@ -137,45 +198,228 @@ void vk_geom::CompactMesh_T3V4x2F::BindBuffers(VkDeviceMemory a_memStorage, size
     m_memStorage.memStorage      = a_memStorage;
     m_memStorage.offsetInStorage = a_offset;
    
-    VK_CHECK_RESULT(vkBindBufferMemory(m_dev, m_vertexBuffers[0], m_memStorage.memStorage, buffOffsets[0] + a_offset ));
-    VK_CHECK_RESULT(vkBindBufferMemory(m_dev, m_vertexBuffers[1], m_memStorage.memStorage, buffOffsets[1] + a_offset ));
-    VK_CHECK_RESULT(vkBindBufferMemory(m_dev, m_indexBuffer,      m_memStorage.memStorage, buffOffsets[2] + a_offset ));
+    for(int i=0;i<VertexBuffersNum();i++)
+      VK_CHECK_RESULT(vkBindBufferMemory(m_dev, m_vertexBuffers[i], m_memStorage.memStorage, buffOffsets[i] + a_offset ));
+    VK_CHECK_RESULT(vkBindBufferMemory(m_dev, m_indexBuffer, m_memStorage.memStorage, buffOffsets[VertexBuffersNum()] + a_offset ));
   }
 
   if(m_memStorage.IsEmpty())
     RUN_TIME_ERROR("[CompactMesh_T3V4x2F::BindBuffers()]: empty input and/or internal storage!");
 }
 
+void vk_geom::CompactMesh_T3V4x2F::EncodeVertices(const cmesh::SimpleMesh& a_mesh, int a_firstVert, int a_vertsNum, float* a_posNorm, float* a_texTang) const
+{
+  // output may be write-combined memory (staging or direct write path), so it is only written, sequentially
+  //
+  if(a_posNorm != nullptr)
+  {
+    for(int j=0;j<a_vertsNum;j++)
+    {
+      const int i = a_firstVert + j;
+      a_posNorm[j*4+0] = a_mesh.vPos4f[i*4+0];
+      a_posNorm[j*4+1] = a_mesh.vPos4f[i*4+1];
+      a_posNorm[j*4+2] = a_mesh.vPos4f[i*4+2];
+      a_posNorm[j*4+3] = as_float(EncodeNormal(a_mesh.vNorm4f.data() + i*4));    
+    }
+  }
+
+  if(a_texTang != nullptr)
+  {
+    for(int j=0;j<a_vertsNum;j++)
+    {
+      const int i = a_firstVert + j;
+      a_texTang[j*4+0] = a_mesh.vTexCoord2f[i*2+0];
+      a_texTang[j*4+1] = a_mesh.vTexCoord2f[i*2+1];
+      a_texTang[j*4+2] = as_float(EncodeNormal(a_mesh.vTang4f.data() + i*4));
+      a_texTang[j*4+3] = 0.0f; // reserved
+    }
+  }
+}
+
+void vk_geom::CompactMesh_T3V4x2F::EncodeIndices(const cmesh::SimpleMesh& a_mesh, size_t a_first, size_t a_num, void* a_dst) const
+{
+  const size_t indicesNum = a_mesh.indices.size();
+
+  if(m_indexType == VK_INDEX_TYPE_UINT16)
+  {
+    uint16_t* indices16 = (uint16_t*)a_dst;
+    for(size_t j=0;j<a_num;j++)
+    {
+      const size_t i = a_first + j;
+      assert(i >= indicesNum || (a_mesh.indices[i] >= 0 && a_mesh.indices[i] < 65536));
+      indices16[j] = (i < indicesNum) ? uint16_t(a_mesh.indices[i]) : 0; // padding to 4 bytes
+    }
+  }
+  else
+    memcpy(a_dst, a_mesh.indices.data() + a_first, sizeof(int)*a_num);
+}
+
+char* vk_geom::CompactMesh_T3V4x2F::MappedStorage(ICopyEngine* a_pCopyEngine) const
+{
+  char* mapped = (char*)a_pCopyEngine->MappedMemory(m_memStorage.memStorage);
+  return (mapped == nullptr) ? nullptr : mapped + m_memStorage.offsetInStorage;
+}
+
+void vk_geom::CompactMesh_T3V4x2F::WriteVertices(char* a_mapped, int a_firstVert, int a_vertsNum, int a_copy, const cmesh::SimpleMesh& a_mesh) const
+{
+  const size_t offset = size_t(a_firstVert)*sizeof(float)*4;
+  EncodeVertices(a_mesh, a_firstVert, a_vertsNum, (float*)(a_mapped + buffOffsets[a_copy*2+0] + offset), 
+                                                  (float*)(a_mapped + buffOffsets[a_copy*2+1] + offset));
+}
+
+void vk_geom::CompactMesh_T3V4x2F::AddVertexRegions(const cmesh::SimpleMesh& a_mesh, int a_firstVert, int a_vertsNum, int a_copy, 
+                                                    std::vector<ICopyEngine::Region>* a_pRegions) const
+{
+  if(a_vertsNum == 0)
+    return;
+
+  // vertices are encoded by the copy engine right to staging memory (possibly by several threads), one float4 per vertex in each stream
+  //
+  const size_t offset = size_t(a_firstVert)*sizeof(float)*4;
+  const size_t size   = size_t(a_vertsNum)*sizeof(float)*4;
+
+  ICopyEngine::Region posNorm = {m_vertexBuffers[a_copy*2+0], offset, nullptr, size};
+  posNorm.encode      = [this, &a_mesh, a_firstVert](size_t a_begin, size_t a_size, void* a_out) 
+                        { EncodeVertices(a_mesh, a_firstVert + int(a_begin/16), int(a_size/16), (float*)a_out, nullptr); };
+  posNorm.granularity = sizeof(float)*4;
+
+  ICopyEngine::Region texTang = {m_vertexBuffers[a_copy*2+1], offset, nullptr, size};
+  texTang.encode      = [this, &a_mesh, a_firstVert](size_t a_begin, size_t a_size, void* a_out) 
+                        { EncodeVertices(a_mesh, a_firstVert + int(a_begin/16), int(a_size/16), nullptr, (float*)a_out); };
+  texTang.granularity = sizeof(float)*4;
+
+  a_pRegions->push_back(posNorm);
+  a_pRegions->push_back(texTang);
+}
+
+void vk_geom::CompactMesh_T3V4x2F::UpdateVerticesRange(const cmesh::SimpleMesh& a_mesh, int a_firstVert, int a_vertsNum, ICopyEngine* a_pCopyEngine)
+{
+  assert(a_mesh.VerticesNum() == m_vertNum);
+  assert(a_pCopyEngine        != nullptr);
+
+  if(a_firstVert < 0 || a_vertsNum < 0 || a_firstVert + a_vertsNum > m_vertNum)
+    RUN_TIME_ERROR("[CompactMesh_T3V4x2F::UpdateVerticesRange()]: vertex range is out of mesh!");
+
+  std::vector<ICopyEngine::Region> regions;
+  regions.reserve(4);
+
+  // the only copy may be read by frames in flight, so it is never written directly by CPU; 
+  // copy engine puts the upload to the queue after them
+  //
+  if(!m_doubleBuffered)
+  {
+    AddVertexRegions(a_mesh, a_firstVert, a_vertsNum, 0, &regions);
+    a_pCopyEngine->UpdateBuffers(regions.data(), regions.size());
+    return;
+  }
+
+  char* mapped = MappedStorage(a_pCopyEngine); // not null for direct write path, then vertices are encoded right to the back copy
+
+  // back copy missed the range of previous update (it went to the current front copy only), so write both of them;
+  // a_mesh holds the whole current data, so re-encoding old range from it is correct
+  //
+  const int backCopy = 1 - m_frontCopy;
+
+  int rangeFirst[2] = { m_pendingFirst, a_firstVert };
+  int rangeNum[2]   = { m_pendingNum,   a_vertsNum  };
+  int rangesNum     = 2;
+
+  const int pendingEnd = m_pendingFirst + m_pendingNum;
+  const int currEnd    = a_firstVert    + a_vertsNum;
+  if(m_pendingNum > 0 && a_vertsNum > 0 && m_pendingFirst <= currEnd && a_firstVert <= pendingEnd) // overlapped ranges, upload their union
+  {
+    rangeFirst[0] = std::min(m_pendingFirst, a_firstVert);
+    rangeNum[0]   = std::max(pendingEnd, currEnd) - rangeFirst[0];
+    rangesNum     = 1;
+  }
+
+  for(int r=0;r<rangesNum;r++)
+  {
+    if(mapped != nullptr)
+      WriteVertices(mapped, rangeFirst[r], rangeNum[r], backCopy, a_mesh);
+    else
+      AddVertexRegions(a_mesh, rangeFirst[r], rangeNum[r], backCopy, &regions);
+  }
+  
+  if(!regions.empty())
+    a_pCopyEngine->UpdateBuffers(regions.data(), regions.size()); // all ranges go with single submit
+
+  // don't swap here: upload is only recorded, front copy is used for drawing until application calls SwapVertexCopies()
+  //
+  m_pendingFirst = 0;
+  m_pendingNum   = 0;
+  MergeRange(&m_backFirst, &m_backNum, a_firstVert, a_vertsNum);
+}
+
+void vk_geom::CompactMesh_T3V4x2F::SwapVertexCopies()
+{
+  if(!m_doubleBuffered || m_backNum == 0)
+    return;
+
+  m_frontCopy    = 1 - m_frontCopy;
+  m_pendingFirst = m_backFirst;
+  m_pendingNum   = m_backNum;
+  m_backFirst    = 0;
+  m_backNum      = 0;
+}
+
 void vk_geom::CompactMesh_T3V4x2F::UpdateBuffers(const cmesh::SimpleMesh& a_mesh, ICopyEngine* a_pCopyEngine)
 {
   assert(a_mesh.VerticesNum() == m_vertNum);
   assert(a_mesh.IndicesNum()  == m_indNum);
   assert(a_pCopyEngine        != nullptr);
 
-  std::vector<float> vPosNorm4f        (a_mesh.VerticesNum()*4);
-  std::vector<float> vTexCoordAndTang4f(a_mesh.VerticesNum()*4);
+  const int    copies       = m_doubleBuffered ? 2 : 1;
+  const size_t indicesAlloc = (m_indexType == VK_INDEX_TYPE_UINT16) ? Padding(a_mesh.indices.size(), 2) : a_mesh.indices.size();
+  m_pendingFirst = 0;
+  m_pendingNum   = 0;
+  m_backFirst    = 0;
+  m_backNum      = 0;
 
-  for(int i=0;i<a_mesh.VerticesNum();i++)
+  // vertices may be updated later (UpdateVerticesRange), copy engine must know that they are shared by queue families
+  //
+  if(m_concurrentFamilies.size() >= 2)
+  {
+    for(int i=0;i<VertexBuffersNum();i++)
+      a_pCopyEngine->MarkConcurrent(m_vertexBuffers[i]);
+  }
+
+  // direct write path: vertices and indices are encoded right to the mapped device memory, there is no staging copy at all
+  //
+  char* mapped = MappedStorage(a_pCopyEngine);
+  if(mapped != nullptr)
   {
-    vPosNorm4f[i*4+0] = a_mesh.vPos4f[i*4+0];
-    vPosNorm4f[i*4+1] = a_mesh.vPos4f[i*4+1];
-    vPosNorm4f[i*4+2] = a_mesh.vPos4f[i*4+2];
-    vPosNorm4f[i*4+3] = as_float(EncodeNormal(a_mesh.vNorm4f.data() + i*4));    
+    for(int copy = 0; copy < copies; copy++)
+      WriteVertices(mapped, 0, m_vertNum, copy, a_mesh);
+    EncodeIndices(a_mesh, 0, indicesAlloc, mapped + buffOffsets[VertexBuffersNum()]);
+    return;
+  }
+
+  // all vertex streams (of both copies) and indices go to the copy engine as one batch; 
+  // they are encoded by the copy engine to staging memory, so there is no intermediate copy of the mesh
+  //
+  std::vector<ICopyEngine::Region> regions;
+  regions.reserve(5);
+
+  for(int copy = 0; copy < copies; copy++)
+    AddVertexRegions(a_mesh, 0, m_vertNum, copy, &regions);
 
-    vTexCoordAndTang4f[i*4+0] = a_mesh.vTexCoord2f[i*2+0];
-    vTexCoordAndTang4f[i*4+1] = a_mesh.vTexCoord2f[i*2+1];
-    vTexCoordAndTang4f[i*4+2] = as_float(EncodeNormal(a_mesh.vTang4f.data() + i*4));
-    vTexCoordAndTang4f[i*4+3] = 0.0f; // reserved
+  if(m_indexType == VK_INDEX_TYPE_UINT16)
+  {
+    ICopyEngine::Region indices = {m_indexBuffer, 0, nullptr, sizeof(uint16_t)*indicesAlloc};
+    indices.encode      = [this, &a_mesh](size_t a_begin, size_t a_size, void* a_out) { EncodeIndices(a_mesh, a_begin/2, a_size/2, a_out); };
+    indices.granularity = 4;
+    regions.push_back(indices);
   }
+  else
+    regions.push_back(ICopyEngine::Region{m_indexBuffer, 0, a_mesh.indices.data(), sizeof(int)*a_mesh.indices.size()});
 
-  a_pCopyEngine->UpdateBuffer(m_vertexBuffers[0], 0, vPosNorm4f.data(),         sizeof(float)*vPosNorm4f.size());
-  a_pCopyEngine->UpdateBuffer(m_vertexBuffers[1], 0, vTexCoordAndTang4f.data(), sizeof(float)*vTexCoordAndTang4f.size());
-  a_pCopyEngine->UpdateBuffer(m_indexBuffer,      0, a_mesh.indices.data(),     sizeof(int)*a_mesh.indices.size());
+  a_pCopyEngine->UpdateBuffers(regions.data(), regions.size());
 }
 
 std::vector<VkBuffer> vk_geom::CompactMesh_T3V4x2F::VertexBuffers()
 {
-  return std::vector<VkBuffer>(m_vertexBuffers, m_vertexBuffers + 2);
+  return std::vector<VkBuffer>(m_vertexBuffers + m_frontCopy*2, m_vertexBuffers + m_frontCopy*2 + 2);
 }
 
 VkBuffer vk_geom::CompactMesh_T3V4x2F::IndexBuffer()
@@ -183,6 +427,27 @@ VkBuffer vk_geom::CompactMesh_T3V4x2F::IndexBuffer()
   return m_indexBuffer;
 }
 
+VkPipelineVertexInputStateCreateInfo vk_geom::CompactMesh_T3V4x2F::VertexInputLayoutInstanced()
+{
+  auto vertexInputInfo = VertexInputLayout();
+
+  vInputBindings[2].binding   = 2;
+  vInputBindings[2].stride    = sizeof(float) * 16;
+  vInputBindings[2].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+  for(uint32_t col = 0; col < 4; col++) // mat4 takes 4 locations, one per column
+  {
+    vAttributes[2 + col].binding  = 2;
+    vAttributes[2 + col].location = 2 + col;
+    vAttributes[2 + col].format   = VK_FORMAT_R32G32B32A32_SFLOAT;
+    vAttributes[2 + col].offset   = col * sizeof(float) * 4;
+  }
+
+  vertexInputInfo.vertexBindingDescriptionCount   = 3;
+  vertexInputInfo.vertexAttributeDescriptionCount = 6;
+  return vertexInputInfo;
+}
+
 VkPipelineVertexInputStateCreateInfo vk_geom::CompactMesh_T3V4x2F::VertexInputLayout()
 {
   vInputBindings[0].binding   = 0;
@@ -213,7 +478,7 @@ VkPipelineVertexInputStateCreateInfo vk_geom::CompactMesh_T3V4x2F::VertexInputLa
   return vertexInputInfo;   
 }
 
-void vk_geom::CompactMesh_T3V4x2F::DrawCmd(VkCommandBuffer a_cmdBuff)
+void vk_geom::CompactMesh_T3V4x2F::BindCmd(VkCommandBuffer a_cmdBuff)
 {
   auto vertexBuffers = this->VertexBuffers();
   auto indexBuffer   = this->IndexBuffer();
@@ -224,5 +489,531 @@ void vk_geom::CompactMesh_T3V4x2F::DrawCmd(VkCommandBuffer a_cmdBuff)
   
   vkCmdBindVertexBuffers(a_cmdBuff, 0, uint32_t(vertexBuffers.size()), vertexBuffers.data(), offsets.data());
   vkCmdBindIndexBuffer  (a_cmdBuff, indexBuffer, 0, this->IndexType());
-  vkCmdDrawIndexed      (a_cmdBuff, uint32_t(IndicesNum()), 1, 0, 0, 0);
-}
\ No newline at end of file
+}
+
+void vk_geom::CompactMesh_T3V4x2F::DrawCmd(VkCommandBuffer a_cmdBuff)
+{
+  BindCmd(a_cmdBuff);
+  vkCmdDrawIndexed(a_cmdBuff, uint32_t(IndicesNum()), 1, 0, 0, 0);
+}
+
+void vk_geom::CompactMesh_T3V4x2F::DrawInstancedCmd(VkCommandBuffer a_cmdBuff, VkBuffer a_instanceBuffer, VkDeviceSize a_offset, uint32_t a_instancesNum)
+{
+  assert(a_instanceBuffer != nullptr);
+
+  BindCmd(a_cmdBuff);
+  vkCmdBindVertexBuffers(a_cmdBuff, 2, 1, &a_instanceBuffer, &a_offset);
+  vkCmdDrawIndexed      (a_cmdBuff, uint32_t(IndicesNum()), a_instancesNum, 0, 0, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+vk_geom::InstanceMatrices::InstanceMatrices() : m_buffer(nullptr), m_memStorage(nullptr), m_dev(nullptr), m_maxInstances(0), m_instancesNum(0)
+{
+
+}
+
+vk_geom::InstanceMatrices::~InstanceMatrices()
+{
+  if(m_buffer != nullptr && m_dev != nullptr)
+    vkDestroyBuffer(m_dev, m_buffer, NULL);
+}
+
+VkMemoryRequirements vk_geom::InstanceMatrices::CreateBuffers(VkDevice a_dev, int a_maxInstances)
+{
+  assert(a_dev != nullptr); // you should set Vulkan context before using this function
+  assert(a_maxInstances > 0);
+
+  if(m_buffer != nullptr && m_dev != nullptr)
+    vkDestroyBuffer(m_dev, m_buffer, NULL);
+
+  m_dev          = a_dev;
+  m_maxInstances = a_maxInstances;
+  m_instancesNum = 0;
+
+  VkBufferCreateInfo bufferCreateInfo = {};
+  bufferCreateInfo.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferCreateInfo.size        = a_maxInstances*sizeof(float)*16;
+  bufferCreateInfo.usage       = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  VK_CHECK_RESULT(vkCreateBuffer(m_dev, &bufferCreateInfo, NULL, &m_buffer));
+
+  VkMemoryRequirements memoryRequirements;
+  vkGetBufferMemoryRequirements(m_dev, m_buffer, &memoryRequirements);
+  return memoryRequirements;
+}
+
+void vk_geom::InstanceMatrices::BindBuffers(VkDeviceMemory a_memStorage, size_t a_offset)
+{
+  assert(m_dev != nullptr); // you should set Vulkan context before using this function
+
+  if(a_memStorage == nullptr)
+    RUN_TIME_ERROR("[InstanceMatrices::BindBuffers()]: empty input storage!");
+
+  m_memStorage = a_memStorage;
+  VK_CHECK_RESULT(vkBindBufferMemory(m_dev, m_buffer, m_memStorage, a_offset));
+}
+
+void vk_geom::InstanceMatrices::UpdateBuffers(const float* a_matrices, int a_instancesNum, ICopyEngine* a_pCopyEngine)
+{
+  assert(a_pCopyEngine != nullptr);
+
+  if(a_instancesNum > m_maxInstances)
+    RUN_TIME_ERROR("[InstanceMatrices::UpdateBuffers()]: too many instances, increase a_maxInstances in CreateBuffers!");
+
+  m_instancesNum = a_instancesNum;
+  if(a_instancesNum > 0)
+    a_pCopyEngine->UpdateBuffer(m_buffer, 0, a_matrices, a_instancesNum*sizeof(float)*16);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+vk_geom::IndirectDrawList::IndirectDrawList() : m_indirectBuffer(nullptr), m_instanceBuffer(nullptr), m_memStorage(nullptr), m_memOffset(0), m_dev(nullptr), m_maxDraws(0),
+                                                m_multiDrawIndirect(false), m_drawIndirectFirstInstance(false)
+{
+
+}
+
+vk_geom::IndirectDrawList::~IndirectDrawList()
+{
+  DestroyBuffersIfNeeded();
+}
+
+void vk_geom::IndirectDrawList::DestroyBuffersIfNeeded()
+{
+  if(m_indirectBuffer != nullptr && m_instanceBuffer != nullptr && m_dev != nullptr)
+  {
+    vkDestroyBuffer(m_dev, m_indirectBuffer, NULL);
+    vkDestroyBuffer(m_dev, m_instanceBuffer, NULL);
+    m_indirectBuffer = nullptr;
+    m_instanceBuffer = nullptr;
+  }
+}
+
+VkMemoryRequirements vk_geom::IndirectDrawList::CreateBuffers(VkDevice a_dev, int a_maxDraws)
+{
+  assert(a_dev != nullptr); // you should set Vulkan context before using this function
+  assert(a_maxDraws > 0);
+
+  DestroyBuffersIfNeeded();
+
+  m_dev      = a_dev;
+  m_maxDraws = a_maxDraws;
+  m_commands.reserve(a_maxDraws);
+  m_instances.reserve(a_maxDraws);
+
+  VkBufferCreateInfo bufferCreateInfo = {};
+  bufferCreateInfo.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferCreateInfo.size        = a_maxDraws*sizeof(VkDrawIndexedIndirectCommand);
+  bufferCreateInfo.usage       = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  VK_CHECK_RESULT(vkCreateBuffer(m_dev, &bufferCreateInfo, NULL, &m_indirectBuffer));
+
+  bufferCreateInfo.size        = a_maxDraws*sizeof(DrawInstance);
+  bufferCreateInfo.usage       = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  VK_CHECK_RESULT(vkCreateBuffer(m_dev, &bufferCreateInfo, NULL, &m_instanceBuffer));
+
+  VkMemoryRequirements memoryRequirements[2];
+  vkGetBufferMemoryRequirements(m_dev, m_indirectBuffer, &memoryRequirements[0]);
+  vkGetBufferMemoryRequirements(m_dev, m_instanceBuffer, &memoryRequirements[1]);
+
+  buffOffsets[0] = 0;
+  buffOffsets[1] = Padding(memoryRequirements[0].size, memoryRequirements[1].alignment);
+
+  assert(memoryRequirements[0].memoryTypeBits == memoryRequirements[1].memoryTypeBits);
+
+  memoryRequirements[0].size      = Padding(buffOffsets[1] + memoryRequirements[1].size, memoryRequirements[1].alignment);
+  memoryRequirements[0].alignment = std::max(memoryRequirements[0].alignment, memoryRequirements[1].alignment);
+  return memoryRequirements[0];
+}
+
+void vk_geom::IndirectDrawList::BindBuffers(VkDeviceMemory a_memStorage, size_t a_offset)
+{
+  assert(m_dev != nullptr); // you should set Vulkan context before using this function
+
+  if(a_memStorage == nullptr)
+    RUN_TIME_ERROR("[IndirectDrawList::BindBuffers()]: empty input storage!");
+
+  m_memStorage = a_memStorage;
+  m_memOffset  = a_offset;
+
+  VK_CHECK_RESULT(vkBindBufferMemory(m_dev, m_indirectBuffer, m_memStorage, buffOffsets[0] + a_offset));
+  VK_CHECK_RESULT(vkBindBufferMemory(m_dev, m_instanceBuffer, m_memStorage, buffOffsets[1] + a_offset));
+}
+
+void vk_geom::IndirectDrawList::SetFeatures(bool a_multiDrawIndirect, bool a_drawIndirectFirstInstance)
+{
+  m_multiDrawIndirect         = a_multiDrawIndirect;
+  m_drawIndirectFirstInstance = a_drawIndirectFirstInstance;
+}
+
+void vk_geom::IndirectDrawList::Clear()
+{
+  m_commands.clear();
+  m_instances.clear();
+}
+
+uint32_t vk_geom::IndirectDrawList::AddDraw(const cmesh::MeshRange& a_range, const float a_mModel[16], int a_material)
+{
+  if(int(m_commands.size()) >= m_maxDraws)
+    RUN_TIME_ERROR("[IndirectDrawList::AddDraw()]: too many draws, increase a_maxDraws in CreateBuffers!");
+
+  const uint32_t drawId = uint32_t(m_commands.size());
+
+  VkDrawIndexedIndirectCommand cmd = {};
+  cmd.indexCount    = a_range.indexCount;
+  cmd.instanceCount = 1;
+  cmd.firstIndex    = a_range.firstIndex;
+  cmd.vertexOffset  = a_range.vertexOffset;
+  cmd.firstInstance = drawId;                // shader get per-draw data via gl_InstanceIndex
+  m_commands.push_back(cmd);
+
+  DrawInstance inst;
+  memcpy(inst.mModel, a_mModel, sizeof(inst.mModel));
+  inst.material[0] = float(a_material);
+  inst.material[1] = 0.0f;
+  inst.material[2] = 0.0f;
+  inst.material[3] = 0.0f;
+  m_instances.push_back(inst);
+
+  return drawId;
+}
+
+void vk_geom::IndirectDrawList::UpdateBuffers(ICopyEngine* a_pCopyEngine)
+{
+  assert(a_pCopyEngine != nullptr);
+
+  if(m_commands.empty())
+    return;
+
+  const ICopyEngine::Region regions[2] = { {m_indirectBuffer, 0, m_commands.data(),  m_commands.size()*sizeof(VkDrawIndexedIndirectCommand)},
+                                           {m_instanceBuffer, 0, m_instances.data(), m_instances.size()*sizeof(DrawInstance)} };
+  a_pCopyEngine->UpdateBuffers(regions, 2);
+}
+
+void vk_geom::IndirectDrawList::DrawCmd(VkCommandBuffer a_cmdBuff, uint32_t a_firstDraw, uint32_t a_drawsNum)
+{
+  assert(a_firstDraw + a_drawsNum <= DrawsNum());
+
+  if(a_drawsNum == 0)
+    return;
+
+  const uint32_t stride = uint32_t(sizeof(VkDrawIndexedIndirectCommand));
+
+  if(!m_drawIndirectFirstInstance) // firstInstance must be 0 in indirect commands, so we have to draw them directly
+  {
+    for(uint32_t i = a_firstDraw; i < a_firstDraw + a_drawsNum; i++)
+    {
+      const auto& cmd = m_commands[i];
+      vkCmdDrawIndexed(a_cmdBuff, cmd.indexCount, cmd.instanceCount, cmd.firstIndex, cmd.vertexOffset, cmd.firstInstance);
+    }
+  }
+  else if(!m_multiDrawIndirect)    // drawCount must be 0 or 1
+  {
+    for(uint32_t i = a_firstDraw; i < a_firstDraw + a_drawsNum; i++)
+      vkCmdDrawIndexedIndirect(a_cmdBuff, m_indirectBuffer, VkDeviceSize(i)*stride, 1, stride);
+  }
+  else
+    vkCmdDrawIndexedIndirect(a_cmdBuff, m_indirectBuffer, VkDeviceSize(a_firstDraw)*stride, a_drawsNum, stride);
+}
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+vk_geom::MeshDeformer::MeshDeformer() : m_restPoseBuffer(nullptr), m_skinBuffer(nullptr), m_bonesBuffer(nullptr), m_memStorage(nullptr), m_dev(nullptr), 
+                                        m_vertNum(0), m_maxBones(0), m_pipeline(nullptr), m_layout(nullptr), m_dlayout(nullptr), m_pool(nullptr)
+{
+
+}
+
+vk_geom::MeshDeformer::~MeshDeformer()
+{
+  DestroyBuffersIfNeeded();
+
+  if(m_pipeline != nullptr)
+  {
+    vkDestroyPipeline      (m_dev, m_pipeline, nullptr);
+    vkDestroyPipelineLayout(m_dev, m_layout,   nullptr);
+  }
+
+  if(m_pool != nullptr)
+    vkDestroyDescriptorPool(m_dev, m_pool, nullptr);
+
+  if(m_dlayout != nullptr)
+    vkDestroyDescriptorSetLayout(m_dev, m_dlayout, nullptr);
+}
+
+void vk_geom::MeshDeformer::DestroyBuffersIfNeeded()
+{
+  if(m_restPoseBuffer != nullptr && m_dev != nullptr)
+  {
+    vkDestroyBuffer(m_dev, m_restPoseBuffer, NULL);
+    vkDestroyBuffer(m_dev, m_skinBuffer,     NULL);
+    vkDestroyBuffer(m_dev, m_bonesBuffer,    NULL);
+    m_restPoseBuffer = nullptr;
+    m_skinBuffer     = nullptr;
+    m_bonesBuffer    = nullptr;
+  }
+}
+
+VkMemoryRequirements vk_geom::MeshDeformer::CreateBuffers(VkDevice a_dev, int a_vertNum, int a_maxBones)
+{
+  assert(a_dev != nullptr); // you should set Vulkan context before using this function
+  assert(a_vertNum > 0);
+
+  if(a_maxBones <= 0 || a_maxBones > MAX_BONES)
+    RUN_TIME_ERROR("[MeshDeformer::CreateBuffers()]: a_maxBones must be in [1, MAX_BONES]");
+
+  DestroyBuffersIfNeeded();
+
+  m_dev      = a_dev;
+  m_vertNum  = a_vertNum;
+  m_maxBones = a_maxBones;
+
+  VkBufferCreateInfo bufferCreateInfo = {};
+  bufferCreateInfo.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferCreateInfo.size        = a_vertNum*sizeof(float)*4;
+  bufferCreateInfo.usage       = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT; // src for RestPoseCmd
+  bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  VK_CHECK_RESULT(vkCreateBuffer(m_dev, &bufferCreateInfo, NULL, &m_restPoseBuffer));
+
+  bufferCreateInfo.usage       = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  bufferCreateInfo.size        = a_vertNum*sizeof(SkinVertex);
+  VK_CHECK_RESULT(vkCreateBuffer(m_dev, &bufferCreateInfo, NULL, &m_skinBuffer));
+
+  bufferCreateInfo.size        = a_maxBones*sizeof(float)*16;
+  VK_CHECK_RESULT(vkCreateBuffer(m_dev, &bufferCreateInfo, NULL, &m_bonesBuffer));
+
+  VkMemoryRequirements memoryRequirements[3];
+  vkGetBufferMemoryRequirements(m_dev, m_restPoseBuffer, &memoryRequirements[0]);
+  vkGetBufferMemoryRequirements(m_dev, m_skinBuffer,     &memoryRequirements[1]);
+  vkGetBufferMemoryRequirements(m_dev, m_bonesBuffer,    &memoryRequirements[2]);
+
+  buffOffsets[0] = 0;
+  buffOffsets[1] = Padding(buffOffsets[0] + memoryRequirements[0].size, memoryRequirements[1].alignment);
+  buffOffsets[2] = Padding(buffOffsets[1] + memoryRequirements[1].size, memoryRequirements[2].alignment);
+
+  assert(memoryRequirements[0].memoryTypeBits == memoryRequirements[1].memoryTypeBits);
+  assert(memoryRequirements[0].memoryTypeBits == memoryRequirements[2].memoryTypeBits);
+
+  memoryRequirements[0].alignment = std::max(memoryRequirements[0].alignment, std::max(memoryRequirements[1].alignment, memoryRequirements[2].alignment));
+  memoryRequirements[0].size      = Padding(buffOffsets[2] + memoryRequirements[2].size, memoryRequirements[0].alignment);
+  return memoryRequirements[0];
+}
+
+void vk_geom::MeshDeformer::BindBuffers(VkDeviceMemory a_memStorage, size_t a_offset)
+{
+  assert(m_dev != nullptr); // you should set Vulkan context before using this function
+
+  if(a_memStorage == nullptr)
+    RUN_TIME_ERROR("[MeshDeformer::BindBuffers()]: empty input storage!");
+
+  m_memStorage = a_memStorage;
+
+  VK_CHECK_RESULT(vkBindBufferMemory(m_dev, m_restPoseBuffer, m_memStorage, buffOffsets[0] + a_offset));
+  VK_CHECK_RESULT(vkBindBufferMemory(m_dev, m_skinBuffer,     m_memStorage, buffOffsets[1] + a_offset));
+  VK_CHECK_RESULT(vkBindBufferMemory(m_dev, m_bonesBuffer,    m_memStorage, buffOffsets[2] + a_offset));
+}
+
+void vk_geom::MeshDeformer::CreatePipeline(const char* a_cspath)
+{
+  assert(m_dev != nullptr); // call CreateBuffers first
+
+  auto shaderCode = vk_utils::ReadFile(a_cspath);
+  if(shaderCode.size() == 0)
+    RUN_TIME_ERROR("[MeshDeformer::CreatePipeline]: can not load shader");
+
+  VkShaderModule shaderModule = vk_utils::CreateShaderModule(m_dev, shaderCode);
+
+  // binding = 0: rest pose, 1: skin, 2: bones, 3: destination vertex buffer
+  //
+  VkDescriptorSetLayoutBinding descriptorSetLayoutBinding[4] = {};
+  for(uint32_t i=0;i<4;i++)
+  {
+    descriptorSetLayoutBinding[i].binding            = i;
+    descriptorSetLayoutBinding[i].descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorSetLayoutBinding[i].descriptorCount    = 1;
+    descriptorSetLayoutBinding[i].stageFlags         = VK_SHADER_STAGE_COMPUTE_BIT;
+    descriptorSetLayoutBinding[i].pImmutableSamplers = nullptr;
+  }
+
+  VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {};
+  descriptorSetLayoutCreateInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  descriptorSetLayoutCreateInfo.bindingCount = 4;
+  descriptorSetLayoutCreateInfo.pBindings    = descriptorSetLayoutBinding;
+  VK_CHECK_RESULT(vkCreateDescriptorSetLayout(m_dev, &descriptorSetLayoutCreateInfo, NULL, &m_dlayout));
+
+  VkDescriptorPoolSize poolSize = {};
+  poolSize.type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  poolSize.descriptorCount = 4*MAX_TARGETS;
+
+  VkDescriptorPoolCreateInfo poolCreateInfo = {};
+  poolCreateInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolCreateInfo.maxSets       = MAX_TARGETS;
+  poolCreateInfo.poolSizeCount = 1;
+  poolCreateInfo.pPoolSizes    = &poolSize;
+  VK_CHECK_RESULT(vkCreateDescriptorPool(m_dev, &poolCreateInfo, NULL, &m_pool));
+
+  VkPushConstantRange pcRange = {};
+  pcRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  pcRange.offset     = 0;
+  pcRange.size       = 2*sizeof(uint32_t);
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+  pipelineLayoutInfo.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount         = 1;
+  pipelineLayoutInfo.pSetLayouts            = &m_dlayout;
+  pipelineLayoutInfo.pushConstantRangeCount = 1;
+  pipelineLayoutInfo.pPushConstantRanges    = &pcRange;
+  if (vkCreatePipelineLayout(m_dev, &pipelineLayoutInfo, nullptr, &m_layout) != VK_SUCCESS)
+    throw std::runtime_error("[MeshDeformer::CreatePipeline]: failed to create pipeline layout!");
+
+  VkComputePipelineCreateInfo pipelineInfo = {};
+  pipelineInfo.sType        = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.stage.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipelineInfo.stage.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipelineInfo.stage.module = shaderModule;
+  pipelineInfo.stage.pName  = "main";
+  pipelineInfo.layout       = m_layout;
+  if (vkCreateComputePipelines(m_dev, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipeline) != VK_SUCCESS)
+    throw std::runtime_error("[MeshDeformer::CreatePipeline]: failed to create compute pipeline!");
+
+  vkDestroyShaderModule(m_dev, shaderModule, nullptr);
+}
+
+void vk_geom::MeshDeformer::UpdateBuffers(const cmesh::SimpleMesh& a_restPose, const SkinVertex* a_skin, ICopyEngine* a_pCopyEngine)
+{
+  assert(int(a_restPose.VerticesNum()) == m_vertNum);
+  assert(a_skin        != nullptr);
+  assert(a_pCopyEngine != nullptr);
+
+  // same encoding as position/normal stream of CompactMesh_T3V4x2F
+  //
+  std::vector<float> vPosNorm4f(m_vertNum*4);
+  for(int i=0;i<m_vertNum;i++)
+  {
+    vPosNorm4f[i*4+0] = a_restPose.vPos4f[i*4+0];
+    vPosNorm4f[i*4+1] = a_restPose.vPos4f[i*4+1];
+    vPosNorm4f[i*4+2] = a_restPose.vPos4f[i*4+2];
+    vPosNorm4f[i*4+3] = as_float(EncodeNormal(a_restPose.vNorm4f.data() + i*4));
+  }
+
+  const ICopyEngine::Region regions[2] = { {m_restPoseBuffer, 0, vPosNorm4f.data(), sizeof(float)*vPosNorm4f.size()},
+                                           {m_skinBuffer,     0, a_skin,            sizeof(SkinVertex)*m_vertNum} };
+  a_pCopyEngine->UpdateBuffers(regions, 2);
+}
+
+void vk_geom::MeshDeformer::UpdateBonesCmd(VkCommandBuffer a_cmdBuff, const float* a_matrices, int a_bonesNum)
+{
+  if(a_bonesNum <= 0 || a_bonesNum > m_maxBones)
+    RUN_TIME_ERROR("[MeshDeformer::UpdateBonesCmd()]: a_bonesNum must be in [1, a_maxBones]");
+
+  // previous deformations may still read bones
+  //
+  VkMemoryBarrier memBar = {};
+  memBar.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  memBar.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  memBar.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memBar, 0, nullptr, 0, nullptr);
+
+  vkCmdUpdateBuffer(a_cmdBuff, m_bonesBuffer, 0, a_bonesNum*sizeof(float)*16, a_matrices);
+
+  memBar.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  memBar.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memBar, 0, nullptr, 0, nullptr);
+}
+
+VkDescriptorSet vk_geom::MeshDeformer::DescriptorSetFor(VkBuffer a_dstPosNorm)
+{
+  for(const auto& dset : m_dsets)
+    if(dset.first == a_dstPosNorm)
+      return dset.second;
+
+  if(m_dsets.size() >= MAX_TARGETS)
+    RUN_TIME_ERROR("[MeshDeformer::DescriptorSetFor()]: too many destination buffers, increase MAX_TARGETS");
+
+  VkDescriptorSet dset = nullptr;
+
+  VkDescriptorSetAllocateInfo allocInfo = {};
+  allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool     = m_pool;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts        = &m_dlayout;
+  VK_CHECK_RESULT(vkAllocateDescriptorSets(m_dev, &allocInfo, &dset));
+
+  VkDescriptorBufferInfo buffInfo[4] = {};
+  VkBuffer               buffers[4]  = {m_restPoseBuffer, m_skinBuffer, m_bonesBuffer, a_dstPosNorm};
+  VkWriteDescriptorSet   writes[4]   = {};
+  for(uint32_t i=0;i<4;i++)
+  {
+    buffInfo[i].buffer = buffers[i];
+    buffInfo[i].offset = 0;
+    buffInfo[i].range  = VK_WHOLE_SIZE;
+
+    writes[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[i].dstSet          = dset;
+    writes[i].dstBinding      = i;
+    writes[i].descriptorCount = 1;
+    writes[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[i].pBufferInfo     = &buffInfo[i];
+  }
+  vkUpdateDescriptorSets(m_dev, 4, writes, 0, nullptr);
+
+  m_dsets.push_back(std::make_pair(a_dstPosNorm, dset));
+  return dset;
+}
+
+void vk_geom::MeshDeformer::DeformCmd(VkCommandBuffer a_cmdBuff, VkBuffer a_dstPosNorm, uint32_t a_dstFirstVert)
+{
+  assert(m_pipeline != nullptr); // call CreatePipeline first
+
+  VkDescriptorSet dset = DescriptorSetFor(a_dstPosNorm);
+
+  // previous draws may still read vertices that we are going to overwrite
+  //
+  VkMemoryBarrier memBar = {};
+  memBar.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  memBar.srcAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+  memBar.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memBar, 0, nullptr, 0, nullptr);
+
+  const uint32_t params[2] = {a_dstFirstVert, uint32_t(m_vertNum)};
+  const uint32_t groupSize = 64; // must match local_size_x in the shader
+
+  vkCmdBindPipeline      (a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+  vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_COMPUTE, m_layout, 0, 1, &dset, 0, NULL);
+  vkCmdPushConstants     (a_cmdBuff, m_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), params);
+  vkCmdDispatch          (a_cmdBuff, (uint32_t(m_vertNum) + groupSize - 1)/groupSize, 1, 1);
+
+  // make deformed vertices visible for both shadow and main passes
+  //
+  memBar.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  memBar.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &memBar, 0, nullptr, 0, nullptr);
+}
+
+void vk_geom::MeshDeformer::RestPoseCmd(VkCommandBuffer a_cmdBuff, VkBuffer a_dstPosNorm, uint32_t a_dstFirstVert)
+{
+  assert(m_restPoseBuffer != nullptr); // call CreateBuffers first
+
+  // previous draws may still read vertices and previous deformation may still write them
+  //
+  VkMemoryBarrier memBar = {};
+  memBar.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  memBar.srcAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  memBar.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memBar, 0, nullptr, 0, nullptr);
+
+  // rest pose has the same encoding as position/normal stream of CompactMesh_T3V4x2F, so it is just copied
+  //
+  VkBufferCopy region = {};
+  region.srcOffset = 0;
+  region.dstOffset = VkDeviceSize(a_dstFirstVert)*sizeof(float)*4;
+  region.size      = VkDeviceSize(m_vertNum)*sizeof(float)*4;
+  vkCmdCopyBuffer(a_cmdBuff, m_restPoseBuffer, a_dstPosNorm, 1, &region);
+
+  memBar.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  memBar.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &memBar, 0, nullptr, 0, nullptr);
+}
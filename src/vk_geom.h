@@ -11,6 +11,7 @@
 #include <stdexcept>
 #include <sstream>
 #include <memory>
+#include <functional>
 
 #include "cmesh.h"
 
@@ -26,6 +27,52 @@ namespace vk_geom
 
     virtual void UpdateBuffer(VkBuffer a_dst, size_t a_dstOffset, const void* a_src, size_t a_size) = 0;
 
+    struct Region
+    {
+      VkBuffer    dst;
+      size_t      dstOffset;
+      const void* src;         ///< ignored if 'encode' is not empty
+      size_t      size;
+      std::function<void(size_t a_begin, size_t a_size, void* a_out)> encode; ///< writes bytes [a_begin, a_begin + a_size) of region to a_out (i.e. to staging memory); 
+                                                                               ///< may be called concurrently for disjoint ranges
+      size_t      granularity = 4; ///< ranges for 'encode' are multiple of it
+    };
+
+    /**
+    \brief Update several buffer regions at once. Implementation should pack them to staging memory and submit them together;
+           default implementation just calls UpdateBuffer for each region. Regions of the same buffer must not overlap.
+    \param a_regions    - input regions; source data must be valid until this call returns
+    \param a_regionsNum - input regions number
+    */
+    virtual void UpdateBuffers(const Region* a_regions, size_t a_regionsNum) 
+    { 
+      std::vector<char> encoded;
+      for(size_t i=0;i<a_regionsNum;i++) 
+      {
+        const void* src = a_regions[i].src;
+        if(a_regions[i].encode)
+        {
+          encoded.resize(a_regions[i].size);
+          a_regions[i].encode(0, a_regions[i].size, encoded.data());
+          src = encoded.data();
+        }
+        UpdateBuffer(a_regions[i].dst, a_regions[i].dstOffset, src, a_regions[i].size); 
+      }
+    }
+
+    /**
+    \brief Direct write path (resizable BAR or integrated GPU): host pointer to the beginning of a_memory if it is persistently mapped 
+           device local memory, nullptr otherwise (then data goes through UpdateBuffer/UpdateBuffers). Writes through this pointer 
+           are visible to the device after the next queue submit; default implementation has no direct write memory.
+    */
+    virtual void* MappedMemory(VkDeviceMemory /*a_memory*/) { return nullptr; }
+
+    /**
+    \brief a_buffer is created with VK_SHARING_MODE_CONCURRENT, so copy engine must not transfer its ownership between queue families;
+           default implementation has no ownership transfers at all.
+    */
+    virtual void MarkConcurrent(VkBuffer /*a_buffer*/) {}
+
   protected:
     ICopyEngine(const ICopyEngine& rhs) {}
     ICopyEngine& operator=(const ICopyEngine& rhs) { return *this; }    
@@ -44,6 +91,7 @@ namespace vk_geom
     * \param a_vertNum  - input vertices number
     * \param a_indexNum - input indices number
     *
+    *        Implementation may select 16 bit indices when a_vertNum < 65536; check IndexType() after this call.
     */
     virtual VkMemoryRequirements CreateBuffers(VkDevice a_dev, int a_vertNum, int a_indexNum) = 0;
 
@@ -65,11 +113,50 @@ namespace vk_geom
  
     */
     virtual void UpdateBuffers(const cmesh::SimpleMesh& a_mesh, ICopyEngine* a_pCopyEngine) = 0;
+
+   /**
+    * \brief Updates only vertices [a_firstVert, a_firstVert + a_vertsNum) of a dynamic mesh (i.e. from CPU to GPU); indices are not touched.
+    * \param a_mesh        - input simple mesh with the whole current vertex data (only the range is read)
+    * \param a_firstVert   - input first changed vertex
+    * \param a_vertsNum    - input number of changed vertices
+    * \param a_pCopyEngine - input user implementation of UpdateBuffer function 
+    *
+    *        Only the given range is encoded and uploaded. If mesh is double buffered, data goes to the back copy which is not used by the GPU now; 
+    *        BindCmd/DrawCmd keep using the front copy until SwapVertexCopies() is called, so frames never read half-written vertices.
+    *        Copy engine may record upload and submit it later, so it is the application who knows when the upload is complete.
+    *        Single buffered mesh is always updated with copy engine commands, direct write path (see ICopyEngine::MappedMemory) is used for back copy only.
+    */
+    virtual void UpdateVerticesRange(const cmesh::SimpleMesh& a_mesh, int a_firstVert, int a_vertsNum, ICopyEngine* a_pCopyEngine) = 0;
+
+   /**
+    * \brief Make vertices of previous UpdateVerticesRange calls visible for the next BindCmd/DrawCmd (does nothing for single buffered mesh).
+    *        Call it only after the upload is complete (i.e. copy engine ticket is waited for) and ownership of the buffers is acquired 
+    *        by the drawing queue; command buffers recorded before this call still use the old copy.
+    */
+    virtual void SwapVertexCopies() = 0;
     
     virtual VkPipelineVertexInputStateCreateInfo VertexInputLayout() = 0;
 
+    /**
+    \brief Same as VertexInputLayout() plus per-instance mat4 (4 x float4, column-major) at binding = 2, locations = [2..5].
+    */
+    virtual VkPipelineVertexInputStateCreateInfo VertexInputLayoutInstanced() = 0;
+
     virtual void DrawCmd(VkCommandBuffer a_cmdBuff) = 0;
 
+    /**
+    \brief Draw a_instancesNum copies of mesh with single call; pipeline must be created with VertexInputLayoutInstanced().
+    \param a_cmdBuff        - output command buffer
+    \param a_instanceBuffer - input buffer of per-instance matrices (16 floats per instance); it is bound to vertex binding 2
+    \param a_offset         - input offset in a_instanceBuffer
+    \param a_instancesNum   - input number of instances to draw
+    */
+    virtual void DrawInstancedCmd(VkCommandBuffer a_cmdBuff, VkBuffer a_instanceBuffer, VkDeviceSize a_offset, uint32_t a_instancesNum) = 0;
+
+    /**
+    \brief Bind vertex and index buffers only, so that application could issue draw commands for this mesh by itself (for example, indirect ones).
+    */
+    virtual void BindCmd(VkCommandBuffer a_cmdBuff) = 0;
 
     // normally you should not use this functions, but there still could be a reason to directly access these data
     // 
@@ -104,43 +191,260 @@ namespace vk_geom
   // float4(0): float3 pos; uint normCompressed; 
   // float4(1): float2 texCoord; uint tangentCompressed; float reserve; 
   //
+  // if a_doubleBuffered is true, there are 2 copies of vertex buffers for dynamic geometry (see UpdateVerticesRange);
+  // 2 copies are enough while application has no more than 1 frame in flight.
+  //
   struct CompactMesh_T3V4x2F : public IMesh
   {
-    CompactMesh_T3V4x2F();
+    /**
+    \param a_doubleBuffered     - input keep two copies of vertices for UpdateVerticesRange (see IMesh::SwapVertexCopies)
+    \param a_concurrentFamilies - input if there are 2 or more families, vertex buffers are shared by them (VK_SHARING_MODE_CONCURRENT),
+                                  so that they can be updated repeatedly by a transfer queue of other family without ownership transfers
+    */
+    CompactMesh_T3V4x2F(bool a_doubleBuffered = false, const std::vector<uint32_t>& a_concurrentFamilies = {});
     ~CompactMesh_T3V4x2F();
 
     VkMemoryRequirements                 CreateBuffers(VkDevice a_dev, int a_vertNum, int a_indexNum)               override;
     void                                 BindBuffers(VkDeviceMemory a_memStorage, size_t a_offset)                  override;
     void                                 UpdateBuffers(const cmesh::SimpleMesh& a_mesh, ICopyEngine* a_pCopyEngine) override;
+    void                                 UpdateVerticesRange(const cmesh::SimpleMesh& a_mesh, int a_firstVert, int a_vertsNum, ICopyEngine* a_pCopyEngine) override;
+    void                                 SwapVertexCopies() override;
     
     void                                 DrawCmd(VkCommandBuffer a_cmdBuff) override;
+    void                                 DrawInstancedCmd(VkCommandBuffer a_cmdBuff, VkBuffer a_instanceBuffer, VkDeviceSize a_offset, uint32_t a_instancesNum) override;
+    void                                 BindCmd(VkCommandBuffer a_cmdBuff) override;
     VkPipelineVertexInputStateCreateInfo VertexInputLayout()                override;
+    VkPipelineVertexInputStateCreateInfo VertexInputLayoutInstanced()       override;
 
     std::vector<VkBuffer>                VertexBuffers()   override;
     VkBuffer                             IndexBuffer()     override;
 
     size_t                               VerticesNum() const  override { return size_t(m_vertNum); };
     size_t                               IndicesNum()  const  override { return size_t(m_indNum); };
+    VkIndexType                          IndexType()   const  override { return m_indexType; }
 
   protected:
 
     void DestroyBuffersIfNeeded();
-
-    VkBuffer         m_vertexBuffers[2];
+    void EncodeVertices  (const cmesh::SimpleMesh& a_mesh, int a_firstVert, int a_vertsNum, float* a_posNorm, float* a_texTang) const; ///< null output stream is skipped
+    void EncodeIndices   (const cmesh::SimpleMesh& a_mesh, size_t a_first, size_t a_num, void* a_dst) const;                        ///< zero indices past the end (padding)
+    void WriteVertices   (char* a_mapped, int a_firstVert, int a_vertsNum, int a_copy, const cmesh::SimpleMesh& a_mesh) const;
+    char* MappedStorage  (ICopyEngine* a_pCopyEngine) const;
+    void AddVertexRegions(const cmesh::SimpleMesh& a_mesh, int a_firstVert, int a_vertsNum, int a_copy, std::vector<ICopyEngine::Region>* a_pRegions) const;
+    int  VertexBuffersNum() const { return m_doubleBuffered ? 4 : 2; }
+
+    VkBuffer         m_vertexBuffers[4]; ///!< [2*copy + stream]; copy 1 exists only for double buffered mesh
     VkBuffer         m_indexBuffer;
     MemoryLocation   m_memStorage;
     VkDevice         m_dev;
 
     int m_vertNum, m_indNum;
+    VkIndexType m_indexType = VK_INDEX_TYPE_UINT32; ///!< UINT16 if all indices fit in 16 bit
+
+    bool m_doubleBuffered;
+    std::vector<uint32_t> m_concurrentFamilies;
+    int  m_frontCopy;                  ///!< vertex buffers copy that is used for drawing
+    int  m_pendingFirst, m_pendingNum; ///!< range that was written to front copy only, back copy must get it on next update
+    int  m_backFirst,    m_backNum;    ///!< range that was written to back copy since last swap, front copy misses it after swap
 
     // temporary data
     //
-    VkVertexInputBindingDescription   vInputBindings[2] = {};
-    VkVertexInputAttributeDescription vAttributes[2]    = {};
-    size_t                            buffOffsets[3]    = {};
+    VkVertexInputBindingDescription   vInputBindings[3] = {};
+    VkVertexInputAttributeDescription vAttributes[6]    = {};
+    size_t                            buffOffsets[5]    = {};
+
+  };
+
+  // per-instance matrices for hardware instancing (IMesh::DrawInstancedCmd); each instance is a float4x4 in the same memory layout as LiteMath::float4x4
+  //
+  struct InstanceMatrices
+  {
+    InstanceMatrices();
+    ~InstanceMatrices();
+
+    VkMemoryRequirements CreateBuffers(VkDevice a_dev, int a_maxInstances);
+    void                 BindBuffers(VkDeviceMemory a_memStorage, size_t a_offset);
+    void                 UpdateBuffers(const float* a_matrices, int a_instancesNum, ICopyEngine* a_pCopyEngine); ///< a_matrices size is 16*a_instancesNum
+
+    VkBuffer             Buffer()       const { return m_buffer; }
+    uint32_t             InstancesNum() const { return uint32_t(m_instancesNum); }
+    uint32_t             MaxInstances() const { return uint32_t(m_maxInstances); }
+
+  protected:
+
+    InstanceMatrices(const InstanceMatrices& a_rhs) = delete;
+    InstanceMatrices& operator=(const InstanceMatrices& a_rhs) = delete;
+
+    VkBuffer       m_buffer;
+    VkDeviceMemory m_memStorage;
+    VkDevice       m_dev;
+    int            m_maxInstances;
+    int            m_instancesNum;
+  };
+
+  // per-draw data for indirect submission; shaders read it from SSBO (std430) by gl_InstanceIndex, 
+  // because we set firstInstance of each indirect command equal to its draw id.
+  //
+  struct DrawInstance
+  {
+    float mModel[16];  // same memory layout as LiteMath::float4x4, i.e. column-major
+    float material[4]; // x - material (texture array layer), so that draws of different materials go out with the same indirect call
+  };
+
+  // List of draws for multi-draw-indirect submission. All draws must refer to the same vertex and index buffers (i.e. to a merged mesh).
+  // The whole list (or any contiguous part of it) goes out with a single vkCmdDrawIndexedIndirect.
+  //
+  struct IndirectDrawList
+  {
+    IndirectDrawList();
+    ~IndirectDrawList();
 
+    /**
+    \brief Creates indirect and per-draw (SSBO) buffers but DO NOT allocate memory and do not bind buffers to a memory location
+    \param a_dev      - input device in which the list will be bound to.
+    \param a_maxDraws - input maximum number of draws
+    */
+    VkMemoryRequirements CreateBuffers(VkDevice a_dev, int a_maxDraws);
+    void                 BindBuffers(VkDeviceMemory a_memStorage, size_t a_offset);
+
+    /**
+    \brief Set features that are really enabled on the device; if they are absent DrawCmd will fall back to one draw per command.
+    \param a_multiDrawIndirect         - VkPhysicalDeviceFeatures::multiDrawIndirect
+    \param a_drawIndirectFirstInstance - VkPhysicalDeviceFeatures::drawIndirectFirstInstance
+    */
+    void                 SetFeatures(bool a_multiDrawIndirect, bool a_drawIndirectFirstInstance);
+
+    void                 Clear();
+    uint32_t             AddDraw(const cmesh::MeshRange& a_range, const float a_mModel[16], int a_material = 0); ///< returns draw id
+    void                 UpdateBuffers(ICopyEngine* a_pCopyEngine);
+
+    /**
+    \brief Record draws [a_firstDraw, a_firstDraw + a_drawsNum). Mesh buffers and per-draw SSBO must be bound by application.
+    */
+    void                 DrawCmd(VkCommandBuffer a_cmdBuff, uint32_t a_firstDraw, uint32_t a_drawsNum);
+    void                 DrawCmd(VkCommandBuffer a_cmdBuff) { DrawCmd(a_cmdBuff, 0, DrawsNum()); }
+
+    VkBuffer             IndirectBuffer() const { return m_indirectBuffer; }
+    VkBuffer             InstanceBuffer() const { return m_instanceBuffer; }
+    uint32_t             DrawsNum()       const { return uint32_t(m_commands.size()); }
+    uint32_t             MaxDraws()       const { return uint32_t(m_maxDraws); }
+
+  protected:
+
+    IndirectDrawList(const IndirectDrawList& a_rhs) = delete;
+    IndirectDrawList& operator=(const IndirectDrawList& a_rhs) = delete;
+
+    void DestroyBuffersIfNeeded();
+
+    VkBuffer       m_indirectBuffer;
+    VkBuffer       m_instanceBuffer;
+    VkDeviceMemory m_memStorage;
+    size_t         m_memOffset;
+    VkDevice       m_dev;
+    int            m_maxDraws;
+
+    bool           m_multiDrawIndirect;
+    bool           m_drawIndirectFirstInstance;
+
+    std::vector<VkDrawIndexedIndirectCommand> m_commands;
+    std::vector<DrawInstance>                 m_instances;
+    size_t                                    buffOffsets[2] = {};
   };
 
+  // per-vertex skinning data for MeshDeformer; up to 4 bones per vertex, unused bones should have zero weight
+  //
+  struct SkinVertex
+  {
+    float    weights[4];
+    uint32_t bones[4];
+  };
+
+  // Deforms position/normal stream (i.e. VertexBuffers()[0] of CompactMesh_T3V4x2F) on GPU with compute shader, so that 
+  // animated mesh is shared by all passes without CPU re-encoding. Rest pose and skin weights are uploaded once, 
+  // bone matrices are updated inside the frame command buffer. Tangent stream is not touched.
+  //
+  struct MeshDeformer
+  {
+    enum {MAX_TARGETS = 8};      ///< maximum number of different destination buffers for DeformCmd
+    enum {MAX_BONES   = 1024};   ///< bone matrices are updated with vkCmdUpdateBuffer which is limited with 65536 bytes
+
+    MeshDeformer();
+    ~MeshDeformer();
+
+    /**
+    \brief Creates rest pose, skin and bone buffers but DO NOT allocate memory and do not bind buffers to a memory location
+    \param a_dev      - input device in which the deformer will be bound to.
+    \param a_vertNum  - input vertices number of deformed mesh
+    \param a_maxBones - input maximum number of bones
+    */
+    VkMemoryRequirements CreateBuffers(VkDevice a_dev, int a_vertNum, int a_maxBones);
+    void                 BindBuffers(VkDeviceMemory a_memStorage, size_t a_offset);
+
+    /**
+    \brief Creates compute pipeline; must be called after CreateBuffers
+    \param a_cspath - input path to skinning compute shader (compiled to SPIR-V)
+    */
+    void                 CreatePipeline(const char* a_cspath);
+
+    /**
+    \brief Upload rest pose and skin data (i.e. from CPU to GPU).
+    \param a_restPose    - input mesh in rest pose; only positions and normals are used
+    \param a_skin        - input skin data, a_restPose.VerticesNum() elements
+    \param a_pCopyEngine - input user implementation of UpdateBuffer function 
+    */
+    void                 UpdateBuffers(const cmesh::SimpleMesh& a_restPose, const SkinVertex* a_skin, ICopyEngine* a_pCopyEngine);
+
+    /**
+    \brief Record bone matrices update; must be called outside of render pass before DeformCmd
+    \param a_cmdBuff  - output command buffer
+    \param a_matrices - input bone matrices, 16*a_bonesNum floats (same memory layout as LiteMath::float4x4)
+    \param a_bonesNum - input bones number
+    */
+    void                 UpdateBonesCmd(VkCommandBuffer a_cmdBuff, const float* a_matrices, int a_bonesNum);
+
+    /**
+    \brief Record deformation; result is visible for vertex input of next draws; must be called outside of render pass
+    \param a_cmdBuff      - output command buffer
+    \param a_dstPosNorm   - input position/normal vertex buffer to write; it must be created with VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+    \param a_dstFirstVert - input first vertex in a_dstPosNorm (for merged meshes, i.e. cmesh::MeshRange::vertexOffset)
+    */
+    void                 DeformCmd(VkCommandBuffer a_cmdBuff, VkBuffer a_dstPosNorm, uint32_t a_dstFirstVert);
+
+    /**
+    \brief Record copy of rest pose to the destination vertex buffer, i.e. undo DeformCmd (when animation is stopped, for example); 
+           result is visible for vertex input of next draws; must be called outside of render pass
+    \param a_cmdBuff      - output command buffer
+    \param a_dstPosNorm   - input position/normal vertex buffer to write; it must be created with VK_BUFFER_USAGE_TRANSFER_DST_BIT
+    \param a_dstFirstVert - input first vertex in a_dstPosNorm (for merged meshes, i.e. cmesh::MeshRange::vertexOffset)
+    */
+    void                 RestPoseCmd(VkCommandBuffer a_cmdBuff, VkBuffer a_dstPosNorm, uint32_t a_dstFirstVert);
+
+    uint32_t             VerticesNum() const { return uint32_t(m_vertNum); }
+
+  protected:
+
+    MeshDeformer(const MeshDeformer& a_rhs) = delete;
+    MeshDeformer& operator=(const MeshDeformer& a_rhs) = delete;
+
+    void            DestroyBuffersIfNeeded();
+    VkDescriptorSet DescriptorSetFor(VkBuffer a_dstPosNorm);
+
+    VkBuffer              m_restPoseBuffer;
+    VkBuffer              m_skinBuffer;
+    VkBuffer              m_bonesBuffer;
+    VkDeviceMemory        m_memStorage;
+    VkDevice              m_dev;
+    int                   m_vertNum;
+    int                   m_maxBones;
+
+    VkPipeline            m_pipeline;
+    VkPipelineLayout      m_layout;
+    VkDescriptorSetLayout m_dlayout;
+    VkDescriptorPool      m_pool;
+
+    std::vector< std::pair<VkBuffer, VkDescriptorSet> > m_dsets; ///!< one descriptor set per destination buffer
+    size_t                                              buffOffsets[3] = {};
+  };
 
 };
 
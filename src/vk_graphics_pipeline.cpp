@@ -71,6 +71,14 @@ VkPipelineInputAssemblyStateCreateInfo vk_utils::IA_LSList()
 
 
 VkPipelineLayout vk_utils::GraphicsPipelineBuilder::Layout(VkDevice a_device, VkDescriptorSetLayout a_dslayout, uint32_t a_pcRangeSize)
+{
+  std::vector<VkDescriptorSetLayout> dslayouts;
+  if(a_dslayout != VK_NULL_HANDLE)
+    dslayouts.push_back(a_dslayout);
+  return Layout(a_device, dslayouts, a_pcRangeSize);
+}
+
+VkPipelineLayout vk_utils::GraphicsPipelineBuilder::Layout(VkDevice a_device, const std::vector<VkDescriptorSetLayout>& a_dslayouts, uint32_t a_pcRangeSize)
 {
   auto m_device = a_device;
 
@@ -85,10 +93,10 @@ VkPipelineLayout vk_utils::GraphicsPipelineBuilder::Layout(VkDevice a_device, Vk
   pipelineLayoutInfo.pushConstantRangeCount = 1;
   pipelineLayoutInfo.pPushConstantRanges    = &pcRange;
 
-  if(a_dslayout != VK_NULL_HANDLE)
+  if(!a_dslayouts.empty())
   {
-    pipelineLayoutInfo.pSetLayouts            = &a_dslayout; //&descriptorSetLayout;
-    pipelineLayoutInfo.setLayoutCount         = 1;
+    pipelineLayoutInfo.pSetLayouts            = a_dslayouts.data();
+    pipelineLayoutInfo.setLayoutCount         = uint32_t(a_dslayouts.size());
   }
   else
   {
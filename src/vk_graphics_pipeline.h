@@ -42,6 +42,7 @@ namespace vk_utils
     void Shaders(VkDevice a_device, const std::unordered_map<VkShaderStageFlagBits, std::string> &shader_paths);
 
     VkPipelineLayout Layout(VkDevice a_device, VkDescriptorSetLayout a_dslayout, uint32_t a_pcRangeSize);
+    VkPipelineLayout Layout(VkDevice a_device, const std::vector<VkDescriptorSetLayout>& a_dslayouts, uint32_t a_pcRangeSize); ///< set = i for a_dslayouts[i]
 
     void             DefaultState_Simple3D(uint32_t a_width, uint32_t a_height);
 
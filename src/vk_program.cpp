@@ -46,6 +46,16 @@ void vk_utils::ProgramBindings::BindBuffer(uint32_t a_loc, VkBufferView a_buffVi
   m_currBindings[a_loc] = bind;
 }
 
+void vk_utils::ProgramBindings::BindStorageBuffer(uint32_t a_loc, VkBuffer a_buffer)
+{
+  PBinding bind;
+  bind.buffView  = nullptr;
+  bind.buffer    = a_buffer;
+  bind.imageView = nullptr;
+  bind.type      = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  m_currBindings[a_loc] = bind;
+}
+
 void vk_utils::ProgramBindings::BindImage(uint32_t a_loc, VkImageView a_imageView, VkDescriptorType a_bindType)
 {
   PBinding bind;
@@ -140,17 +150,20 @@ vk_utils::DSetId vk_utils::ProgramBindings::BindEnd(VkDescriptorSet* a_pSet, VkD
     descriptorImageInfo[binding.first].sampler     = binding.second.imageSampler;
 
     descriptorBufferInfo[binding.first]        = VkDescriptorBufferInfo{};
-    descriptorBufferInfo[binding.first].buffer = nullptr;          // #TODO: update here!
-    descriptorBufferInfo[binding.first].offset = 0;                // #TODO: update here!
-    descriptorBufferInfo[binding.first].range  = 0;                // #TODO: update here!
+    descriptorBufferInfo[binding.first].buffer = binding.second.buffer;
+    descriptorBufferInfo[binding.first].offset = 0;
+    descriptorBufferInfo[binding.first].range  = (binding.second.buffer != VK_NULL_HANDLE) ? VK_WHOLE_SIZE : 0;
 
     writeDescriptorSet[binding.first]                 = VkWriteDescriptorSet{};
     writeDescriptorSet[binding.first].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     writeDescriptorSet[binding.first].dstSet          = ds;
     writeDescriptorSet[binding.first].dstBinding      = binding.first;
     writeDescriptorSet[binding.first].descriptorCount = 1;
-    writeDescriptorSet[binding.first].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER; // #TODO: update here!
-    writeDescriptorSet[binding.first].pImageInfo      = &descriptorImageInfo[binding.first];
+    writeDescriptorSet[binding.first].descriptorType  = binding.second.type;
+    if(binding.second.buffer != VK_NULL_HANDLE)
+      writeDescriptorSet[binding.first].pBufferInfo   = &descriptorBufferInfo[binding.first];
+    else
+      writeDescriptorSet[binding.first].pImageInfo    = &descriptorImageInfo[binding.first];
   }
 
   vkUpdateDescriptorSets(m_device, uint32_t(writeDescriptorSet.size()), writeDescriptorSet.data(), 0, NULL);
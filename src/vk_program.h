@@ -25,6 +25,7 @@ namespace vk_utils
   
     virtual void BindBegin (VkShaderStageFlagBits a_shaderStage);
     virtual void BindBuffer(uint32_t a_loc, VkBufferView a_buffView, VkDescriptorType a_bindType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    virtual void BindStorageBuffer(uint32_t a_loc, VkBuffer a_buffer); ///< whole buffer as VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
     virtual void BindImage (uint32_t a_loc, VkImageView  a_imageView, VkDescriptorType a_bindType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
     virtual void BindImage (uint32_t a_loc, VkImageView  a_imageView, VkSampler a_sampler, VkDescriptorType a_bindType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
     virtual DSetId BindEnd (VkDescriptorSet* a_pSet = nullptr, VkDescriptorSetLayout* a_pLayout = nullptr);
@@ -17,16 +17,20 @@ namespace vk_utils
       bool buffsMatch = ((buffView != nullptr) && (rhs.buffView != nullptr)) || 
                         ((buffView == nullptr) && (rhs.buffView == nullptr));
 
+      bool buffMatch  = ((buffer != VK_NULL_HANDLE) && (rhs.buffer != VK_NULL_HANDLE)) || 
+                        ((buffer == VK_NULL_HANDLE) && (rhs.buffer == VK_NULL_HANDLE));
+
       bool imgMatch = ((imageView != nullptr) && (rhs.imageView != nullptr)) ||
                       ((imageView == nullptr) && (rhs.imageView == nullptr));
 
       bool samMatch = ((imageSampler != nullptr) && (rhs.imageSampler != nullptr)) ||
                       ((imageSampler == nullptr) && (rhs.imageSampler == nullptr));
 
-      return buffsMatch && imgMatch && samMatch && (type == rhs.type);
+      return buffsMatch && buffMatch && imgMatch && samMatch && (type == rhs.type);
     }
 
     VkBufferView buffView     = nullptr;
+    VkBuffer     buffer       = VK_NULL_HANDLE;
     VkImageView  imageView    = nullptr;
     VkSampler    imageSampler = nullptr;
     VkDescriptorType type;
@@ -88,6 +92,7 @@ namespace std
         currHash ^= ( (hash<bool>()(b.second.buffView    == nullptr)   << 1 ));
         currHash ^= ( (hash<bool>()(b.second.imageView    == nullptr)  << 2 ));
         currHash ^= ( (hash<bool>()(b.second.imageSampler == nullptr)) << 3);
+        currHash ^= ( (hash<bool>()(b.second.buffer       == VK_NULL_HANDLE)) << 4);
         currHash ^= ( (hash<int> ()(b.second.type))                    << 7);
       }
 
@@ -2,6 +2,7 @@
 #include "vk_utils.h"
 #include <cassert>
 #include <cmath>
+#include <cstring>
 #include <algorithm>
 
 #ifdef WIN32
@@ -16,7 +17,7 @@ vk_texture::SimpleTexture2D::~SimpleTexture2D()
 
   vkDestroyImage    (m_device, m_image, NULL);     m_image = nullptr;
   vkDestroyImageView(m_device, m_view, NULL);    m_view = nullptr;
-  vkDestroySampler  (m_device, m_sampler, NULL); m_sampler = nullptr;
+  m_sampler = nullptr;      // owned by m_pSamplers
 
   m_currentLayout = VK_IMAGE_LAYOUT_UNDEFINED;
   m_currentStage  = VK_PIPELINE_STAGE_TRANSFER_BIT;
@@ -34,7 +35,8 @@ static size_t Padding(size_t a_size, size_t a_aligment)
 }
 
 
-VkMemoryRequirements vk_texture::SimpleTexture2D::CreateImage(VkDevice a_device, const int a_width, const int a_height, VkFormat a_format)
+VkMemoryRequirements vk_texture::SimpleTexture2D::CreateImage(VkDevice a_device, const int a_width, const int a_height, VkFormat a_format,
+                                                              std::shared_ptr<SamplerCache> a_pSamplers)
 {
   m_device = a_device;
   m_width  = a_width;
@@ -45,6 +47,9 @@ VkMemoryRequirements vk_texture::SimpleTexture2D::CreateImage(VkDevice a_device,
   if (a_format == VK_FORMAT_R32G32B32A32_UINT)
     m_mipLevels = 1;
 
+  if(!vk_utils::GetFormatBlockInfo(a_format, &m_blockWidth, &m_blockHeight, &m_blockBytes))
+    RUN_TIME_ERROR("[SimpleTexture2D::CreateImage()]: unknown texture format");
+
   VkImageCreateInfo imgCreateInfo = {};
   imgCreateInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
   imgCreateInfo.pNext         = nullptr;
@@ -56,6 +61,8 @@ VkMemoryRequirements vk_texture::SimpleTexture2D::CreateImage(VkDevice a_device,
   imgCreateInfo.samples       = VK_SAMPLE_COUNT_1_BIT;
   imgCreateInfo.tiling        = VK_IMAGE_TILING_OPTIMAL;
   imgCreateInfo.usage         = VK_IMAGE_USAGE_TRANSFER_SRC_BIT| VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT; // copy to the texture and read then
+  if(IsCompressed())
+    imgCreateInfo.usage       = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;                                   // can't blit mips, they are uploaded
   imgCreateInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
   imgCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
   imgCreateInfo.arrayLayers   = 1;
@@ -67,27 +74,13 @@ VkMemoryRequirements vk_texture::SimpleTexture2D::CreateImage(VkDevice a_device,
 
   const bool isFiltered = (a_format != VK_FORMAT_R32G32B32A32_UINT); // #TODO: add other formats here
 
-  VkSamplerCreateInfo samplerInfo = {};
-  {
-    samplerInfo.sType            = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-    samplerInfo.pNext            = nullptr;
-    samplerInfo.flags            = 0;
-    samplerInfo.magFilter        = isFiltered ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
-    samplerInfo.minFilter        = isFiltered ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
-    samplerInfo.mipmapMode       = isFiltered ? VK_SAMPLER_MIPMAP_MODE_LINEAR  : VK_SAMPLER_MIPMAP_MODE_NEAREST;
-    samplerInfo.addressModeU     = isFiltered ? VK_SAMPLER_ADDRESS_MODE_REPEAT : VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-    samplerInfo.addressModeV     = isFiltered ? VK_SAMPLER_ADDRESS_MODE_REPEAT : VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-    samplerInfo.addressModeW     = isFiltered ? VK_SAMPLER_ADDRESS_MODE_REPEAT : VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-    samplerInfo.mipLodBias       = 0.0f;
-    samplerInfo.compareOp        = VK_COMPARE_OP_NEVER;
-    samplerInfo.minLod           = 0;
-    samplerInfo.maxLod           = float(m_mipLevels);
-    samplerInfo.maxAnisotropy    = 1.0;
-    samplerInfo.anisotropyEnable = VK_FALSE;
-    samplerInfo.borderColor      = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-    samplerInfo.unnormalizedCoordinates = VK_FALSE;
-  }
-  VK_CHECK_RESULT(vkCreateSampler(a_device, &samplerInfo, nullptr, &this->m_sampler));
+  m_pSamplers = (a_pSamplers != nullptr) ? a_pSamplers : std::make_shared<SamplerCache>(a_device, VkPhysicalDevice(VK_NULL_HANDLE));
+
+  SamplerDesc samplerDesc;
+  samplerDesc.filter      = isFiltered ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+  samplerDesc.mipmapMode  = isFiltered ? VK_SAMPLER_MIPMAP_MODE_LINEAR  : VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  samplerDesc.addressMode = isFiltered ? VK_SAMPLER_ADDRESS_MODE_REPEAT : VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  SetSampler(samplerDesc);
 
   m_createImageInfo       = imgCreateInfo;
   memoryRequirements.size = Padding(memoryRequirements.size, memoryRequirements.alignment*4);
@@ -98,7 +91,7 @@ VkMemoryRequirements vk_texture::SimpleTexture2D::CreateImage(VkDevice a_device,
 
 static void BindImageToMemoryAndCreateImageView(VkDevice a_device, VkImage a_image, VkFormat a_format, uint32_t a_mipLevels, 
                                                 VkDeviceMemory a_memStorage, size_t a_offset,
-                                                VkImageView* a_pView)
+                                                VkImageView* a_pView, VkImageViewType a_viewType = VK_IMAGE_VIEW_TYPE_2D, uint32_t a_layers = 1)
 {
   VK_CHECK_RESULT(vkBindImageMemory(a_device, a_image, a_memStorage, a_offset));
 
@@ -108,13 +101,13 @@ static void BindImageToMemoryAndCreateImageView(VkDevice a_device, VkImage a_ima
   {
     imageViewInfo.sType      = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     imageViewInfo.flags      = 0;
-    imageViewInfo.viewType   = VK_IMAGE_VIEW_TYPE_2D;
+    imageViewInfo.viewType   = a_viewType;
     imageViewInfo.format     = a_format;
     imageViewInfo.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
     imageViewInfo.subresourceRange.aspectMask     = isDepthTexture ? VK_IMAGE_ASPECT_DEPTH_BIT :  VK_IMAGE_ASPECT_COLOR_BIT;
     imageViewInfo.subresourceRange.baseMipLevel   = 0;
     imageViewInfo.subresourceRange.baseArrayLayer = 0;
-    imageViewInfo.subresourceRange.layerCount     = 1;
+    imageViewInfo.subresourceRange.layerCount     = a_layers;
     imageViewInfo.subresourceRange.levelCount     = a_mipLevels;
     imageViewInfo.image = a_image;     // The view will be based on the texture's image
   }
@@ -133,9 +126,115 @@ void vk_texture::SimpleTexture2D::BindMemory(VkDeviceMemory a_memStorage, size_t
                                       &m_view);
 }
 
+size_t vk_texture::SimpleTexture2D::MipSizeInBytes(int a_level) const
+{
+  const size_t blocksX = (size_t(MipWidth(a_level))  + m_blockWidth  - 1) / m_blockWidth;
+  const size_t blocksY = (size_t(MipHeight(a_level)) + m_blockHeight - 1) / m_blockHeight;
+  return blocksX*blocksY*size_t(m_blockBytes);
+}
+
+bool vk_texture::IsSampledFormatSupported(VkPhysicalDevice a_physDevice, VkFormat a_format)
+{
+  VkFormatProperties props = {};
+  vkGetPhysicalDeviceFormatProperties(a_physDevice, a_format, &props);
+  return (props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+}
+
+vk_texture::SamplerCache::SamplerCache(VkDevice a_device, VkPhysicalDevice a_physDevice) : m_device(a_device), m_physDevice(a_physDevice), m_maxAnisotropy(1.0f)
+{
+  if(a_physDevice == VK_NULL_HANDLE)
+    return;
+
+  VkPhysicalDeviceFeatures features = {};
+  vkGetPhysicalDeviceFeatures(a_physDevice, &features);
+
+  VkPhysicalDeviceProperties props = {};
+  vkGetPhysicalDeviceProperties(a_physDevice, &props);
+
+  if(features.samplerAnisotropy) // vk_utils::CreateLogicalDevice enables it when supported
+    m_maxAnisotropy = std::max(props.limits.maxSamplerAnisotropy, 1.0f);
+}
+
+vk_texture::SamplerCache::~SamplerCache()
+{
+  for(auto& p : m_samplers)
+    vkDestroySampler(m_device, p.second, NULL);
+  m_samplers.clear();
+}
+
+size_t vk_texture::SamplerCache::DescHash::operator()(const SamplerDesc& a_desc) const
+{
+  uint32_t anisoBits = 0;
+  memcpy(&anisoBits, &a_desc.maxAnisotropy, sizeof(anisoBits));
+
+  size_t h = 14695981039346656037ULL;
+  const uint32_t fields[6] = { uint32_t(a_desc.filter), uint32_t(a_desc.mipmapMode), uint32_t(a_desc.addressMode), anisoBits,
+                               uint32_t(a_desc.compareOp), uint32_t(a_desc.borderColor) };
+  for(uint32_t field : fields)
+    h = (h ^ size_t(field)) * 1099511628211ULL;
+  return h;
+}
+
+VkSampler vk_texture::SamplerCache::GetSampler(const SamplerDesc& a_desc)
+{
+  SamplerDesc desc   = a_desc;
+  desc.maxAnisotropy = std::min(std::max(desc.maxAnisotropy, 1.0f), m_maxAnisotropy); // so that i.e. x16 and x8 share sampler on x8 device
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  auto p = m_samplers.find(desc);
+  if(p != m_samplers.end())
+    return p->second;
+
+  VkSamplerCreateInfo samplerInfo = {};
+  {
+    samplerInfo.sType            = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.pNext            = nullptr;
+    samplerInfo.flags            = 0;
+    samplerInfo.magFilter        = desc.filter;
+    samplerInfo.minFilter        = desc.filter;
+    samplerInfo.mipmapMode       = desc.mipmapMode;
+    samplerInfo.addressModeU     = desc.addressMode;
+    samplerInfo.addressModeV     = desc.addressMode;
+    samplerInfo.addressModeW     = desc.addressMode;
+    samplerInfo.mipLodBias       = 0.0f;
+    samplerInfo.compareEnable    = (desc.compareOp != VK_COMPARE_OP_NEVER) ? VK_TRUE : VK_FALSE;
+    samplerInfo.compareOp        = desc.compareOp;
+    samplerInfo.minLod           = 0;
+    samplerInfo.maxLod           = VK_LOD_CLAMP_NONE;
+    samplerInfo.maxAnisotropy    = desc.maxAnisotropy;
+    samplerInfo.anisotropyEnable = (desc.maxAnisotropy > 1.0f) ? VK_TRUE : VK_FALSE;
+    samplerInfo.borderColor      = desc.borderColor;
+    samplerInfo.unnormalizedCoordinates = VK_FALSE;
+  }
+
+  VkSampler sampler = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateSampler(m_device, &samplerInfo, nullptr, &sampler));
+  m_samplers[desc] = sampler;
+  return sampler;
+}
+
+bool vk_texture::SamplerCache::IsLinearFilterSupported(VkFormat a_format) const
+{
+  if(m_physDevice == VK_NULL_HANDLE)
+    return true;
+  VkFormatProperties props = {};
+  vkGetPhysicalDeviceFormatProperties(m_physDevice, a_format, &props);
+  return (props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) != 0;
+}
+
+size_t vk_texture::SamplerCache::SamplersNum() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_samplers.size();
+}
+
 void vk_texture::SimpleTexture2D::Update(const void* a_src, int a_width, int a_height, int a_bpp, ICopyEngine* a_pCopyImpl)
 {
   assert(a_pCopyImpl != nullptr);
+
+  if(IsCompressed())
+    RUN_TIME_ERROR("[SimpleTexture2D::Update()]: block compressed texture must be updated with UpdateMips");
   
   a_pCopyImpl->UpdateImage(Image(), a_src, a_width, a_height, a_bpp);
   
@@ -143,6 +242,29 @@ void vk_texture::SimpleTexture2D::Update(const void* a_src, int a_width, int a_h
   m_currentStage  = VK_PIPELINE_STAGE_TRANSFER_BIT;
 }
 
+void vk_texture::SimpleTexture2D::UpdateMips(const void* const* a_mips, int a_mipsNum, ICopyEngine* a_pCopyImpl)
+{
+  assert(a_pCopyImpl != nullptr);
+
+  if(a_mipsNum != m_mipLevels)
+    RUN_TIME_ERROR("[SimpleTexture2D::UpdateMips()]: mip levels number differs from the one of the image");
+
+  std::vector<ICopyEngine::MipData> mips(a_mipsNum);
+  for(int i=0;i<a_mipsNum;i++)
+  {
+    mips[i].src        = a_mips[i];
+    mips[i].mipLevel   = uint32_t(i);
+    mips[i].arrayLayer = 0;
+    mips[i].width      = uint32_t(MipWidth(i));
+    mips[i].height     = uint32_t(MipHeight(i));
+  }
+
+  a_pCopyImpl->UpdateImageMips(Image(), m_format, mips.data(), mips.size(), uint32_t(m_mipLevels), 1);
+
+  m_currentLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL; 
+  m_currentStage  = VK_PIPELINE_STAGE_TRANSFER_BIT;
+}
+
 namespace vk_utils
 {
     static void setImageLayout(
@@ -273,6 +395,9 @@ namespace vk_utils
 
 void vk_texture::SimpleTexture2D::GenerateMipsCmd(VkCommandBuffer a_cmdBuff)
 {
+  if(IsCompressed())
+    RUN_TIME_ERROR("[SimpleTexture2D::GenerateMipsCmd()]: can't blit block compressed texture, upload mips with UpdateMips");
+
   VkCommandBuffer blitCmd = a_cmdBuff;
 
   // at first, transfer 0 mip level to the VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
@@ -403,6 +528,19 @@ void vk_texture::SimpleTexture2D::GenerateMipsCmd(VkCommandBuffer a_cmdBuff)
   
 }
 
+void vk_texture::SimpleTexture2D::SetSampler(const SamplerDesc& a_desc)
+{
+  m_samplerDesc = a_desc;
+  m_sampler     = m_pSamplers->GetSampler(a_desc);
+}
+
+void vk_texture::SimpleTexture2D::SetMaxAnisotropy(float a_maxAnisotropy)
+{
+  SamplerDesc desc   = m_samplerDesc;
+  desc.maxAnisotropy = a_maxAnisotropy;
+  SetSampler(desc);
+}
+
 void vk_texture::SimpleTexture2D::ChangeLayoutCmd(VkCommandBuffer a_cmdBuff, VkImageLayout a_newLayout, VkPipelineStageFlags a_newStage)
 {
   if(m_currentLayout == a_newLayout && m_currentStage == a_newStage)
@@ -414,7 +552,7 @@ void vk_texture::SimpleTexture2D::ChangeLayoutCmd(VkCommandBuffer a_cmdBuff, VkI
   imgBar.pNext               = nullptr;
   imgBar.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
   imgBar.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  imgBar.srcAccessMask       = 0;                                        // #NOTE: THIS IS NOT CORRECT! please use vk_utils::setImageLayout!
+  imgBar.srcAccessMask       = (m_currentLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) ? VK_ACCESS_TRANSFER_WRITE_BIT : 0; // #NOTE: THIS IS NOT CORRECT in general! please use vk_utils::setImageLayout!
   imgBar.dstAccessMask       = VK_ACCESS_SHADER_READ_BIT;                // #NOTE: THIS IS NOT CORRECT! please use vk_utils::setImageLayout!
   imgBar.oldLayout           = m_currentLayout;
   imgBar.newLayout           = a_newLayout;
@@ -438,6 +576,140 @@ void vk_texture::SimpleTexture2D::ChangeLayoutCmd(VkCommandBuffer a_cmdBuff, VkI
   m_currentStage  = a_newStage;
 }
 
+vk_texture::Texture2DArray::~Texture2DArray()
+{
+  if (m_device == nullptr)
+    return;
+
+  vkDestroyImage    (m_device, m_image, NULL);   m_image   = nullptr;
+  vkDestroyImageView(m_device, m_view, NULL);    m_view    = nullptr;
+  m_sampler = nullptr;      // owned by m_pSamplers
+}
+
+VkMemoryRequirements vk_texture::Texture2DArray::CreateImage(VkDevice a_device, const int a_width, const int a_height, const int a_layers, VkFormat a_format,
+                                                             std::shared_ptr<SamplerCache> a_pSamplers)
+{
+  m_device    = a_device;
+  m_width     = a_width;
+  m_height    = a_height;
+  m_layers    = a_layers;
+  m_format    = a_format;
+  m_mipLevels = int(floor(log2(std::max(m_width, m_height))) + 1);
+
+  if(!vk_utils::GetFormatBlockInfo(a_format, &m_blockWidth, &m_blockHeight, &m_blockBytes))
+    RUN_TIME_ERROR("[Texture2DArray::CreateImage()]: unknown texture format");
+
+  VkImageCreateInfo imgCreateInfo = {};
+  imgCreateInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imgCreateInfo.pNext         = nullptr;
+  imgCreateInfo.flags         = 0;
+  imgCreateInfo.imageType     = VK_IMAGE_TYPE_2D;
+  imgCreateInfo.format        = a_format;
+  imgCreateInfo.extent        = VkExtent3D{ uint32_t(a_width), uint32_t(a_height), 1 };
+  imgCreateInfo.mipLevels     = m_mipLevels;
+  imgCreateInfo.samples       = VK_SAMPLE_COUNT_1_BIT;
+  imgCreateInfo.tiling        = VK_IMAGE_TILING_OPTIMAL;
+  imgCreateInfo.usage         = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT; // all mips are uploaded
+  imgCreateInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+  imgCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imgCreateInfo.arrayLayers   = uint32_t(a_layers);
+
+  VK_CHECK_RESULT(vkCreateImage(a_device, &imgCreateInfo, nullptr, &m_image));
+
+  VkMemoryRequirements memoryRequirements;
+  vkGetImageMemoryRequirements(a_device, m_image, &memoryRequirements);
+
+  m_pSamplers = (a_pSamplers != nullptr) ? a_pSamplers : std::make_shared<SamplerCache>(a_device, VkPhysicalDevice(VK_NULL_HANDLE));
+  SetSampler(SamplerDesc()); // linear, repeat
+
+  m_currentLayout   = VK_IMAGE_LAYOUT_UNDEFINED;
+  m_currentStage    = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+  m_createImageInfo = imgCreateInfo;
+  return memoryRequirements;
+}
+
+void vk_texture::Texture2DArray::BindMemory(VkDeviceMemory a_memStorage, size_t a_offset)
+{
+  assert(m_memStorage == nullptr); // this implementation does not allow to rebind memory!
+  assert(m_view       == nullptr);
+
+  m_memStorage = a_memStorage;
+
+  BindImageToMemoryAndCreateImageView(m_device, m_image, m_format, m_mipLevels, a_memStorage, a_offset, &m_view, 
+                                      VK_IMAGE_VIEW_TYPE_2D_ARRAY, uint32_t(m_layers));
+}
+
+size_t vk_texture::Texture2DArray::MipSizeInBytes(int a_level) const
+{
+  const size_t blocksX = (size_t(MipWidth(a_level))  + m_blockWidth  - 1) / m_blockWidth;
+  const size_t blocksY = (size_t(MipHeight(a_level)) + m_blockHeight - 1) / m_blockHeight;
+  return blocksX*blocksY*size_t(m_blockBytes);
+}
+
+void vk_texture::Texture2DArray::UpdateLayers(const void* const* a_mips, ICopyEngine* a_pCopyImpl)
+{
+  assert(a_pCopyImpl != nullptr);
+
+  std::vector<ICopyEngine::MipData> mips(size_t(m_layers)*size_t(m_mipLevels));
+  for(int layer = 0; layer < m_layers; layer++)
+  {
+    for(int level = 0; level < m_mipLevels; level++)
+    {
+      auto& mip      = mips[size_t(layer)*size_t(m_mipLevels) + size_t(level)];
+      mip.src        = a_mips[size_t(layer)*size_t(m_mipLevels) + size_t(level)];
+      mip.mipLevel   = uint32_t(level);
+      mip.arrayLayer = uint32_t(layer);
+      mip.width      = uint32_t(MipWidth(level));
+      mip.height     = uint32_t(MipHeight(level));
+    }
+  }
+
+  a_pCopyImpl->UpdateImageMips(Image(), m_format, mips.data(), mips.size(), uint32_t(m_mipLevels), uint32_t(m_layers));
+
+  m_currentLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL; 
+  m_currentStage  = VK_PIPELINE_STAGE_TRANSFER_BIT;
+}
+
+void vk_texture::Texture2DArray::SetSampler(const SamplerDesc& a_desc)
+{
+  m_samplerDesc = a_desc;
+  m_sampler     = m_pSamplers->GetSampler(a_desc);
+}
+
+void vk_texture::Texture2DArray::SetMaxAnisotropy(float a_maxAnisotropy)
+{
+  SamplerDesc desc   = m_samplerDesc;
+  desc.maxAnisotropy = a_maxAnisotropy;
+  SetSampler(desc);
+}
+
+void vk_texture::Texture2DArray::ChangeLayoutCmd(VkCommandBuffer a_cmdBuff, VkImageLayout a_newLayout, VkPipelineStageFlags a_newStage)
+{
+  if(m_currentLayout == a_newLayout && m_currentStage == a_newStage)
+    return;
+
+  VkImageMemoryBarrier imgBar = {};
+  imgBar.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  imgBar.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imgBar.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imgBar.srcAccessMask       = (m_currentLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) ? VK_ACCESS_TRANSFER_WRITE_BIT : 0;
+  imgBar.dstAccessMask       = VK_ACCESS_SHADER_READ_BIT;
+  imgBar.oldLayout           = m_currentLayout;
+  imgBar.newLayout           = a_newLayout;
+  imgBar.image               = m_image;
+
+  imgBar.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+  imgBar.subresourceRange.baseMipLevel   = 0;
+  imgBar.subresourceRange.levelCount     = uint32_t(m_mipLevels);
+  imgBar.subresourceRange.baseArrayLayer = 0;
+  imgBar.subresourceRange.layerCount     = uint32_t(m_layers);
+
+  vkCmdPipelineBarrier(a_cmdBuff, m_currentStage, a_newStage, 0, 0, nullptr, 0, nullptr, 1, &imgBar);
+
+  m_currentLayout = a_newLayout;
+  m_currentStage  = a_newStage;
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -456,13 +728,15 @@ vk_texture::RenderableTexture2D::~RenderableTexture2D()
 
   vkDestroyImage      (m_device, m_image, NULL);   m_image   = nullptr;
   vkDestroyImageView  (m_device, m_view, NULL);    m_view    = nullptr;
-  vkDestroySampler    (m_device, m_sampler, NULL); m_sampler = nullptr;
+  m_sampler        = nullptr; // owned by m_pSamplers
+  m_compareSampler = nullptr;
 
   m_currentLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 }
 
 
-VkMemoryRequirements vk_texture::RenderableTexture2D::CreateImage(VkDevice a_device, const int a_width, const int a_height, VkFormat a_format)
+VkMemoryRequirements vk_texture::RenderableTexture2D::CreateImage(VkDevice a_device, const int a_width, const int a_height, VkFormat a_format,
+                                                                  std::shared_ptr<SamplerCache> a_pSamplers)
 {
   m_device = a_device;
   m_width  = a_width;
@@ -484,7 +758,7 @@ VkMemoryRequirements vk_texture::RenderableTexture2D::CreateImage(VkDevice a_dev
   imgCreateInfo.mipLevels     = m_mipLevels;
   imgCreateInfo.samples       = VK_SAMPLE_COUNT_1_BIT;
   imgCreateInfo.tiling        = VK_IMAGE_TILING_OPTIMAL;
-  imgCreateInfo.usage         = attachmentFlags | VK_IMAGE_USAGE_SAMPLED_BIT; // copy to the texture and read then
+  imgCreateInfo.usage         = attachmentFlags | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT; // render to the texture and read then; transfer src is for readback
   imgCreateInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
   imgCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
   imgCreateInfo.arrayLayers   = 1;
@@ -495,27 +769,21 @@ VkMemoryRequirements vk_texture::RenderableTexture2D::CreateImage(VkDevice a_dev
   VkMemoryRequirements memoryRequirements;
   vkGetImageMemoryRequirements(a_device, m_image, &memoryRequirements);
 
-  VkSamplerCreateInfo samplerInfo = {};
+  m_pSamplers = (a_pSamplers != nullptr) ? a_pSamplers : std::make_shared<SamplerCache>(a_device, VkPhysicalDevice(VK_NULL_HANDLE));
+
+  SamplerDesc samplerDesc;
+  samplerDesc.filter      = VK_FILTER_LINEAR;
+  samplerDesc.mipmapMode  = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  samplerDesc.addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerDesc.borderColor = isDepthTexture ? VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK : VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+  m_sampler = m_pSamplers->GetSampler(samplerDesc);
+
+  if(isDepthTexture) // 2x2 PCF for free if linear filtering of depth format is supported
   {
-    samplerInfo.sType            = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-    samplerInfo.pNext            = nullptr;
-    samplerInfo.flags            = 0;
-    samplerInfo.magFilter        = VK_FILTER_LINEAR;
-    samplerInfo.minFilter        = VK_FILTER_LINEAR;
-    samplerInfo.mipmapMode       = VK_SAMPLER_MIPMAP_MODE_NEAREST;
-    samplerInfo.addressModeU     = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE; 
-    samplerInfo.addressModeV     = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE; 
-    samplerInfo.addressModeW     = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-    samplerInfo.mipLodBias       = 0.0f;
-    samplerInfo.compareOp        = VK_COMPARE_OP_NEVER;
-    samplerInfo.minLod           = 0;
-    samplerInfo.maxLod           = float(m_mipLevels);
-    samplerInfo.maxAnisotropy    = 1.0;
-    samplerInfo.anisotropyEnable = VK_FALSE;
-    samplerInfo.borderColor      = isDepthTexture ? VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK : VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-    samplerInfo.unnormalizedCoordinates = VK_FALSE;
+    samplerDesc.filter    = m_pSamplers->IsLinearFilterSupported(a_format) ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+    samplerDesc.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+    m_compareSampler      = m_pSamplers->GetSampler(samplerDesc);
   }
-  VK_CHECK_RESULT(vkCreateSampler(a_device, &samplerInfo, nullptr, &this->m_sampler));
 
   m_createImageInfo = imgCreateInfo;
 
@@ -540,7 +808,7 @@ void vk_texture::RenderableTexture2D::CreateRenderPass()
   colorAttachment.storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
   colorAttachment.stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  colorAttachment.initialLayout  = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  colorAttachment.initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;                // cleared anyway; valid if memory is aliased (AliasingAllocator)
   colorAttachment.finalLayout    = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
   VkAttachmentReference colorAttachmentRef = {};
@@ -561,10 +829,11 @@ void vk_texture::RenderableTexture2D::CreateRenderPass()
   VkSubpassDependency dependency = {};
   dependency.srcSubpass    = VK_SUBPASS_EXTERNAL;
   dependency.dstSubpass    = 0;
-  dependency.srcStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependency.srcAccessMask = 0;
-  dependency.dstStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependency.srcStageMask  = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT; // previous readers, or previous user of aliased memory
+  dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependency.dstStageMask  = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | 
+                             VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
   VkRenderPassCreateInfo renderPassInfo = {};
   renderPassInfo.sType           = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -668,3 +937,89 @@ void vk_texture::RenderableTexture2D::EndRenderingToThisTexture(VkCommandBuffer
   vkCmdEndRenderPass(a_cmdBuff);
   m_currentLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;   
 }
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+vk_texture::AliasingAllocator::~AliasingAllocator()
+{
+  if(m_memory != VK_NULL_HANDLE)
+    vkFreeMemory(m_device, m_memory, NULL);
+  m_memory = VK_NULL_HANDLE;
+}
+
+int vk_texture::AliasingAllocator::AddTarget(const VkMemoryRequirements& a_memReq, int a_firstPass, int a_lastPass)
+{
+  assert(m_memory == VK_NULL_HANDLE); // targets can't be added after Allocate
+  assert(a_firstPass <= a_lastPass);
+  m_targets.push_back(Target{a_memReq, a_firstPass, a_lastPass, 0});
+  return int(m_targets.size()) - 1;
+}
+
+VkDeviceSize vk_texture::AliasingAllocator::UnaliasedSize() const
+{
+  VkDeviceSize size = 0;
+  for(const auto& target : m_targets)
+    size += target.memReq.size;
+  return size;
+}
+
+void vk_texture::AliasingAllocator::Allocate()
+{
+  if(m_memory != VK_NULL_HANDLE || m_targets.empty())
+    return;
+
+  // the largest targets are placed first; each one goes to the lowest offset that doesn't intersect targets with overlapping lifetime
+  //
+  std::vector<int> order(m_targets.size());
+  for(size_t i=0;i<order.size();i++)
+    order[i] = int(i);
+  std::sort(order.begin(), order.end(), [this](int a, int b) { return m_targets[a].memReq.size > m_targets[b].memReq.size; });
+
+  uint32_t         typeBits = uint32_t(-1);
+  std::vector<int> placed;
+  for(int id : order)
+  {
+    Target& target = m_targets[id];
+    typeBits &= target.memReq.memoryTypeBits;
+
+    std::vector<int> conflicts;
+    for(int other : placed)
+    {
+      if(m_targets[other].firstPass <= target.lastPass && target.firstPass <= m_targets[other].lastPass)
+        conflicts.push_back(other);
+    }
+
+    std::vector<VkDeviceSize> candidates(1, 0);
+    for(int other : conflicts)
+      candidates.push_back(m_targets[other].offset + m_targets[other].memReq.size);
+
+    VkDeviceSize best = VkDeviceSize(-1);
+    for(VkDeviceSize candidate : candidates)
+    {
+      const VkDeviceSize offset = (candidate + target.memReq.alignment - 1) / target.memReq.alignment * target.memReq.alignment;
+      bool fits = true;
+      for(int other : conflicts)
+      {
+        const Target& o = m_targets[other];
+        fits = fits && (offset + target.memReq.size <= o.offset || o.offset + o.memReq.size <= offset);
+      }
+      if(fits)
+        best = std::min(best, offset);
+    }
+
+    target.offset = best;
+    m_size        = std::max(m_size, best + target.memReq.size);
+    placed.push_back(id);
+  }
+
+  if(typeBits == 0)
+    RUN_TIME_ERROR("[AliasingAllocator::Allocate()]: targets have no common memory type");
+
+  VkMemoryAllocateInfo allocateInfo = {};
+  allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocateInfo.pNext           = nullptr;
+  allocateInfo.allocationSize  = m_size;
+  allocateInfo.memoryTypeIndex = vk_utils::FindMemoryType(typeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_physDevice);
+  VK_CHECK_RESULT(vkAllocateMemory(m_device, &allocateInfo, NULL, &m_memory));
+}
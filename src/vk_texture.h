@@ -7,6 +7,9 @@
 #include <stdexcept>
 #include <sstream>
 #include <memory>
+#include <algorithm>
+#include <unordered_map>
+#include <mutex>
 
 namespace vk_texture
 {
@@ -19,36 +22,146 @@ namespace vk_texture
 
     virtual void UpdateImage(VkImage a_image, const void* a_src, int a_width, int a_height, int a_bpp) = 0; // this function assume texture is in undefined layout and it must leave texture in transfer dst layout
 
+    // Textures record their barriers with VK_QUEUE_FAMILY_IGNORED, i.e. they assume the image is owned by the family of the queue they are used on.
+    // If copy engine uploads on a dedicated transfer family, it must release images there and application must acquire them 
+    // (see vk_copy::AsyncCopyHelper::AcquireOwnershipCmd) before GenerateMipsCmd/ChangeLayoutCmd are executed.
+
+    struct MipData
+    {
+      const void* src;         ///< tightly packed texels (or blocks for compressed formats)
+      uint32_t    mipLevel;
+      uint32_t    arrayLayer;
+      uint32_t    width;       ///< mip level width in texels
+      uint32_t    height;      ///< mip level height in texels
+    };
+
+    /**
+    \brief Upload precomputed mip levels and array layers. Texture is assumed to be in undefined layout; 
+           all a_mipLevels x a_arrayLayers subresources must be left in transfer dst layout.
+    */
+    virtual void UpdateImageMips(VkImage a_image, VkFormat a_format, const MipData* a_mips, size_t a_mipsNum, uint32_t a_mipLevels, uint32_t a_arrayLayers)
+    {
+      throw std::runtime_error("[vk_texture::ICopyEngine::UpdateImageMips]: not implemented by copy engine");
+    }
+
   protected:
     ICopyEngine(const ICopyEngine& rhs) {}
     ICopyEngine& operator=(const ICopyEngine& rhs) { return *this; }    
   };
 
 
+  /**
+  \brief Check that a_format can be sampled from optimal tiling images, i.e. BCn formats on devices without textureCompressionBC are not.
+  */
+  bool IsSampledFormatSupported(VkPhysicalDevice a_physDevice, VkFormat a_format);
+
+  /**
+  \brief Sampler state. Everything else is fixed: no lod bias, minLod = 0 and maxLod = VK_LOD_CLAMP_NONE, 
+         so textures with different number of mips share the same sampler.
+  */
+  struct SamplerDesc
+  {
+    VkFilter             filter        = VK_FILTER_LINEAR;                  ///< both min and mag
+    VkSamplerMipmapMode  mipmapMode    = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    VkSamplerAddressMode addressMode   = VK_SAMPLER_ADDRESS_MODE_REPEAT;    ///< for u, v and w
+    float                maxAnisotropy = 1.0f;                              ///< 1 disables anisotropic filtering
+    VkCompareOp          compareOp     = VK_COMPARE_OP_NEVER;               ///< VK_COMPARE_OP_NEVER disables depth compare, otherwise it is sampler2DShadow in shaders
+    VkBorderColor        borderColor   = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+
+    bool operator==(const SamplerDesc& a_rhs) const 
+    { 
+      return filter == a_rhs.filter && mipmapMode == a_rhs.mipmapMode && addressMode == a_rhs.addressMode && maxAnisotropy == a_rhs.maxAnisotropy && 
+             compareOp == a_rhs.compareOp && borderColor == a_rhs.borderColor;
+    }
+  };
+
+  /**
+  \brief Hashed cache of samplers: equal SamplerDesc gives the same VkSampler, so the number of samplers depends on the number of distinct states
+         rather than on the number of textures (maxSamplerAllocationCount is only 4000 on many devices). 
+         Cache owns samplers and destroys them in destructor; textures keep shared pointer to it. Thread safe.
+  */
+  struct SamplerCache
+  {
+    /**
+    \param a_device     - input logical device
+    \param a_physDevice - input physical device to query anisotropy limit; may be VK_NULL_HANDLE, then anisotropic filtering is disabled
+    */
+    SamplerCache(VkDevice a_device, VkPhysicalDevice a_physDevice);
+    ~SamplerCache();
+
+    /**
+    \brief Get sampler from the cache or create it. a_desc.maxAnisotropy is clamped to [1, MaxAnisotropy()] before lookup.
+    */
+    VkSampler GetSampler(const SamplerDesc& a_desc);
+
+    float     MaxAnisotropy() const { return m_maxAnisotropy; }  ///< 1 if device does not support anisotropic filtering
+    bool      IsLinearFilterSupported(VkFormat a_format) const;  ///< i.e. for depth formats that are sampled with hardware PCF
+    size_t    SamplersNum() const;
+
+  protected:
+
+    SamplerCache(const SamplerCache& a_rhs) = delete;
+    SamplerCache& operator=(const SamplerCache& a_rhs) = delete;
+
+    struct DescHash { size_t operator()(const SamplerDesc& a_desc) const; };
+
+    VkDevice         m_device;
+    VkPhysicalDevice m_physDevice;
+    float            m_maxAnisotropy;
+
+    std::unordered_map<SamplerDesc, VkSampler, DescHash> m_samplers;
+    mutable std::mutex                                   m_mutex;
+  };
+
   struct SimpleTexture2D
   {
-    SimpleTexture2D() : m_memStorage(0), m_image(0), m_sampler(0), m_view(0), m_device(0) {}
+    SimpleTexture2D() : m_memStorage(0), m_image(0), m_sampler(0), m_view(0), m_device(0), m_blockWidth(1), m_blockHeight(1), m_blockBytes(4) {}
     ~SimpleTexture2D();
    
     //// useful functions
     //
-    VkMemoryRequirements CreateImage(VkDevice a_device, const int a_width, const int a_height, VkFormat a_format);
+    /**
+    \brief Create image and take sampler from a_pSamplers; if it is nullptr, texture makes private cache (anisotropic filtering is not available then).
+    */
+    VkMemoryRequirements CreateImage(VkDevice a_device, const int a_width, const int a_height, VkFormat a_format, 
+                                     std::shared_ptr<SamplerCache> a_pSamplers = nullptr);
     void                 BindMemory (VkDeviceMemory a_memStorage, size_t a_offset);
     void                 Update     (const void* a_src, int a_width, int a_height, int a_bpp, ICopyEngine* a_pCopyImpl);
+
+    /**
+    \brief Upload the whole precomputed mip chain (i.e. from offline pipeline), so GenerateMipsCmd is not needed. 
+           Texture is left in transfer dst layout, use ChangeLayoutCmd to make it readable in shaders.
+           This is the only way to fill block compressed (BCn) textures.
+    \param a_mips      - input pointers to mip levels, from 0 to MipLevels()-1; level i has MipWidth(i) x MipHeight(i) texels,
+                         for block compressed formats it is rows of 4x4 blocks rounded up, MipSizeInBytes(i) in total
+    \param a_mipsNum   - input mip levels number, must be equal to MipLevels()
+    \param a_pCopyImpl - input copy engine
+    */
+    void                 UpdateMips (const void* const* a_mips, int a_mipsNum, ICopyEngine* a_pCopyImpl);
   
-    void                 GenerateMipsCmd(VkCommandBuffer a_cmdBuff);
+    void                 GenerateMipsCmd(VkCommandBuffer a_cmdBuff); ///< blit based, not available for block compressed formats
     void                 ChangeLayoutCmd(VkCommandBuffer a_cmdBuff, VkImageLayout a_newLayout, VkPipelineStageFlags a_newStage);
+
+    void                 SetSampler(const SamplerDesc& a_desc);        ///< must be called before Sampler() is written to descriptor sets
+    void                 SetMaxAnisotropy(float a_maxAnisotropy);      ///< same as SetSampler with changed SamplerDesc::maxAnisotropy
     
     //// information functions
     //
     VkImage              Image()      const { return m_image;     }
     VkImageView          View()       const { return m_view;    }
     VkSampler            Sampler()    const { return m_sampler; }
+    const SamplerDesc&   SamplerInfo() const { return m_samplerDesc; }
 
     VkImageCreateInfo    Info()       const { return m_createImageInfo; }
     int                  Width()      const { return m_width;  }
     int                  Height()     const { return m_height; }
     VkFormat             Format()     const { return m_format; }
+    int                  MipLevels()  const { return m_mipLevels; }
+
+    bool                 IsCompressed()             const { return m_blockWidth > 1; }
+    int                  MipWidth (int a_level)     const { return std::max(m_width  >> a_level, 1); }
+    int                  MipHeight(int a_level)     const { return std::max(m_height >> a_level, 1); }
+    size_t               MipSizeInBytes(int a_level) const; ///< tightly packed texels or blocks of mip level, partial blocks are rounded up
 
     VkImageLayout        Layout()     const { return m_currentLayout; }
     VkPipelineStageFlags Stage()      const { return m_currentStage;  }
@@ -57,12 +170,16 @@ namespace vk_texture
 
     VkDeviceMemory m_memStorage; // SimpleVulkanTexture DOES NOT OWN memStorage! It just save reference to it.
     VkImage        m_image;
-    VkSampler      m_sampler;
+    VkSampler      m_sampler;    // owned by m_pSamplers
     VkImageView    m_view;
     VkDevice       m_device;
     VkFormat       m_format;
     int m_width, m_height;
     int m_mipLevels;
+    uint32_t m_blockWidth, m_blockHeight, m_blockBytes; ///< 1x1 texel "block" for uncompressed formats
+
+    std::shared_ptr<SamplerCache> m_pSamplers;
+    SamplerDesc                   m_samplerDesc;
     
     VkImageCreateInfo  m_createImageInfo;
 
@@ -72,15 +189,80 @@ namespace vk_texture
   };
 
 
+  // Same-sized textures (i.e. materials) packed in layers of a single image: the whole scene samples them through one descriptor,
+  // shaders select layer per draw (push constant, per-draw data). All layers have the full mip chain and the same format.
+  //
+  struct Texture2DArray
+  {
+    Texture2DArray() : m_memStorage(0), m_image(0), m_sampler(0), m_view(0), m_device(0), m_layers(0),
+                       m_blockWidth(1), m_blockHeight(1), m_blockBytes(4) {}
+    ~Texture2DArray();
+
+    VkMemoryRequirements CreateImage(VkDevice a_device, const int a_width, const int a_height, const int a_layers, VkFormat a_format,
+                                     std::shared_ptr<SamplerCache> a_pSamplers = nullptr); ///< same as SimpleTexture2D::CreateImage
+    void                 BindMemory (VkDeviceMemory a_memStorage, size_t a_offset);
+
+    /**
+    \brief Upload all mip levels of all layers at once (texture is assumed to be in undefined layout, so layers can't be updated one by one).
+           Texture is left in transfer dst layout, use ChangeLayoutCmd to make it readable in shaders.
+    \param a_mips      - input Layers()*MipLevels() pointers; a_mips[layer*MipLevels() + level] has MipWidth(level) x MipHeight(level) texels (or blocks)
+    \param a_pCopyImpl - input copy engine
+    */
+    void                 UpdateLayers(const void* const* a_mips, ICopyEngine* a_pCopyImpl);
+    void                 ChangeLayoutCmd(VkCommandBuffer a_cmdBuff, VkImageLayout a_newLayout, VkPipelineStageFlags a_newStage);
+
+    void                 SetSampler(const SamplerDesc& a_desc);        ///< must be called before Sampler() is written to descriptor sets
+    void                 SetMaxAnisotropy(float a_maxAnisotropy);
+
+    VkImage              Image()      const { return m_image;   }
+    VkImageView          View()       const { return m_view;    } ///< VK_IMAGE_VIEW_TYPE_2D_ARRAY, i.e. sampler2DArray in shaders
+    VkSampler            Sampler()    const { return m_sampler; }
+    const SamplerDesc&   SamplerInfo() const { return m_samplerDesc; }
+
+    int                  Width()      const { return m_width;  }
+    int                  Height()     const { return m_height; }
+    int                  Layers()     const { return m_layers; }
+    VkFormat             Format()     const { return m_format; }
+    int                  MipLevels()  const { return m_mipLevels; }
+
+    int                  MipWidth (int a_level)      const { return std::max(m_width  >> a_level, 1); }
+    int                  MipHeight(int a_level)      const { return std::max(m_height >> a_level, 1); }
+    size_t               MipSizeInBytes(int a_level) const; ///< of a single layer
+
+  protected:
+
+    Texture2DArray(const Texture2DArray& a_rhs) = delete;
+    Texture2DArray& operator=(const Texture2DArray& a_rhs) = delete;
+
+    VkDeviceMemory m_memStorage; // Texture2DArray DOES NOT OWN memStorage! It just save reference to it.
+    VkImage        m_image;
+    VkSampler      m_sampler;    // owned by m_pSamplers
+    VkImageView    m_view;
+    VkDevice       m_device;
+    VkFormat       m_format;
+    int m_width, m_height, m_layers;
+    int m_mipLevels;
+    uint32_t m_blockWidth, m_blockHeight, m_blockBytes;
+
+    std::shared_ptr<SamplerCache> m_pSamplers;
+    SamplerDesc                   m_samplerDesc;
+
+    VkImageCreateInfo    m_createImageInfo;
+    VkImageLayout        m_currentLayout;
+    VkPipelineStageFlags m_currentStage;
+  };
+
+
   struct RenderableTexture2D
   {
-    RenderableTexture2D() : m_memStorage(0), m_image(0), m_sampler(0), m_view(0), m_fbo(0), m_device(0), 
+    RenderableTexture2D() : m_memStorage(0), m_image(0), m_sampler(0), m_compareSampler(0), m_view(0), m_fbo(0), m_device(0), 
                             m_renderPass(0) { }
     ~RenderableTexture2D();
 
     //// useful functions
     //
-    VkMemoryRequirements CreateImage(VkDevice a_device, const int a_width, const int a_height, VkFormat a_format);
+    VkMemoryRequirements CreateImage(VkDevice a_device, const int a_width, const int a_height, VkFormat a_format,
+                                     std::shared_ptr<SamplerCache> a_pSamplers = nullptr); ///< same as SimpleTexture2D::CreateImage
     void                 BindMemory(VkDeviceMemory a_memStorage, size_t a_offset);
 
     void                 BeginRenderingToThisTexture(VkCommandBuffer a_cmdBuff);
@@ -91,6 +273,7 @@ namespace vk_texture
     VkImage              Image()      const { return m_image; }
     VkImageView          View()       const { return m_view; }
     VkSampler            Sampler()    const { return m_sampler; }
+    VkSampler            CompareSampler() const { return m_compareSampler; } ///< depth textures only: VK_COMPARE_OP_LESS_OR_EQUAL, linear if supported (hardware PCF), sampler2DShadow in shaders
 
     VkImageCreateInfo    Info()       const { return m_createImageInfo; }
     int                  Width()      const { return m_width; }
@@ -109,9 +292,12 @@ namespace vk_texture
 
     VkDeviceMemory m_memStorage; // RenderableTexture2D DOES NOT OWN memStorage! It just save reference to it.
     VkImage        m_image;
-    VkSampler      m_sampler;
+    VkSampler      m_sampler;        // both samplers are owned by m_pSamplers
+    VkSampler      m_compareSampler;
     VkImageView    m_view;
 
+    std::shared_ptr<SamplerCache> m_pSamplers;
+
     VkRenderPass   m_renderPass;
     VkFramebuffer  m_fbo;
 
@@ -125,6 +311,48 @@ namespace vk_texture
 
   };
 
+
+  /**
+  \brief Lifetime based placement of render targets in a single memory block: targets that are never used in the same passes share memory.
+         Lifetime is the range of pass indices [firstPass, lastPass] in which target is written or read, within one frame.
+         Contents of aliased target are undefined at its first pass, so it must be cleared (or fully overwritten) there with 
+         UNDEFINED initial layout, as RenderableTexture2D does.
+
+         Usage: AddTarget for each target (memory requirements from CreateImage), Allocate, then BindMemory(Memory(), Offset(id)).
+  */
+  struct AliasingAllocator
+  {
+    AliasingAllocator(VkDevice a_device, VkPhysicalDevice a_physDevice) : m_device(a_device), m_physDevice(a_physDevice), m_memory(VK_NULL_HANDLE), m_size(0) {}
+    ~AliasingAllocator();
+
+    int  AddTarget(const VkMemoryRequirements& a_memReq, int a_firstPass, int a_lastPass); ///< returns target id
+    void Allocate();                                                                       ///< place targets and allocate memory, once
+
+    VkDeviceMemory Memory()               const { return m_memory; }
+    VkDeviceSize   Offset(int a_id)       const { return m_targets[a_id].offset; }
+    VkDeviceSize   Size()                 const { return m_size; }  ///< of the memory block
+    VkDeviceSize   UnaliasedSize()        const;                    ///< what separate allocations would take
+
+  protected:
+
+    AliasingAllocator(const AliasingAllocator& a_rhs) = delete;
+    AliasingAllocator& operator=(const AliasingAllocator& a_rhs) = delete;
+
+    struct Target
+    {
+      VkMemoryRequirements memReq;
+      int                  firstPass;
+      int                  lastPass;
+      VkDeviceSize         offset;
+    };
+
+    VkDevice            m_device;
+    VkPhysicalDevice    m_physDevice;
+    VkDeviceMemory      m_memory;
+    VkDeviceSize        m_size;
+    std::vector<Target> m_targets;
+  };
+
 };
 
 #endif
\ No newline at end of file
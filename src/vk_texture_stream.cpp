@@ -0,0 +1,347 @@
+#include "vk_texture_stream.h"
+#include "vk_utils.h"
+
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+
+#ifdef WIN32
+#undef max
+#undef min
+#endif
+
+/**
+\brief vk_texture::ICopyEngine over async copy helper, so that uploads of streamed textures go to the current batch and are not waited for.
+*/
+struct AsyncTextureCopy : public vk_texture::ICopyEngine
+{
+  AsyncTextureCopy(vk_copy::AsyncCopyHelper* a_pHelper) : m_pHelper(a_pHelper) {}
+
+  void UpdateImage(VkImage a_image, const void* a_src, int a_width, int a_height, int a_bpp) override { m_pHelper->UpdateImage(a_image, a_src, a_width, a_height, a_bpp); }
+
+  void UpdateImageMips(VkImage a_image, VkFormat a_format, const MipData* a_mips, size_t a_mipsNum, uint32_t a_mipLevels, uint32_t a_arrayLayers) override
+  {
+    std::vector<vk_copy::ImageSubresourceData> subres(a_mipsNum);
+    for(size_t i=0;i<a_mipsNum;i++)
+      subres[i] = vk_copy::ImageSubresourceData{a_mips[i].src, a_mips[i].mipLevel, a_mips[i].arrayLayer, a_mips[i].width, a_mips[i].height};
+    m_pHelper->UpdateImageSubresources(a_image, a_format, subres.data(), subres.size(), a_mipLevels, a_arrayLayers);
+  }
+
+  vk_copy::AsyncCopyHelper* m_pHelper;
+};
+
+static int FullChainLevels(int a_width, int a_height) { return int(floor(log2(std::max(a_width, a_height))) + 1); } // same as Texture2DArray::CreateImage
+
+vk_texture::TextureStreamer::TextureStreamer(VkDevice a_device, VkPhysicalDevice a_physDevice, vk_copy::AsyncCopyHelper* a_pCopy,
+                                             std::shared_ptr<SamplerCache> a_pSamplers, const StreamingParams& a_params) :
+                                             m_device(a_device), m_physDevice(a_physDevice), m_pCopy(a_pCopy), m_pSamplers(a_pSamplers), m_params(a_params),
+                                             m_memory(VK_NULL_HANDLE), m_memTypeIndex(uint32_t(-1)), m_uploadsTicket(0), m_frame(1)
+{
+  assert(a_pCopy != nullptr);
+  if(m_pSamplers == nullptr)
+    m_pSamplers = std::make_shared<SamplerCache>(a_device, a_physDevice);
+  m_freeRanges.push_back(Allocation{0, m_params.budget});
+}
+
+vk_texture::TextureStreamer::~TextureStreamer()
+{
+  if(m_uploadsTicket != 0)
+    m_pCopy->Wait(m_uploadsTicket); // don't destroy images that are written now
+
+  m_uploads.clear();
+  m_retired.clear();
+  m_textures.clear();
+
+  if(m_memory != VK_NULL_HANDLE)
+    vkFreeMemory(m_device, m_memory, NULL);
+}
+
+bool vk_texture::TextureStreamer::Allocate(const VkMemoryRequirements& a_memReq, Allocation* a_pAlloc)
+{
+  if(m_memory == VK_NULL_HANDLE) // all images of the streamer live in single allocation of budget size
+  {
+    m_memTypeIndex = vk_utils::FindMemoryType(a_memReq.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_physDevice);
+
+    VkMemoryAllocateInfo allocateInfo = {};
+    allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.pNext           = nullptr;
+    allocateInfo.allocationSize  = m_params.budget;
+    allocateInfo.memoryTypeIndex = m_memTypeIndex;
+    VK_CHECK_RESULT(vkAllocateMemory(m_device, &allocateInfo, NULL, &m_memory));
+  }
+  else if((a_memReq.memoryTypeBits & (1u << m_memTypeIndex)) == 0)
+    RUN_TIME_ERROR("[TextureStreamer::Allocate()]: image can't be placed in the memory type of streaming budget");
+
+  // first fit
+  //
+  for(size_t i=0;i<m_freeRanges.size();i++)
+  {
+    const Allocation range  = m_freeRanges[i];
+    const VkDeviceSize begin = (range.offset + a_memReq.alignment - 1) / a_memReq.alignment * a_memReq.alignment;
+    if(begin + a_memReq.size > range.offset + range.size)
+      continue;
+
+    a_pAlloc->offset = range.offset; // alignment padding stays in the allocation, so Free gets the whole range back
+    a_pAlloc->size   = begin + a_memReq.size - range.offset;
+
+    if(a_pAlloc->size == range.size)
+      m_freeRanges.erase(m_freeRanges.begin() + i);
+    else
+      m_freeRanges[i] = Allocation{range.offset + a_pAlloc->size, range.size - a_pAlloc->size};
+    return true;
+  }
+  return false;
+}
+
+void vk_texture::TextureStreamer::Free(const Allocation& a_alloc)
+{
+  if(a_alloc.size == 0)
+    return;
+
+  auto p = std::lower_bound(m_freeRanges.begin(), m_freeRanges.end(), a_alloc,
+                            [](const Allocation& a, const Allocation& b) { return a.offset < b.offset; });
+  p = m_freeRanges.insert(p, a_alloc);
+
+  auto next = p + 1;
+  if(next != m_freeRanges.end() && p->offset + p->size == next->offset)
+  {
+    p->size += next->size;
+    m_freeRanges.erase(next);
+  }
+  if(p != m_freeRanges.begin())
+  {
+    auto prev = p - 1;
+    if(prev->offset + prev->size == p->offset)
+    {
+      prev->size += p->size;
+      m_freeRanges.erase(p);
+    }
+  }
+}
+
+VkDeviceSize vk_texture::TextureStreamer::UsedMemory() const
+{
+  VkDeviceSize freeSize = 0;
+  for(const auto& range : m_freeRanges)
+    freeSize += range.size;
+  return m_params.budget - freeSize;
+}
+
+std::unique_ptr<vk_texture::Texture2DArray> vk_texture::TextureStreamer::CreateLevels(const Texture& a_tex, int a_mip, Allocation* a_pAlloc)
+{
+  const int width  = std::max(a_tex.src.width  >> a_mip, 1);
+  const int height = std::max(a_tex.src.height >> a_mip, 1);
+
+  auto pImage = std::make_unique<Texture2DArray>();
+  auto memReq = pImage->CreateImage(m_device, width, height, a_tex.src.layers, a_tex.src.format, m_pSamplers);
+  if(!Allocate(memReq, a_pAlloc))
+    return nullptr;
+
+  pImage->BindMemory(m_memory, a_pAlloc->offset + a_pAlloc->size - memReq.size);
+  pImage->SetSampler(a_tex.src.sampler);
+  return pImage;
+}
+
+void vk_texture::TextureStreamer::UploadLevels(const Texture& a_tex, int a_mip, Texture2DArray* a_pImage)
+{
+  const int levels = a_pImage->MipLevels();
+  assert(a_mip + levels == a_tex.src.levels);
+
+  std::vector<const void*> mips(size_t(a_tex.src.layers)*size_t(levels));
+  for(int layer = 0; layer < a_tex.src.layers; layer++)
+    for(int level = 0; level < levels; level++)
+      mips[size_t(layer)*size_t(levels) + size_t(level)] = a_tex.src.subres[size_t(layer)*size_t(a_tex.src.levels) + size_t(a_mip + level)];
+
+  AsyncTextureCopy copy(m_pCopy);
+  a_pImage->UpdateLayers(mips.data(), &copy);
+}
+
+void vk_texture::TextureStreamer::Retire(std::unique_ptr<Texture2DArray>& a_image, Allocation& a_alloc)
+{
+  m_retired.push_back(Retired{std::move(a_image), a_alloc, m_frame});
+  a_image = nullptr;
+  a_alloc = Allocation();
+}
+
+bool vk_texture::TextureStreamer::EvictLRU(int a_exceptId)
+{
+  int victim = -1;
+  for(int i=0;i<int(m_textures.size());i++)
+  {
+    const Texture& tex = m_textures[i];
+    if(i == a_exceptId || tex.full == nullptr || tex.pending || tex.lastUsed == m_frame)
+      continue;
+    if(victim == -1 || tex.lastUsed < m_textures[victim].lastUsed)
+      victim = i;
+  }
+
+  if(victim == -1)
+    return false;
+
+  Texture& tex = m_textures[victim]; // back to the mip tail; memory is returned when GPU can't use the image anymore
+  Retire(tex.full, tex.fullAlloc);
+  return true;
+}
+
+int vk_texture::TextureStreamer::AddTexture(const StreamingSource& a_src)
+{
+  if(a_src.width <= 0 || a_src.height <= 0 || a_src.layers <= 0 || a_src.levels != FullChainLevels(a_src.width, a_src.height))
+    RUN_TIME_ERROR("[TextureStreamer::AddTexture()]: source must have the full mip chain");
+  if(a_src.subres.size() != size_t(a_src.levels)*size_t(a_src.layers) || a_src.sizes.size() != a_src.subres.size())
+    RUN_TIME_ERROR("[TextureStreamer::AddTexture()]: wrong number of subresources");
+
+  uint32_t blockWidth = 1, blockHeight = 1, blockBytes = 4;
+  if(!vk_utils::GetFormatBlockInfo(a_src.format, &blockWidth, &blockHeight, &blockBytes))
+    RUN_TIME_ERROR("[TextureStreamer::AddTexture()]: unknown texture format");
+
+  for(int layer = 0; layer < a_src.layers; layer++)
+  {
+    for(int level = 0; level < a_src.levels; level++)
+    {
+      const size_t blocksX = (size_t(std::max(a_src.width  >> level, 1)) + blockWidth  - 1) / blockWidth;
+      const size_t blocksY = (size_t(std::max(a_src.height >> level, 1)) + blockHeight - 1) / blockHeight;
+      if(a_src.sizes[size_t(layer)*size_t(a_src.levels) + size_t(level)] != blocksX*blocksY*size_t(blockBytes))
+        RUN_TIME_ERROR("[TextureStreamer::AddTexture()]: mip level size is wrong");
+    }
+  }
+
+  Texture tex;
+  tex.src     = a_src;
+  tex.tailMip = 0;
+  while(std::max(a_src.width >> tex.tailMip, a_src.height >> tex.tailMip) > m_params.mipTailSize)
+    tex.tailMip++;
+  tex.requested = tex.tailMip;
+
+  tex.tail = CreateLevels(tex, tex.tailMip, &tex.tailAlloc);
+  if(tex.tail == nullptr)
+    RUN_TIME_ERROR("[TextureStreamer::AddTexture()]: mip tails don't fit in streaming budget");
+  UploadLevels(tex, tex.tailMip, tex.tail.get());
+
+  m_textures.push_back(std::move(tex));
+  m_tailsToAcquire.push_back(int(m_textures.size()) - 1);
+  return int(m_textures.size()) - 1;
+}
+
+void vk_texture::TextureStreamer::AcquireTailsCmd(VkCommandBuffer a_cmdBuff)
+{
+  for(int id : m_tailsToAcquire)
+    m_textures[id].tail->ChangeLayoutCmd(a_cmdBuff, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+  m_tailsToAcquire.clear();
+}
+
+void vk_texture::TextureStreamer::RequestMip(int a_id, int a_mip)
+{
+  Texture& tex  = m_textures[a_id];
+  tex.requested = (tex.lastUsed == m_frame) ? std::min(tex.requested, a_mip) : a_mip;
+  tex.requested = std::max(std::min(tex.requested, tex.tailMip), 0);
+  tex.lastUsed  = m_frame;
+}
+
+bool vk_texture::TextureStreamer::UpdateCmd(VkCommandBuffer a_cmdBuff)
+{
+  bool changed = false;
+
+  // (1) destroy images that GPU can't use anymore
+  //
+  for(size_t i=0;i<m_retired.size();)
+  {
+    if(m_retired[i].frame + uint64_t(m_params.framesInFlight) <= m_frame)
+    {
+      m_retired[i].image = nullptr;
+      Free(m_retired[i].alloc);
+      m_retired.erase(m_retired.begin() + i);
+    }
+    else
+      i++;
+  }
+
+  // (2) swap in completed uploads; AcquireOwnershipCmd records acquire barriers, release goes with semaphore the frame submit waits for
+  //
+  if(m_uploadsTicket != 0 && m_pCopy->IsComplete(m_uploadsTicket))
+  {
+    m_pCopy->AcquireOwnershipCmd(a_cmdBuff);
+    for(auto& upload : m_uploads)
+    {
+      upload.image->ChangeLayoutCmd(a_cmdBuff, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+      Texture& tex = m_textures[upload.id];
+      if(tex.full != nullptr)
+        Retire(tex.full, tex.fullAlloc);
+      tex.full      = std::move(upload.image);
+      tex.fullAlloc = upload.alloc;
+      tex.fullMip   = upload.mip;
+      tex.pending   = false;
+    }
+    m_uploads.clear();
+    m_uploadsTicket = 0;
+    changed         = true;
+  }
+
+  // (3) start the next wave when the previous one is done: textures of this frame that need finer mips, the largest gap first
+  //
+  if(m_uploadsTicket == 0)
+  {
+    std::vector<int> candidates;
+    for(int i=0;i<int(m_textures.size());i++)
+    {
+      const Texture& tex = m_textures[i];
+      if(tex.lastUsed == m_frame && tex.requested < tex.ResidentMip())
+        candidates.push_back(i);
+    }
+    std::sort(candidates.begin(), candidates.end(), [this](int a, int b)
+              { return m_textures[a].ResidentMip() - m_textures[a].requested > m_textures[b].ResidentMip() - m_textures[b].requested; });
+
+    VkDeviceSize waveBytes = 0;
+    for(int id : candidates)
+    {
+      Texture& tex = m_textures[id];
+
+      // if the budget is exceeded, drop the least recently used texture (its memory is returned in a few frames) and try coarser mips now
+      //
+      bool evicted = false;
+      for(int mip = tex.requested; mip < tex.ResidentMip(); mip++)
+      {
+        Allocation alloc;
+        auto pImage = CreateLevels(tex, mip, &alloc);
+        if(pImage == nullptr)
+        {
+          evicted = evicted || EvictLRU(id);
+          continue;
+        }
+
+        UploadLevels(tex, mip, pImage.get());
+        waveBytes  += alloc.size;
+        tex.pending = true;
+        m_uploads.push_back(Upload{id, mip, std::move(pImage), alloc});
+        break;
+      }
+      changed = changed || evicted;
+
+      if(waveBytes >= m_params.maxBytesPerWave)
+        break;
+    }
+
+    if(!m_uploads.empty())
+      m_uploadsTicket = m_pCopy->Submit();
+  }
+
+  m_frame++;
+  return changed;
+}
+
+VkImageView vk_texture::TextureStreamer::View(int a_id) const
+{
+  const Texture& tex = m_textures[a_id];
+  return (tex.full != nullptr) ? tex.full->View() : tex.tail->View();
+}
+
+VkSampler vk_texture::TextureStreamer::Sampler(int a_id) const
+{
+  const Texture& tex = m_textures[a_id];
+  return (tex.full != nullptr) ? tex.full->Sampler() : tex.tail->Sampler();
+}
+
+int vk_texture::TextureStreamer::ResidentMip(int a_id) const
+{
+  return m_textures[a_id].ResidentMip();
+}
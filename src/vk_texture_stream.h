@@ -0,0 +1,152 @@
+#ifndef VULKAN_TEXTURE_STREAM_H
+#define VULKAN_TEXTURE_STREAM_H
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "vk_texture.h"
+#include "vk_copy.h"
+
+namespace vk_texture
+{
+  /**
+  \brief CPU side of streamed texture: all mips of all layers. Streamer keeps only pointers, so data must stay valid
+         while texture is in the streamer (i.e. memory mapped container, see ctexture::TextureFile).
+  */
+  struct StreamingSource
+  {
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    int      width  = 0;
+    int      height = 0;
+    int      levels = 0;                    ///< must be the full chain down to 1x1
+    int      layers = 1;
+    std::vector<const void*> subres;        ///< levels*layers pointers, subres[layer*levels + level]; tightly packed texels or blocks
+    std::vector<size_t>      sizes;         ///< sizes of subres in bytes, they are checked against format
+    SamplerDesc              sampler;       ///< i.e. per texture anisotropy
+  };
+
+  struct StreamingParams
+  {
+    VkDeviceSize budget          = 64*1024*1024; ///< device memory for all streamed textures; allocated once, never exceeded
+    int          mipTailSize     = 64;           ///< levels not larger than mipTailSize x mipTailSize are resident all the time
+    VkDeviceSize maxBytesPerWave = 8*1024*1024;  ///< limits uploads that are started at once, so that frames don't hitch
+    int          framesInFlight  = 2;            ///< replaced images are destroyed after this number of UpdateCmd calls
+  };
+
+  /**
+  \brief Texture streaming for Vulkan 1.0 (no sparse residency). Each texture always has its mip tail resident;
+         finer mips are loaded on demand to a separate image [mip, levels) that replaces the previous one when upload is complete.
+
+         Application reports the finest mip each texture needs with RequestMip (i.e. estimated from distance or read back from GPU feedback),
+         UpdateCmd starts uploads for the textures used in this frame, finishes completed ones and, when the budget is exceeded,
+         drops high mips of least recently used textures back to the tail. Uploads go through async copy helper and are never waited for.
+
+         All textures are 2D array images (sampler2DArray in shaders), View() changes when residency changes.
+  */
+  struct TextureStreamer
+  {
+    TextureStreamer(VkDevice a_device, VkPhysicalDevice a_physDevice, vk_copy::AsyncCopyHelper* a_pCopy,
+                    std::shared_ptr<SamplerCache> a_pSamplers, const StreamingParams& a_params = StreamingParams());
+    ~TextureStreamer();
+
+    /**
+    \brief Add texture and record upload of its mip tail to the copy helper (not submitted). Application makes the upload available
+           as usual (Submit and AcquireOwnershipCmd) and then calls AcquireTailsCmd, before textures are used.
+    \return texture id
+    */
+    int  AddTexture(const StreamingSource& a_src);
+    void AcquireTailsCmd(VkCommandBuffer a_cmdBuff); ///< put mip tails that were added since the last call to shader read layout
+
+    /**
+    \brief Feedback for the current frame: a_mip is the finest mip level texture needs; texture becomes the most recently used one.
+    */
+    void RequestMip(int a_id, int a_mip);
+
+    /**
+    \brief Once per frame, before draws and outside of render pass: finish completed uploads, evict, start new uploads.
+           When uploads are complete, copy helper AcquireOwnershipCmd is recorded to a_cmdBuff (CPU doesn't wait for anything), 
+           so the submit of a_cmdBuff must wait for copy helper TakeWaitSemaphores(). Each upload goes to a new image, 
+           so ownership of streamed images is transferred only once, from transfer to graphics family.
+    \param a_cmdBuff - output command buffer of the frame; acquire and layout barriers for completed uploads are recorded here
+    \return true if View() or Sampler() of some textures have changed, so descriptor sets must be updated before they are bound
+    */
+    bool UpdateCmd(VkCommandBuffer a_cmdBuff);
+
+    VkImageView  View       (int a_id) const;   ///< VK_IMAGE_VIEW_TYPE_2D_ARRAY
+    VkSampler    Sampler    (int a_id) const;
+    int          ResidentMip(int a_id) const;   ///< finest mip that can be sampled now
+    int          TexturesNum()         const { return int(m_textures.size()); }
+    VkDeviceSize UsedMemory()          const;   ///< including images that wait for destruction
+
+  protected:
+
+    TextureStreamer(const TextureStreamer& a_rhs) = delete;
+    TextureStreamer& operator=(const TextureStreamer& a_rhs) = delete;
+
+    struct Allocation
+    {
+      VkDeviceSize offset = 0;
+      VkDeviceSize size   = 0;     ///< 0 if nothing is allocated
+    };
+
+    struct Texture
+    {
+      StreamingSource                 src;
+      int                             tailMip   = 0;
+      std::unique_ptr<Texture2DArray> tail;
+      Allocation                      tailAlloc;
+      std::unique_ptr<Texture2DArray> full;      ///< [fullMip, levels); nullptr if only tail is resident
+      Allocation                      fullAlloc;
+      int                             fullMip   = 0;
+      int                             requested = 0;  ///< finest mip requested in the current frame
+      uint64_t                        lastUsed  = 0;  ///< frame of the last request
+      bool                            pending   = false;
+
+      int ResidentMip() const { return (full != nullptr) ? fullMip : tailMip; }
+    };
+
+    struct Upload
+    {
+      int                             id;
+      int                             mip;
+      std::unique_ptr<Texture2DArray> image;
+      Allocation                      alloc;
+    };
+
+    struct Retired
+    {
+      std::unique_ptr<Texture2DArray> image;
+      Allocation                      alloc;
+      uint64_t                        frame;
+    };
+
+    std::unique_ptr<Texture2DArray> CreateLevels(const Texture& a_tex, int a_mip, Allocation* a_pAlloc); ///< nullptr if budget is exceeded
+    void                            UploadLevels(const Texture& a_tex, int a_mip, Texture2DArray* a_pImage);
+    void                            Retire(std::unique_ptr<Texture2DArray>& a_image, Allocation& a_alloc);
+    bool                            EvictLRU(int a_exceptId);
+
+    bool Allocate(const VkMemoryRequirements& a_memReq, Allocation* a_pAlloc);
+    void Free(const Allocation& a_alloc);
+
+    VkDevice                      m_device;
+    VkPhysicalDevice              m_physDevice;
+    vk_copy::AsyncCopyHelper*     m_pCopy;
+    std::shared_ptr<SamplerCache> m_pSamplers;
+    StreamingParams               m_params;
+
+    VkDeviceMemory                m_memory;      ///< m_params.budget bytes, allocated with the first image
+    uint32_t                      m_memTypeIndex;
+    std::vector<Allocation>       m_freeRanges;  ///< sorted by offset, adjacent ranges are merged
+
+    std::vector<Texture>          m_textures;
+    std::vector<int>              m_tailsToAcquire;
+    std::vector<Upload>           m_uploads;     ///< current wave; all of them are submitted at once
+    uint64_t                      m_uploadsTicket;
+    std::vector<Retired>          m_retired;
+    uint64_t                      m_frame;
+  };
+};
+
+#endif
@@ -12,6 +12,7 @@
 #include <cassert>
 
 #include <algorithm>
+#include <chrono>
 #ifdef WIN32
 #undef min
 #undef max
@@ -283,16 +284,53 @@ uint32_t vk_utils::GetQueueFamilyIndex(VkPhysicalDevice a_physicalDevice, VkQueu
 }
 
 
-VkDevice vk_utils::CreateLogicalDevice(uint32_t queueFamilyIndex, VkPhysicalDevice physicalDevice, const std::vector<const char *>& a_enabledLayers, std::vector<const char *> a_extentions)
+uint32_t vk_utils::GetTransferQueueFamilyIndex(VkPhysicalDevice a_physicalDevice, uint32_t a_fallbackFID)
+{
+  uint32_t queueFamilyCount;
+  vkGetPhysicalDeviceQueueFamilyProperties(a_physicalDevice, &queueFamilyCount, NULL);
+
+  std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(a_physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+  // pure transfer family first, then transfer + compute (async compute queues can copy too)
+  //
+  for (uint32_t i = 0; i < queueFamilyCount; ++i)
+  {
+    const VkQueueFlags flags = queueFamilies[i].queueFlags;
+    if (queueFamilies[i].queueCount > 0 && (flags & VK_QUEUE_TRANSFER_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT) && !(flags & VK_QUEUE_COMPUTE_BIT))
+      return i;
+  }
+
+  for (uint32_t i = 0; i < queueFamilyCount; ++i)
+  {
+    const VkQueueFlags flags = queueFamilies[i].queueFlags;
+    if (queueFamilies[i].queueCount > 0 && (flags & VK_QUEUE_TRANSFER_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT))
+      return i;
+  }
+
+  return a_fallbackFID;
+}
+
+VkDevice vk_utils::CreateLogicalDevice(uint32_t queueFamilyIndex, VkPhysicalDevice physicalDevice, const std::vector<const char *>& a_enabledLayers, std::vector<const char *> a_extentions,
+                                       uint32_t a_transferQueueFID)
 {
   // When creating the device, we also specify what queues it has.
   //
-  VkDeviceQueueCreateInfo queueCreateInfo = {};
-  queueCreateInfo.sType            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-  queueCreateInfo.queueFamilyIndex = queueFamilyIndex;
-  queueCreateInfo.queueCount       = 1;    // create one queue in this family. We don't need more.
-  float queuePriorities            = 1.0;  // we only have one queue, so this is not that imporant.
-  queueCreateInfo.pQueuePriorities = &queuePriorities;
+  float queuePriorities = 1.0;  // we only have one queue per family, so this is not that imporant.
+
+  VkDeviceQueueCreateInfo queueCreateInfos[2] = {};
+  queueCreateInfos[0].sType            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+  queueCreateInfos[0].queueFamilyIndex = queueFamilyIndex;
+  queueCreateInfos[0].queueCount       = 1;    // create one queue in this family. We don't need more.
+  queueCreateInfos[0].pQueuePriorities = &queuePriorities;
+
+  uint32_t queueCreateInfoCount = 1;
+  if(a_transferQueueFID != VK_QUEUE_FAMILY_IGNORED && a_transferQueueFID != queueFamilyIndex) // separate queue for async uploads
+  {
+    queueCreateInfos[1]                  = queueCreateInfos[0];
+    queueCreateInfos[1].queueFamilyIndex = a_transferQueueFID;
+    queueCreateInfoCount                 = 2;
+  }
 
   // Now we create the logical device. The logical device allows us to interact with the physical device.
   //
@@ -300,14 +338,21 @@ VkDevice vk_utils::CreateLogicalDevice(uint32_t queueFamilyIndex, VkPhysicalDevi
 
   // Specify any desired device features here. We do not need any for this application, though.
   //
+  VkPhysicalDeviceFeatures supportedFeatures = {};
+  vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
   VkPhysicalDeviceFeatures deviceFeatures = {};
-  deviceFeatures.fillModeNonSolid = VK_TRUE;   // me want to darw lines also
+  deviceFeatures.fillModeNonSolid          = VK_TRUE;   // me want to darw lines also
+  deviceFeatures.multiDrawIndirect         = supportedFeatures.multiDrawIndirect;         // optional, for drawing whole scene with single indirect call
+  deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance; // optional, for drawing whole scene with single indirect call
+  deviceFeatures.textureCompressionBC      = supportedFeatures.textureCompressionBC;      // optional, for BCn textures
+  deviceFeatures.samplerAnisotropy         = supportedFeatures.samplerAnisotropy;         // optional, see vk_texture::SamplerCache
 
   deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
   deviceCreateInfo.enabledLayerCount    = uint32_t(a_enabledLayers.size());  // need to specify validation layers here as well.
   deviceCreateInfo.ppEnabledLayerNames  = a_enabledLayers.data();
-  deviceCreateInfo.pQueueCreateInfos    = &queueCreateInfo;        // when creating the logical device, we also specify what queues it has.
-  deviceCreateInfo.queueCreateInfoCount = 1;
+  deviceCreateInfo.pQueueCreateInfos    = queueCreateInfos;        // when creating the logical device, we also specify what queues it has.
+  deviceCreateInfo.queueCreateInfoCount = queueCreateInfoCount;
   deviceCreateInfo.pEnabledFeatures     = &deviceFeatures;
   deviceCreateInfo.enabledExtensionCount   = static_cast<uint32_t>(a_extentions.size());
   deviceCreateInfo.ppEnabledExtensionNames = a_extentions.data();
@@ -339,6 +384,39 @@ uint32_t vk_utils::FindMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags
   return -1;
 }
 
+uint32_t vk_utils::FindDirectWriteMemoryType(uint32_t memoryTypeBits, VkPhysicalDevice physicalDevice)
+{
+  VkPhysicalDeviceMemoryProperties memoryProperties;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+  VkDeviceSize largestLocalHeap = 0;
+  for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
+  {
+    if(memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+      largestLocalHeap = std::max(largestLocalHeap, memoryProperties.memoryHeaps[i].size);
+  }
+
+  const VkMemoryPropertyFlags directFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+  // skip types of small heaps; with ReBAR, host visible heap is the same size as device local one (or nearly so)
+  //
+  uint32_t typeBits = memoryTypeBits;
+  while(typeBits != 0)
+  {
+    const uint32_t typeId = FindMemoryType(typeBits, directFlags, physicalDevice);
+    if(typeId == uint32_t(-1))
+      break;
+
+    const VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[typeId].heapIndex].size;
+    if(heapSize >= largestLocalHeap/2)
+      return typeId;
+
+    typeBits &= ~(1u << typeId);
+  }
+
+  return uint32_t(-1);
+}
+
 std::vector<uint32_t> vk_utils::ReadFile(const char* filename)
 {
   FILE* fp = fopen(filename, "rb");
@@ -413,12 +491,17 @@ std::vector<VkCommandBuffer> vk_utils::CreateCommandBuffers(VkDevice a_device, V
   return commandBuffers;
 }
 
-void vk_utils::ExecuteCommandBufferNow(VkCommandBuffer a_cmdBuff, VkQueue a_queue, VkDevice a_device)
+void vk_utils::ExecuteCommandBufferNow(VkCommandBuffer a_cmdBuff, VkQueue a_queue, VkDevice a_device, const std::vector<VkSemaphore>& a_waitSemaphores)
 {
+  const std::vector<VkPipelineStageFlags> waitStages(a_waitSemaphores.size(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
   // Now we shall finally submit the recorded command bufferStaging to a queue.
   //
   VkSubmitInfo submitInfo       = {};
   submitInfo.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.waitSemaphoreCount = uint32_t(a_waitSemaphores.size());
+  submitInfo.pWaitSemaphores    = a_waitSemaphores.data();
+  submitInfo.pWaitDstStageMask  = waitStages.data();
   submitInfo.commandBufferCount = 1; // submit a single command bufferStaging
   submitInfo.pCommandBuffers    = &a_cmdBuff; // the command bufferStaging to submit.
 
@@ -442,6 +525,232 @@ void vk_utils::ExecuteCommandBufferNow(VkCommandBuffer a_cmdBuff, VkQueue a_queu
   vkDestroyFence(a_device, fence, NULL);
 }
 
+static double HostTimeMs()
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+vk_utils::SubmitContext::SubmitContext(VkPhysicalDevice a_physDevice, VkDevice a_device, VkQueue a_queue, uint32_t a_queueFID, int a_slotsNum) : 
+                                       m_device(a_device), m_queue(a_queue), m_pool(nullptr), m_timestamps(nullptr), m_timestampMask(0), m_timestampPeriod(0.0f), m_lastTicket(0)
+{
+  assert(a_slotsNum > 0);
+
+  VkCommandPoolCreateInfo poolInfo = {};
+  poolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  poolInfo.queueFamilyIndex = a_queueFID;
+  VK_CHECK_RESULT(vkCreateCommandPool(a_device, &poolInfo, nullptr, &m_pool));
+
+  auto cmdBuffs = CreateCommandBuffers(a_device, m_pool, uint32_t(a_slotsNum));
+
+  VkFenceCreateInfo fenceCreateInfo = {};
+  fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fenceCreateInfo.flags = 0;
+
+  m_slots.resize(a_slotsNum);
+  for(int i=0;i<a_slotsNum;i++)
+  {
+    m_slots[i].cmdBuff    = cmdBuffs[i];
+    m_slots[i].state      = SLOT_FREE;
+    m_slots[i].ticket     = 0;
+    m_slots[i].submitTime = 0.0;
+    m_slots[i].timing     = SubmitTiming{-1.0f, -1.0f};
+    VK_CHECK_RESULT(vkCreateFence(a_device, &fenceCreateInfo, NULL, &m_slots[i].fence));
+  }
+
+  // timestamps are optional, transfer-only queues often don't have them;
+  // they also can't use vkCmdResetQueryPool (graphics or compute only), so there are no timestamps for transfer-only families at all
+  //
+  uint32_t queueFamilyCount;
+  vkGetPhysicalDeviceQueueFamilyProperties(a_physDevice, &queueFamilyCount, NULL);
+  std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(a_physDevice, &queueFamilyCount, queueFamilies.data());
+
+  VkPhysicalDeviceProperties props;
+  vkGetPhysicalDeviceProperties(a_physDevice, &props);
+
+  const bool     canReset  = (a_queueFID < queueFamilyCount) && (queueFamilies[a_queueFID].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) != 0;
+  const uint32_t validBits = canReset ? queueFamilies[a_queueFID].timestampValidBits : 0;
+  if(validBits != 0 && props.limits.timestampPeriod > 0.0f)
+  {
+    VkQueryPoolCreateInfo queryInfo = {};
+    queryInfo.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryInfo.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+    queryInfo.queryCount = uint32_t(2*a_slotsNum);
+    VK_CHECK_RESULT(vkCreateQueryPool(a_device, &queryInfo, nullptr, &m_timestamps));
+
+    m_timestampMask   = (validBits >= 64) ? ~uint64_t(0) : ((uint64_t(1) << validBits) - 1);
+    m_timestampPeriod = props.limits.timestampPeriod;
+  }
+}
+
+vk_utils::SubmitContext::~SubmitContext()
+{
+  WaitAll();
+
+  for(auto& slot : m_slots)
+  {
+    vkDestroyFence      (m_device, slot.fence, NULL);
+    vkFreeCommandBuffers(m_device, m_pool, 1, &slot.cmdBuff);
+  }
+
+  if(m_timestamps != nullptr)
+    vkDestroyQueryPool(m_device, m_timestamps, nullptr);
+  vkDestroyCommandPool(m_device, m_pool, nullptr);
+}
+
+int vk_utils::SubmitContext::FindSlot(uint64_t a_ticket) const
+{
+  for(size_t i=0;i<m_slots.size();i++)
+  {
+    if(m_slots[i].ticket == a_ticket && m_slots[i].state != SLOT_RECORDING)
+      return int(i);
+  }
+  return -1;
+}
+
+void vk_utils::SubmitContext::Retire(int a_slotId)
+{
+  Slot& slot = m_slots[a_slotId];
+  assert(slot.state == SLOT_IN_FLIGHT);
+
+  slot.timing.hostMs = float(HostTimeMs() - slot.submitTime);
+  slot.timing.gpuMs  = -1.0f;
+
+  if(m_timestamps != nullptr)
+  {
+    uint64_t stamps[2] = {0,0};
+    if(vkGetQueryPoolResults(m_device, m_timestamps, uint32_t(2*a_slotId), 2, sizeof(stamps), stamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+      slot.timing.gpuMs = float(double((stamps[1] - stamps[0]) & m_timestampMask)*double(m_timestampPeriod)*1e-6);
+  }
+
+  slot.state = SLOT_FREE;
+}
+
+VkCommandBuffer vk_utils::SubmitContext::Begin()
+{
+  int slotId = -1;
+  while(slotId < 0)
+  {
+    // take free slot; completed submissions free their slots; if there is nothing, wait for the oldest one
+    //
+    int oldest = -1;
+    for(size_t i=0;i<m_slots.size() && slotId < 0;i++)
+    {
+      if(m_slots[i].state == SLOT_IN_FLIGHT && vkGetFenceStatus(m_device, m_slots[i].fence) == VK_SUCCESS)
+        Retire(int(i));
+
+      if(m_slots[i].state == SLOT_FREE)
+        slotId = int(i);
+      else if(m_slots[i].state == SLOT_IN_FLIGHT && (oldest < 0 || m_slots[i].ticket < m_slots[oldest].ticket))
+        oldest = int(i);
+    }
+
+    if(slotId < 0)
+    {
+      if(oldest < 0)
+        RUN_TIME_ERROR("[SubmitContext::Begin()]: all command buffers are being recorded, submit some of them or create context with more slots");
+      Wait(m_slots[oldest].ticket);
+    }
+  }
+
+  Slot& slot  = m_slots[slotId];
+  slot.state  = SLOT_RECORDING;
+  slot.ticket = 0;
+
+  VkCommandBufferBeginInfo beginInfo = {};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  VK_CHECK_RESULT(vkResetCommandBuffer(slot.cmdBuff, 0));
+  VK_CHECK_RESULT(vkBeginCommandBuffer(slot.cmdBuff, &beginInfo));
+
+  if(m_timestamps != nullptr)
+  {
+    vkCmdResetQueryPool(slot.cmdBuff, m_timestamps, uint32_t(2*slotId), 2);
+    vkCmdWriteTimestamp(slot.cmdBuff, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_timestamps, uint32_t(2*slotId));
+  }
+
+  return slot.cmdBuff;
+}
+
+uint64_t vk_utils::SubmitContext::Submit(VkCommandBuffer a_cmdBuff)
+{
+  int slotId = -1;
+  for(size_t i=0;i<m_slots.size();i++)
+  {
+    if(m_slots[i].cmdBuff == a_cmdBuff && m_slots[i].state == SLOT_RECORDING)
+      slotId = int(i);
+  }
+
+  if(slotId < 0)
+    RUN_TIME_ERROR("[SubmitContext::Submit()]: command buffer was not taken from this context with Begin()");
+
+  Slot& slot = m_slots[slotId];
+
+  if(m_timestamps != nullptr)
+    vkCmdWriteTimestamp(slot.cmdBuff, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestamps, uint32_t(2*slotId + 1));
+
+  VK_CHECK_RESULT(vkEndCommandBuffer(slot.cmdBuff));
+
+  VkSubmitInfo submitInfo       = {};
+  submitInfo.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers    = &slot.cmdBuff;
+
+  VK_CHECK_RESULT(vkResetFences(m_device, 1, &slot.fence));
+  VK_CHECK_RESULT(vkQueueSubmit(m_queue, 1, &submitInfo, slot.fence));
+
+  slot.state      = SLOT_IN_FLIGHT;
+  slot.ticket     = ++m_lastTicket;
+  slot.submitTime = HostTimeMs();
+  return slot.ticket;
+}
+
+bool vk_utils::SubmitContext::IsComplete(uint64_t a_ticket)
+{
+  assert(a_ticket <= m_lastTicket);
+  const int slotId = FindSlot(a_ticket);
+  if(slotId < 0 || m_slots[slotId].state == SLOT_FREE) // slot was retired (and may be reused)
+    return true;
+
+  if(vkGetFenceStatus(m_device, m_slots[slotId].fence) != VK_SUCCESS)
+    return false;
+
+  Retire(slotId);
+  return true;
+}
+
+void vk_utils::SubmitContext::Wait(uint64_t a_ticket)
+{
+  assert(a_ticket <= m_lastTicket);
+  const int slotId = FindSlot(a_ticket);
+  if(slotId < 0 || m_slots[slotId].state == SLOT_FREE)
+    return;
+
+  VK_CHECK_RESULT(vkWaitForFences(m_device, 1, &m_slots[slotId].fence, VK_TRUE, 100000000000));
+  Retire(slotId);
+}
+
+void vk_utils::SubmitContext::WaitAll()
+{
+  for(auto& slot : m_slots)
+  {
+    if(slot.state == SLOT_IN_FLIGHT)
+      Wait(slot.ticket);
+  }
+}
+
+bool vk_utils::SubmitContext::GetTiming(uint64_t a_ticket, SubmitTiming* a_pTiming)
+{
+  const int slotId = FindSlot(a_ticket);
+  if(slotId < 0 || !IsComplete(a_ticket))
+    return false;
+
+  (*a_pTiming) = m_slots[slotId].timing;
+  return true;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -611,7 +920,7 @@ void vk_utils::CreateScreenFrameBuffers(VkDevice a_device, VkRenderPass a_render
 }
 
 void vk_utils::CreateDepthTexture(VkDevice a_device, VkPhysicalDevice a_physDevice, const int a_width, const int a_height,
-                                  VkDeviceMemory *a_pImageMemory, VkImage *a_image, VkImageView* a_imageView)
+                                  VkDeviceMemory *a_pImageMemory, VkImage *a_image, VkImageView* a_imageView, bool a_transient)
 {
   VkImageCreateInfo imgCreateInfo = {};
   imgCreateInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -624,6 +933,8 @@ void vk_utils::CreateDepthTexture(VkDevice a_device, VkPhysicalDevice a_physDevi
   imgCreateInfo.samples       = VK_SAMPLE_COUNT_1_BIT;
   imgCreateInfo.tiling        = VK_IMAGE_TILING_OPTIMAL;
   imgCreateInfo.usage         = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+  if(a_transient)
+    imgCreateInfo.usage      |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
   imgCreateInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
   imgCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
   imgCreateInfo.arrayLayers   = 1;
@@ -631,11 +942,19 @@ void vk_utils::CreateDepthTexture(VkDevice a_device, VkPhysicalDevice a_physDevi
 
   VkMemoryRequirements memoryRequirements;
   vkGetImageMemoryRequirements(a_device, (*a_image), &memoryRequirements);
+
+  // tile based GPUs keep transient attachments in on-chip memory, lazily allocated memory is not committed then; others don't have such memory type
+  //
+  uint32_t memTypeIndex = uint32_t(-1);
+  if(a_transient)
+    memTypeIndex = vk_utils::FindMemoryType(memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, a_physDevice);
+  if(memTypeIndex == uint32_t(-1))
+    memTypeIndex = vk_utils::FindMemoryType(memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, a_physDevice);
   
   VkMemoryAllocateInfo allocateInfo = {};
   allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
   allocateInfo.allocationSize  = memoryRequirements.size; // specify required memory.
-  allocateInfo.memoryTypeIndex = vk_utils::FindMemoryType(memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, a_physDevice);
+  allocateInfo.memoryTypeIndex = memTypeIndex;
   VK_CHECK_RESULT(vkAllocateMemory(a_device, &allocateInfo, NULL, a_pImageMemory)); // allocate memory on device.
   VK_CHECK_RESULT(vkBindImageMemory(a_device, (*a_image), (*a_pImageMemory), 0));
 
@@ -703,3 +1022,79 @@ bool vk_utils::IsDepthFormat(VkFormat a_format)
 {
   return (a_format == VK_FORMAT_D32_SFLOAT) || (a_format == VK_FORMAT_D16_UNORM);
 }
+
+bool vk_utils::GetFormatBlockInfo(VkFormat a_format, uint32_t* a_pBlockWidth, uint32_t* a_pBlockHeight, uint32_t* a_pBlockBytes)
+{
+  uint32_t blockSize = 1;
+  uint32_t bytes     = 0;
+
+  switch(a_format)
+  {
+    case VK_FORMAT_R8_UNORM:
+      bytes = 1; break;
+
+    case VK_FORMAT_R8G8_UNORM:
+    case VK_FORMAT_R16_UNORM:
+    case VK_FORMAT_R16_SFLOAT:
+    case VK_FORMAT_D16_UNORM:
+      bytes = 2; break;
+
+    case VK_FORMAT_R8G8B8_UNORM:
+    case VK_FORMAT_B8G8R8_UNORM:
+      bytes = 3; break;
+
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SNORM:
+    case VK_FORMAT_R8G8B8A8_UINT:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+    case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+    case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+    case VK_FORMAT_R16G16_SFLOAT:
+    case VK_FORMAT_R32_SFLOAT:
+    case VK_FORMAT_D32_SFLOAT:
+      bytes = 4; break;
+
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+    case VK_FORMAT_R32G32_SFLOAT:
+      bytes = 8; break;
+
+    case VK_FORMAT_R32G32B32_SFLOAT:
+      bytes = 12; break;
+
+    case VK_FORMAT_R32G32B32A32_SFLOAT:
+    case VK_FORMAT_R32G32B32A32_UINT:
+      bytes = 16; break;
+
+    // block compressed formats, 4x4 texels per block
+    //
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+    case VK_FORMAT_BC4_SNORM_BLOCK:
+      blockSize = 4; bytes = 8; break;
+
+    case VK_FORMAT_BC2_UNORM_BLOCK:
+    case VK_FORMAT_BC2_SRGB_BLOCK:
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+    case VK_FORMAT_BC5_SNORM_BLOCK:
+    case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+    case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+      blockSize = 4; bytes = 16; break;
+
+    default:
+      return false;
+  };
+
+  (*a_pBlockWidth)  = blockSize;
+  (*a_pBlockHeight) = blockSize;
+  (*a_pBlockBytes)  = bytes;
+  return true;
+}
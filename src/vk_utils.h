@@ -39,9 +39,28 @@ namespace vk_utils
 
   uint32_t GetQueueFamilyIndex(VkPhysicalDevice a_physicalDevice, VkQueueFlagBits a_bits);
   uint32_t GetComputeQueueFamilyIndex(VkPhysicalDevice a_physicalDevice);
-  VkDevice CreateLogicalDevice(uint32_t queueFamilyIndex, VkPhysicalDevice physicalDevice, const std::vector<const char *>& a_enabledLayers, std::vector<const char *> a_extentions = std::vector<const char *>());
+
+  /**
+  \brief Find queue family that supports transfer but not graphics (preferably not compute too), i.e. DMA engine of the GPU.
+  \param a_physicalDevice - input physical device
+  \param a_fallbackFID    - input family to return if there is no dedicated transfer family (usually the graphics one)
+  */
+  uint32_t GetTransferQueueFamilyIndex(VkPhysicalDevice a_physicalDevice, uint32_t a_fallbackFID);
+
+  /**
+  \brief Create logical device with one queue in queueFamilyIndex and one more queue in a_transferQueueFID if it is differs from queueFamilyIndex
+  */
+  VkDevice CreateLogicalDevice(uint32_t queueFamilyIndex, VkPhysicalDevice physicalDevice, const std::vector<const char *>& a_enabledLayers, std::vector<const char *> a_extentions = std::vector<const char *>(),
+                               uint32_t a_transferQueueFID = VK_QUEUE_FAMILY_IGNORED);
   uint32_t FindMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags properties, VkPhysicalDevice physicalDevice);
 
+  /**
+  \brief Find DEVICE_LOCAL | HOST_VISIBLE | HOST_COHERENT memory type which heap covers (almost) the whole video memory, i.e. resizable BAR 
+         on discrete GPUs or unified memory of integrated ones. CPU may write such memory directly, without staging copy.
+         Returns uint32_t(-1) if there is no such type; small (usually 256 MB) BAR window of discrete GPUs without ReBAR is not accepted.
+  */
+  uint32_t FindDirectWriteMemoryType(uint32_t memoryTypeBits, VkPhysicalDevice physicalDevice);
+
   //// FrameBuffer and SwapChain issues
   //
   struct ScreenBufferResources
@@ -61,16 +80,100 @@ namespace vk_utils
 
   void CreateScreenFrameBuffers(VkDevice a_device, VkRenderPass a_renderPass, VkImageView a_depthView, ScreenBufferResources* pScreen);
 
+  /**
+  \brief Create D32 depth buffer with its own memory.
+  \param a_transient - input depth is only used inside render passes (load op CLEAR, store op DONT_CARE): image is created as transient attachment
+                        in lazily allocated memory if device has it (tile based GPUs), so it may take no memory at all
+  */
   void CreateDepthTexture(VkDevice a_device, VkPhysicalDevice a_physDevice, const int a_width, const int a_height,
-                          VkDeviceMemory *a_pImageMemory, VkImage *a_image, VkImageView* a_imageView);
+                          VkDeviceMemory *a_pImageMemory, VkImage *a_image, VkImageView* a_imageView, bool a_transient = false);
 
   std::vector<uint32_t> ReadFile(const char* filename);
   VkShaderModule CreateShaderModule(VkDevice a_device, const std::vector<uint32_t>& code);
 
   /**
-  \brief Immediately execute command buffer and wait.
+  \brief Immediately execute command buffer and wait. Creates temporary fence, use SubmitContext for frequent submissions.
+  \param a_waitSemaphores - input semaphores the submit waits for before any command (AsyncCopyHelper::TakeWaitSemaphores(), for example)
+  */
+  void ExecuteCommandBufferNow(VkCommandBuffer a_cmdBuff, VkQueue a_queue, VkDevice a_device, const std::vector<VkSemaphore>& a_waitSemaphores = {});
+
+  /**
+  \brief Timing of a single submission, see SubmitContext::GetTiming
   */
-  void ExecuteCommandBufferNow(VkCommandBuffer a_cmdBuff, VkQueue a_queue, VkDevice a_device);
+  struct SubmitTiming
+  {
+    float gpuMs;   ///< time between first and last command of the command buffer on device; -1 if queue does not support timestamps or is transfer-only
+    float hostMs;  ///< time from vkQueueSubmit to the moment host observed the fence signaled (upper bound of latency)
+  };
+
+  /**
+  \brief Reusable submission context for one queue: a pool of command buffers and fences that are recycled 
+         instead of being created for each submit. Submit does not block, it returns a ticket that can be polled or waited for.
+
+         VkCommandBuffer cmd = ctx.Begin();    // command buffer is already begun
+         ...                                   // record commands
+         uint64_t ticket = ctx.Submit(cmd);    // end and submit
+         ...
+         if(ctx.IsComplete(ticket)) ...        // or ctx.Wait(ticket)
+
+         If all slots are in flight, Begin() waits for the oldest submission.
+  */
+  struct SubmitContext
+  {
+    /**
+    \param a_physDevice - input physical device, used to query timestamp support
+    \param a_device     - input logical device
+    \param a_queue      - input queue for all submissions
+    \param a_queueFID   - input queue family index of a_queue
+    \param a_slotsNum   - input maximum number of submissions in flight (and command buffers being recorded)
+    */
+    SubmitContext(VkPhysicalDevice a_physDevice, VkDevice a_device, VkQueue a_queue, uint32_t a_queueFID, int a_slotsNum = 8);
+    ~SubmitContext();
+
+    VkCommandBuffer Begin();                                ///< get free command buffer from the pool and begin it
+    uint64_t        Submit(VkCommandBuffer a_cmdBuff);      ///< end command buffer taken from Begin() and submit it; returns ticket
+    bool            IsComplete(uint64_t a_ticket);          ///< non blocking
+    void            Wait(uint64_t a_ticket);
+    void            WaitAll();
+
+    /**
+    \brief Get timing of completed submission. Returns false if submission is not completed yet, 
+           or if its slot was already reused by later submissions (only last a_slotsNum timings are stored).
+    */
+    bool            GetTiming(uint64_t a_ticket, SubmitTiming* a_pTiming);
+
+    VkQueue         Queue() const { return m_queue; }
+
+  protected:
+
+    SubmitContext(const SubmitContext& a_rhs) = delete;
+    SubmitContext& operator=(const SubmitContext& a_rhs) = delete;
+
+    enum SLOT_STATE { SLOT_FREE = 0, SLOT_RECORDING = 1, SLOT_IN_FLIGHT = 2 };
+
+    struct Slot
+    {
+      VkCommandBuffer cmdBuff;
+      VkFence         fence;
+      SLOT_STATE      state;
+      uint64_t        ticket;
+      double          submitTime;  ///< host time in ms
+      SubmitTiming    timing;      ///< valid after slot has been retired
+    };
+
+    int  FindSlot(uint64_t a_ticket) const;
+    void Retire(int a_slotId);     ///< a_slotId fence must be signaled
+
+    VkDevice          m_device;
+    VkQueue           m_queue;
+    VkCommandPool     m_pool;
+    VkQueryPool       m_timestamps;    ///< two queries per slot; null if queue family does not support timestamps or is transfer-only
+    uint64_t          m_timestampMask;
+    float             m_timestampPeriod;
+
+    std::vector<Slot> m_slots;
+    uint64_t          m_lastTicket;
+  };
 
   /**
   \brief TBD
@@ -98,6 +201,16 @@ namespace vk_utils
                         VkRenderPass* a_pRenderPass);
 
   bool IsDepthFormat(VkFormat a_format);
+
+  /**
+  \brief Get texel block size for image format; for uncompressed formats block is a single texel.
+  \param a_format       - input image format
+  \param a_pBlockWidth  - output block width in texels
+  \param a_pBlockHeight - output block height in texels
+  \param a_pBlockBytes  - output block size in bytes
+  \return false if format is unknown; combined depth/stencil formats are unknown too, since their aspects are copied separately with different texel sizes
+  */
+  bool GetFormatBlockInfo(VkFormat a_format, uint32_t* a_pBlockWidth, uint32_t* a_pBlockHeight, uint32_t* a_pBlockBytes);
 };
 
 #undef  RUN_TIME_ERROR
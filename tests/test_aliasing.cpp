@@ -0,0 +1,121 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// AliasingAllocator placement: targets with disjoint lifetimes share memory, targets with overlapping lifetimes never intersect,
+// offsets respect alignment; expected offsets are computed by hand for the largest-first, lowest-offset placement.
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <stdexcept>
+
+#include "test_utils.h"
+#include "vk_texture.h"
+
+static const VkDeviceSize KB = 1024;
+static const VkDeviceSize MB = 1024*1024;
+
+static uint32_t DeviceLocalTypeBits(VkPhysicalDevice a_physicalDevice)
+{
+  VkPhysicalDeviceMemoryProperties memoryProperties;
+  vkGetPhysicalDeviceMemoryProperties(a_physicalDevice, &memoryProperties);
+
+  uint32_t typeBits = 0;
+  for(uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+  {
+    if(memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+      typeBits |= (1u << i);
+  }
+  return typeBits;
+}
+
+struct TestTarget
+{
+  VkDeviceSize size;
+  VkDeviceSize alignment;
+  int          firstPass;
+  int          lastPass;
+  VkDeviceSize expectedOffset;
+};
+
+int main(int argc, const char** argv)
+{
+  TestContext ctx;
+  if(!ctx.Init())
+    return TEST_SKIPPED;
+
+  const uint32_t typeBits = DeviceLocalTypeBits(ctx.physicalDevice);
+  CHECK(typeBits != 0);
+
+  // passes 0..3, i.e. shadow map, G-buffer, lighting, post process
+  //
+  const TestTarget targets[] = {
+    { 4*MB,       64*KB,  0, 1, 0              },  // A
+    { 4*MB,       64*KB,  2, 3, 0              },  // B: disjoint with A, shares its memory
+    { 2*MB,       64*KB,  1, 2, 4*MB           },  // C: overlaps A and B
+    { 1*MB + 100, 4*KB,   3, 3, 4*MB           },  // D: overlaps B only, reuses memory of C
+    { 1*MB,       256*KB, 0, 0, 4*MB           },  // E: overlaps A only
+    { 512*KB,     64*KB,  1, 3, 6*MB           },  // F: overlaps A, B, C and D
+    { 256*KB,     128*KB, 3, 3, 5*MB + 128*KB  },  // G: after the end of D (5 MB + 100) aligned up
+  };
+  const int targetsNum = int(sizeof(targets)/sizeof(targets[0]));
+
+  vk_texture::AliasingAllocator allocator(ctx.device, ctx.physicalDevice);
+  std::vector<int> ids(targetsNum);
+  for(int i=0;i<targetsNum;i++)
+  {
+    VkMemoryRequirements memReq = {};
+    memReq.size           = targets[i].size;
+    memReq.alignment      = targets[i].alignment;
+    memReq.memoryTypeBits = typeBits;
+    ids[i] = allocator.AddTarget(memReq, targets[i].firstPass, targets[i].lastPass);
+  }
+
+  allocator.Allocate();
+  CHECK(allocator.Memory() != VK_NULL_HANDLE);
+
+  for(int i=0;i<targetsNum;i++)
+  {
+    const VkDeviceSize offset = allocator.Offset(ids[i]);
+    if(offset != targets[i].expectedOffset)
+      std::cout << "target " << i << ": offset = " << offset << ", expected " << targets[i].expectedOffset << std::endl;
+    CHECK(offset == targets[i].expectedOffset);
+    CHECK(offset % targets[i].alignment == 0);
+    CHECK(offset + targets[i].size <= allocator.Size());
+  }
+
+  // whatever the placement is, targets that live at the same time must not intersect
+  //
+  for(int i=0;i<targetsNum;i++)
+  {
+    for(int j=i+1;j<targetsNum;j++)
+    {
+      const bool sameTime = (targets[i].firstPass <= targets[j].lastPass && targets[j].firstPass <= targets[i].lastPass);
+      const bool disjoint = (allocator.Offset(ids[i]) + targets[i].size <= allocator.Offset(ids[j]) ||
+                             allocator.Offset(ids[j]) + targets[j].size <= allocator.Offset(ids[i]));
+      CHECK(!sameTime || disjoint);
+    }
+  }
+
+  std::cout << "aliased size = " << allocator.Size() << ", unaliased size = " << allocator.UnaliasedSize() << std::endl;
+  CHECK(allocator.Size() == 6*MB + 512*KB);
+  CHECK(allocator.UnaliasedSize() == 12*MB + 768*KB + 100);
+  CHECK(allocator.Size() < allocator.UnaliasedSize());
+
+  // targets without common memory type
+  //
+  if(typeBits != (typeBits & (~typeBits + 1))) // single device local type can't be split in two disjoint masks
+  {
+    vk_texture::AliasingAllocator badAllocator(ctx.device, ctx.physicalDevice);
+    VkMemoryRequirements memReq = {};
+    memReq.size           = 1*MB;
+    memReq.alignment      = 64*KB;
+    memReq.memoryTypeBits = typeBits & (~typeBits + 1); // lowest bit
+    badAllocator.AddTarget(memReq, 0, 0);
+    memReq.memoryTypeBits = typeBits & ~memReq.memoryTypeBits;
+    badAllocator.AddTarget(memReq, 1, 1);
+
+    bool thrown = false;
+    try { badAllocator.Allocate(); } catch(std::runtime_error&) { thrown = true; }
+    CHECK(thrown);
+  }
+
+  return TestResult();
+}
@@ -0,0 +1,256 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// BCn encoder (ctexture::CompressBC) round trip: blocks are decoded with reference decoder written from the format specification
+// (interpolation in float, as hardware does) and compared with the source; size is not multiple of 4, so border blocks are partial.
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+
+#include "test_utils.h"
+#include "ctexture.h"
+
+static uint64_t ReadLE(const unsigned char* a_src, int a_bytes)
+{
+  uint64_t res = 0;
+  for(int i=0;i<a_bytes;i++)
+    res |= uint64_t(a_src[i]) << (8*i);
+  return res;
+}
+
+static void Decode565(uint32_t a_color, float a_rgb[3])
+{
+  a_rgb[0] = float((a_color >> 11) & 31)*(255.0f/31.0f);
+  a_rgb[1] = float((a_color >> 5)  & 63)*(255.0f/63.0f);
+  a_rgb[2] = float((a_color >> 0)  & 31)*(255.0f/31.0f);
+}
+
+/**
+\brief BC1 color block to 16 rgb texels in [0, 255]; a_forceFourColors is true for color block of BC3
+*/
+static void DecodeColorBlock(const unsigned char* a_src, bool a_forceFourColors, float a_texels[16][4])
+{
+  const uint32_t c0 = uint32_t(ReadLE(a_src + 0, 2));
+  const uint32_t c1 = uint32_t(ReadLE(a_src + 2, 2));
+  const uint32_t indices = uint32_t(ReadLE(a_src + 4, 4));
+
+  float palette[4][3];
+  Decode565(c0, palette[0]);
+  Decode565(c1, palette[1]);
+  for(int c=0;c<3;c++)
+  {
+    if(c0 > c1 || a_forceFourColors)
+    {
+      palette[2][c] = (2.0f*palette[0][c] + palette[1][c])/3.0f;
+      palette[3][c] = (palette[0][c] + 2.0f*palette[1][c])/3.0f;
+    }
+    else
+    {
+      palette[2][c] = (palette[0][c] + palette[1][c])/2.0f;
+      palette[3][c] = 0.0f;
+    }
+  }
+
+  for(int i=0;i<16;i++)
+    for(int c=0;c<3;c++)
+      a_texels[i][c] = palette[(indices >> (2*i)) & 3][c];
+}
+
+/**
+\brief BC4 block (alpha of BC3, channels of BC5) to channel a_channel of 16 texels
+*/
+static void DecodeChannelBlock(const unsigned char* a_src, int a_channel, float a_texels[16][4])
+{
+  const float    r0      = float(a_src[0]);
+  const float    r1      = float(a_src[1]);
+  const uint64_t indices = ReadLE(a_src + 2, 6);
+
+  float palette[8] = { r0, r1, 0, 0, 0, 0, 0, 255.0f };
+  if(r0 > r1)
+  {
+    for(int i=1;i<7;i++)
+      palette[i+1] = (float(7-i)*r0 + float(i)*r1)/7.0f;
+  }
+  else
+  {
+    for(int i=1;i<5;i++)
+      palette[i+1] = (float(5-i)*r0 + float(i)*r1)/5.0f;
+    palette[6] = 0.0f;
+  }
+
+  for(int i=0;i<16;i++)
+    a_texels[i][a_channel] = palette[(indices >> (3*i)) & 7];
+}
+
+/**
+\brief Decode whole image to float rgba; channels that format doesn't store are 0
+*/
+static std::vector<float> DecodeImage(const unsigned char* a_blocks, int a_width, int a_height, ctexture::BC_FORMAT a_format)
+{
+  const int    blocksX    = (a_width + 3)/4;
+  const size_t blockBytes = ctexture::BlockBytes(a_format);
+
+  std::vector<float> res(size_t(a_width)*size_t(a_height)*4, 0.0f);
+  for(int by = 0; by < (a_height + 3)/4; by++)
+  {
+    for(int bx = 0; bx < blocksX; bx++)
+    {
+      const unsigned char* src = a_blocks + (size_t(by)*size_t(blocksX) + size_t(bx))*blockBytes;
+      float texels[16][4] = {};
+      switch(a_format)
+      {
+        case ctexture::BC_FORMAT_BC1: DecodeColorBlock(src, false, texels);                                  break;
+        case ctexture::BC_FORMAT_BC3: DecodeChannelBlock(src, 3, texels); DecodeColorBlock(src + 8, true, texels); break;
+        case ctexture::BC_FORMAT_BC4: DecodeChannelBlock(src, 0, texels);                                    break;
+        case ctexture::BC_FORMAT_BC5: DecodeChannelBlock(src, 0, texels); DecodeChannelBlock(src + 8, 1, texels);  break;
+      };
+
+      for(int y=0;y<4;y++)
+      {
+        for(int x=0;x<4;x++)
+        {
+          const int px = bx*4 + x, py = by*4 + y;
+          if(px < a_width && py < a_height)
+            memcpy(&res[(size_t(py)*size_t(a_width) + size_t(px))*4], texels[y*4+x], sizeof(float)*4);
+        }
+      }
+    }
+  }
+  return res;
+}
+
+static void StoredChannels(ctexture::BC_FORMAT a_format, int* a_pFirst, int* a_pLast)
+{
+  switch(a_format)
+  {
+    case ctexture::BC_FORMAT_BC1: (*a_pFirst) = 0; (*a_pLast) = 3; break;
+    case ctexture::BC_FORMAT_BC3: (*a_pFirst) = 0; (*a_pLast) = 4; break;
+    case ctexture::BC_FORMAT_BC4: (*a_pFirst) = 0; (*a_pLast) = 1; break;
+    case ctexture::BC_FORMAT_BC5: (*a_pFirst) = 0; (*a_pLast) = 2; break;
+  };
+}
+
+/**
+\brief RMS error over stored channels
+*/
+static double RoundTripError(const std::vector<unsigned int>& a_pixels, int a_width, int a_height, ctexture::BC_FORMAT a_format, ctexture::BC_QUALITY a_quality,
+                             float* a_pMaxError = nullptr)
+{
+  std::vector<unsigned char> blocks(ctexture::CompressedSize(a_format, a_width, a_height));
+  ctexture::CompressBC(a_pixels.data(), a_width, a_height, a_format, a_quality, blocks.data(), 1);
+  const std::vector<float> decoded = DecodeImage(blocks.data(), a_width, a_height, a_format);
+
+  int first = 0, last = 0;
+  StoredChannels(a_format, &first, &last);
+
+  double sum      = 0.0;
+  float  maxError = 0.0f;
+  for(size_t i=0;i<a_pixels.size();i++)
+  {
+    for(int c=first;c<last;c++)
+    {
+      const float diff = decoded[i*4 + c] - float((a_pixels[i] >> (8*c)) & 0xFF);
+      sum     += double(diff)*double(diff);
+      maxError = std::max(maxError, std::abs(diff));
+    }
+  }
+
+  if(a_pMaxError != nullptr)
+    (*a_pMaxError) = maxError;
+  return std::sqrt(sum/double(a_pixels.size()*size_t(last - first)));
+}
+
+/**
+\brief Smooth gradients with some noise and a few hard edges
+*/
+static std::vector<unsigned int> MakeTestImage(int a_width, int a_height)
+{
+  std::vector<unsigned int> pixels(size_t(a_width)*size_t(a_height));
+  uint32_t seed = 12345;
+  for(int y=0;y<a_height;y++)
+  {
+    for(int x=0;x<a_width;x++)
+    {
+      seed = seed*1664525u + 1013904223u;
+      const int noise = int(seed >> 28) - 8;
+      const int edge  = ((x / 9 + y / 7) % 3 == 0) ? 60 : 0;
+      const int r = std::min(std::max(x*6 + noise + edge, 0), 255);
+      const int g = std::min(std::max(y*11 - noise, 0), 255);
+      const int b = std::min(std::max((x + y)*3 + edge, 0), 255);
+      const int a = std::min(std::max(255 - x*4 - y*2 + noise, 0), 255);
+      pixels[size_t(y)*size_t(a_width) + size_t(x)] = uint32_t(r) | (uint32_t(g) << 8) | (uint32_t(b) << 16) | (uint32_t(a) << 24);
+    }
+  }
+  return pixels;
+}
+
+int main(int argc, const char** argv)
+{
+  const int width = 37, height = 21;
+  const std::vector<unsigned int> pixels = MakeTestImage(width, height);
+
+  CHECK(ctexture::CompressedSize(ctexture::BC_FORMAT_BC1, width, height) == 10*6*8);
+  CHECK(ctexture::CompressedSize(ctexture::BC_FORMAT_BC5, 1, 1)          == 16);
+
+  // (1) error of each format is small and better quality is never worse
+  //
+  const ctexture::BC_FORMAT formats[4]     = { ctexture::BC_FORMAT_BC1, ctexture::BC_FORMAT_BC3, ctexture::BC_FORMAT_BC4, ctexture::BC_FORMAT_BC5 };
+  const double              maxRMSE[4]     = { 12.0, 12.0, 4.0, 4.0 };  // for fast quality
+  const char*               formatNames[4] = { "BC1", "BC3", "BC4", "BC5" };
+
+  for(int f=0;f<4;f++)
+  {
+    const double fast   = RoundTripError(pixels, width, height, formats[f], ctexture::BC_QUALITY_FAST);
+    const double normal = RoundTripError(pixels, width, height, formats[f], ctexture::BC_QUALITY_NORMAL);
+    const double high   = RoundTripError(pixels, width, height, formats[f], ctexture::BC_QUALITY_HIGH);
+    std::cout << formatNames[f] << " rmse: fast = " << fast << ", normal = " << normal << ", high = " << high << std::endl;
+
+    CHECK(fast   < maxRMSE[f]);
+    CHECK(normal <= fast*1.01);
+    CHECK(high   <= normal + 1e-9);
+  }
+
+  // (2) solid color, exact in 565, and two level channel blocks are lossless; 0 and 255 stay exact among other values with high quality
+  //
+  {
+    std::vector<unsigned int> solid(8*8, 255u | (0u << 8) | (255u << 16) | (255u << 24)); // magenta
+    float maxError = 1.0f;
+    RoundTripError(solid, 8, 8, ctexture::BC_FORMAT_BC1, ctexture::BC_QUALITY_NORMAL, &maxError);
+    CHECK(maxError < 1e-3f);
+
+    std::vector<unsigned int> twoLevels(8*8);
+    for(size_t i=0;i<twoLevels.size();i++)
+      twoLevels[i] = (i % 3 == 0) ? (17u | (200u << 8)) : (230u | (3u << 8));
+    RoundTripError(twoLevels, 8, 8, ctexture::BC_FORMAT_BC5, ctexture::BC_QUALITY_FAST, &maxError);
+    CHECK(maxError < 1e-3f);
+
+    std::vector<unsigned int> extremes(4*4);
+    const unsigned int values[4] = { 0, 255, 100, 120 };
+    for(size_t i=0;i<extremes.size();i++)
+      extremes[i] = values[i % 4];
+    std::vector<unsigned char> block(8);
+    ctexture::CompressBC(extremes.data(), 4, 4, ctexture::BC_FORMAT_BC4, ctexture::BC_QUALITY_HIGH, block.data(), 1);
+    const std::vector<float> decoded = DecodeImage(block.data(), 4, 4, ctexture::BC_FORMAT_BC4);
+    for(size_t i=0;i<extremes.size();i++)
+    {
+      if(extremes[i] == 0 || extremes[i] == 255)
+        CHECK(decoded[i*4] == float(extremes[i]));
+    }
+    CHECK(block[0] <= block[1]); // 6 values mode
+  }
+
+  // (3) result doesn't depend on threads number; image is large enough to be split between threads
+  //
+  const int bigWidth = 301, bigHeight = 259;
+  const std::vector<unsigned int> bigPixels = MakeTestImage(bigWidth, bigHeight);
+  for(int f=0;f<4;f++)
+  {
+    std::vector<unsigned char> single(ctexture::CompressedSize(formats[f], bigWidth, bigHeight)), multi(single.size());
+    ctexture::CompressBC(bigPixels.data(), bigWidth, bigHeight, formats[f], ctexture::BC_QUALITY_HIGH, single.data(), 1);
+    ctexture::CompressBC(bigPixels.data(), bigWidth, bigHeight, formats[f], ctexture::BC_QUALITY_HIGH, multi.data(),  3);
+    CHECK(single == multi);
+  }
+
+  return TestResult();
+}
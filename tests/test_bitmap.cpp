@@ -0,0 +1,323 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// BMP decoder (Bitmap.h) on small fixtures that are formed in memory and written to temporary files: bottom-up and top-down
+// 24 bit, 1/4/8 bit palette, 32 bit bit fields, RLE8/RLE4 with all escapes, and truncated or unsupported files.
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <filesystem>
+
+#include "test_utils.h"
+#include "Bitmap.h"
+
+enum { BI_RGB = 0, BI_RLE8 = 1, BI_RLE4 = 2, BI_BITFIELDS = 3 };
+
+static void PutUInt16(std::vector<unsigned char>& a_file, size_t a_offset, uint16_t a_value) { memcpy(a_file.data() + a_offset, &a_value, sizeof(uint16_t)); }
+static void PutUInt32(std::vector<unsigned char>& a_file, size_t a_offset, uint32_t a_value) { memcpy(a_file.data() + a_offset, &a_value, sizeof(uint32_t)); }
+
+/**
+\brief Form BMP file with BITMAPINFOHEADER
+\param a_height - input image height; negative for top-down file
+\param a_extra  - input dwords right after the header: bit fields masks or palette (B, G, R, 0 in each entry)
+\param a_pixels - input pixel data as is (rows padded to 4 bytes or RLE stream)
+*/
+static std::vector<unsigned char> MakeBMP(int a_width, int a_height, int a_bpp, int a_compression, const std::vector<uint32_t>& a_extra,
+                                          const std::vector<unsigned char>& a_pixels)
+{
+  const size_t offBits = 54 + a_extra.size()*4;
+
+  std::vector<unsigned char> file(offBits + a_pixels.size(), 0);
+  file[0] = 'B';
+  file[1] = 'M';
+  PutUInt32(file, 2,  uint32_t(file.size()));
+  PutUInt32(file, 10, uint32_t(offBits));
+  PutUInt32(file, 14, 40);
+  PutUInt32(file, 18, uint32_t(a_width));
+  PutUInt32(file, 22, uint32_t(a_height));
+  PutUInt16(file, 26, 1);
+  PutUInt16(file, 28, uint16_t(a_bpp));
+  PutUInt32(file, 30, uint32_t(a_compression));
+  PutUInt32(file, 34, uint32_t(a_pixels.size()));
+  PutUInt32(file, 46, (a_bpp <= 8) ? uint32_t(a_extra.size()) : 0);
+
+  for(size_t i=0;i<a_extra.size();i++)
+    PutUInt32(file, 54 + i*4, a_extra[i]);
+  memcpy(file.data() + offBits, a_pixels.data(), a_pixels.size());
+  return file;
+}
+
+static std::string WriteFixture(const char* a_name, const std::vector<unsigned char>& a_file)
+{
+  const std::string path = (std::filesystem::temp_directory_path() / (std::string("test_bitmap_") + a_name + ".bmp")).string();
+  FILE* f = fopen(path.c_str(), "wb");
+  if(f != NULL)
+  {
+    fwrite(a_file.data(), 1, a_file.size(), f);
+    fclose(f);
+  }
+  return path;
+}
+
+static uint32_t PackRGBA(uint32_t r, uint32_t g, uint32_t b, uint32_t a) { return r | (g << 8) | (b << 16) | (a << 24); } // R8G8B8A8 in memory
+
+static uint32_t PixelColor(int x, int y) { return PackRGBA(uint32_t(x*19 + 7) & 0xFF, uint32_t(y*53 + 1) & 0xFF, uint32_t(x*y + 100) & 0xFF, 0); }
+
+static std::vector<uint32_t> GrayPalette(int a_entries) // index i --> gray 10*i + 5
+{
+  std::vector<uint32_t> palette(a_entries);
+  for(int i=0;i<a_entries;i++)
+    palette[i] = uint32_t(10*i + 5)*0x00010101u;
+  return palette;
+}
+
+/**
+\brief 24 bit, width is odd (row padding) and long enough for SIMD paths; top-down file must give the same pixels, bottom row first.
+*/
+static void Test24Bit()
+{
+  const int width = 13, height = 3;
+  const size_t rowSize = (width*3 + 3) & ~3;
+
+  std::vector<unsigned char> bottomUp(rowSize*height, 0xEE), topDown(rowSize*height, 0xEE); // garbage in padding must not matter
+  for(int y=0;y<height;y++)
+  {
+    for(int x=0;x<width;x++)
+    {
+      const uint32_t c   = PixelColor(x, y);
+      const unsigned char bgr[3] = { (unsigned char)(c >> 16), (unsigned char)(c >> 8), (unsigned char)c };
+      memcpy(bottomUp.data() + y*rowSize + x*3,                bgr, 3);
+      memcpy(topDown.data()  + (height - 1 - y)*rowSize + x*3, bgr, 3);
+    }
+  }
+
+  const std::string pathBU = WriteFixture("24_bottom_up", MakeBMP(width,  height, 24, BI_RGB, {}, bottomUp));
+  const std::string pathTD = WriteFixture("24_top_down",  MakeBMP(width, -height, 24, BI_RGB, {}, topDown));
+
+  for(const auto& path : {pathBU, pathTD})
+  {
+    int w = 0, h = 0;
+    const std::vector<unsigned int> pixels = LoadBMP(path.c_str(), &w, &h);
+    CHECK(w == width && h == height);
+    CHECK(pixels.size() == size_t(width*height));
+    bool same = (pixels.size() == size_t(width*height));
+    for(int y=0;y<height && same;y++)
+      for(int x=0;x<width;x++)
+        same &= (pixels[y*width + x] == PixelColor(x, y));
+    CHECK(same);
+
+    BMPInfo info;
+    CHECK(LoadBMPInfo(path.c_str(), &info) && info.width == width && info.height == height && info.channels == 4);
+    remove(path.c_str());
+  }
+}
+
+/**
+\brief 8 bit gray palette gives single channel; the same file expanded to 4 channels with padded destination rows
+*/
+static void Test8BitGray()
+{
+  const int width = 5, height = 3;
+  std::vector<unsigned char> rows(8*height, 0);
+  for(int y=0;y<height;y++)
+    for(int x=0;x<width;x++)
+      rows[y*8 + x] = (unsigned char)((x + y) % 6);
+
+  const std::string path = WriteFixture("8_gray", MakeBMP(width, height, 8, BI_RGB, GrayPalette(6), rows));
+
+  BMPInfo info;
+  const std::vector<unsigned char> data = LoadBMPData(path.c_str(), &info);
+  CHECK(info.width == width && info.height == height && info.channels == 1);
+  CHECK(data.size() == size_t(width*height));
+  for(int y=0;y<height && data.size() == size_t(width*height);y++)
+    for(int x=0;x<width;x++)
+      CHECK(data[y*width + x] == 10*((x + y) % 6) + 5);
+
+  const size_t pitch = 32;
+  std::vector<unsigned char> expanded(pitch*height, 0xAB);
+  CHECK(DecodeBMP(path.c_str(), expanded.data(), pitch, 4));
+  for(int y=0;y<height;y++)
+  {
+    for(int x=0;x<width;x++)
+    {
+      uint32_t texel;
+      memcpy(&texel, expanded.data() + y*pitch + x*4, sizeof(uint32_t));
+      const uint32_t gray = 10*((x + y) % 6) + 5;
+      CHECK(texel == PackRGBA(gray, gray, gray, 0));
+    }
+    CHECK(expanded[y*pitch + width*4] == 0xAB); // padding of destination rows is not touched
+  }
+
+  // 4 channel images can't be reduced to one
+  //
+  std::vector<unsigned char> single(width*height);
+  const std::string path24 = WriteFixture("24_small", MakeBMP(1, 1, 24, BI_RGB, {}, {1, 2, 3, 0}));
+  CHECK(!DecodeBMP(path24.c_str(), single.data(), 0, 1));
+
+  remove(path.c_str());
+  remove(path24.c_str());
+}
+
+/**
+\brief 4 bit color palette (nibble order) and 1 bit palette with row wider than a byte
+*/
+static void TestPalette4And1Bit()
+{
+  const std::vector<uint32_t> palette = { 0x00000000, 0x000000FF, 0x0000FF00, 0x00FF0000 }; // B, G, R, 0 in file: black, blue, green, red
+  const uint32_t colors[4]            = { PackRGBA(0,0,0,0), PackRGBA(0,0,255,0), PackRGBA(0,255,0,0), PackRGBA(255,0,0,0) };
+
+  // 3x2, 4 bit: row 0 = 1 2 3, row 1 = 3 0 1
+  //
+  const std::string path4 = WriteFixture("4_color", MakeBMP(3, 2, 4, BI_RGB, palette, { 0x12, 0x30, 0, 0,  0x30, 0x10, 0, 0 }));
+  const int expected4[6]  = { 1, 2, 3, 3, 0, 1 };
+
+  int w = 0, h = 0;
+  std::vector<unsigned int> pixels = LoadBMP(path4.c_str(), &w, &h);
+  CHECK(w == 3 && h == 2 && pixels.size() == 6);
+  for(size_t i=0;i<pixels.size() && i<6;i++)
+    CHECK(pixels[i] == colors[expected4[i]]);
+
+  BMPInfo info;
+  CHECK(LoadBMPInfo(path4.c_str(), &info) && info.channels == 4);
+
+  // 10x1, 1 bit black and white: 1011001110 --> 0xB3, 0x80
+  //
+  const std::string path1 = WriteFixture("1_bw", MakeBMP(10, 1, 1, BI_RGB, { 0x00000000, 0x00FFFFFF }, { 0xB3, 0x80, 0, 0 }));
+  const unsigned char expected1[10] = { 1,0,1,1,0,0,1,1,1,0 };
+
+  const std::vector<unsigned char> data = LoadBMPData(path1.c_str(), &info);
+  CHECK(info.width == 10 && info.height == 1 && info.channels == 1 && data.size() == 10);
+  for(size_t i=0;i<data.size() && i<10;i++)
+    CHECK(data[i] == (expected1[i] ? 255 : 0));
+
+  remove(path4.c_str());
+  remove(path1.c_str());
+}
+
+/**
+\brief 32 bit: standard masks (SIMD path, alpha is 0 without alpha mask) and 10 bit masks that are scaled to 8 bits
+*/
+static void TestBitfields()
+{
+  const int width = 9;
+  std::vector<unsigned char> row(width*4);
+  for(int x=0;x<width;x++)
+  {
+    const uint32_t c = PixelColor(x, 0);
+    const unsigned char bgra[4] = { (unsigned char)(c >> 16), (unsigned char)(c >> 8), (unsigned char)c, 0x7F };
+    memcpy(row.data() + x*4, bgra, 4);
+  }
+
+  const std::string pathStd = WriteFixture("32_std_masks", MakeBMP(width, 1, 32, BI_BITFIELDS, { 0x00FF0000, 0x0000FF00, 0x000000FF }, row));
+  int w = 0, h = 0;
+  std::vector<unsigned int> pixels = LoadBMP(pathStd.c_str(), &w, &h);
+  CHECK(w == width && h == 1 && pixels.size() == size_t(width));
+  for(int x=0;x<int(pixels.size());x++)
+    CHECK(pixels[x] == PixelColor(x, 0));
+
+  // 10 bit channels: r in bits 0..9, g in 10..19, b in 20..29
+  //
+  const uint32_t texels[3] = { 1023u | (0u << 10) | (512u << 20), 0u | (1023u << 10) | (1u << 20), 512u | (512u << 10) | (1023u << 20) };
+  std::vector<unsigned char> row10(sizeof(texels));
+  memcpy(row10.data(), texels, sizeof(texels));
+
+  const std::string path10 = WriteFixture("32_10bit", MakeBMP(3, 1, 32, BI_BITFIELDS, { 0x000003FF, 0x000FFC00, 0x3FF00000 }, row10));
+  pixels = LoadBMP(path10.c_str(), &w, &h);
+  CHECK(w == 3 && h == 1 && pixels.size() == 3);
+  if(pixels.size() == 3) // (v*255 + 511)/1023: 512 --> 128, 1 --> 0
+  {
+    CHECK(pixels[0] == PackRGBA(255, 0,   128, 0));
+    CHECK(pixels[1] == PackRGBA(0,   255, 0,   0));
+    CHECK(pixels[2] == PackRGBA(128, 128, 255, 0));
+  }
+
+  remove(pathStd.c_str());
+  remove(path10.c_str());
+}
+
+/**
+\brief RLE8 with encoded run, odd absolute run (padded), end of line, delta and end of bitmap; RLE4 with alternating runs
+*/
+static void TestRLE()
+{
+  // 6x3:  row 0 = 1 1 1 2 3 1;  delta(2, 1) from the start of row 1 skips the rest of row 1;  row 2 = 0 0 3 3 0 0
+  //
+  const std::vector<unsigned char> rle8 = { 3,1,  0,3, 2,3,1, 0,  0,0,  0,2, 2,1,  2,3,  0,1 };
+  const unsigned char expected8[18]     = { 1,1,1,2,3,1,  0,0,0,0,0,0,  0,0,3,3,0,0 };
+
+  const std::string path8 = WriteFixture("rle8", MakeBMP(6, 3, 8, BI_RLE8, GrayPalette(4), rle8));
+  BMPInfo info;
+  std::vector<unsigned char> data = LoadBMPData(path8.c_str(), &info);
+  CHECK(info.width == 6 && info.height == 3 && info.channels == 1 && data.size() == 18);
+  for(size_t i=0;i<data.size() && i<18;i++)
+    CHECK(data[i] == 10*expected8[i] + 5);
+
+  // 4x2:  row 0 = run of 4 alternating 1, 2;  row 1 = absolute 3 4 5, then run of single 7
+  //
+  const std::vector<unsigned char> rle4 = { 4,0x12,  0,0,  0,3, 0x34,0x50,  1,0x70,  0,1 };
+  const unsigned char expected4[8]      = { 1,2,1,2,  3,4,5,7 };
+
+  const std::string path4 = WriteFixture("rle4", MakeBMP(4, 2, 4, BI_RLE4, GrayPalette(8), rle4));
+  data = LoadBMPData(path4.c_str(), &info);
+  CHECK(info.width == 4 && info.height == 2 && info.channels == 1 && data.size() == 8);
+  for(size_t i=0;i<data.size() && i<8;i++)
+    CHECK(data[i] == 10*expected4[i] + 5);
+
+  remove(path8.c_str());
+  remove(path4.c_str());
+}
+
+/**
+\brief truncated files: uncompressed data must be complete, RLE stream is decoded up to the cut; unsupported and missing files fail
+*/
+static void TestTruncated()
+{
+  const int width = 4, height = 4;
+  std::vector<unsigned char> rows(12*height, 0x55);
+  std::vector<unsigned char> file = MakeBMP(width, height, 24, BI_RGB, {}, rows);
+  file.resize(file.size() - 1);
+
+  const std::string pathData = WriteFixture("truncated_data", file);
+  BMPInfo info;
+  int w = -1, h = -1;
+  CHECK(!LoadBMPInfo(pathData.c_str(), &info));
+  CHECK(LoadBMP(pathData.c_str(), &w, &h).empty() && w == 0 && h == 0);
+  CHECK(LoadBMPData(pathData.c_str(), &info).empty() && info.width == 0);
+
+  file.resize(40);
+  const std::string pathHeader = WriteFixture("truncated_header", file);
+  CHECK(!LoadBMPInfo(pathHeader.c_str(), &info));
+
+  // RLE8 stream is cut inside absolute run: row 0 gets only the encoded run, the rest stays index 0
+  //
+  const std::string pathRLE = WriteFixture("truncated_rle", MakeBMP(6, 2, 8, BI_RLE8, GrayPalette(4), { 3,1,  0,3, 2,3 }));
+  const std::vector<unsigned char> data = LoadBMPData(pathRLE.c_str(), &info);
+  const unsigned char expected[12] = { 1,1,1,0,0,0,  0,0,0,0,0,0 };
+  CHECK(info.width == 6 && info.height == 2 && data.size() == 12);
+  for(size_t i=0;i<data.size() && i<12;i++)
+    CHECK(data[i] == 10*expected[i] + 5);
+
+  // 16 bit is not supported; missing file
+  //
+  const std::string path16 = WriteFixture("16bit", MakeBMP(2, 1, 16, BI_RGB, {}, { 0,0,0,0 }));
+  CHECK(!LoadBMPInfo(path16.c_str(), &info));
+  CHECK(!LoadBMPInfo((std::filesystem::temp_directory_path() / "test_bitmap_no_such_file.bmp").string().c_str(), &info));
+
+  remove(pathData.c_str());
+  remove(pathHeader.c_str());
+  remove(pathRLE.c_str());
+  remove(path16.c_str());
+}
+
+int main(int argc, const char** argv)
+{
+  Test24Bit();
+  Test8BitGray();
+  TestPalette4And1Bit();
+  TestBitfields();
+  TestRLE();
+  TestTruncated();
+  return TestResult();
+}
@@ -0,0 +1,107 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// UpdateImageSubresources of both copy helpers with tiny staging memory, so that mips are split in many pieces and packs;
+// texel sizes which are not power of 2 (3 and 12 bytes) make aligned pieces larger than raw ones. Mip 0 is read back and compared.
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+#include "test_utils.h"
+#include "vk_copy.h"
+
+static bool IsTransferFormatSupported(const TestContext& a_ctx, VkFormat a_format)
+{
+  VkImageFormatProperties props;
+  return vkGetPhysicalDeviceImageFormatProperties(a_ctx.physicalDevice, a_format, VK_IMAGE_TYPE_2D, VK_IMAGE_TILING_OPTIMAL,
+                                                  VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, 0, &props) == VK_SUCCESS;
+}
+
+static VkImage CreateImage(const TestContext& a_ctx, VkFormat a_format, int a_width, int a_height, uint32_t a_mipLevels, VkDeviceMemory* a_pMemory)
+{
+  VkImageCreateInfo imgCreateInfo = {};
+  imgCreateInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imgCreateInfo.imageType     = VK_IMAGE_TYPE_2D;
+  imgCreateInfo.format        = a_format;
+  imgCreateInfo.extent        = VkExtent3D{ uint32_t(a_width), uint32_t(a_height), 1 };
+  imgCreateInfo.mipLevels     = a_mipLevels;
+  imgCreateInfo.arrayLayers   = 1;
+  imgCreateInfo.samples       = VK_SAMPLE_COUNT_1_BIT;
+  imgCreateInfo.tiling        = VK_IMAGE_TILING_OPTIMAL;
+  imgCreateInfo.usage         = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  imgCreateInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+  imgCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+  VkImage image = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateImage(a_ctx.device, &imgCreateInfo, nullptr, &image));
+
+  VkMemoryRequirements memReq;
+  vkGetImageMemoryRequirements(a_ctx.device, image, &memReq);
+  (*a_pMemory) = AllocateTestMemory(a_ctx, memReq, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  VK_CHECK_RESULT(vkBindImageMemory(a_ctx.device, image, (*a_pMemory), 0));
+  return image;
+}
+
+static void WaitUpload(vk_copy::SimpleCopyHelper&) { }  // waits for all its parts itself
+static void WaitUpload(vk_copy::AsyncCopyHelper& a_helper) { a_helper.WaitAll(); }
+
+template<typename CopyHelper>
+static void TestHelper(const TestContext& a_ctx, CopyHelper& a_helper, VkFormat a_format, uint32_t a_texelBytes)
+{
+  const int      width     = 37;
+  const int      height    = 29;
+  const uint32_t mipLevels = 3;
+
+  std::vector< std::vector<uint8_t> >        mips(mipLevels);
+  std::vector<vk_copy::ImageSubresourceData> subres(mipLevels);
+  for(uint32_t mip = 0; mip < mipLevels; mip++)
+  {
+    const uint32_t w = std::max(uint32_t(width)  >> mip, 1u);
+    const uint32_t h = std::max(uint32_t(height) >> mip, 1u);
+    mips[mip].resize(size_t(w)*size_t(h)*a_texelBytes);
+    for(size_t i=0;i<mips[mip].size();i++)
+      mips[mip][i] = uint8_t(i*13 + mip*7 + 1);
+    subres[mip] = vk_copy::ImageSubresourceData{mips[mip].data(), mip, 0, w, h};
+  }
+
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkImage        image  = CreateImage(a_ctx, a_format, width, height, mipLevels, &memory);
+
+  a_helper.UpdateImageSubresources(image, a_format, subres.data(), subres.size(), mipLevels, 1);
+  WaitUpload(a_helper);
+
+  CHECK(ReadbackTestImage(a_ctx, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, width, height, a_texelBytes) == mips[0]);
+
+  vkDestroyImage(a_ctx.device, image, NULL);
+  vkFreeMemory  (a_ctx.device, memory, NULL);
+}
+
+int main(int argc, const char** argv)
+{
+  TestContext ctx;
+  if(!ctx.Init())
+    return TEST_SKIPPED;
+
+  const VkFormat formats[3]    = {VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R8G8B8_UNORM, VK_FORMAT_R32G32B32_SFLOAT};
+  const uint32_t texelBytes[3] = {4, 3, 12};
+
+  for(int i=0;i<3;i++)
+  {
+    if(!IsTransferFormatSupported(ctx, formats[i]))
+    {
+      std::cout << "format " << int(formats[i]) << " is not supported, skip it" << std::endl;
+      continue;
+    }
+    std::cout << "format " << int(formats[i]) << std::endl;
+
+    // staging memory is smaller than a mip, but large enough for a row of it
+    //
+    vk_copy::SimpleCopyHelper simpleHelper(ctx.physicalDevice, ctx.device, ctx.queue, 1024, ctx.queueFID);
+    TestHelper(ctx, simpleHelper, formats[i], texelBytes[i]);
+
+    vk_copy::AsyncCopyHelper asyncHelper(ctx.physicalDevice, ctx.device, ctx.queue, ctx.queueFID, 1024);
+    TestHelper(ctx, asyncHelper, formats[i], texelBytes[i]);
+  }
+
+  return TestResult();
+}
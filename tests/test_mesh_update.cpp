@@ -0,0 +1,131 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Dynamic vertex updates of double buffered mesh (CompactMesh_T3V4x2F::UpdateVerticesRange/SwapVertexCopies):
+// front copy must not change until the swap, and after each swap it must be the same as full upload of the current mesh.
+// Both staging copy and direct write paths are checked.
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <cstring>
+#include <memory>
+
+#include "test_utils.h"
+#include "vk_geom.h"
+#include "vk_copy.h"
+
+/**
+\brief Read both vertex streams of the copy that is used for drawing now
+*/
+static std::vector<char> ReadFrontCopy(const TestContext& a_ctx, vk_geom::IMesh* a_pMesh)
+{
+  const size_t streamSize = a_pMesh->VerticesNum()*sizeof(float)*4;
+
+  std::vector<char> res;
+  for(VkBuffer buffer : a_pMesh->VertexBuffers())
+  {
+    const std::vector<char> stream = ReadbackTestBuffer(a_ctx, buffer, 0, streamSize);
+    res.insert(res.end(), stream.begin(), stream.end());
+  }
+  return res;
+}
+
+static void RaiseVertices(cmesh::SimpleMesh& a_mesh, int a_first, int a_num, float a_height)
+{
+  for(int i = a_first; i < a_first + a_num; i++)
+    a_mesh.vPos4f[i*4+2] += a_height;
+}
+
+static void RunTest(const TestContext& a_ctx, bool a_directWrite)
+{
+  std::cout << (a_directWrite ? "direct write path" : "staging copy path") << std::endl;
+
+  auto mesh = cmesh::CreateQuad(8, 8, 1.0f);
+
+  vk_geom::CompactMesh_T3V4x2F dynMesh(true);
+  vk_geom::CompactMesh_T3V4x2F refMesh;
+
+  auto memReq    = dynMesh.CreateBuffers(a_ctx.device, int(mesh.VerticesNum()), int(mesh.IndicesNum()));
+  auto memReqRef = refMesh.CreateBuffers(a_ctx.device, int(mesh.VerticesNum()), int(mesh.IndicesNum()));
+
+  vk_copy::CopyEngine copyEngine(a_ctx.physicalDevice, a_ctx.device, a_ctx.queue, a_ctx.queueFID, 1024*1024);
+  if(a_directWrite && copyEngine.m_helper.UploadPath(memReq.memoryTypeBits) != vk_copy::UPLOAD_PATH_DIRECT)
+  {
+    std::cout << "no direct write memory, skip this path" << std::endl;
+    return;
+  }
+
+  VkDeviceMemory memory    = copyEngine.AllocateBufferMemory(memReq, a_directWrite);
+  VkDeviceMemory memoryRef = AllocateTestMemory(a_ctx, memReqRef, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  CHECK((copyEngine.MappedMemory(memory) != nullptr) == a_directWrite);
+
+  dynMesh.BindBuffers(memory,    0);
+  refMesh.BindBuffers(memoryRef, 0);
+
+  dynMesh.UpdateBuffers(mesh, &copyEngine);
+  copyEngine.WaitAll();
+
+  const auto buffers0 = dynMesh.VertexBuffers();
+  const auto initial  = ReadFrontCopy(a_ctx, &dynMesh);
+
+  // (1) update is recorded and even completed, but front copy is not touched until swap
+  //
+  RaiseVertices(mesh, 10, 10, 1.0f);
+  dynMesh.UpdateVerticesRange(mesh, 10, 10, &copyEngine);
+  CHECK(dynMesh.VertexBuffers() == buffers0);
+
+  const uint64_t ticket = copyEngine.Submit();
+  copyEngine.Wait(ticket);
+  CHECK(dynMesh.VertexBuffers() == buffers0);
+  CHECK(ReadFrontCopy(a_ctx, &dynMesh) == initial);
+
+  // (2) after swap front copy is the same as full upload of current mesh
+  //
+  dynMesh.SwapVertexCopies();
+  CHECK(dynMesh.VertexBuffers() != buffers0);
+
+  refMesh.UpdateBuffers(mesh, &copyEngine);
+  copyEngine.WaitAll();
+  CHECK(ReadFrontCopy(a_ctx, &dynMesh) == ReadFrontCopy(a_ctx, &refMesh));
+
+  // (3) second update goes to the first copy again; it must get the range of previous update too
+  //
+  RaiseVertices(mesh, 50, 20, 2.0f);
+  dynMesh.UpdateVerticesRange(mesh, 50, 20, &copyEngine);
+  copyEngine.WaitAll();
+  dynMesh.SwapVertexCopies();
+  CHECK(dynMesh.VertexBuffers() == buffers0);
+
+  refMesh.UpdateBuffers(mesh, &copyEngine);
+  copyEngine.WaitAll();
+  CHECK(ReadFrontCopy(a_ctx, &dynMesh) == ReadFrontCopy(a_ctx, &refMesh));
+
+  // (4) several updates before swap are merged; swap without updates does nothing
+  //
+  RaiseVertices(mesh, 0,  5, 0.5f);
+  dynMesh.UpdateVerticesRange(mesh, 0,  5, &copyEngine);
+  RaiseVertices(mesh, 75, 6, 0.5f);
+  dynMesh.UpdateVerticesRange(mesh, 75, 6, &copyEngine);
+  copyEngine.WaitAll();
+  dynMesh.SwapVertexCopies();
+  dynMesh.SwapVertexCopies();
+  CHECK(dynMesh.VertexBuffers() != buffers0);
+
+  refMesh.UpdateBuffers(mesh, &copyEngine);
+  copyEngine.WaitAll();
+  CHECK(ReadFrontCopy(a_ctx, &dynMesh) == ReadFrontCopy(a_ctx, &refMesh));
+
+  vkDeviceWaitIdle(a_ctx.device);
+  copyEngine.FreeBufferMemory(memory);
+  vkFreeMemory(a_ctx.device, memoryRef, NULL);
+}
+
+int main(int argc, const char** argv)
+{
+  TestContext ctx;
+  if(!ctx.Init())
+    return TEST_SKIPPED;
+
+  RunTest(ctx, false);
+  RunTest(ctx, true);
+
+  return TestResult();
+}
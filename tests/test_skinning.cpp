@@ -0,0 +1,179 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// GPU skinning (MeshDeformer with shaders/skinning.spv) against CPU skinned reference; then RestPoseCmd must give back
+// exactly the rest pose. Destination starts from non zero vertex, same as bunny in the merged scene mesh.
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <cstring>
+#include <cmath>
+
+#include "test_utils.h"
+#include "vk_geom.h"
+#include "vk_copy.h"
+#include "LiteMath.h"
+
+static LiteMath::float3 DecodeNormal(uint32_t a_data) // same as in skinning.comp
+{
+  const uint32_t encX = (a_data & 0x0000FFFF);
+  const uint32_t encY = ((a_data & 0xFFFF0000) >> 16);
+  const float    sign = (encX & 0x0001) != 0 ? -1.0f : 1.0f;
+
+  const int usX = int(encX & 0x0000fffe);
+  const int usY = int(encY & 0x0000ffff);
+  const int sX  = (usX <= 32767) ? usX : usX - 65536;
+  const int sY  = (usY <= 32767) ? usY : usY - 65536;
+
+  const float x = sX*(1.0f / 32767.0f);
+  const float y = sY*(1.0f / 32767.0f);
+  const float z = sign*sqrtf(std::max(1.0f - x*x - y*y, 0.0f));
+  return LiteMath::float3(x, y, z);
+}
+
+static float MaxDiff(LiteMath::float3 a, LiteMath::float3 b)
+{
+  return std::max(fabsf(a.x - b.x), std::max(fabsf(a.y - b.y), fabsf(a.z - b.z)));
+}
+
+int main(int argc, const char** argv)
+{
+  TestContext ctx;
+  if(!ctx.Init())
+    return TEST_SKIPPED;
+
+  // tilted quad with more vertices than a work group, so that normals are not trivial and several groups run
+  //
+  auto mesh = cmesh::CreateQuad(12, 12, 2.0f);
+  const int vertsNum = int(mesh.VerticesNum());
+  for(int i=0;i<vertsNum;i++)
+  {
+    const float x = mesh.vPos4f[i*4+0];
+    LiteMath::float3 n = LiteMath::normalize(LiteMath::float3(-0.5f*x, 0.25f, 1.0f));
+    mesh.vPos4f [i*4+2] = 0.25f*x*x;
+    mesh.vNorm4f[i*4+0] = n.x;
+    mesh.vNorm4f[i*4+1] = n.y;
+    mesh.vNorm4f[i*4+2] = n.z;
+  }
+
+  std::vector<vk_geom::SkinVertex> skin(vertsNum);
+  for(int i=0;i<vertsNum;i++)
+  {
+    const float w = float(i % 17)/16.0f;
+    skin[i] = vk_geom::SkinVertex{ {1.0f - w, 0.5f*w, 0.5f*w, 0.0f}, {0, 1, 2, 0} };
+  }
+
+  LiteMath::float4x4 bones[3];
+  bones[0] = LiteMath::float4x4();
+  bones[1] = LiteMath::translate4x4(LiteMath::float3(0.5f, -0.25f, 1.0f))*LiteMath::rotate4x4Z(0.7f);
+  bones[2] = LiteMath::rotate4x4X(-0.4f)*LiteMath::translate4x4(LiteMath::float3(0.0f, 1.0f, 0.0f));
+
+  const uint32_t dstFirstVert = 7;
+
+  // deformer and destination buffer (vertex buffer of merged mesh in the app)
+  //
+  vk_geom::MeshDeformer deformer;
+  auto memReq = deformer.CreateBuffers(ctx.device, vertsNum, 3);
+  VkDeviceMemory deformerMem = AllocateTestMemory(ctx, memReq, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  deformer.BindBuffers(deformerMem, 0);
+  deformer.CreatePipeline("shaders/skinning.spv");
+
+  const size_t dstSize = (dstFirstVert + vertsNum)*sizeof(float)*4;
+
+  VkBuffer dstBuffer = VK_NULL_HANDLE;
+  VkBufferCreateInfo bufferCreateInfo = {};
+  bufferCreateInfo.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferCreateInfo.size        = dstSize;
+  bufferCreateInfo.usage       = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  VK_CHECK_RESULT(vkCreateBuffer(ctx.device, &bufferCreateInfo, NULL, &dstBuffer));
+
+  VkMemoryRequirements dstMemReq;
+  vkGetBufferMemoryRequirements(ctx.device, dstBuffer, &dstMemReq);
+  VkDeviceMemory dstMem = AllocateTestMemory(ctx, dstMemReq, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  VK_CHECK_RESULT(vkBindBufferMemory(ctx.device, dstBuffer, dstMem, 0));
+
+  // vertices before dstFirstVert must not be touched
+  //
+  std::vector<float> guard(dstFirstVert*4, 123.0f);
+
+  vk_copy::CopyEngine copyEngine(ctx.physicalDevice, ctx.device, ctx.queue, ctx.queueFID, 1024*1024);
+  deformer.UpdateBuffers(mesh, skin.data(), &copyEngine);
+  copyEngine.UpdateBuffer(dstBuffer, 0, guard.data(), guard.size()*sizeof(float));
+  copyEngine.WaitAll();
+
+  TestCommandBuffer  cmd(ctx);
+  std::vector<float> result(dstSize/sizeof(float));
+
+  // (1) deformed vertices
+  //
+  {
+    VkCommandBuffer cmdBuff = cmd.Begin();
+    deformer.UpdateBonesCmd(cmdBuff, (const float*)bones, 3);
+    deformer.DeformCmd(cmdBuff, dstBuffer, dstFirstVert);
+    cmd.Execute();
+
+    const std::vector<char> bytes = ReadbackTestBuffer(ctx, dstBuffer, 0, dstSize);
+    memcpy(result.data(), bytes.data(), dstSize);
+  }
+
+  CHECK(memcmp(result.data(), guard.data(), guard.size()*sizeof(float)) == 0);
+
+  float maxPosErr = 0.0f, maxNormErr = 0.0f;
+  for(int i=0;i<vertsNum;i++)
+  {
+    const LiteMath::float4 pos  (mesh.vPos4f [i*4+0], mesh.vPos4f [i*4+1], mesh.vPos4f [i*4+2], 1.0f);
+    const LiteMath::float4 norm (mesh.vNorm4f[i*4+0], mesh.vNorm4f[i*4+1], mesh.vNorm4f[i*4+2], 0.0f);
+
+    LiteMath::float3 refPos(0.0f, 0.0f, 0.0f), refNorm(0.0f, 0.0f, 0.0f);
+    for(int j=0;j<4;j++)
+    {
+      const auto& bone = bones[skin[i].bones[j]];
+      refPos  += skin[i].weights[j]*LiteMath::to_float3(bone*pos);
+      refNorm += skin[i].weights[j]*LiteMath::to_float3(bone*norm);
+    }
+    refNorm = LiteMath::normalize(refNorm);
+
+    const float* gpu = result.data() + (dstFirstVert + i)*4;
+    uint32_t gpuNormBits;
+    memcpy(&gpuNormBits, gpu + 3, sizeof(uint32_t));
+
+    maxPosErr  = std::max(maxPosErr,  MaxDiff(refPos, LiteMath::float3(gpu[0], gpu[1], gpu[2])));
+    maxNormErr = std::max(maxNormErr, MaxDiff(refNorm, DecodeNormal(gpuNormBits)));
+  }
+
+  std::cout << "max position error = " << maxPosErr << ", max normal error = " << maxNormErr << std::endl;
+  CHECK(maxPosErr  < 1e-5f);
+  CHECK(maxNormErr < 2e-3f); // 16 bit normal encoding
+
+  // (2) rest pose is restored exactly
+  //
+  {
+    VkCommandBuffer cmdBuff = cmd.Begin();
+    deformer.RestPoseCmd(cmdBuff, dstBuffer, dstFirstVert);
+    cmd.Execute();
+
+    const std::vector<char> bytes = ReadbackTestBuffer(ctx, dstBuffer, 0, dstSize);
+    memcpy(result.data(), bytes.data(), dstSize);
+  }
+
+  CHECK(memcmp(result.data(), guard.data(), guard.size()*sizeof(float)) == 0);
+
+  float maxRestErr = 0.0f, maxRestNormErr = 0.0f;
+  for(int i=0;i<vertsNum;i++)
+  {
+    const float* gpu = result.data() + (dstFirstVert + i)*4;
+    uint32_t gpuNormBits;
+    memcpy(&gpuNormBits, gpu + 3, sizeof(uint32_t));
+
+    maxRestErr     = std::max(maxRestErr,     MaxDiff(LiteMath::float3(mesh.vPos4f[i*4+0],  mesh.vPos4f[i*4+1],  mesh.vPos4f[i*4+2]),  LiteMath::float3(gpu[0], gpu[1], gpu[2])));
+    maxRestNormErr = std::max(maxRestNormErr, MaxDiff(LiteMath::float3(mesh.vNorm4f[i*4+0], mesh.vNorm4f[i*4+1], mesh.vNorm4f[i*4+2]), DecodeNormal(gpuNormBits)));
+  }
+
+  CHECK(maxRestErr     == 0.0f);
+  CHECK(maxRestNormErr <  2e-3f);
+
+  vkDestroyBuffer(ctx.device, dstBuffer, NULL);
+  vkFreeMemory   (ctx.device, dstMem,      NULL);
+  vkFreeMemory   (ctx.device, deformerMem, NULL);
+
+  return TestResult();
+}
@@ -0,0 +1,182 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Texture container (ctexture_file.h): save/open round trip, then TextureFile::Open on broken copies of a valid file; each of them
+// must be rejected, so that Data() never points outside of the file.
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+
+#include "test_utils.h"
+#include "ctexture_file.h"
+
+static std::string TempPath(const char* a_name)
+{
+  return (std::filesystem::temp_directory_path() / (std::string("test_texture_file_") + a_name + ".ctex")).string();
+}
+
+static std::vector<unsigned char> ReadBytes(const std::string& a_path)
+{
+  std::vector<unsigned char> res;
+  FILE* f = fopen(a_path.c_str(), "rb");
+  if(f == NULL)
+    return res;
+  fseek(f, 0, SEEK_END);
+  res.resize(size_t(ftell(f)));
+  fseek(f, 0, SEEK_SET);
+  if(fread(res.data(), 1, res.size(), f) != res.size())
+    res.clear();
+  fclose(f);
+  return res;
+}
+
+static void WriteBytes(const std::string& a_path, const std::vector<unsigned char>& a_bytes)
+{
+  FILE* f = fopen(a_path.c_str(), "wb");
+  if(f == NULL)
+    return;
+  fwrite(a_bytes.data(), 1, a_bytes.size(), f);
+  fclose(f);
+}
+
+template<typename T>
+static std::vector<unsigned char> Patched(std::vector<unsigned char> a_bytes, size_t a_offset, T a_value)
+{
+  memcpy(a_bytes.data() + a_offset, &a_value, sizeof(T));
+  return a_bytes;
+}
+
+/**
+\brief Open must fail and leave the object empty
+*/
+static void CheckRejected(const char* a_name, const std::vector<unsigned char>& a_bytes)
+{
+  const std::string path = TempPath(a_name);
+  WriteBytes(path, a_bytes);
+
+  ctexture::TextureFile file;
+  const bool opened = file.Open(path.c_str());
+  if(opened)
+    std::cout << "broken file '" << a_name << "' is opened" << std::endl;
+  CHECK(!opened);
+  CHECK(file.Desc().width == 0 && file.Desc().levels == 1);
+
+  remove(path.c_str());
+}
+
+int main(int argc, const char** argv)
+{
+  // 3 levels x 2 layers of 8x4 texture, 4 bytes per texel; level sizes are not multiple of the alignment
+  //
+  ctexture::TextureFileDesc desc;
+  desc.vkFormat = 37; // VK_FORMAT_R8G8B8A8_UNORM
+  desc.width    = 8;
+  desc.height   = 4;
+  desc.levels   = 3;
+  desc.layers   = 2;
+  desc.flags    = ctexture::TEXTURE_FILE_SRGB_DATA;
+
+  std::vector< std::vector<unsigned char> > subres(6);
+  std::vector<const void*>                  pointers(6);
+  std::vector<size_t>                       sizes(6);
+  for(int level=0;level<3;level++)
+  {
+    for(int layer=0;layer<2;layer++)
+    {
+      const int i = level*2 + layer;
+      subres[i].resize(size_t(std::max(8 >> level, 1))*size_t(std::max(4 >> level, 1))*4);
+      for(size_t k=0;k<subres[i].size();k++)
+        subres[i][k] = (unsigned char)(k*7 + i*31);
+      pointers[i] = subres[i].data();
+      sizes[i]    = subres[i].size();
+    }
+  }
+
+  const std::string path = TempPath("valid");
+  CHECK(ctexture::SaveTextureFile(path.c_str(), desc, pointers.data(), sizes.data()));
+
+  ctexture::TextureFileDesc badDesc = desc;
+  badDesc.width = 0;
+  CHECK(!ctexture::SaveTextureFile(TempPath("bad_desc").c_str(), badDesc, pointers.data(), sizes.data()));
+
+  // (1) round trip; object can be opened again
+  //
+  {
+    ctexture::TextureFile file;
+    CHECK(file.Open(path.c_str()));
+    CHECK(file.Open(path.c_str()));
+
+    const auto& d = file.Desc();
+    CHECK(d.vkFormat == desc.vkFormat && d.width == desc.width && d.height == desc.height && d.levels == desc.levels && d.layers == desc.layers && d.flags == desc.flags);
+
+    const unsigned char* base = (const unsigned char*)file.Data(0, 0);
+    for(int level=0;level<desc.levels;level++)
+    {
+      for(int layer=0;layer<desc.layers;layer++)
+      {
+        const int i = level*desc.layers + layer;
+        CHECK(file.Size(level, layer) == sizes[i]);
+        CHECK(memcmp(file.Data(level, layer), subres[i].data(), sizes[i]) == 0);
+        CHECK(size_t((const unsigned char*)file.Data(level, layer) - base) % ctexture::TEXTURE_FILE_ALIGNMENT == 0);
+      }
+    }
+
+    const std::vector<const void*> layer1 = file.LevelPointers(1);
+    CHECK(layer1.size() == 3 && layer1[2] == file.Data(2, 1));
+
+    file.Close();
+    CHECK(file.Desc().width == 0);
+  }
+
+  // (2) broken files
+  //
+  const std::vector<unsigned char> valid = ReadBytes(path);
+  CHECK(valid.size() > sizeof(ctexture::TextureFileHeader));
+
+  ctexture::TextureFileHeader header;
+  memcpy(&header, valid.data(), sizeof(header));
+  const size_t tableOffset = size_t(header.subresOffset);
+
+  std::vector<unsigned char> truncated(valid.begin(), valid.end() - 1), extended(valid);
+  extended.push_back(0);
+
+  CheckRejected("empty",            std::vector<unsigned char>());
+  CheckRejected("short_header",     std::vector<unsigned char>(valid.begin(), valid.begin() + sizeof(header) - 1));
+  CheckRejected("truncated",        truncated);
+  CheckRejected("extended",         extended);
+  CheckRejected("magic",            Patched(valid, offsetof(ctexture::TextureFileHeader, magic) + 1, 'X'));
+  CheckRejected("version",          Patched(valid, offsetof(ctexture::TextureFileHeader, version), uint32_t(ctexture::TEXTURE_FILE_VERSION + 1)));
+  CheckRejected("zero_width",       Patched(valid, offsetof(ctexture::TextureFileHeader, width),   uint32_t(0)));
+  CheckRejected("zero_levels",      Patched(valid, offsetof(ctexture::TextureFileHeader, levels),  uint32_t(0)));
+  CheckRejected("many_levels",      Patched(valid, offsetof(ctexture::TextureFileHeader, levels),  uint32_t(33)));
+  CheckRejected("zero_layers",      Patched(valid, offsetof(ctexture::TextureFileHeader, layers),  uint32_t(0)));
+  CheckRejected("table_too_large",  Patched(valid, offsetof(ctexture::TextureFileHeader, layers),  uint32_t(65536)));
+  CheckRejected("table_outside",    Patched(valid, offsetof(ctexture::TextureFileHeader, subresOffset), uint64_t(valid.size() + 16)));
+  CheckRejected("table_at_end",     Patched(valid, offsetof(ctexture::TextureFileHeader, subresOffset), uint64_t(valid.size() - 8)));
+
+  const size_t lastEntry = tableOffset + 5*sizeof(ctexture::TextureFileSubresource);
+  CheckRejected("subres_outside",   Patched(valid, lastEntry + offsetof(ctexture::TextureFileSubresource, offset), uint64_t(valid.size() + 1)));
+  CheckRejected("subres_too_large", Patched(valid, lastEntry + offsetof(ctexture::TextureFileSubresource, size),   uint64_t(valid.size())));
+  CheckRejected("subres_overflow",  Patched(valid, lastEntry + offsetof(ctexture::TextureFileSubresource, size),   uint64_t(-1)));
+
+  {
+    ctexture::TextureFile file;
+    CHECK(!file.Open(TempPath("no_such_file").c_str()));
+
+    // failed Open closes previous file
+    //
+    const std::string pathBroken = TempPath("broken");
+    WriteBytes(pathBroken, truncated);
+    CHECK(file.Open(path.c_str()));
+    CHECK(!file.Open(pathBroken.c_str()));
+    CHECK(file.Desc().width == 0);
+    remove(pathBroken.c_str());
+  }
+
+  remove(path.c_str());
+  return TestResult();
+}
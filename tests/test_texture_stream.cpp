@@ -0,0 +1,102 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// TextureStreamer residency: budget holds the mip tails and only one full chain, so when requests move from texture A to 
+// texture B, A must be evicted back to its tail and B must get its finest mip; memory in use never exceeds the budget.
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "test_utils.h"
+#include "vk_texture_stream.h"
+
+static const int TEX_SIZE   = 256;
+static const int TEX_LEVELS = 9;  // full chain of 256x256
+static const int MAX_FRAMES = 64;
+
+/**
+\brief One frame of the application: requests, UpdateCmd and its barriers are executed, then uploads are waited for (slow frames)
+*/
+static void RunFrame(TestCommandBuffer& a_cmd, vk_copy::AsyncCopyHelper& a_copy, vk_texture::TextureStreamer& a_streamer, int a_texId)
+{
+  VkCommandBuffer cmdBuff = a_cmd.Begin();
+  a_streamer.RequestMip(a_texId, 0);
+  a_streamer.UpdateCmd(cmdBuff);
+  a_cmd.Execute(a_copy.TakeWaitSemaphores());
+  a_copy.WaitAll();
+}
+
+int main(int argc, const char** argv)
+{
+  TestContext ctx;
+  if(!ctx.Init())
+    return TEST_SKIPPED;
+
+  // two RGBA8 textures with full mip chains; full chain is ~340 KB, tail (64x64 and smaller) is ~21 KB
+  //
+  std::vector< std::vector<uint32_t> > texels(2*TEX_LEVELS);
+  vk_texture::StreamingSource src[2];
+  for(int t=0;t<2;t++)
+  {
+    src[t].format = VK_FORMAT_R8G8B8A8_UNORM;
+    src[t].width  = TEX_SIZE;
+    src[t].height = TEX_SIZE;
+    src[t].levels = TEX_LEVELS;
+    for(int level=0;level<TEX_LEVELS;level++)
+    {
+      const int size = std::max(TEX_SIZE >> level, 1);
+      std::vector<uint32_t>& mip = texels[t*TEX_LEVELS + level];
+      mip.assign(size_t(size)*size_t(size), 0xFF000000u | uint32_t(t*0x7F + level));
+      src[t].subres.push_back(mip.data());
+      src[t].sizes.push_back(mip.size()*sizeof(uint32_t));
+    }
+  }
+
+  vk_texture::StreamingParams params;
+  params.budget         = 640*1024;
+  params.mipTailSize    = 64;
+  params.framesInFlight = 2;
+
+  vk_copy::AsyncCopyHelper copy(ctx.physicalDevice, ctx.device, ctx.queue, ctx.queueFID, 1024*1024);
+  TestCommandBuffer        cmd(ctx);
+  {
+    vk_texture::TextureStreamer streamer(ctx.device, ctx.physicalDevice, &copy, nullptr, params);
+    const int texA = streamer.AddTexture(src[0]);
+    const int texB = streamer.AddTexture(src[1]);
+    const int tailMip = streamer.ResidentMip(texA);
+    CHECK(tailMip == 2 && streamer.ResidentMip(texB) == tailMip);
+
+    VkCommandBuffer cmdBuff = cmd.Begin(); // tails are uploaded, same as at application start
+    copy.AcquireOwnershipCmd(cmdBuff);
+    streamer.AcquireTailsCmd(cmdBuff);
+    cmd.Execute(copy.TakeWaitSemaphores());
+
+    // (1) A is requested until it is fully resident
+    //
+    for(int frame = 0; frame < MAX_FRAMES && streamer.ResidentMip(texA) != 0; frame++)
+    {
+      RunFrame(cmd, copy, streamer, texA);
+      CHECK(streamer.UsedMemory() <= params.budget);
+    }
+    CHECK(streamer.ResidentMip(texA) == 0);
+    CHECK(streamer.ResidentMip(texB) == tailMip);
+
+    // (2) only B is requested; both chains don't fit, so A (least recently used) goes back to the tail
+    //
+    bool evicted = false;
+    for(int frame = 0; frame < MAX_FRAMES && streamer.ResidentMip(texB) != 0; frame++)
+    {
+      RunFrame(cmd, copy, streamer, texB);
+      CHECK(streamer.UsedMemory() <= params.budget);
+      evicted = evicted || (streamer.ResidentMip(texA) == tailMip);
+    }
+    CHECK(evicted);
+    CHECK(streamer.ResidentMip(texA) == tailMip);
+    CHECK(streamer.ResidentMip(texB) == 0);
+    std::cout << "used memory = " << streamer.UsedMemory() << " of " << params.budget << std::endl;
+
+    vkDeviceWaitIdle(ctx.device);
+  }
+
+  return TestResult();
+}
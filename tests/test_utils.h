@@ -0,0 +1,236 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Minimal helpers for tests: CHECK macro and headless Vulkan context. Each test is a separate executable that returns 0 on
+// success, 1 on failure and TEST_SKIPPED if there is no Vulkan device (ctest treats it as skipped, see CMakeLists.txt).
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef VULKAN_TEST_UTILS_H
+#define VULKAN_TEST_UTILS_H
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+#include <cstdint>
+#include <iostream>
+#include <exception>
+
+#include "vk_utils.h"
+
+#define TEST_SKIPPED 77
+
+static int g_testFails = 0;
+
+#define CHECK(expr) do { if(!(expr)) { std::cout << __FILE__ << "(" << __LINE__ << "): CHECK(" << #expr << ") failed" << std::endl; g_testFails++; } } while(0)
+
+static inline int TestResult()
+{
+  std::cout << (g_testFails == 0 ? "PASSED" : "FAILED") << std::endl;
+  return (g_testFails == 0) ? 0 : 1;
+}
+
+/**
+\brief Headless Vulkan context: no surface and no swapchain extensions, single queue with compute (and usually graphics and transfer) capability.
+*/
+struct TestContext
+{
+  VkInstance       instance       = VK_NULL_HANDLE;
+  VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+  VkDevice         device         = VK_NULL_HANDLE;
+  VkQueue          queue          = VK_NULL_HANDLE;
+  uint32_t         queueFID       = 0;
+
+  /**
+  \brief returns false if there is no Vulkan device; then test should return TEST_SKIPPED
+  */
+  bool Init()
+  {
+    // instance is created here instead of vk_utils::CreateInstance, which asserts when there is no Vulkan driver at all
+    //
+    VkApplicationInfo appInfo = {};
+    appInfo.sType      = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    appInfo.apiVersion = VK_API_VERSION_1_0;
+
+    VkInstanceCreateInfo createInfo = {};
+    createInfo.sType            = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    createInfo.pApplicationInfo = &appInfo;
+    if(vkCreateInstance(&createInfo, NULL, &instance) != VK_SUCCESS)
+    {
+      std::cout << "no Vulkan driver, test is skipped" << std::endl;
+      instance = VK_NULL_HANDLE;
+      return false;
+    }
+
+    try
+    {
+      std::vector<const char*> enabledLayers;
+      physicalDevice = vk_utils::FindPhysicalDevice(instance, false, 0);
+      queueFID       = vk_utils::GetQueueFamilyIndex(physicalDevice, VK_QUEUE_COMPUTE_BIT);
+      device         = vk_utils::CreateLogicalDevice(queueFID, physicalDevice, enabledLayers);
+      vkGetDeviceQueue(device, queueFID, 0, &queue);
+    }
+    catch(std::exception& e)
+    {
+      std::cout << "no Vulkan device, test is skipped: " << e.what() << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  ~TestContext()
+  {
+    if(device != VK_NULL_HANDLE)
+      vkDestroyDevice(device, NULL);
+    if(instance != VK_NULL_HANDLE)
+      vkDestroyInstance(instance, NULL);
+  }
+};
+
+/**
+\brief Allocate memory of given properties for a_memReq; returns VK_NULL_HANDLE if device has no such memory type
+*/
+static inline VkDeviceMemory AllocateTestMemory(const TestContext& a_ctx, const VkMemoryRequirements& a_memReq, VkMemoryPropertyFlags a_props)
+{
+  VkMemoryAllocateInfo allocateInfo = {};
+  allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocateInfo.allocationSize  = a_memReq.size;
+  allocateInfo.memoryTypeIndex = vk_utils::FindMemoryType(a_memReq.memoryTypeBits, a_props, a_ctx.physicalDevice);
+
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  if(allocateInfo.memoryTypeIndex == uint32_t(-1))
+    return memory;
+  VK_CHECK_RESULT(vkAllocateMemory(a_ctx.device, &allocateInfo, NULL, &memory));
+  return memory;
+}
+
+/**
+\brief Command pool with a single command buffer; Execute() ends the buffer, submits it to the test queue and waits
+*/
+struct TestCommandBuffer
+{
+  TestCommandBuffer(const TestContext& a_ctx) : m_ctx(a_ctx)
+  {
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = a_ctx.queueFID;
+    VK_CHECK_RESULT(vkCreateCommandPool(a_ctx.device, &poolInfo, NULL, &m_pool));
+
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool        = m_pool;
+    allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    VK_CHECK_RESULT(vkAllocateCommandBuffers(a_ctx.device, &allocInfo, &m_cmdBuff));
+  }
+
+  ~TestCommandBuffer() { vkDestroyCommandPool(m_ctx.device, m_pool, NULL); }
+
+  VkCommandBuffer Begin()
+  {
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkResetCommandBuffer(m_cmdBuff, 0);
+    vkBeginCommandBuffer(m_cmdBuff, &beginInfo);
+    return m_cmdBuff;
+  }
+
+  void Execute(const std::vector<VkSemaphore>& a_waitSemaphores = {})
+  {
+    vkEndCommandBuffer(m_cmdBuff);
+    vk_utils::ExecuteCommandBufferNow(m_cmdBuff, m_ctx.queue, m_ctx.device, a_waitSemaphores);
+  }
+
+private:
+  const TestContext& m_ctx;
+  VkCommandPool      m_pool    = VK_NULL_HANDLE;
+  VkCommandBuffer    m_cmdBuff = VK_NULL_HANDLE;
+
+  TestCommandBuffer(const TestCommandBuffer& rhs) = delete;
+  TestCommandBuffer& operator=(const TestCommandBuffer& rhs) = delete;
+};
+
+/**
+\brief Host visible buffer of a_size bytes for readback; the whole memory is mapped to (*a_pMapped)
+*/
+static inline VkBuffer CreateTestReadbackBuffer(const TestContext& a_ctx, size_t a_size, VkDeviceMemory* a_pMemory, void** a_pMapped)
+{
+  VkBufferCreateInfo bufferCreateInfo = {};
+  bufferCreateInfo.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferCreateInfo.size        = a_size;
+  bufferCreateInfo.usage       = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  VkBuffer buffer = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateBuffer(a_ctx.device, &bufferCreateInfo, NULL, &buffer));
+
+  VkMemoryRequirements memReq;
+  vkGetBufferMemoryRequirements(a_ctx.device, buffer, &memReq);
+  (*a_pMemory) = AllocateTestMemory(a_ctx, memReq, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  VK_CHECK_RESULT(vkBindBufferMemory(a_ctx.device, buffer, (*a_pMemory), 0));
+  VK_CHECK_RESULT(vkMapMemory(a_ctx.device, (*a_pMemory), 0, VK_WHOLE_SIZE, 0, a_pMapped));
+  return buffer;
+}
+
+/**
+\brief Copy [a_offset, a_offset + a_size) of a_src to host and wait; writes to a_src must be complete (i.e. waited for)
+*/
+static inline std::vector<char> ReadbackTestBuffer(const TestContext& a_ctx, VkBuffer a_src, size_t a_offset, size_t a_size)
+{
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  void*          mapped = nullptr;
+  VkBuffer       buffer = CreateTestReadbackBuffer(a_ctx, a_size, &memory, &mapped);
+
+  TestCommandBuffer cmd(a_ctx);
+  VkBufferCopy region = {};
+  region.srcOffset    = a_offset;
+  region.dstOffset    = 0;
+  region.size         = a_size;
+  vkCmdCopyBuffer(cmd.Begin(), a_src, buffer, 1, &region);
+  cmd.Execute();
+
+  std::vector<char> res((const char*)mapped, (const char*)mapped + a_size);
+  vkDestroyBuffer(a_ctx.device, buffer, NULL);
+  vkFreeMemory   (a_ctx.device, memory, NULL);
+  return res;
+}
+
+/**
+\brief Copy mip 0 of layer 0 to host (tightly packed) and wait; image is left in transfer src layout
+\param a_layout     - input current layout of the image; writes to it must be complete
+\param a_texelBytes - input texel size of uncompressed image format
+*/
+static inline std::vector<uint8_t> ReadbackTestImage(const TestContext& a_ctx, VkImage a_image, VkImageLayout a_layout, uint32_t a_width, uint32_t a_height, uint32_t a_texelBytes)
+{
+  const size_t   size   = size_t(a_width)*size_t(a_height)*a_texelBytes;
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  void*          mapped = nullptr;
+  VkBuffer       buffer = CreateTestReadbackBuffer(a_ctx, size, &memory, &mapped);
+
+  TestCommandBuffer cmd(a_ctx);
+  VkCommandBuffer   cmdBuff = cmd.Begin();
+
+  VkImageMemoryBarrier bar = {};
+  bar.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  bar.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+  bar.dstAccessMask       = VK_ACCESS_TRANSFER_READ_BIT;
+  bar.oldLayout           = a_layout;
+  bar.newLayout           = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  bar.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bar.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bar.image               = a_image;
+  bar.subresourceRange    = VkImageSubresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+  vkCmdPipelineBarrier(cmdBuff, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &bar);
+
+  VkBufferImageCopy region = {};
+  region.imageSubresource  = VkImageSubresourceLayers{VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+  region.imageExtent       = VkExtent3D{a_width, a_height, 1};
+  vkCmdCopyImageToBuffer(cmdBuff, a_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer, 1, &region);
+  cmd.Execute();
+
+  std::vector<uint8_t> res((const uint8_t*)mapped, (const uint8_t*)mapped + size);
+  vkDestroyBuffer(a_ctx.device, buffer, NULL);
+  vkFreeMemory   (a_ctx.device, memory, NULL);
+  return res;
+}
+
+#endif